@@ -21,6 +21,25 @@ DSP_API := 2
 BIN_CFLAGS += -DDSP_API=$(DSP_API) -ansi
 BIN_CFLAGS += -D_GNU_SOURCE
 
+ifeq ($(DSP_EMULATED),yes)
+BIN_CFLAGS += -DDSP_EMULATED
+endif
+
+ifeq ($(PROFILER),no)
+BIN_CFLAGS += -DPROFILER_DISABLED
+endif
+
+ifeq ($(PERF_COUNTERS),yes)
+BIN_CFLAGS += -DTIMEMEASURE_PERF
+endif
+
+BIN_CFLAGS += -DLOGGER_LEVEL=$(LOGGER_LEVEL)
+
+# clock_gettime of the profiler
+ifneq ($(filter glx a64 ARM,$(ARCH)),)
+BIN_LDFLAGS += -lrt
+endif
+
 ifneq ($(DBG),)
 BIN_CFLAGS += -g
 endif
@@ -19,6 +19,9 @@ DLL_NAME = vl
 DLL_CFLAGS  = $(CFLAGS)
 DLL_CFLAGS += -fvisibility=hidden -fPIC -DVL_BUILD_DLL -pthread
 DLL_CFLAGS += $(call if-like,%_sse2,$*,-msse2)
+ifeq ($(ARCH),ARM)
+DLL_CFLAGS += $(call if-like,%_neon,$*,-mfpu=neon -mfloat-abi=softfp)
+endif
 
 BINDIR = bin/$(ARCH)
 
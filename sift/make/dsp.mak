@@ -72,7 +72,7 @@ $(BINDIR)/%.dll64P: $(BINDIR)/objs/libdsp/%.x64P
 #################        Vlfeat-library    ############################
 
 
-dsp_dll_src := $(VLDIR)/vl/sift.c $(VLDIR)/vl/host.c $(VLDIR)/vl/generic.c $(VLDIR)/vl/random.c $(VLDIR)/vl/imopv.c $(VLDIR)/vl/mathop.c 
+dsp_dll_src := $(VLDIR)/vl/sift.c $(VLDIR)/vl/host.c $(VLDIR)/vl/generic.c $(VLDIR)/vl/random.c $(VLDIR)/vl/imopv.c $(VLDIR)/vl/mathop.c $(VLDIR)/vl/threads.c 
 dsp_dll_obj := $(addprefix $(BINDIR)/objs/, $(notdir $(dsp_dll_src:.c=.o64P)))
 
 DSPCFLAGS_VL := -gcc -DVL_DISABLE_THREADS -DVL_DISABLE_SSE2 -I$(VLDIR)
@@ -35,6 +35,7 @@ Dsp& Dsp::Instance()
 Dsp::Dsp()
 {
   init = false;
+  node = NULL;
 }
 
 Dsp::~Dsp()
@@ -138,7 +139,8 @@ void DspNode::SendMessage(uint32_t cmd, uint32_t arg1, uint32_t arg2, unsigned i
 
 void DspNode::SendMessage(dsp_msg msg, unsigned int timeout)
 {
-  Logger::info(Logger::DSP, "DspNode::SendMessage(cmd=%d, arg_1=%d, arg_2=%d, timeout=%d)", msg.cmd, msg.arg_1, msg.arg_2, timeout);
+  //called for every command, so only at debug level
+  LOG_DEBUG(Logger::DSP, "DspNode::SendMessage(cmd=%d, arg_1=%d, arg_2=%d, timeout=%d)", msg.cmd, msg.arg_1, msg.arg_2, timeout);
 
   bool ret = dsp_node_put_message(this->dsp_handle, this->node, &msg, timeout);
 
@@ -149,12 +151,12 @@ void DspNode::SendMessage(dsp_msg msg, unsigned int timeout)
   }
 }
 
-dsp_msg DspNode::GetMessage()
+dsp_msg DspNode::GetMessage(unsigned int timeout)
 {
-  Logger::info(Logger::DSP, "DspNode::GetMessage()");
+  LOG_DEBUG(Logger::DSP, "DspNode::GetMessage(timeout=%d)", timeout);
 
   dsp_msg msg;
-  bool ret = dsp_node_get_message(dsp_handle, node, &msg, -1);
+  bool ret = dsp_node_get_message(dsp_handle, node, &msg, timeout);
 
   if(!ret)
   {
@@ -162,12 +164,19 @@ dsp_msg DspNode::GetMessage()
     throw DspException("getting message failed");
   }
 
-  Logger::debug(Logger::DSP, "DspNode::received message(cmd=%d, arg_1=%d, arg_2=%d)", msg.cmd, msg.arg_1, msg.arg_2);
+  LOG_DEBUG(Logger::DSP, "DspNode::received message(cmd=%d, arg_1=%d, arg_2=%d)", msg.cmd, msg.arg_1, msg.arg_2);
   return msg;
 }
 
 void Dsp::Destroy()
 {
+  //the pooled buffers have to be unmapped while the dsp is attached
+  if (init)
+  {
+    dmmManager.LogStats();
+    dmmManager.ReleasePool();
+  }
+
   init = false;
 
   DestroyNode();
@@ -211,7 +220,7 @@ void Dsp::Init()
     throw DspException("dsp open failed");
   }
 
-  Logger::debug(Logger::DSP, "calling dsp_attach(%d, 0, NULL, &proc)", dsp_handle);
+  LOG_DEBUG(Logger::DSP, "calling dsp_attach(%d, 0, NULL, &proc)", dsp_handle);
   if (!dsp_attach(dsp_handle, 0, NULL, &proc))
   {
     Logger::error(Logger::DSP, "dsp attach failed");
@@ -236,72 +245,339 @@ DspNode& Dsp::CreateNode(dsp_uuid uuid, const char *path)
 void Dsp::DestroyNode()
 {
   if(node)
+  {
     node->Destroy();
+    delete node;
+  }
 
   node = NULL;
 }
 
 DmmManager dmmManager;
 
-void* dsp_malloc(size_t n)
+/* holds the mutex of a DmmManager for the scope */
+class DmmLock
 {
-  Logger::debug(Logger::DSP, "dsp_malloc(%d)", n);
+  pthread_mutex_t* mutex;
 
-  dmm_buffer* buf = dmm_buffer_new(Dsp::Instance().GetHandle(), Dsp::Instance().GetProc(), DMA_BIDIRECTIONAL);
-  dmm_buffer_allocate(buf, n);
+public:
+  DmmLock(pthread_mutex_t* m) : mutex(m)
+  {
+    pthread_mutex_lock(mutex);
+  }
 
-  dmmManager.Add(buf);
+  ~DmmLock()
+  {
+    pthread_mutex_unlock(mutex);
+  }
+};
 
-  return buf->data;
+DmmManager::DmmManager()
+{
+  memset(&stats, 0, sizeof(stats));
+  pool_limit = DMM_POOL_LIMIT;
+  pthread_mutex_init(&mutex, NULL);
 }
 
-void* dsp_realloc(void *ptr, size_t n)
+DmmManager::~DmmManager()
+{
+  //the dsp may already be detached here, buffers are released by Dsp::Destroy()
+  pthread_mutex_destroy(&mutex);
+}
+
+size_t DmmManager::SizeClass(size_t n)
 {
-  Logger::debug(Logger::DSP, "dsp_realloc(0x%x, %d)", ptr, n);
+  size_t size = 256;
 
-  //TODO: this is a very stupid implementation!!!!
+  while(size < n && size < 0x10000)
+    size <<= 1;
+
+  if(size >= n)
+    return size;
+
+  //above 64kB: the smallest of 4/4, 5/4, 6/4, 7/4 times a power of two
+  while(size * 2 < n)
+    size <<= 1;
+
+  size_t step = size / 4;
+  while(size < n)
+    size += step;
+
+  return size;
+}
 
+dmm_buffer* DmmManager::NewBuffer(size_t capacity)
+{
   dmm_buffer* buf = dmm_buffer_new(Dsp::Instance().GetHandle(), Dsp::Instance().GetProc(), DMA_BIDIRECTIONAL);
-  dmm_buffer_allocate(buf, n);
+  dmm_buffer_allocate(buf, capacity);
 
-  dmmManager.Add(buf);
+  if(buf->data == NULL)
+  {
+    Logger::error(Logger::DMMMANGER, "DmmManager: could not allocate %d bytes", capacity);
+    dmm_buffer_free(buf);
+    return NULL;
+  }
 
-  dmm_buffer* old_buf = dmmManager.GetDMMBuffer(ptr);
+  //map once, the buffer keeps its mapping while it is pooled
+  dmm_buffer_map(buf);
+  stats.maps++;
+  stats.bytes_mapped += capacity;
 
-  memcpy(buf->data, old_buf->data, old_buf->size);
+  return buf;
+}
 
-  //free the old buffer!
-  dmmManager.Remove(ptr);
-  dmm_buffer_free(old_buf);
+void DmmManager::DeleteBuffer(dmm_buffer* buf)
+{
+  stats.unmaps++;
+  stats.bytes_unmapped += buf->size;
 
-  return buf->data;
+  dmm_buffer_unmap(buf);
+  dmm_buffer_free(buf);
 }
 
-void* dsp_calloc(size_t n, size_t size)
+void* DmmManager::Allocate(size_t n)
+{
+  DmmLock lock(&mutex);
+  return AllocateLocked(n);
+}
+
+void* DmmManager::AllocateLocked(size_t n)
 {
-  Logger::debug(Logger::DSP, "dsp_calloc(%d, %d)", n, size);
+  size_t capacity = SizeClass(n);
+  dmm_buffer* buf;
 
-  dmm_buffer* buf = dmm_buffer_calloc(Dsp::Instance().GetHandle(), Dsp::Instance().GetProc(), n*size, DMA_BIDIRECTIONAL);
+  vector<dmm_buffer*>& pool = free_buffers[capacity];
 
-  dmmManager.Add(buf);
+  if(!pool.empty())
+  {
+    buf = pool.back();
+    pool.pop_back();
+    stats.pool_hits++;
+    stats.bytes_pooled -= capacity;
+  }
+  else
+  {
+    buf = NewBuffer(capacity);
+    if(buf == NULL)
+      return NULL;
+    stats.pool_misses++;
+  }
+
+  buf->len = n;
+  stats.bytes_in_use += capacity;
+
+  Add(buf);
 
   return buf->data;
 }
 
-void dsp_free(void* ptr)
+void* DmmManager::Reallocate(void* ptr, size_t n)
 {
-  Logger::debug(Logger::DSP, "dsp_free(%x)", ptr);
+  DmmLock lock(&mutex);
 
-  dmm_buffer* buf = dmmManager.GetDMMBuffer(ptr);
+  if(ptr == NULL)
+    return AllocateLocked(n);
 
-  dmm_buffer_free(buf);
+  dmm_buffer* old_buf = GetDMMBufferLocked(ptr);
+
+  if(old_buf == NULL || old_buf->data != ptr)
+  {
+    Logger::error(Logger::DMMMANGER, "DmmManager::Reallocate(%x): not allocated!!!", ptr);
+    return NULL;
+  }
+
+  //still fits in the buffer of the same size class
+  if(SizeClass(n) == old_buf->size)
+  {
+    old_buf->len = n;
+    return ptr;
+  }
+
+  void* data = AllocateLocked(n);
+
+  if(data)
+  {
+    memcpy(data, ptr, old_buf->len < n ? old_buf->len : n);
+    FreeLocked(ptr);
+  }
+
+  return data;
+}
+
+void DmmManager::Free(void* ptr)
+{
+  DmmLock lock(&mutex);
+  FreeLocked(ptr);
+}
+
+void DmmManager::FreeLocked(void* ptr)
+{
+  if(ptr == NULL)
+    return;
+
+  map<void*,dmm_buffer*>::iterator iter = allocated_mem.find(ptr);
+
+  if(iter == allocated_mem.end())
+  {
+    Logger::error(Logger::DMMMANGER, "DmmManager::Free(%x): not allocated!!!", ptr);
+    return;
+  }
+
+  dmm_buffer* buf = iter->second;
+  Remove(ptr);
+
+  stats.bytes_in_use -= buf->size;
+  stats.bytes_pooled += buf->size;
+  free_buffers[buf->size].push_back(buf);
+
+  if(stats.bytes_pooled > pool_limit)
+    TrimLocked(pool_limit);
+}
+
+void DmmManager::Reserve(size_t size, unsigned count)
+{
+  DmmLock lock(&mutex);
+  size_t capacity = SizeClass(size);
+  vector<dmm_buffer*>& pool = free_buffers[capacity];
+
+  //not trimmed here, the caller allocates the reserved buffers next
+  while(pool.size() < count)
+  {
+    dmm_buffer* buf = NewBuffer(capacity);
+
+    if(buf == NULL)
+      throw DspException("could not reserve dmm buffers");
+
+    pool.push_back(buf);
+    stats.bytes_pooled += capacity;
+  }
+}
+
+void DmmManager::SetPoolLimit(size_t max_bytes)
+{
+  DmmLock lock(&mutex);
+
+  pool_limit = max_bytes;
+  TrimLocked(pool_limit);
+}
+
+void DmmManager::Trim(size_t max_bytes)
+{
+  DmmLock lock(&mutex);
+  TrimLocked(max_bytes);
+}
+
+void DmmManager::TrimLocked(size_t max_bytes)
+{
+  //size classes in decreasing order
+  map<size_t, vector<dmm_buffer*> >::reverse_iterator iter = free_buffers.rbegin();
+
+  while(stats.bytes_pooled > max_bytes && iter != free_buffers.rend())
+  {
+    if(iter->second.empty())
+    {
+      iter++;
+      continue;
+    }
+
+    DeleteBuffer(iter->second.back());
+    iter->second.pop_back();
+    stats.bytes_pooled -= iter->first;
+  }
+}
+
+dmm_buffer* DmmManager::GetDMMBuffer(void* addr)
+{
+  DmmLock lock(&mutex);
+  return GetDMMBufferLocked(addr);
+}
+
+dmm_buffer* DmmManager::GetDMMBufferLocked(void* addr)
+{
+  LOG_DEBUG(Logger::DMMMANGER, "DmmManager::GetDMMBuffer(buf->data:%x)", addr);
+
+  //first buffer starting after addr, the one before may contain it
+  map<void*,dmm_buffer*>::iterator iter = allocated_mem.upper_bound(addr);
+
+  if(iter == allocated_mem.begin())
+    return NULL;
+
+  --iter;
+
+  if((uintptr_t)addr < (uintptr_t)iter->first + iter->second->size)
+    return iter->second;
+
+  return NULL;
+}
+
+DmmStats DmmManager::GetStats()
+{
+  DmmLock lock(&mutex);
+  return stats;
+}
+
+void DmmManager::ReleasePool()
+{
+  DmmLock lock(&mutex);
+  map<size_t, vector<dmm_buffer*> >::iterator iter;
+
+  for(iter = free_buffers.begin(); iter != free_buffers.end(); iter++)
+  {
+    for(unsigned i = 0; i < iter->second.size(); i++)
+      DeleteBuffer(iter->second[i]);
+  }
 
-  dmmManager.Remove(ptr);
+  free_buffers.clear();
+  stats.bytes_pooled = 0;
+}
+
+void DmmManager::LogStats()
+{
+  DmmLock lock(&mutex);
+
+  Logger::info(Logger::DMMMANGER, "DmmManager: %lu maps (%llu bytes), %lu unmaps (%llu bytes)",
+      stats.maps, stats.bytes_mapped, stats.unmaps, stats.bytes_unmapped);
+  Logger::info(Logger::DMMMANGER, "DmmManager: %lu pool hits, %lu misses, %lu bytes in use, %lu bytes pooled",
+      stats.pool_hits, stats.pool_misses, (unsigned long)stats.bytes_in_use, (unsigned long)stats.bytes_pooled);
+}
+
+void* dsp_malloc(size_t n)
+{
+  LOG_DEBUG(Logger::DSP, "dsp_malloc(%d)", n);
+
+  return dmmManager.Allocate(n);
+}
+
+void* dsp_realloc(void *ptr, size_t n)
+{
+  LOG_DEBUG(Logger::DSP, "dsp_realloc(0x%x, %d)", ptr, n);
+
+  return dmmManager.Reallocate(ptr, n);
+}
+
+void* dsp_calloc(size_t n, size_t size)
+{
+  LOG_DEBUG(Logger::DSP, "dsp_calloc(%d, %d)", n, size);
+
+  //pooled buffers are not clean
+  void* data = dmmManager.Allocate(n*size);
+
+  if(data)
+    memset(data, 0, n*size);
+
+  return data;
+}
+
+void dsp_free(void* ptr)
+{
+  LOG_DEBUG(Logger::DSP, "dsp_free(%x)", ptr);
+
+  dmmManager.Free(ptr);
 }
 
 void* dsp_get_mapped_addr(void* ptr)
 {
-  Logger::debug(Logger::DSP, "dsp_get_mapped_addr(%x)", ptr);
+  LOG_DEBUG(Logger::DSP, "dsp_get_mapped_addr(%x)", ptr);
 
   dmm_buffer* buf = dmmManager.GetDMMBuffer(ptr);
 
@@ -313,17 +589,20 @@ void* dsp_get_mapped_addr(void* ptr)
 
   if(buf->map == NULL)
   {
-    Logger::debug(Logger::DSP, "dsp_get_mapped_addr(%x): mapping addr", ptr);
+    LOG_DEBUG(Logger::DSP, "dsp_get_mapped_addr(%x): mapping addr", ptr);
     dmm_buffer_map(buf);
   }
 
-  Logger::debug(Logger::DSP, "dsp_get_mapped_addr(%x)=%x", ptr, buf->map);
-  return buf->map;
+  /* ptr may point inside the buffer (e.g. one level of an octave) */
+  void* mapped = (char*)buf->map + ((char*)ptr - (char*)buf->data);
+
+  LOG_DEBUG(Logger::DSP, "dsp_get_mapped_addr(%x)=%x", ptr, mapped);
+  return mapped;
 }
 
 int dsp_dmm_buffer_begin(void* ptr)
 {
-  Logger::debug(Logger::DSP, "dsp_dmm_buffer_begin(%x)", ptr);
+  LOG_DEBUG(Logger::DSP, "dsp_dmm_buffer_begin(%x)", ptr);
 
   dmm_buffer* buf = dmmManager.GetDMMBuffer(ptr);
 
@@ -346,7 +625,7 @@ int dsp_dmm_buffer_begin(void* ptr)
 
 int dsp_dmm_buffer_end(void* ptr)
 {
-  Logger::debug(Logger::DSP, "dsp_dmm_buffer_end(%x)", ptr);
+  LOG_DEBUG(Logger::DSP, "dsp_dmm_buffer_end(%x)", ptr);
 
   dmm_buffer* buf = dmmManager.GetDMMBuffer(ptr);
 
@@ -367,6 +646,62 @@ int dsp_dmm_buffer_end(void* ptr)
   return 0;
 }
 
+/* returns the buffer ptr lies in with size clamped to its end, or 0 */
+static dmm_buffer* dsp_get_range(const char* func, void* ptr, size_t& size)
+{
+  dmm_buffer* buf = dmmManager.GetDMMBuffer(ptr);
+
+  if(buf == 0)
+  {
+    Logger::error(Logger::DSP, "%s(%x): not found!!!", func, ptr);
+    return 0;
+  }
+
+  if(buf->map == NULL)
+  {
+    Logger::warn(Logger::DSP, "%s(%x) not mapped => mapping addr", func, ptr);
+    dmm_buffer_map(buf);
+  }
+
+  size_t offset = (char*)ptr - (char*)buf->data;
+
+  if(offset + size > buf->size)
+  {
+    Logger::warn(Logger::DSP, "%s(%x, %d): range exceeds buffer, clamped", func, ptr, size);
+    size = buf->size - offset;
+  }
+
+  return buf;
+}
+
+int dsp_dmm_range_begin(void* ptr, size_t size, int dir)
+{
+  LOG_DEBUG(Logger::DSP, "dsp_dmm_range_begin(%x, %d, %d)", ptr, size, dir);
+
+  dmm_buffer* buf = dsp_get_range("dsp_dmm_range_begin", ptr, size);
+
+  if(buf == 0)
+    return -1;
+
+  dmm_buffer_range_begin(buf, ptr, size, dir);
+
+  return 0;
+}
+
+int dsp_dmm_range_end(void* ptr, size_t size, int dir)
+{
+  LOG_DEBUG(Logger::DSP, "dsp_dmm_range_end(%x, %d, %d)", ptr, size, dir);
+
+  dmm_buffer* buf = dsp_get_range("dsp_dmm_range_end", ptr, size);
+
+  if(buf == 0)
+    return -1;
+
+  dmm_buffer_range_end(buf, ptr, size, dir);
+
+  return 0;
+}
+
 int dsp_send_message(uint32_t cmd, uint32_t arg1, uint32_t arg2)
 {
   try
@@ -12,6 +12,8 @@
 #include "dsp_bridge.h"
 #include "Exception.h"
 #include <map>
+#include <vector>
+#include <pthread.h>
 
 #include "../common/node.h"
 #include "logger.h"
@@ -24,6 +26,8 @@ void  dsp_free    (void* ptr) ;
 void* dsp_get_mapped_addr(void* ptr);
 int dsp_dmm_buffer_begin(void* ptr);
 int dsp_dmm_buffer_end(void* ptr);
+int dsp_dmm_range_begin(void* ptr, size_t size, int dir);
+int dsp_dmm_range_end(void* ptr, size_t size, int dir);
 dsp_msg_t dsp_get_message();
 int dsp_send_message(uint32_t cmd, uint32_t arg1, uint32_t arg2);
 
@@ -67,6 +71,11 @@ public:
     return *node;
   }
 
+  bool HasNode()
+  {
+    return node != NULL;
+  }
+
   int GetHandle()
   {
     if(!init)
@@ -110,48 +119,127 @@ public:
 
   void SendMessage(uint32_t cmd, uint32_t arg1, uint32_t arg2, unsigned int timeout = -1);
   void SendMessage(dsp_msg msg, unsigned int timeout = -1);
-  dsp_msg GetMessage();
+
+  /**
+   * waits at most timeout ms ((unsigned)-1 waits forever) for a message
+   * of the node, throws a DspException on timeout.
+   */
+  dsp_msg GetMessage(unsigned int timeout = -1);
 };
 
 using namespace std;
 
+struct DmmStats
+{
+  unsigned long maps;              //dmm_buffer_map calls
+  unsigned long unmaps;            //dmm_buffer_unmap calls
+  unsigned long long bytes_mapped;
+  unsigned long long bytes_unmapped;
+  unsigned long pool_hits;         //allocations served by a pooled buffer
+  unsigned long pool_misses;       //allocations that needed a new buffer
+  size_t bytes_in_use;             //capacity of the allocated buffers
+  size_t bytes_pooled;             //capacity of the free pooled buffers
+};
+
+//default limit of the free buffers kept mapped by DmmManager
+#define DMM_POOL_LIMIT (64 << 20)
+
+/**
+ * keeps the dmm buffers handed out by dsp_malloc and friends.
+ *
+ * Buffers are mapped to the DSP once, when they are created, and are
+ * recycled: a freed buffer goes back to the pool of its size class
+ * instead of being unmapped, and the next allocation of that class
+ * takes it from there. Reserve() maps the buffers of known sizes up
+ * front (Sift does so for every new image size). The pool holds at
+ * most SetPoolLimit() bytes, beyond that the largest pooled buffers
+ * are unmapped; ReleasePool() unmaps all of them.
+ *
+ * Allocated buffers are indexed by start address, so the buffer
+ * containing any address (e.g. one level of an octave) is found in
+ * O(log n).
+ *
+ * DmmManager is the vl_malloc of the DSP builds, so all methods lock a
+ * mutex and may be called from several threads.
+ */
 class DmmManager
 {
-  map<void*, dmm_buffer*> allocated_mem;
-public:
+  map<void*, dmm_buffer*> allocated_mem;            //by start address
+  map<size_t, vector<dmm_buffer*> > free_buffers;   //by size class
+  DmmStats stats;
+  size_t pool_limit;                                //bytes
+  pthread_mutex_t mutex;
+
+  dmm_buffer* NewBuffer(size_t capacity);
+  void DeleteBuffer(dmm_buffer* buf);
+
+  //the same as the public methods, with the mutex held
+  void* AllocateLocked(size_t n);
+  void FreeLocked(void* ptr);
+  void TrimLocked(size_t max_bytes);
+  dmm_buffer* GetDMMBufferLocked(void* addr);
+
   void Add(dmm_buffer* buf)
   {
-    Logger::debug(Logger::DMMMANGER, "DmmManager::Add(buf->data:%x)", buf->data);
+    LOG_DEBUG(Logger::DMMMANGER, "DmmManager::Add(buf->data:%x)", buf->data);
     allocated_mem[buf->data] = buf;
   }
 
   void Remove(void* addr)
   {
-    Logger::debug(Logger::DMMMANGER, "DmmManager::Remove(buf->data:%x)", addr);
+    LOG_DEBUG(Logger::DMMMANGER, "DmmManager::Remove(buf->data:%x)", addr);
     allocated_mem.erase(addr);
   }
 
-  dmm_buffer* GetDMMBuffer(void* addr)
-  {
-    Logger::debug(Logger::DMMMANGER, "DmmManager::GetDMMBuffer(buf->data:%x)", addr);
-
-    dmm_buffer* buf =  allocated_mem[addr];
-    if(buf)
-      return buf;
-
-    Logger::warn(Logger::DMMMANGER, "DmmManager::GetDMMBuffer(buf->data:%x) not found -> searching", addr);
-
-    map<void*,dmm_buffer*>::iterator iter;
-    for( iter = allocated_mem.begin(); iter != allocated_mem.end(); iter++ )
-    {
-      if(((unsigned)addr >= (unsigned)iter->first) && (unsigned)addr <= ((unsigned)iter->first + (unsigned)iter->second->size))
-      {
-        return iter->second;
-      }
-    }
-
-    return NULL;
-  }
+public:
+  DmmManager();
+  ~DmmManager();
+
+  /**
+   * size of the buffers used for an allocation of n bytes: powers of two
+   * up to 64kB, then steps of a quarter of a power of two, so at most
+   * 25% of the buffer is wasted.
+   */
+  static size_t SizeClass(size_t n);
+
+  void* Allocate(size_t n);
+  void* Reallocate(void* ptr, size_t n);
+  void Free(void* ptr);
+
+  /**
+   * maps buffers until count of them are pooled for allocations of
+   * size bytes, so they are ready before the first image of that size
+   * is processed.
+   */
+  void Reserve(size_t size, unsigned count);
+
+  /**
+   * the pool keeps at most max_bytes of free buffers (default
+   * DMM_POOL_LIMIT), a smaller limit takes effect at once.
+   */
+  void SetPoolLimit(size_t max_bytes);
+
+  /**
+   * unmaps pooled buffers, the largest first, until at most max_bytes
+   * are pooled.
+   */
+  void Trim(size_t max_bytes);
+
+  /**
+   * unmaps and frees all pooled buffers (not the allocated ones).
+   */
+  void ReleasePool();
+
+  /**
+   * returns the allocated buffer containing addr, or NULL
+   */
+  dmm_buffer* GetDMMBuffer(void* addr);
+
+  DmmStats GetStats();
+
+  void LogStats();
 };
 
+extern DmmManager dmmManager;
+
 #endif /* DSP_H_ */
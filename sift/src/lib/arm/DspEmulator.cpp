@@ -0,0 +1,482 @@
+/*
+ * DspEmulator.cpp
+ *
+ * in-process emulation of the SIFT DSP node, see DspEmulator.h
+ */
+
+#include "DspEmulator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <vl/generic.h>
+
+#include "logger.h"
+
+/*
+ * the node code itself, unchanged. It is compiled in its own namespace,
+ * so its vl_imconvcol_vf does not clash with the one of libvl.
+ */
+#define ARCH_DSP
+namespace dspnode
+{
+#include "../../progs/dsp/sift.c"
+}
+#undef ARCH_DSP
+
+/*
+ * the message arguments are 32 bit wide, so on 64 bit hosts everything
+ * the node gets a pointer to has to live in the first 4GB.
+ */
+#ifdef MAP_32BIT
+#define DSPEMU_MAP_FLAGS MAP_32BIT
+#else
+#define DSPEMU_MAP_FLAGS 0
+#endif
+
+/* each block starts with its mapped size, data stays 128 byte aligned
+   like the DMM buffers (dmm_buffer_new) */
+#define DSPEMU_HEADER 128
+
+
+/* microseconds from a to b */
+static long elapsed_us(const struct timeval& a, const struct timeval& b)
+{
+  return (b.tv_sec - a.tv_sec) * 1000000L + (b.tv_usec - a.tv_usec);
+}
+
+static unsigned long env_ulong(const char* name)
+{
+  const char* value = getenv(name);
+  return value ? strtoul(value, NULL, 10) : 0;
+}
+
+DspEmulatorLatency DspEmulatorLatency::FromEnvironment()
+{
+  DspEmulatorLatency l;
+  const char* speed = getenv("DSP_EMU_SPEED");
+
+  l.msg_us = env_ulong("DSP_EMU_MSG_US");
+  l.cache_us = env_ulong("DSP_EMU_CACHE_US");
+  l.cache_mbs = env_ulong("DSP_EMU_CACHE_MBS");
+  l.map_us = env_ulong("DSP_EMU_MAP_US");
+  l.dsp_speed = speed ? strtod(speed, NULL) : 0;
+
+  return l;
+}
+
+
+DspEmulator* DspEmulator::instance = NULL;
+
+DspEmulator& DspEmulator::Instance()
+{
+  if(instance == NULL)
+    instance = new DspEmulator();
+
+  return *instance;
+}
+
+DspEmulator::DspEmulator()
+{
+  running = false;
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+  memset(&latency, 0, sizeof(latency));
+  ResetStats();
+}
+
+DspEmulator::~DspEmulator()
+{
+  if(running)
+    Stop();
+
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+}
+
+void* DspEmulator::NodeThread(void* arg)
+{
+  dspnode::dsp_sift_create();
+  dspnode::dsp_sift_execute(arg);
+  dspnode::dsp_sift_delete();
+
+  return NULL;
+}
+
+void DspEmulator::Start()
+{
+  Logger::info(Logger::DSP, "DspEmulator::Start()");
+
+  if(running)
+  {
+    Logger::warn(Logger::DSP, "calling DspEmulator::Start(), even if already running");
+    return;
+  }
+
+  to_dsp.clear();
+  from_dsp.clear();
+
+  if(pthread_create(&thread, NULL, NodeThread, this) != 0)
+  {
+    Logger::error(Logger::DSP, "DspEmulator: could not start the node thread");
+    throw DspEmulatorException("could not start the node thread");
+  }
+
+  running = true;
+}
+
+void DspEmulator::Stop()
+{
+  Logger::info(Logger::DSP, "DspEmulator::Stop()");
+
+  if(!running)
+    return;
+
+  dsp_msg_t msg;
+  msg.cmd = VL_DSP_CMD_EXIT;
+  msg.arg_1 = 0;
+  msg.arg_2 = 0;
+
+  SendMessage(msg);
+  pthread_join(thread, NULL);
+
+  running = false;
+}
+
+void DspEmulator::SetLatency(const DspEmulatorLatency& latency)
+{
+  Logger::info(Logger::DSP, "DspEmulator: msg %luus, cache %luus + %luMB/s, map %luus, speed %g",
+      latency.msg_us, latency.cache_us, latency.cache_mbs, latency.map_us, latency.dsp_speed);
+
+  pthread_mutex_lock(&mutex);
+  this->latency = latency;
+  pthread_mutex_unlock(&mutex);
+}
+
+DspEmulatorLatency DspEmulator::GetLatency()
+{
+  pthread_mutex_lock(&mutex);
+  DspEmulatorLatency l = latency;
+  pthread_mutex_unlock(&mutex);
+
+  return l;
+}
+
+//sleeps for a modelled latency, must be called without the mutex
+void DspEmulator::Delay(unsigned long us)
+{
+  if(us == 0)
+    return;
+
+  pthread_mutex_lock(&mutex);
+  stats.delay_us += us;
+  pthread_mutex_unlock(&mutex);
+
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000;
+
+  while(nanosleep(&ts, &ts) != 0)
+    ;
+}
+
+void DspEmulator::SendMessage(dsp_msg_t msg)
+{
+  Delay(GetLatency().msg_us);
+
+  pthread_mutex_lock(&mutex);
+  to_dsp.push_back(msg);
+  stats.messages++;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+dsp_msg_t DspEmulator::GetMessage()
+{
+  pthread_mutex_lock(&mutex);
+  while(from_dsp.empty())
+    pthread_cond_wait(&cond, &mutex);
+
+  dsp_msg_t msg = from_dsp.front();
+  from_dsp.pop_front();
+  pthread_mutex_unlock(&mutex);
+
+  return msg;
+}
+
+bool DspEmulator::GetMessage(dsp_msg_t& msg, unsigned int timeout)
+{
+  if(timeout == (unsigned int)-1)
+  {
+    msg = GetMessage();
+    return true;
+  }
+
+  struct timeval now;
+  struct timespec until;
+
+  gettimeofday(&now, NULL);
+  until.tv_sec = now.tv_sec + timeout / 1000;
+  until.tv_nsec = (now.tv_usec + (timeout % 1000) * 1000L) * 1000L;
+  if(until.tv_nsec >= 1000000000L)
+  {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&mutex);
+  while(from_dsp.empty())
+  {
+    if(pthread_cond_timedwait(&cond, &mutex, &until) != 0 && from_dsp.empty())
+    {
+      pthread_mutex_unlock(&mutex);
+      return false;
+    }
+  }
+
+  msg = from_dsp.front();
+  from_dsp.pop_front();
+  pthread_mutex_unlock(&mutex);
+
+  return true;
+}
+
+dsp_msg_t DspEmulator::NodeGetMessage()
+{
+  pthread_mutex_lock(&mutex);
+  while(to_dsp.empty())
+    pthread_cond_wait(&cond, &mutex);
+
+  dsp_msg_t msg = to_dsp.front();
+  to_dsp.pop_front();
+  pthread_mutex_unlock(&mutex);
+
+  gettimeofday(&node_start, NULL);
+
+  return msg;
+}
+
+void DspEmulator::NodePutMessage(dsp_msg_t msg)
+{
+  DspEmulatorLatency l = GetLatency();
+  struct timeval now;
+
+  //stretch the command to the modelled DSP speed
+  gettimeofday(&now, NULL);
+  long busy = elapsed_us(node_start, now);
+  long extra = l.dsp_speed > 0 ? (long)(busy / l.dsp_speed) - busy : 0;
+
+  if(extra > 0)
+    Delay(extra);
+
+  pthread_mutex_lock(&mutex);
+  stats.node_us += busy + (extra > 0 ? extra : 0);
+  pthread_mutex_unlock(&mutex);
+
+  Delay(l.msg_us);
+
+  pthread_mutex_lock(&mutex);
+  from_dsp.push_back(msg);
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+/* modelled cost of a cache flush or invalidate of size bytes */
+static unsigned long cache_cost(const DspEmulatorLatency& l, size_t size)
+{
+  //1MB/s is one byte per microsecond
+  return l.cache_us + (l.cache_mbs ? size / l.cache_mbs : 0);
+}
+
+void DspEmulator::CountBufferBegin(size_t size)
+{
+  pthread_mutex_lock(&mutex);
+  stats.buffer_begins++;
+  stats.begin_bytes += size;
+  unsigned long cost = cache_cost(latency, size);
+  pthread_mutex_unlock(&mutex);
+
+  Delay(cost);
+}
+
+void DspEmulator::CountBufferEnd(size_t size)
+{
+  pthread_mutex_lock(&mutex);
+  stats.buffer_ends++;
+  stats.end_bytes += size;
+  unsigned long cost = cache_cost(latency, size);
+  pthread_mutex_unlock(&mutex);
+
+  Delay(cost);
+}
+
+void DspEmulator::CountCacheOp(size_t size)
+{
+  pthread_mutex_lock(&mutex);
+  stats.cache_ops++;
+  stats.cache_bytes += size;
+  unsigned long cost = cache_cost(latency, size);
+  pthread_mutex_unlock(&mutex);
+
+  Delay(cost);
+}
+
+void DspEmulator::CountMap()
+{
+  pthread_mutex_lock(&mutex);
+  stats.maps++;
+  unsigned long cost = latency.map_us;
+  pthread_mutex_unlock(&mutex);
+
+  Delay(cost);
+}
+
+DspEmulatorStats DspEmulator::GetStats()
+{
+  pthread_mutex_lock(&mutex);
+  DspEmulatorStats s = stats;
+  pthread_mutex_unlock(&mutex);
+
+  return s;
+}
+
+void DspEmulator::ResetStats()
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+
+/* DSP/BIOS functions used by the node */
+
+unsigned short NODE_getMsg(void *node, dsp_msg_t *msg, unsigned int)
+{
+  *msg = ((DspEmulator*)node)->NodeGetMessage();
+  return 0;
+}
+
+unsigned short NODE_putMsg(void *node, void *, dsp_msg_t *msg, unsigned int)
+{
+  ((DspEmulator*)node)->NodePutMessage(*msg);
+  return 0;
+}
+
+void BCACHE_inv(void *, size_t size, unsigned short)
+{
+  DspEmulator::Instance().CountCacheOp(size);
+}
+
+void BCACHE_wbInv(void *, size_t size, unsigned short)
+{
+  DspEmulator::Instance().CountCacheOp(size);
+}
+
+
+/* vlfeat functions */
+
+//usable size of a block from dspemu_malloc
+static size_t dspemu_block_size(void* ptr)
+{
+  return *(size_t*)((char*)ptr - DSPEMU_HEADER) - DSPEMU_HEADER;
+}
+
+void* dspemu_malloc(size_t n)
+{
+  size_t size = n + DSPEMU_HEADER;
+  void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | DSPEMU_MAP_FLAGS, -1, 0);
+
+  if(p == MAP_FAILED)
+  {
+    Logger::error(Logger::DSP, "dspemu_malloc(%d) failed", n);
+    return NULL;
+  }
+
+  *(size_t*)p = size;
+  return (char*)p + DSPEMU_HEADER;
+}
+
+void* dspemu_realloc(void *ptr, size_t n)
+{
+  void* buf = dspemu_malloc(n);
+
+  if(ptr && buf)
+  {
+    size_t old = dspemu_block_size(ptr);
+    memcpy(buf, ptr, old < n ? old : n);
+    dspemu_free(ptr);
+  }
+
+  return buf;
+}
+
+void* dspemu_calloc(size_t n, size_t size)
+{
+  //anonymous mappings are zero filled
+  return dspemu_malloc(n * size);
+}
+
+void dspemu_free(void* ptr)
+{
+  if(ptr == NULL)
+    return;
+
+  char* p = (char*)ptr - DSPEMU_HEADER;
+  munmap(p, *(size_t*)p);
+}
+
+void* dspemu_get_mapped_addr(void* ptr)
+{
+  if((uintptr_t)ptr != (uint32_t)(uintptr_t)ptr)
+    Logger::error(Logger::DSP, "dspemu_get_mapped_addr(%p): not allocated by dspemu_malloc!!!", ptr);
+
+  return ptr;
+}
+
+int dspemu_dmm_buffer_begin(void* ptr)
+{
+  DspEmulator::Instance().CountBufferBegin(dspemu_block_size(ptr));
+  return 0;
+}
+
+int dspemu_dmm_buffer_end(void* ptr)
+{
+  DspEmulator::Instance().CountBufferEnd(dspemu_block_size(ptr));
+  return 0;
+}
+
+int dspemu_dmm_range_begin(void*, size_t size, int)
+{
+  DspEmulator::Instance().CountBufferBegin(size);
+  return 0;
+}
+
+int dspemu_dmm_range_end(void*, size_t size, int dir)
+{
+  if(dir != VL_DSP_TO_DEVICE)
+    DspEmulator::Instance().CountBufferEnd(size);
+
+  return 0;
+}
+
+int dspemu_send_message(uint32_t cmd, uint32_t arg1, uint32_t arg2)
+{
+  DspEmulator& emu = DspEmulator::Instance();
+
+  if(!emu.IsRunning())
+    return -1;
+
+  dsp_msg_t msg;
+  msg.cmd = cmd;
+  msg.arg_1 = arg1;
+  msg.arg_2 = arg2;
+
+  emu.SendMessage(msg);
+  return 0;
+}
+
+dsp_msg_t dspemu_get_message()
+{
+  return DspEmulator::Instance().GetMessage();
+}
@@ -0,0 +1,147 @@
+/*
+ * DspEmulator.h
+ *
+ * runs the SIFT DSP node (src/progs/dsp/sift.c) on a thread of the host,
+ * so the DSP offload path of vlfeat can be exercised without a
+ * BeagleBoard. Messages go through two queues instead of the DSP bridge,
+ * memory is shared and cache maintenance is only counted. Latencies of
+ * the real hardware can be modelled, see DspEmulatorLatency.
+ *
+ * dsp_bridge_emu.cpp builds the dsp_* bridge API on top of it.
+ */
+
+#ifndef DSPEMULATOR_H_
+#define DSPEMULATOR_H_
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <deque>
+
+#include "../common/node.h"
+#include "Exception.h"
+
+//replacements of the Dsp.h functions for vlfeat (C - Functions ...)
+void* dspemu_malloc  (size_t n) ;
+void* dspemu_realloc (void *ptr, size_t n) ;
+void* dspemu_calloc  (size_t n, size_t size) ;
+void  dspemu_free    (void* ptr) ;
+void* dspemu_get_mapped_addr(void* ptr);
+int dspemu_dmm_buffer_begin(void* ptr);
+int dspemu_dmm_buffer_end(void* ptr);
+int dspemu_dmm_range_begin(void* ptr, size_t size, int dir);
+int dspemu_dmm_range_end(void* ptr, size_t size, int dir);
+dsp_msg_t dspemu_get_message();
+int dspemu_send_message(uint32_t cmd, uint32_t arg1, uint32_t arg2);
+
+
+class DspEmulatorException : public Exception
+{
+public:
+  DspEmulatorException(const char* msg) : Exception(msg)
+  {
+  }
+};
+
+/**
+ * modelled costs, all 0 (the default) gives the plain host speed.
+ * DSP_EMU_MSG_US, DSP_EMU_CACHE_US, DSP_EMU_CACHE_MBS, DSP_EMU_MAP_US and
+ * DSP_EMU_SPEED set them from the environment (see FromEnvironment).
+ */
+struct DspEmulatorLatency
+{
+  unsigned long msg_us;     //per message, in each direction
+  unsigned long cache_us;   //per flush/invalidate, both sides
+  unsigned long cache_mbs;  //flush/invalidate bandwidth in MB/s, 0 = unlimited
+  unsigned long map_us;     //per map/unmap of a buffer
+  double dsp_speed;         //node speed relative to the host, 0 = same
+
+  static DspEmulatorLatency FromEnvironment();
+};
+
+struct DspEmulatorStats
+{
+  unsigned long messages;       //messages sent to the node
+  unsigned long buffer_begins;  //ARM side cache maintenance calls
+  unsigned long buffer_ends;
+  unsigned long begin_bytes;    //bytes they cover
+  unsigned long end_bytes;
+  unsigned long cache_ops;      //DSP side BCACHE_* calls
+  unsigned long cache_bytes;
+  unsigned long maps;           //dsp_map calls (bridge emulation only)
+  unsigned long delay_us;       //time spent in modelled latencies
+  unsigned long node_us;        //time the node was busy, scaled by dsp_speed
+};
+
+class DspEmulator
+{
+  static DspEmulator* instance;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  std::deque<dsp_msg_t> to_dsp;
+  std::deque<dsp_msg_t> from_dsp;
+  bool running;
+
+  DspEmulatorStats stats;
+  DspEmulatorLatency latency;
+
+  struct timeval node_start;  //start of the command the node works on
+
+  DspEmulator();
+
+  void Delay(unsigned long us);
+
+  static void* NodeThread(void* arg);
+
+public:
+
+  ~DspEmulator();
+
+  /**
+   * starts the node thread. The caller installs the dspemu_* functions
+   * with vl_set_alloc_func and vl_set_dsp_mem_func, as Sift does for the
+   * real DSP.
+   */
+  void Start();
+
+  /**
+   * sends the exit command to the node and waits for it.
+   */
+  void Stop();
+
+  bool IsRunning()
+  {
+    return running;
+  }
+
+  void SetLatency(const DspEmulatorLatency& latency);
+  DspEmulatorLatency GetLatency();
+
+  //ARM side
+  void SendMessage(dsp_msg_t msg);
+  dsp_msg_t GetMessage();
+
+  /**
+   * like GetMessage, but gives up after timeout ms ((unsigned)-1 waits
+   * forever). Returns false on timeout.
+   */
+  bool GetMessage(dsp_msg_t& msg, unsigned int timeout);
+
+  //node side (NODE_getMsg, NODE_putMsg)
+  dsp_msg_t NodeGetMessage();
+  void NodePutMessage(dsp_msg_t msg);
+
+  void CountBufferBegin(size_t size);
+  void CountBufferEnd(size_t size);
+  void CountCacheOp(size_t size);
+  void CountMap();
+
+  DspEmulatorStats GetStats();
+  void ResetStats();
+
+  static DspEmulator& Instance();
+};
+
+#endif /* DSPEMULATOR_H_ */
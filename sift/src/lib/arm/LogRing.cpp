@@ -0,0 +1,409 @@
+/*
+ * LogRing.cpp
+ *
+ * lock free message ring of Logger, see LogRing.h
+ */
+
+#include "LogRing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOGRING_MASK (LOGRING_ENTRIES - 1)
+
+//how an argument was passed
+enum
+{
+  ARG_INT,
+  ARG_LONG,
+  ARG_LLONG,
+  ARG_DOUBLE,
+  ARG_LDOUBLE,
+  ARG_PTR,
+  ARG_STR
+};
+
+/*
+ * parses the conversion specification after a '%', returns the character
+ * after it. stars is the number of '*' (int arguments before the value),
+ * kind the type of the value, -1 for "%%" and unsupported conversions.
+ */
+static const char* ParseSpec(const char* f, int& stars, int& kind)
+{
+  int length = 0;     //'l', 'q' (ll), 'L' or 'z'
+
+  stars = 0;
+  kind = -1;
+
+  if(*f == '%')
+    return f + 1;
+
+  while(*f && strchr("-+ #0'", *f))
+    f++;
+
+  if(*f == '*')
+  {
+    stars++;
+    f++;
+  }
+  while(*f >= '0' && *f <= '9')
+    f++;
+
+  if(*f == '.')
+  {
+    f++;
+    if(*f == '*')
+    {
+      stars++;
+      f++;
+    }
+    while(*f >= '0' && *f <= '9')
+      f++;
+  }
+
+  while(*f && strchr("hlLqjzt", *f))
+  {
+    if(*f == 'l')
+      length = length == 'l' ? 'q' : 'l';
+    else if(*f == 'j')
+      length = 'q';
+    else if(*f == 'z' || *f == 't')
+      length = 'l';
+    else if(*f != 'h')
+      length = *f;
+    f++;
+  }
+
+  switch(*f)
+  {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+      kind = length == 'q' ? ARG_LLONG : (length == 'l' ? ARG_LONG : ARG_INT);
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      kind = length == 'L' ? ARG_LDOUBLE : ARG_DOUBLE;
+      break;
+    case 'p':
+      kind = ARG_PTR;
+      break;
+    case 's':
+      //wide strings would have to be copied differently
+      if(length == 0)
+        kind = ARG_STR;
+      break;
+  }
+
+  return *f ? f + 1 : f;
+}
+
+bool LogRing::Encode(Entry& e, const char* fmt, va_list ap)
+{
+  unsigned used = 0;
+
+  e.nargs = 0;
+
+  for(const char* f = fmt; *f; )
+  {
+    if(*f++ != '%')
+      continue;
+
+    int stars, kind;
+    const char* spec = f;
+
+    f = ParseSpec(f, stars, kind);
+
+    if(kind < 0)
+    {
+      //"%%" has no argument, anything else cannot be deferred
+      if(*spec == '%')
+        continue;
+      return false;
+    }
+
+    if(e.nargs + stars + 1 > LOGRING_MAX_ARGS)
+      return false;
+
+    for(int i = 0; i < stars; i++)
+    {
+      e.kinds[e.nargs] = ARG_INT;
+      e.args[e.nargs++].i = va_arg(ap, int);
+    }
+
+    Arg& a = e.args[e.nargs];
+    e.kinds[e.nargs++] = kind;
+
+    switch(kind)
+    {
+      case ARG_INT:
+        a.i = va_arg(ap, int);
+        break;
+      case ARG_LONG:
+        a.i = va_arg(ap, long);
+        break;
+      case ARG_LLONG:
+        a.i = va_arg(ap, long long);
+        break;
+      case ARG_DOUBLE:
+        a.d = va_arg(ap, double);
+        break;
+      case ARG_LDOUBLE:
+        a.ld = va_arg(ap, long double);
+        break;
+      case ARG_PTR:
+        a.p = va_arg(ap, void*);
+        break;
+      case ARG_STR:
+      {
+        const char* s = va_arg(ap, const char*);
+        unsigned n;
+
+        if(s == NULL)
+          s = "(null)";
+
+        n = strlen(s) + 1;
+        if(used + n > LOGRING_STRING_BYTES)
+          return false;
+
+        memcpy(e.strings + used, s, n);
+        a.str = used;
+        used += n;
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+//one conversion with its '*' arguments
+template <typename T>
+static int FormatArg(char* out, size_t size, const char* spec, const int* star, int stars, T value)
+{
+  switch(stars)
+  {
+    case 0:
+      return snprintf(out, size, spec, value);
+    case 1:
+      return snprintf(out, size, spec, star[0], value);
+    default:
+      return snprintf(out, size, spec, star[0], star[1], value);
+  }
+}
+
+void LogRing::Format(const Entry& e, char* msg, int maxlen)
+{
+  int len = 0;
+  unsigned arg = 0;
+
+  if(e.fmt == NULL)
+  {
+    snprintf(msg, maxlen, "%s", e.strings);
+    return;
+  }
+
+  msg[0] = 0;
+
+  for(const char* f = e.fmt; *f && len < maxlen - 1; )
+  {
+    if(*f != '%')
+    {
+      msg[len++] = *f++;
+      msg[len] = 0;
+      continue;
+    }
+
+    int stars, kind;
+    const char* begin = f;
+    char spec[32];
+    int star[2];
+
+    f = ParseSpec(f + 1, stars, kind);
+
+    if(kind < 0 || f - begin >= (long)sizeof(spec))
+    {
+      //"%%", Encode() has refused anything else
+      msg[len++] = '%';
+      msg[len] = 0;
+      continue;
+    }
+
+    memcpy(spec, begin, f - begin);
+    spec[f - begin] = 0;
+
+    for(int i = 0; i < stars; i++)
+      star[i] = (int)e.args[arg++].i;
+
+    const Arg& a = e.args[arg++];
+    char* out = msg + len;
+    size_t size = maxlen - len;
+    int n = 0;
+
+    switch(kind)
+    {
+      case ARG_INT:
+        n = FormatArg(out, size, spec, star, stars, (int)a.i);
+        break;
+      case ARG_LONG:
+        n = FormatArg(out, size, spec, star, stars, (long)a.i);
+        break;
+      case ARG_LLONG:
+        n = FormatArg(out, size, spec, star, stars, a.i);
+        break;
+      case ARG_DOUBLE:
+        n = FormatArg(out, size, spec, star, stars, a.d);
+        break;
+      case ARG_LDOUBLE:
+        n = FormatArg(out, size, spec, star, stars, a.ld);
+        break;
+      case ARG_PTR:
+        n = FormatArg(out, size, spec, star, stars, a.p);
+        break;
+      case ARG_STR:
+        n = FormatArg(out, size, spec, star, stars, e.strings + a.str);
+        break;
+    }
+
+    if(n > 0)
+      len += n < (int)size ? n : (int)size - 1;
+  }
+}
+
+
+LogRing::LogRing(void (*output)(const int type, const int level, const char* msg))
+{
+  this->output = output;
+
+  entries = new Entry[LOGRING_ENTRIES];
+  for(unsigned long i = 0; i < LOGRING_ENTRIES; i++)
+    entries[i].seq = i;
+
+  head = 0;
+  tail = 0;
+  dropped = 0;
+  stop = false;
+
+  if(pthread_create(&thread, NULL, DrainThread, this) != 0)
+  {
+    fprintf(stderr, "LogRing: could not start the drain thread\n");
+    delete[] entries;
+    throw 0;
+  }
+}
+
+LogRing::~LogRing()
+{
+  stop = true;
+  pthread_join(thread, NULL);
+
+  delete[] entries;
+}
+
+bool LogRing::Push(const int type, const int level, const char* fmt, va_list ap, bool wait)
+{
+  unsigned long pos = head;
+  Entry* e;
+
+  //claim a slot: it is free if its sequence number is the position
+  while(true)
+  {
+    e = &entries[pos & LOGRING_MASK];
+    long diff = (long)(e->seq - pos);
+
+    if(diff == 0)
+    {
+      if(__sync_bool_compare_and_swap(&head, pos, pos + 1))
+        break;
+      pos = head;
+    }
+    else if(diff < 0)
+    {
+      if(!wait)
+      {
+        __sync_fetch_and_add(&dropped, 1);
+        return false;
+      }
+
+      //the drain thread frees the slot
+      usleep(100);
+      pos = head;
+    }
+    else
+      pos = head;
+  }
+
+  va_list aq;
+  __builtin_va_copy(aq, ap);
+
+  e->type = type;
+  e->level = level;
+  e->fmt = fmt;
+
+  if(!Encode(*e, fmt, aq))
+  {
+    e->fmt = NULL;
+    vsnprintf(e->strings, sizeof(e->strings), fmt, ap);
+  }
+
+  va_end(aq);
+
+  //publish: the entry must be complete before the drain thread sees it
+  __sync_synchronize();
+  e->seq = pos + 1;
+
+  return true;
+}
+
+bool LogRing::DrainOne()
+{
+  Entry& e = entries[tail & LOGRING_MASK];
+
+  if(e.seq != tail + 1)
+    return false;
+
+  __sync_synchronize();
+
+  char msg[1024];
+  Format(e, msg, sizeof(msg));
+  output(e.type, e.level, msg);
+
+  //free the slot for the next round
+  __sync_synchronize();
+  e.seq = tail + LOGRING_ENTRIES;
+  tail++;
+
+  return true;
+}
+
+void* LogRing::DrainThread(void* arg)
+{
+  LogRing* ring = (LogRing*)arg;
+  unsigned long reported = 0;
+
+  while(true)
+  {
+    if(ring->DrainOne())
+      continue;
+
+    if(ring->dropped != reported)
+    {
+      reported = ring->dropped;
+      fprintf(stderr, "LogRing: %lu log messages dropped, the ring was full\n", reported);
+    }
+
+    if(ring->stop)
+      break;
+
+    usleep(1000);
+  }
+
+  return NULL;
+}
+
+void LogRing::Flush()
+{
+  unsigned long pos = head;
+
+  while((long)(tail - pos) < 0)
+    usleep(100);
+}
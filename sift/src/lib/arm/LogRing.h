@@ -0,0 +1,96 @@
+/*
+ * LogRing.h
+ *
+ * asynchronous backend of Logger: a message is not formatted by the
+ * logging thread, Push() only stores the format pointer and the binary
+ * arguments (strings are copied) in a ring of fixed size entries. A drain
+ * thread formats the messages and hands them to the loggers.
+ *
+ * Any thread can push, a slot is claimed with a compare and swap on the
+ * head and published with its sequence number, there are no locks. If
+ * the ring is full the message is dropped and counted, the logging thread
+ * never waits for the output unless it asks to (see Push()).
+ *
+ * The format must be a string literal (it is read later), %n is not
+ * supported. A message with more arguments or string bytes than an entry
+ * holds is formatted by Push() itself.
+ */
+
+#ifndef LOGRING_H_
+#define LOGRING_H_
+
+#include <stdarg.h>
+#include <pthread.h>
+
+#define LOGRING_ENTRIES      1024     //power of two
+#define LOGRING_MAX_ARGS     12
+#define LOGRING_STRING_BYTES 192
+
+class Logger;
+
+class LogRing
+{
+  union Arg
+  {
+    long long i;
+    double d;
+    long double ld;
+    const void* p;
+    unsigned str;            //offset of a copied string
+  };
+
+  struct Entry
+  {
+    volatile unsigned long seq;
+    int type;
+    int level;
+    const char* fmt;         //NULL: strings holds the formatted message
+    unsigned nargs;
+    unsigned char kinds[LOGRING_MAX_ARGS];
+    Arg args[LOGRING_MAX_ARGS];
+    char strings[LOGRING_STRING_BYTES];
+  };
+
+  Entry* entries;
+  volatile unsigned long head;     //next slot to claim
+  volatile unsigned long tail;     //next slot to drain, written by the drain thread only
+  volatile unsigned long dropped;
+
+  pthread_t thread;
+  volatile bool stop;
+
+  void (*output)(const int type, const int level, const char* msg);
+
+  static bool Encode(Entry& e, const char* fmt, va_list ap);
+  static void Format(const Entry& e, char* msg, int maxlen);
+  static void* DrainThread(void* arg);
+
+  bool DrainOne();
+
+  LogRing(const LogRing&);
+  LogRing& operator=(const LogRing&);
+
+public:
+  /**
+   * starts the drain thread, which passes every message to output
+   */
+  LogRing(void (*output)(const int type, const int level, const char* msg));
+
+  /**
+   * drains what is left and stops the drain thread
+   */
+  ~LogRing();
+
+  /**
+   * queues a message, false if it was dropped. With wait a full ring
+   * is waited on instead, the message is never dropped.
+   */
+  bool Push(const int type, const int level, const char* fmt, va_list ap, bool wait = false);
+
+  /**
+   * returns when everything pushed before has been written
+   */
+  void Flush();
+};
+
+#endif /* LOGRING_H_ */
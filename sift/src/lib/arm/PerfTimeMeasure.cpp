@@ -0,0 +1,115 @@
+/*
+ * PerfTimeMeasure.cpp
+ *
+ * hardware counters through perf_event_open, see PerfTimeMeasure.h
+ */
+
+#include "PerfTimeMeasure.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_perf_event_open)
+
+//in the order of TimeMeasureBase::counterNames
+static const unsigned long long perf_configs[TIMEMEASURE_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static int OpenCounter(unsigned long long config)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  //this thread and its children, on any cpu
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void PerfTimeMeasure::init()
+{
+  for(int i = 0; i < TIMEMEASURE_COUNTERS; i++)
+  {
+    fds[i] = OpenCounter(perf_configs[i]);
+
+    if(fds[i] < 0)
+      fprintf(stderr, "PerfTimeMeasure: %s not available (%s)\n", counterNames[i], strerror(errno));
+    else
+      opened++;
+  }
+
+  if(opened == 0)
+    fprintf(stderr, "PerfTimeMeasure: no hardware counters, measuring times only\n");
+}
+
+bool PerfTimeMeasure::readCounters(unsigned long long* values)
+{
+  if(opened == 0)
+    return false;
+
+  for(int i = 0; i < TIMEMEASURE_COUNTERS; i++)
+  {
+    unsigned long long v[3];    //value, time enabled, time running
+
+    values[i] = TIMEMEASURE_NO_COUNTER;
+
+    if(fds[i] < 0 || read(fds[i], v, sizeof(v)) != sizeof(v))
+      continue;
+
+    //multiplexed: scale to the time the counter was enabled
+    if(v[2] > 0 && v[2] < v[1])
+      values[i] = (unsigned long long)((double)v[0] * v[1] / v[2]);
+    else if(v[2] > 0)
+      values[i] = v[0];
+  }
+
+  return true;
+}
+
+#else
+
+void PerfTimeMeasure::init()
+{
+  fprintf(stderr, "PerfTimeMeasure: perf_event_open not supported, measuring times only\n");
+}
+
+bool PerfTimeMeasure::readCounters(unsigned long long*)
+{
+  return false;
+}
+
+#endif
+
+PerfTimeMeasure::PerfTimeMeasure()
+{
+  opened = 0;
+
+  for(int i = 0; i < TIMEMEASURE_COUNTERS; i++)
+    fds[i] = -1;
+}
+
+PerfTimeMeasure::~PerfTimeMeasure()
+{
+  for(int i = 0; i < TIMEMEASURE_COUNTERS; i++)
+  {
+    if(fds[i] >= 0)
+      close(fds[i]);
+  }
+}
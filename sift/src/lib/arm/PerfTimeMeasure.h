@@ -0,0 +1,53 @@
+/*
+ * PerfTimeMeasure.h
+ *
+ * TimeMeasureBase backend that reads the hardware counters of the CPU
+ * (cycles, instructions, cache misses and branch misses) through
+ * perf_event_open along with the time, selected with PERF_COUNTERS=yes
+ * (-DTIMEMEASURE_PERF).
+ *
+ * Only user space is counted, for the measuring thread and the threads
+ * it starts after the first measurement. The counters are opened one by
+ * one, so the kernel multiplexes them if the PMU has too few (the
+ * Cortex-A8 has two besides the cycle counter) and the values are scaled
+ * to the whole time. A counter the kernel refuses (no PMU, a container,
+ * perf_event_paranoid) is left out, without any the times are measured
+ * as by SystemTimeMeasure.
+ */
+
+#ifndef PERFTIMEMEASURE_H_
+#define PERFTIMEMEASURE_H_
+
+#include "TimeMeasureBase.h"
+#include <sys/time.h>
+#include <stddef.h>
+
+class PerfTimeMeasure : public TimeMeasureBase
+{
+  int fds[TIMEMEASURE_COUNTERS];
+  int opened;
+
+  virtual void init();
+
+  virtual timeval getCurrentTime()
+  {
+    timeval t;
+
+    gettimeofday(&t, NULL);
+
+    return t;
+  }
+
+  virtual bool readCounters(unsigned long long* values);
+
+public:
+  PerfTimeMeasure();
+  virtual ~PerfTimeMeasure();
+
+  virtual bool hasCounters()
+  {
+    return opened > 0;
+  }
+};
+
+#endif /* PERFTIMEMEASURE_H_ */
@@ -0,0 +1,478 @@
+/*
+ * Profiler.cpp
+ *
+ * scoped timers, see Profiler.h
+ */
+
+#include "Profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+
+struct ProfileThread
+{
+  ProfileZoneStats zones[PROFILER_MAX_ZONES];
+  ProfileScope* top;       //innermost open scope
+  ProfileThread* next;     //all tables
+  ProfileThread* next_free;
+  int id;                  //row in the trace, shared by the threads that used the table
+  ProfileEvent* events;    //kept calls if tracing, else NULL
+  unsigned nevents;
+  unsigned long dropped;
+};
+
+static const char* zone_names[PROFILER_MAX_ZONES];
+static int num_zones = 0;
+static ProfileThread* threads = NULL;
+static ProfileThread* free_threads = NULL;   //tables of exited threads
+static ProfileZoneStats retired[PROFILER_MAX_ZONES];   //their stats (entries with count 0 are unset)
+static int num_threads = 0;
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+static profile_ns epoch = 0;
+static bool trace_enabled = false;
+static pthread_mutex_t profiler_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread ProfileThread* this_thread = NULL;
+
+
+static void ClearStats(ProfileZoneStats* stats, int n)
+{
+  memset(stats, 0, n * sizeof(*stats));
+
+  for(int i = 0; i < n; i++)
+  {
+    stats[i].min = ~(profile_ns)0;
+    stats[i].parent = -1;
+  }
+}
+
+//adds the zones of src to dst
+static void AddStats(ProfileZoneStats* dst, const ProfileZoneStats* src, int n)
+{
+  for(int z = 0; z < n; z++)
+  {
+    const ProfileZoneStats& s = src[z];
+    ProfileZoneStats& m = dst[z];
+
+    if(s.count == 0)
+      continue;
+
+    if(m.count == 0 || m.parent < 0)
+      m.parent = s.parent;
+    if(m.count == 0 || s.min < m.min)
+      m.min = s.min;
+
+    m.count += s.count;
+    m.total += s.total;
+    m.children += s.children;
+    if(s.max > m.max)
+      m.max = s.max;
+    for(int b = 0; b < PROFILER_BUCKETS; b++)
+      m.histogram[b] += s.histogram[b];
+  }
+}
+
+//destructor of thread_key: the exiting thread hands its table back
+static void ReleaseThread(void* table)
+{
+  ProfileThread* t = (ProfileThread*)table;
+
+  pthread_mutex_lock(&profiler_mutex);
+  AddStats(retired, t->zones, PROFILER_MAX_ZONES);
+  ClearStats(t->zones, PROFILER_MAX_ZONES);
+  t->top = NULL;
+  t->next_free = free_threads;
+  free_threads = t;
+  pthread_mutex_unlock(&profiler_mutex);
+
+  this_thread = NULL;
+}
+
+//runs once, before the first thread table is handed out
+static void CreateThreadKey()
+{
+  pthread_key_create(&thread_key, ReleaseThread);
+
+  if(getenv("PROFILER_TRACE"))
+    trace_enabled = true;
+}
+
+//table of the calling thread, taken on its first scope
+static ProfileThread* GetThread()
+{
+  if(this_thread == NULL)
+  {
+    ProfileThread* t;
+
+    pthread_once(&thread_key_once, CreateThreadKey);
+
+    pthread_mutex_lock(&profiler_mutex);
+    t = free_threads;
+    if(t)
+    {
+      //cleared when it was released, the events stay for the trace
+      free_threads = t->next_free;
+    }
+    else
+    {
+      t = new ProfileThread;
+      ClearStats(t->zones, PROFILER_MAX_ZONES);
+      t->top = NULL;
+      t->events = NULL;
+      t->nevents = 0;
+      t->dropped = 0;
+      t->id = num_threads++;
+      t->next = threads;
+      threads = t;
+    }
+    pthread_mutex_unlock(&profiler_mutex);
+
+    pthread_setspecific(thread_key, t);
+    this_thread = t;
+  }
+
+  return this_thread;
+}
+
+
+ProfileZone::ProfileZone(const char* name)
+{
+  id = Profiler::RegisterZone(name);
+}
+
+
+ProfileScope::ProfileScope(const ProfileZone& zone)
+{
+  this->zone = zone.GetId();
+  thread = GetThread();
+  parent = thread->top;
+  children = 0;
+  thread->top = this;
+  start = Profiler::Now();
+}
+
+ProfileScope::~ProfileScope()
+{
+  profile_ns duration = Profiler::Now() - start;
+
+  thread->top = parent;
+
+  //zones beyond PROFILER_MAX_ZONES are not recorded
+  if(zone < 0)
+    return;
+
+  ProfileZoneStats& s = thread->zones[zone];
+
+  if(s.count == 0)
+    s.parent = parent ? parent->zone : -1;
+
+  s.count++;
+  s.total += duration;
+  s.children += children;
+  if(duration < s.min)
+    s.min = duration;
+  if(duration > s.max)
+    s.max = duration;
+  s.histogram[Profiler::Bucket(duration)]++;
+
+  if(parent)
+    parent->children += duration;
+
+  if(trace_enabled)
+  {
+    if(thread->events == NULL)
+      thread->events = new ProfileEvent[PROFILER_TRACE_EVENTS];
+
+    if(thread->nevents < PROFILER_TRACE_EVENTS)
+    {
+      ProfileEvent& e = thread->events[thread->nevents++];
+      e.zone = zone;
+      e.start = start - epoch;
+      e.end = start + duration - epoch;
+    }
+    else
+      thread->dropped++;
+  }
+}
+
+
+int Profiler::RegisterZone(const char* name)
+{
+  int id = -1;
+
+  pthread_mutex_lock(&profiler_mutex);
+  if(epoch == 0)
+    epoch = Now();
+
+  if(num_zones < PROFILER_MAX_ZONES)
+  {
+    id = num_zones++;
+    zone_names[id] = name;
+  }
+  pthread_mutex_unlock(&profiler_mutex);
+
+  if(id < 0)
+    fprintf(stderr, "Profiler: too many zones, '%s' is not measured\n", name);
+
+  return id;
+}
+
+int Profiler::GetNumZones()
+{
+  return num_zones;
+}
+
+const char* Profiler::GetZoneName(int zone)
+{
+  return zone >= 0 && zone < num_zones ? zone_names[zone] : "";
+}
+
+int Profiler::Bucket(profile_ns ns)
+{
+  if(ns < 4)
+    return (int)ns;
+
+  //four buckets per power of two: the exponent and the next two bits
+  int e = 63 - __builtin_clzll(ns);
+  return (e - 1) * 4 + (int)((ns >> (e - 2)) & 3);
+}
+
+profile_ns Profiler::BucketStart(int bucket)
+{
+  if(bucket < 4)
+    return bucket;
+
+  int e = bucket / 4 + 1;
+  return (profile_ns)(4 + bucket % 4) << (e - 2);
+}
+
+void Profiler::GetStats(std::vector<ProfileZoneStats>& stats)
+{
+  stats.resize(num_zones);
+  if(num_zones == 0)
+    return;
+
+  ClearStats(&stats[0], num_zones);
+
+  pthread_mutex_lock(&profiler_mutex);
+  for(ProfileThread* t = threads; t; t = t->next)
+    AddStats(&stats[0], t->zones, num_zones);
+  AddStats(&stats[0], retired, num_zones);
+  pthread_mutex_unlock(&profiler_mutex);
+}
+
+profile_ns Profiler::Percentile(const ProfileZoneStats& stats, double p)
+{
+  if(stats.count == 0)
+    return 0;
+
+  unsigned long rank = (unsigned long)(p * stats.count);
+  unsigned long seen = 0;
+
+  if(rank >= stats.count)
+    rank = stats.count - 1;
+
+  for(int b = 0; b < PROFILER_BUCKETS; b++)
+  {
+    seen += stats.histogram[b];
+    if(seen > rank)
+    {
+      profile_ns end = b + 1 < PROFILER_BUCKETS ? BucketStart(b + 1) - 1 : stats.max;
+
+      if(end > stats.max)
+        end = stats.max;
+      if(end < stats.min)
+        end = stats.min;
+
+      return end;
+    }
+  }
+
+  return stats.max;
+}
+
+void Profiler::Reset()
+{
+  pthread_mutex_lock(&profiler_mutex);
+  ClearStats(retired, PROFILER_MAX_ZONES);
+
+  for(ProfileThread* t = threads; t; t = t->next)
+  {
+    ClearStats(t->zones, PROFILER_MAX_ZONES);
+    t->nevents = 0;
+    t->dropped = 0;
+  }
+  pthread_mutex_unlock(&profiler_mutex);
+}
+
+static void PrintZone(FILE* out, const std::vector<ProfileZoneStats>& stats, int zone, int depth)
+{
+  const ProfileZoneStats& s = stats[zone];
+
+  if(s.count > 0)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "%*s%s", 2 * depth, "", Profiler::GetZoneName(zone));
+
+    fprintf(out, "%-28s %9lu %11.3f %11.3f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+        name, s.count,
+        s.total / 1e6, (s.total - s.children) / 1e6,
+        s.total / 1e3 / s.count,
+        s.min / 1e3,
+        Profiler::Percentile(s, 0.5) / 1e3,
+        Profiler::Percentile(s, 0.9) / 1e3,
+        Profiler::Percentile(s, 0.99) / 1e3,
+        s.max / 1e3);
+  }
+
+  for(unsigned z = 0; z < stats.size(); z++)
+  {
+    //depth stops zones that are each other's parent
+    if(stats[z].parent == zone && (int)z != zone && depth < PROFILER_MAX_ZONES)
+      PrintZone(out, stats, z, depth + 1);
+  }
+}
+
+void Profiler::Print(FILE* out)
+{
+  std::vector<ProfileZoneStats> stats;
+  GetStats(stats);
+
+  fprintf(out, "%-28s %9s %11s %11s %10s %10s %10s %10s %10s %10s\n",
+      "zone", "calls", "total(ms)", "self(ms)", "mean(us)", "min(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+
+  for(unsigned z = 0; z < stats.size(); z++)
+  {
+    if(stats[z].parent < 0)
+      PrintZone(out, stats, z, 0);
+  }
+}
+
+void Profiler::WriteCsv(FILE* out)
+{
+  std::vector<ProfileZoneStats> stats;
+  GetStats(stats);
+
+  fprintf(out, "zone,parent,calls,total_ms,self_ms,mean_us,min_us,p50_us,p90_us,p99_us,max_us\n");
+
+  for(unsigned z = 0; z < stats.size(); z++)
+  {
+    const ProfileZoneStats& s = stats[z];
+
+    if(s.count == 0)
+      continue;
+
+    fprintf(out, "%s,%s,%lu,%.3f,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+        GetZoneName(z), GetZoneName(s.parent), s.count,
+        s.total / 1e6, (s.total - s.children) / 1e6,
+        s.total / 1e3 / s.count, s.min / 1e3,
+        Percentile(s, 0.5) / 1e3, Percentile(s, 0.9) / 1e3, Percentile(s, 0.99) / 1e3,
+        s.max / 1e3);
+  }
+}
+
+//zone names are string literals in the code, only quotes and backslashes need escaping
+static void WriteJsonString(FILE* out, const char* str)
+{
+  fputc('"', out);
+  for(; *str; str++)
+  {
+    if(*str == '"' || *str == '\\')
+      fputc('\\', out);
+    fputc(*str, out);
+  }
+  fputc('"', out);
+}
+
+void Profiler::WriteJson(FILE* out)
+{
+  std::vector<ProfileZoneStats> stats;
+  GetStats(stats);
+
+  bool first = true;
+
+  fprintf(out, "{\"zones\": [");
+
+  for(unsigned z = 0; z < stats.size(); z++)
+  {
+    const ProfileZoneStats& s = stats[z];
+
+    if(s.count == 0)
+      continue;
+
+    fprintf(out, "%s\n  {\"name\": ", first ? "" : ",");
+    WriteJsonString(out, GetZoneName(z));
+    fprintf(out, ", \"parent\": ");
+    WriteJsonString(out, GetZoneName(s.parent));
+    fprintf(out, ", \"calls\": %lu, \"total_ns\": %llu, \"self_ns\": %llu, \"min_ns\": %llu, "
+        "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}",
+        s.count, s.total, s.total - s.children, s.min,
+        Percentile(s, 0.5), Percentile(s, 0.9), Percentile(s, 0.99), s.max);
+    first = false;
+  }
+
+  fprintf(out, "\n]}\n");
+}
+
+void Profiler::EnableTrace()
+{
+  trace_enabled = true;
+}
+
+void Profiler::WriteTrace(FILE* out)
+{
+  bool first = true;
+
+  fprintf(out, "{\"traceEvents\": [");
+
+  pthread_mutex_lock(&profiler_mutex);
+  for(ProfileThread* t = threads; t; t = t->next)
+  {
+    for(unsigned i = 0; i < t->nevents; i++)
+    {
+      const ProfileEvent& e = t->events[i];
+
+      //complete events, timestamps in microseconds
+      fprintf(out, "%s\n  {\"name\": ", first ? "" : ",");
+      WriteJsonString(out, GetZoneName(e.zone));
+      fprintf(out, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+          t->id, e.start / 1e3, (e.end - e.start) / 1e3);
+      first = false;
+    }
+
+    if(t->dropped)
+      fprintf(stderr, "Profiler: trace of thread %d is missing %lu calls\n", t->id, t->dropped);
+  }
+  pthread_mutex_unlock(&profiler_mutex);
+
+  fprintf(out, "\n]}\n");
+}
+
+static void ExportFile(const char* variable, void (*write)(FILE*))
+{
+  const char* name = getenv(variable);
+
+  if(name == NULL || *name == 0)
+    return;
+
+  FILE* out = fopen(name, "w");
+
+  if(out == NULL)
+  {
+    fprintf(stderr, "Profiler: could not open '%s' for writing\n", name);
+    return;
+  }
+
+  write(out);
+  fclose(out);
+}
+
+void Profiler::Export()
+{
+  ExportFile("PROFILER_CSV", WriteCsv);
+  ExportFile("PROFILER_JSON", WriteJson);
+  ExportFile("PROFILER_TRACE", WriteTrace);
+}
@@ -0,0 +1,178 @@
+/*
+ * Profiler.h
+ *
+ * scoped timers with a low overhead, for the hot paths where the string
+ * keyed timers of TimeMeasureBase would distort what they measure.
+ *
+ * A zone is defined once at file scope and gets its id at program start,
+ * a scope measures the block it is declared in:
+ *
+ *   PROFILE_ZONE(octave, "process_octave");
+ *   ...
+ *   {
+ *     PROFILE_SCOPE(octave);
+ *     ...
+ *   }
+ *
+ * Every thread accumulates into a table of its own, without locks or
+ * atomic operations. When a thread exits its table is added to the
+ * totals and kept for the next new thread, so short lived workers (e.g.
+ * those of vl_parallel_for) do not pile up tables. The time of a scope is also booked as child time of
+ * the enclosing scope of the same thread, so the report gives total and
+ * self time of every zone in a tree. The durations are kept in a
+ * histogram with four buckets per power of two, for the percentiles.
+ *
+ * The clock is CLOCK_MONOTONIC (the cycle counter of the Cortex-A8 is not
+ * readable from user space by default).
+ *
+ * The statistics can be written as CSV or JSON, and with tracing enabled
+ * every call is also kept as an event for a Chrome trace (chrome://tracing),
+ * see Export(). profcompare compares the exported (or printed) statistics
+ * of two sets of runs.
+ *
+ * With PROFILER=no (-DPROFILER_DISABLED) the macros expand to nothing.
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#define PROFILER_MAX_ZONES 64
+#define PROFILER_BUCKETS   256
+
+//calls kept per thread for the trace, later ones are dropped
+#define PROFILER_TRACE_EVENTS 65536
+
+typedef unsigned long long profile_ns;
+
+struct ProfileEvent
+{
+  int zone;
+  profile_ns start;      //since the start of the program
+  profile_ns end;
+};
+
+struct ProfileZoneStats
+{
+  unsigned long count;
+  profile_ns total;
+  profile_ns children;   //part of total spent in nested scopes
+  profile_ns min;
+  profile_ns max;
+  int parent;            //zone of the enclosing scope at the first call, -1 for none
+  unsigned long histogram[PROFILER_BUCKETS];
+};
+
+class ProfileZone
+{
+  int id;
+
+public:
+  /**
+   * registers the zone, name must stay valid (a string literal)
+   */
+  ProfileZone(const char* name);
+
+  int GetId() const
+  {
+    return id;
+  }
+};
+
+struct ProfileThread;
+
+class ProfileScope
+{
+  ProfileThread* thread;
+  ProfileScope* parent;
+  int zone;
+  profile_ns start;
+  profile_ns children;
+
+  ProfileScope(const ProfileScope&);
+  ProfileScope& operator=(const ProfileScope&);
+
+public:
+  ProfileScope(const ProfileZone& zone);
+  ~ProfileScope();
+};
+
+class Profiler
+{
+public:
+  static profile_ns Now()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (profile_ns)t.tv_sec * 1000000000ULL + t.tv_nsec;
+  }
+
+  static int RegisterZone(const char* name);
+
+  static int GetNumZones();
+  static const char* GetZoneName(int zone);
+
+  /**
+   * stats of all threads added up, one entry per zone. The threads
+   * should not be inside a scope meanwhile, their tables are read
+   * without synchronisation.
+   */
+  static void GetStats(std::vector<ProfileZoneStats>& stats);
+
+  /**
+   * upper bound of the duration of the p-th fraction (0..1) of the
+   * calls, within the resolution of the histogram
+   */
+  static profile_ns Percentile(const ProfileZoneStats& stats, double p);
+
+  /**
+   * clears the tables of all threads
+   */
+  static void Reset();
+
+  /**
+   * prints the zones as a tree: calls, total and self time, mean, min,
+   * median, 90th/99th percentile and max.
+   */
+  static void Print(FILE* out);
+
+  /**
+   * the statistics of Print, one line per zone, with the parent zone by name
+   */
+  static void WriteCsv(FILE* out);
+  static void WriteJson(FILE* out);
+
+  /**
+   * keeps up to PROFILER_TRACE_EVENTS calls per thread from now on
+   */
+  static void EnableTrace();
+
+  /**
+   * the kept calls in the Chrome trace event format, one row per thread
+   */
+  static void WriteTrace(FILE* out);
+
+  /**
+   * writes the files named by the environment: PROFILER_CSV, PROFILER_JSON
+   * and PROFILER_TRACE. Setting PROFILER_TRACE also enables the trace from
+   * the first measured scope on.
+   */
+  static void Export();
+
+  //histogram bucket of a duration and the smallest duration in a bucket
+  static int Bucket(profile_ns ns);
+  static profile_ns BucketStart(int bucket);
+};
+
+#ifndef PROFILER_DISABLED
+#define PROFILE_ZONE(var, name) static ProfileZone profile_zone_##var(name)
+#define PROFILE_SCOPE(var) ProfileScope profile_scope_##var(profile_zone_##var)
+#else
+#define PROFILE_ZONE(var, name) typedef int profile_zone_##var##_unused
+#define PROFILE_SCOPE(var) ((void)0)
+#endif
+
+#endif /* PROFILER_H_ */
@@ -0,0 +1,367 @@
+/*
+ * SiftMatcher.cpp
+ *
+ * kd-tree forest matching of SIFT descriptors, see SiftMatcher.h
+ */
+
+#include "SiftMatcher.h"
+
+#include <stdio.h>
+#include <float.h>
+#include <algorithm>
+
+#include "logger.h"
+
+
+SiftMatcher::SiftMatcher(unsigned num_trees, unsigned max_comparisons, double threshold)
+{
+  forest = NULL;
+  data_type = VL_TYPE_FLOAT;
+  reference_data = NULL;
+  num_reference = 0;
+  comparisons = 0;
+
+  this->num_trees = num_trees < 1 ? 1 : num_trees;
+  this->max_comparisons = max_comparisons;
+  this->threshold = threshold;
+}
+
+SiftMatcher::~SiftMatcher()
+{
+  DeleteForest();
+}
+
+void SiftMatcher::DeleteForest()
+{
+  if(forest)
+    vl_kdforest_delete(forest);
+  forest = NULL;
+}
+
+void SiftMatcher::Build()
+{
+  //the descriptors of a loaded forest go away with it
+  if(forest && reference.empty() && reference_u8.empty() && num_reference)
+  {
+    if(data_type == VL_TYPE_UINT8)
+    {
+      const vl_uint8* data = (const vl_uint8*)reference_data;
+      reference_u8.assign(data, data + num_reference * SIFT_DESCRIPTOR_SIZE);
+      reference_data = &reference_u8[0];
+    }
+    else
+    {
+      const float* data = (const float*)reference_data;
+      reference.assign(data, data + num_reference * SIFT_DESCRIPTOR_SIZE);
+      reference_data = &reference[0];
+    }
+  }
+
+  DeleteForest();
+
+  if(num_reference == 0)
+    return;
+
+  forest = vl_kdforest_new(data_type, SIFT_DESCRIPTOR_SIZE, num_trees);
+  vl_kdforest_build(forest, num_reference, reference_data);
+
+  LOG_DEBUG(Logger::SIFT, "matcher: forest of %u trees over %u %s descriptors", num_trees, GetNumReference(),
+      data_type == VL_TYPE_UINT8 ? "uint8" : "float");
+}
+
+void SiftMatcher::SetReference(const float* descr, unsigned n)
+{
+  DeleteForest();
+
+  reference_u8.clear();
+  reference.assign(descr, descr + n * SIFT_DESCRIPTOR_SIZE);
+  reference_data = reference.empty() ? NULL : &reference[0];
+  num_reference = n;
+  data_type = VL_TYPE_FLOAT;
+}
+
+void SiftMatcher::SetReference(const vl_uint8* descr, unsigned n)
+{
+  DeleteForest();
+
+  reference.clear();
+  reference_u8.assign(descr, descr + n * SIFT_DESCRIPTOR_SIZE);
+  reference_data = reference_u8.empty() ? NULL : &reference_u8[0];
+  num_reference = n;
+  data_type = VL_TYPE_UINT8;
+}
+
+void SiftMatcher::SetReference(const std::vector<KeyPointDescriptor>& keypoints, bool quantize)
+{
+  DeleteForest();
+
+  reference.clear();
+  reference_u8.clear();
+
+  if(quantize)
+  {
+    for(unsigned i = 0; i < keypoints.size(); i++)
+      Quantize(keypoints[i].descr, 1, reference_u8);
+
+    reference_data = reference_u8.empty() ? NULL : &reference_u8[0];
+    data_type = VL_TYPE_UINT8;
+  }
+  else
+  {
+    reference.resize(keypoints.size() * SIFT_DESCRIPTOR_SIZE);
+
+    for(unsigned i = 0; i < keypoints.size(); i++)
+      std::copy(keypoints[i].descr, keypoints[i].descr + SIFT_DESCRIPTOR_SIZE, &reference[i * SIFT_DESCRIPTOR_SIZE]);
+
+    reference_data = reference.empty() ? NULL : &reference[0];
+    data_type = VL_TYPE_FLOAT;
+  }
+
+  num_reference = keypoints.size();
+}
+
+void SiftMatcher::Save(const char* filename)
+{
+  if(forest == NULL)
+    Build();
+
+  if(forest == NULL)
+    throw MatcherException("no reference descriptors to save");
+
+  if(vl_kdforest_save(forest, filename, VL_TRUE) != VL_ERR_OK)
+    throw MatcherException(vl_get_last_error_message());
+}
+
+void SiftMatcher::Load(const char* filename, bool check)
+{
+  VlKDForest* loaded = vl_kdforest_load(filename, NULL, check ? VL_TRUE : VL_FALSE);
+
+  if(loaded == NULL)
+    throw MatcherException(vl_get_last_error_message());
+
+  if((vl_kdforest_get_data_type(loaded) != VL_TYPE_FLOAT &&
+      vl_kdforest_get_data_type(loaded) != VL_TYPE_UINT8) ||
+     vl_kdforest_get_data_dimension(loaded) != SIFT_DESCRIPTOR_SIZE)
+  {
+    vl_kdforest_delete(loaded);
+    throw MatcherException("the index does not hold SIFT descriptors");
+  }
+
+  DeleteForest();
+  reference.clear();
+  reference_u8.clear();
+
+  forest = loaded;
+  data_type = vl_kdforest_get_data_type(forest);
+  reference_data = forest->data;
+  num_reference = forest->numData;
+  num_trees = vl_kdforest_get_num_trees(forest);
+
+  LOG_DEBUG(Logger::SIFT, "matcher: loaded a forest of %u trees over %u descriptors", num_trees, num_reference);
+}
+
+void SiftMatcher::CheckType(vl_type type)
+{
+  if(type != data_type)
+    throw MatcherException(data_type == VL_TYPE_UINT8 ?
+        "the reference descriptors are uint8, the queries must be too" :
+        "the reference descriptors are float, the queries must be too");
+}
+
+bool SiftMatcher::RatioTest(unsigned q, unsigned r, float best, float second,
+                            std::vector<SiftMatch>& matches)
+{
+  if(threshold * best <= second)
+  {
+    SiftMatch m;
+    m.query = q;
+    m.reference = r;
+    m.distance = best;
+    m.second = second;
+    matches.push_back(m);
+    return true;
+  }
+
+  return false;
+}
+
+unsigned SiftMatcher::Match(const float* query, unsigned n, std::vector<SiftMatch>& matches)
+{
+  CheckType(VL_TYPE_FLOAT);
+  return MatchForest(query, n, matches);
+}
+
+unsigned SiftMatcher::Match(const vl_uint8* query, unsigned n, std::vector<SiftMatch>& matches)
+{
+  CheckType(VL_TYPE_UINT8);
+  return MatchForest(query, n, matches);
+}
+
+unsigned SiftMatcher::MatchForest(const void* query, unsigned n, std::vector<SiftMatch>& matches)
+{
+  unsigned found = 0;
+
+  comparisons = 0;
+
+  //the ratio test needs a second neighbour
+  if(GetNumReference() < 2 || n == 0)
+    return 0;
+
+  if(forest == NULL)
+    Build();
+
+  //two neighbours per query, on vl_get_max_threads() threads (the
+  //distances of a uint8 forest are floats as well)
+  std::vector<vl_uint32> indexes(2 * n);
+  std::vector<float> distances(2 * n);
+
+  vl_kdforest_set_max_num_comparisons(forest, max_comparisons);
+  comparisons = vl_kdforest_query_with_array(forest, &indexes[0], 2, n, &distances[0], query);
+
+  for(unsigned q = 0; q < n; q++)
+  {
+    float best = distances[2 * q], second = distances[2 * q + 1];
+
+    //a bounded search may end before it has seen two descriptors
+    if(second != second)
+      continue;
+
+    if(RatioTest(q, indexes[2 * q], best, second, matches))
+      found++;
+  }
+
+  return found;
+}
+
+unsigned SiftMatcher::MatchExact(const float* query, unsigned n, std::vector<SiftMatch>& matches)
+{
+  const float* ref = (const float*)reference_data;
+  unsigned nref = GetNumReference();
+  unsigned found = 0;
+
+  CheckType(VL_TYPE_FLOAT);
+  comparisons = 0;
+
+  if(nref < 2)
+    return 0;
+
+  for(unsigned q = 0; q < n; q++)
+  {
+    const float* a = query + q * SIFT_DESCRIPTOR_SIZE;
+    float best = FLT_MAX, second = FLT_MAX;
+    unsigned best_index = 0;
+
+    for(unsigned r = 0; r < nref; r++)
+    {
+      const float* b = ref + r * SIFT_DESCRIPTOR_SIZE;
+      float acc = 0;
+
+      for(int l = 0; l < SIFT_DESCRIPTOR_SIZE; l++)
+      {
+        float delta = a[l] - b[l];
+        acc += delta * delta;
+      }
+
+      if(acc < best)
+      {
+        second = best;
+        best = acc;
+        best_index = r;
+      }
+      else if(acc < second)
+        second = acc;
+    }
+
+    comparisons += nref;
+
+    if(RatioTest(q, best_index, best, second, matches))
+      found++;
+  }
+
+  return found;
+}
+
+unsigned SiftMatcher::MatchExact(const vl_uint8* query, unsigned n, std::vector<SiftMatch>& matches)
+{
+  const vl_uint8* ref = (const vl_uint8*)reference_data;
+  VlUInt8VectorComparisonFunction distance = vl_get_vector_comparison_function_ui8(VlDistanceL2);
+  unsigned nref = GetNumReference();
+  unsigned found = 0;
+
+  CheckType(VL_TYPE_UINT8);
+  comparisons = 0;
+
+  if(nref < 2)
+    return 0;
+
+  for(unsigned q = 0; q < n; q++)
+  {
+    const vl_uint8* a = query + q * SIFT_DESCRIPTOR_SIZE;
+    vl_uint32 best = 0xffffffff, second = 0xffffffff;
+    unsigned best_index = 0;
+
+    for(unsigned r = 0; r < nref; r++)
+    {
+      vl_uint32 acc = distance(SIFT_DESCRIPTOR_SIZE, a, ref + r * SIFT_DESCRIPTOR_SIZE);
+
+      if(acc < best)
+      {
+        second = best;
+        best = acc;
+        best_index = r;
+      }
+      else if(acc < second)
+        second = acc;
+    }
+
+    comparisons += nref;
+
+    if(RatioTest(q, best_index, best, second, matches))
+      found++;
+  }
+
+  return found;
+}
+
+unsigned SiftMatcher::ReadSiftFile(const char* filename, std::vector<float>& descr, std::vector<double>* frames)
+{
+  FILE* in = fopen(filename, "r");
+  unsigned n = 0;
+  double frame[4];
+
+  if(in == NULL)
+    throw MatcherException("could not open the .sift file");
+
+  while(fscanf(in, "%lf %lf %lf %lf", &frame[0], &frame[1], &frame[2], &frame[3]) == 4)
+  {
+    float d[SIFT_DESCRIPTOR_SIZE];
+    int l;
+
+    for(l = 0; l < SIFT_DESCRIPTOR_SIZE && fscanf(in, "%f", &d[l]) == 1; l++)
+      ;
+
+    if(l < SIFT_DESCRIPTOR_SIZE)
+      break;
+
+    descr.insert(descr.end(), d, d + SIFT_DESCRIPTOR_SIZE);
+    if(frames)
+      frames->insert(frames->end(), frame, frame + 4);
+    n++;
+  }
+
+  fclose(in);
+  return n;
+}
+
+void SiftMatcher::Quantize(const float* descr, unsigned n, std::vector<vl_uint8>& out, float scale)
+{
+  unsigned size = n * SIFT_DESCRIPTOR_SIZE;
+
+  out.reserve(out.size() + size);
+
+  for(unsigned i = 0; i < size; i++)
+  {
+    float x = scale * descr[i];
+    out.push_back(x >= 255.0f ? 255 : x <= 0.0f ? 0 : (vl_uint8)x);
+  }
+}
@@ -0,0 +1,202 @@
+/*
+ * SiftMatcher.h
+ *
+ * matches SIFT descriptors of a query image against the descriptors of a
+ * reference image: the reference descriptors are indexed by a randomized
+ * kd-tree forest (vl/kdtree.c), every query descriptor looks up its two
+ * nearest neighbours with a bounded number of comparisons and is kept if
+ * it passes Lowe's ratio test. MatchExact() does the same by brute force,
+ * as toolbox/sift/vl_ubcmatch.c.
+ *
+ * Distances are squared euclidean distances, the threshold is applied as
+ * by vl_ubcmatch: a match is unique if threshold * best <= second best.
+ *
+ * The descriptors are stored either as floats or quantized to one byte
+ * per component (VL_TYPE_UINT8, as written to .sift files), which takes
+ * a quarter of the memory and compares with integer SIMD kernels. The
+ * queries must have the type of the reference descriptors.
+ */
+
+#ifndef SIFTMATCHER_H_
+#define SIFTMATCHER_H_
+
+#include <vector>
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C" {
+#endif
+
+#include <vl/kdtree.h>
+
+#ifdef __cplusplus /* If this is a C++ compiler, end C linkage */
+}
+#endif
+
+#include "sift.h"
+#include "Exception.h"
+
+#define SIFT_DESCRIPTOR_SIZE 128
+
+//scale of the uint8 descriptors of sift and sifttest
+#define SIFT_DESCRIPTOR_SCALE 512.0f
+
+struct SiftMatch
+{
+  unsigned query;        //index of the query descriptor
+  unsigned reference;    //index of the reference descriptor
+  float distance;        //squared distance of the two
+  float second;          //squared distance of the second nearest reference
+};
+
+class SiftMatcher
+{
+  VlKDForest* forest;
+  vl_type data_type;              //VL_TYPE_FLOAT or VL_TYPE_UINT8
+  std::vector<float> reference;   //128 floats per descriptor, unless loaded
+  std::vector<vl_uint8> reference_u8;  //the same for uint8 descriptors
+  const void* reference_data;     //one of the above or the descriptors of a loaded forest
+  unsigned num_reference;
+
+  unsigned num_trees;
+  unsigned max_comparisons;
+  double threshold;
+  unsigned long comparisons;      //of the last Match()
+
+  void DeleteForest();
+  void CheckType(vl_type type);
+  unsigned MatchForest(const void* query, unsigned n, std::vector<SiftMatch>& matches);
+  bool RatioTest(unsigned q, unsigned r, float best, float second,
+                 std::vector<SiftMatch>& matches);
+
+  SiftMatcher(const SiftMatcher&);
+  SiftMatcher& operator=(const SiftMatcher&);
+
+public:
+  /**
+   * num_trees randomized trees, max_comparisons descriptor comparisons
+   * per query (0 searches exhaustively), threshold of the ratio test
+   */
+  SiftMatcher(unsigned num_trees = 4, unsigned max_comparisons = 128, double threshold = 1.5);
+
+  virtual ~SiftMatcher();
+
+  /**
+   * copies the reference descriptors, the forest over them is built by
+   * Build() or the next Match()
+   */
+  void SetReference(const float* descr, unsigned n);
+  void SetReference(const vl_uint8* descr, unsigned n);
+
+  /**
+   * quantize stores the descriptors as uint8, scaled as by sifttest
+   */
+  void SetReference(const std::vector<KeyPointDescriptor>& keypoints, bool quantize = false);
+
+  /**
+   * builds the forest over the reference descriptors
+   */
+  void Build();
+
+  /**
+   * writes the forest and the reference descriptors to a file (see
+   * vl_kdforest_save), building the forest first if needed
+   */
+  void Save(const char* filename);
+
+  /**
+   * takes forest and reference descriptors from a file written by
+   * Save(). The file is mapped, not read, and processes that load the
+   * same file share its memory. Unless check is false the trees are
+   * checked, which takes time linear in their size; without the check
+   * loading takes the same time for any number of descriptors, but a
+   * corrupted file can crash the matching, so skip it for trusted files
+   * only.
+   */
+  void Load(const char* filename, bool check = true);
+
+  unsigned GetNumReference()
+  {
+    return num_reference;
+  }
+
+  vl_type GetDataType()
+  {
+    return data_type;
+  }
+
+  /**
+   * memory of the reference descriptors
+   */
+  unsigned long GetReferenceBytes()
+  {
+    return (unsigned long)num_reference * SIFT_DESCRIPTOR_SIZE * vl_get_type_size(data_type);
+  }
+
+  /**
+   * takes effect with the next Build()
+   */
+  void SetNumTrees(unsigned n)
+  {
+    num_trees = n < 1 ? 1 : n;
+  }
+
+  void SetMaxComparisons(unsigned n)
+  {
+    max_comparisons = n;
+  }
+
+  void SetThreshold(double t)
+  {
+    threshold = t;
+  }
+
+  /**
+   * matches n query descriptors (128 values each, of the type of the
+   * reference descriptors) against the forest, appends the unique
+   * matches to matches and returns their number. The queries run on
+   * vl_get_max_threads() threads.
+   */
+  unsigned Match(const float* query, unsigned n, std::vector<SiftMatch>& matches);
+  unsigned Match(const vl_uint8* query, unsigned n, std::vector<SiftMatch>& matches);
+
+  /**
+   * the same by comparing every query with every reference descriptor
+   */
+  unsigned MatchExact(const float* query, unsigned n, std::vector<SiftMatch>& matches);
+  unsigned MatchExact(const vl_uint8* query, unsigned n, std::vector<SiftMatch>& matches);
+
+  /**
+   * descriptor comparisons of the last Match() or MatchExact()
+   */
+  unsigned long GetComparisons()
+  {
+    return comparisons;
+  }
+
+  /**
+   * reads the descriptors of a .sift file (x y sigma angle and 128
+   * values per line, as written by sift and sifttest) and appends them
+   * to descr, frames gets the x y sigma angle if not NULL. Returns the
+   * number of descriptors read.
+   */
+  static unsigned ReadSiftFile(const char* filename, std::vector<float>& descr,
+                               std::vector<double>* frames = NULL);
+
+  /**
+   * appends n descriptors of 128 floats to out as uint8, multiplied by
+   * scale and truncated as by sifttest but saturated at 255. The values
+   * of .sift files take scale 1.
+   */
+  static void Quantize(const float* descr, unsigned n, std::vector<vl_uint8>& out,
+                       float scale = SIFT_DESCRIPTOR_SCALE);
+};
+
+class MatcherException : public Exception
+{
+public:
+  MatcherException(const char* msg) : Exception(msg)
+  {
+  }
+};
+
+#endif /* SIFTMATCHER_H_ */
@@ -10,6 +10,7 @@
 
 #include "TimeMeasureBase.h"
 #include <sys/time.h>
+#include <stddef.h>
 
 class SystemTimeMeasure : public TimeMeasureBase
 {
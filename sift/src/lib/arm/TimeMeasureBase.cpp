@@ -7,6 +7,7 @@
 
 #include "TimeMeasureBase.h"
 #include "SystemTimeMeasure.h"
+#include "PerfTimeMeasure.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,10 +16,20 @@
 
 TimeMeasureBase* TimeMeasureBase::instance = 0;
 
+const char* TimeMeasureBase::counterNames[TIMEMEASURE_COUNTERS] = {
+  "cycles", "instructions", "cache misses", "branch misses"
+};
+
 TimeMeasureBase* TimeMeasureBase::getInstance()
 {
   if(instance == 0)
+  {
+#ifdef TIMEMEASURE_PERF
+    instance = new PerfTimeMeasure();
+#else
     instance = new SystemTimeMeasure();
+#endif
+  }
 
   return instance;
 }
@@ -37,7 +48,6 @@ TimeMeasureBase::~TimeMeasureBase()
 
 void TimeMeasureBase::startTimer(const char *identifier)
 {
-  Logger::debug(Logger::TIMEMEASURE, "startTimer called");
   if(first)
   {
     Logger::info(Logger::TIMEMEASURE, "initializing...");
@@ -55,7 +65,9 @@ void TimeMeasureBase::startTimer(const char *identifier)
     newobj.totalTime.tv_sec = 0;
     newobj.totalTime.tv_usec = 0;
     newobj.running = false;
-    Logger::debug(Logger::TIMEMEASURE, "startTimer: creating new TimeMeasureObject");
+    for(int i = 0; i < TIMEMEASURE_COUNTERS; i++)
+      newobj.counters[i] = 0;
+    LOG_DEBUG(Logger::TIMEMEASURE, "startTimer: creating new TimeMeasureObject");
     timers.push_back(newobj);
 
     obj = getTimeMeasureObjectByIdentifier(identifier);
@@ -70,14 +82,20 @@ void TimeMeasureBase::startTimer(const char *identifier)
 
   obj->running = true;
   obj->lastStart = getCurrentTime();
+
+  if(!readCounters(obj->lastCounters))
+  {
+    for(int i = 0; i < TIMEMEASURE_COUNTERS; i++)
+      obj->lastCounters[i] = TIMEMEASURE_NO_COUNTER;
+  }
 }
 
 void TimeMeasureBase::stopTimer(const char *identifier)
 {
+  unsigned long long currentCounters[TIMEMEASURE_COUNTERS];
+  bool counted = readCounters(currentCounters);
   timeval currentTime = getCurrentTime();
 
-  Logger::debug(Logger::TIMEMEASURE, "stopTimer called");
-
   TimeMeasureObject* obj = getTimeMeasureObjectByIdentifier(identifier);
 
   if(obj == NULL)
@@ -89,8 +107,30 @@ void TimeMeasureBase::stopTimer(const char *identifier)
 
   obj->totalTime.tv_sec += currentTime.tv_sec - obj->lastStart.tv_sec;
   obj->totalTime.tv_usec += currentTime.tv_usec - obj->lastStart.tv_usec;
+
+  //keep tv_usec within a second, else it overflows on long runs
+  while(obj->totalTime.tv_usec < 0)
+  {
+    obj->totalTime.tv_usec += 1000000;
+    obj->totalTime.tv_sec--;
+  }
+  while(obj->totalTime.tv_usec >= 1000000)
+  {
+    obj->totalTime.tv_usec -= 1000000;
+    obj->totalTime.tv_sec++;
+  }
+
   obj->callCount++;
 
+  for(int i = 0; i < TIMEMEASURE_COUNTERS; i++)
+  {
+    if(!counted || currentCounters[i] == TIMEMEASURE_NO_COUNTER ||
+       obj->lastCounters[i] == TIMEMEASURE_NO_COUNTER || obj->counters[i] == TIMEMEASURE_NO_COUNTER)
+      obj->counters[i] = TIMEMEASURE_NO_COUNTER;
+    else
+      obj->counters[i] += currentCounters[i] - obj->lastCounters[i];
+  }
+
   obj->running = false;
 }
 
@@ -111,6 +151,15 @@ timeval TimeMeasureBase::getTotalTime(const char *identifier)
 
 
 
+double TimeMeasureBase::getCurrentSeconds()
+{
+  timeval t = getCurrentTime();
+
+  return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+
+
 int TimeMeasureBase::getCallCount(const char *identifier)
 {
   TimeMeasureObject* obj = getTimeMeasureObjectByIdentifier(identifier);
@@ -126,15 +175,62 @@ int TimeMeasureBase::getCallCount(const char *identifier)
 
 
 
-void TimeMeasureBase::printStatistic()
+void TimeMeasureBase::printStatistic(FILE* out)
+{
+  fprintf(out, "identifier        | totaltime(ms)    | callcount    | mean duration\n");
+  fprintf(out, "-----------------------------------------------------------------\n");
+  for(unsigned i = 0; i < timers.size(); i++)
+  {
+    double totalTime = timers[i].totalTime.tv_sec * 1000.0 + timers[i].totalTime.tv_usec / 1000.0;
+    fprintf(out, "%17s |%17f |%13d |%f\n", timers[i].identifier, totalTime, (int)timers[i].callCount, totalTime/timers[i].callCount);
+  }
+
+  if(!hasCounters())
+    return;
+
+  //IPC and misses per 1000 instructions tell compute from memory bound code
+  fprintf(out, "\nidentifier        | cycles(M)  | instr(M)   | IPC   | cache miss | /1k instr | branch miss | /1k instr\n");
+  fprintf(out, "------------------------------------------------------------------------------------------------------\n");
+  for(unsigned i = 0; i < timers.size(); i++)
+  {
+    const unsigned long long* c = timers[i].counters;
+    char value[TIMEMEASURE_COUNTERS][16];
+    char ipc[16], cache_pki[16], branch_pki[16];
+    bool instructions = c[1] != TIMEMEASURE_NO_COUNTER && c[1] > 0;
+
+    for(int k = 0; k < TIMEMEASURE_COUNTERS; k++)
+    {
+      if(c[k] == TIMEMEASURE_NO_COUNTER)
+        snprintf(value[k], sizeof(value[k]), "-");
+      else if(k < 2)
+        snprintf(value[k], sizeof(value[k]), "%.3f", c[k] / 1e6);
+      else
+        snprintf(value[k], sizeof(value[k]), "%llu", c[k]);
+    }
+
+    snprintf(ipc, sizeof(ipc), "-");
+    snprintf(cache_pki, sizeof(cache_pki), "-");
+    snprintf(branch_pki, sizeof(branch_pki), "-");
+
+    if(instructions && c[0] != TIMEMEASURE_NO_COUNTER && c[0] > 0)
+      snprintf(ipc, sizeof(ipc), "%.2f", (double)c[1] / c[0]);
+    if(instructions && c[2] != TIMEMEASURE_NO_COUNTER)
+      snprintf(cache_pki, sizeof(cache_pki), "%.2f", 1000.0 * c[2] / c[1]);
+    if(instructions && c[3] != TIMEMEASURE_NO_COUNTER)
+      snprintf(branch_pki, sizeof(branch_pki), "%.2f", 1000.0 * c[3] / c[1]);
+
+    fprintf(out, "%17s |%11s |%11s |%6s |%11s |%10s |%12s |%10s\n", timers[i].identifier,
+        value[0], value[1], ipc, value[2], cache_pki, value[3], branch_pki);
+  }
+}
+
+void TimeMeasureBase::writeCsv(FILE* out)
 {
-  printf("identifier        | totaltime(ms)    | callcount    | mean duration\n");
-  printf("-----------------------------------------------------------------\n");
+  fprintf(out, "zone,parent,calls,total_ms\n");
   for(unsigned i = 0; i < timers.size(); i++)
   {
-    float test = timers[i].totalTime.tv_usec;
-    float totalTime = timers[i].totalTime.tv_sec*1000 + test/1000.0;
-    printf("%17s |%17f |%13d |%f\n", timers[i].identifier, totalTime, (int)timers[i].callCount, totalTime/timers[i].callCount);
+    double totalTime = timers[i].totalTime.tv_sec * 1000.0 + timers[i].totalTime.tv_usec / 1000.0;
+    fprintf(out, "%s,,%ld,%.3f\n", timers[i].identifier, timers[i].callCount, totalTime);
   }
 }
 
@@ -9,10 +9,15 @@
 #define TIMEMEASUREBASE_H_
 
 #include <sys/time.h>                // for gettimeofday()
+#include <stdio.h>
 #include <vector>
 
 using namespace std;
 
+//cycles, instructions, cache misses and branch misses, see PerfTimeMeasure
+#define TIMEMEASURE_COUNTERS 4
+#define TIMEMEASURE_NO_COUNTER (~0ULL)
+
 struct TimeMeasureObject
 {
   TimeMeasureObject(const char* id) : identifier(id)
@@ -37,6 +42,13 @@ struct TimeMeasureObject
    */
   timeval lastStart;
 
+  /**
+   * the hardware counters spent so far and their values at lastStart,
+   * TIMEMEASURE_NO_COUNTER if a counter could not be read
+   */
+  unsigned long long counters[TIMEMEASURE_COUNTERS];
+  unsigned long long lastCounters[TIMEMEASURE_COUNTERS];
+
   /**
    * if a timer is running at the moment.
    */
@@ -63,6 +75,18 @@ protected:
    */
   virtual timeval getCurrentTime() = 0;
 
+  /**
+   * reads the hardware counters, false if there are none. A counter that
+   * is not available reads TIMEMEASURE_NO_COUNTER.
+   */
+  virtual bool readCounters(unsigned long long* values)
+  {
+    (void)values;
+    return false;
+  }
+
+  static const char* counterNames[TIMEMEASURE_COUNTERS];
+
 public:
   TimeMeasureBase();
   virtual ~TimeMeasureBase();
@@ -84,9 +108,51 @@ public:
 
   int getCallCount(const char* identifier);
 
-  void printStatistic();
+  /**
+   * returns the current time of this time source in seconds, e.g. for
+   * vl_set_real_time_func.
+   */
+  double getCurrentSeconds();
+
+  /**
+   * prints the times, and the counters per identifier if there are any.
+   */
+  void printStatistic(FILE* out = stdout);
+
+  /**
+   * if the hardware counters are measured along with the time
+   */
+  virtual bool hasCounters()
+  {
+    return false;
+  }
+
+  /**
+   * the statistic in the CSV format of Profiler::WriteCsv (without the
+   * parent and the percentiles), e.g. for profcompare.
+   */
+  void writeCsv(FILE* out);
 
   static TimeMeasureBase* getInstance();
 };
 
+/**
+ * measures the block it is declared in with the instance
+ */
+class TimeMeasureScope
+{
+  const char* identifier;
+
+public:
+  TimeMeasureScope(const char* identifier) : identifier(identifier)
+  {
+    TimeMeasureBase::getInstance()->startTimer(identifier);
+  }
+
+  ~TimeMeasureScope()
+  {
+    TimeMeasureBase::getInstance()->stopTimer(identifier);
+  }
+};
+
 #endif /* TIMEMEASUREBASE_H_ */
@@ -96,6 +96,29 @@ dmm_buffer_end(struct dmm_buffer *b,
 		dsp_invalidate(b->handle, b->proc, b->data, len);
 }
 
+/* like dmm_buffer_begin/end, for part of the buffer and a given direction */
+static inline void
+dmm_buffer_range_begin(struct dmm_buffer *b,
+		void *ptr,
+		size_t len,
+		int dir)
+{
+	if (dir == DMA_FROM_DEVICE)
+		dsp_invalidate(b->handle, b->proc, ptr, len);
+	else
+		dsp_flush(b->handle, b->proc, ptr, len, 1);
+}
+
+static inline void
+dmm_buffer_range_end(struct dmm_buffer *b,
+		void *ptr,
+		size_t len,
+		int dir)
+{
+	if (dir != DMA_TO_DEVICE)
+		dsp_invalidate(b->handle, b->proc, ptr, len);
+}
+
 static inline void
 dmm_buffer_map(struct dmm_buffer *b)
 {
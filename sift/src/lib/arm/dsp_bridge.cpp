@@ -10,6 +10,9 @@
  * packaging of this file.
  */
 
+/* replaced by dsp_bridge_emu.cpp on hosts without a DSP */
+#ifndef DSP_EMULATED
+
 #include "dsp_bridge.h"
 
 /* for open */
@@ -1226,3 +1229,5 @@ bool dsp_stream_free_buffers(int handle,
 
 	return true;
 }
+
+#endif /* DSP_EMULATED */
@@ -0,0 +1,518 @@
+/*
+ * dsp_bridge_emu.cpp
+ *
+ * software backend of the dsp_* bridge API (dsp_bridge.h) for hosts
+ * without /dev/DspBridge, selected with DSP_EMULATED=yes (-DDSP_EMULATED),
+ * which also compiles out dsp_bridge.cpp. Dsp, DspNode and DmmManager run
+ * unchanged on top of it.
+ *
+ * The node runs on a host thread through DspEmulator. DSP memory is not
+ * shared with the ARM: dsp_reserve hands out memory below 4GB and
+ * dsp_map copies the buffer into it. From then on only dsp_flush copies
+ * ARM data to the DSP and only dsp_invalidate copies it back, so a
+ * missing or too short cache operation gives wrong results just as on
+ * the board. Transfer, cache and message latencies are modelled as set
+ * with DspEmulator::SetLatency (by default from the environment, see
+ * DspEmulatorLatency).
+ *
+ * Only one node at a time is supported, streams and notifications are
+ * not emulated.
+ */
+
+#ifdef DSP_EMULATED
+
+#include "dsp_bridge.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <map>
+
+#include "DspEmulator.h"
+#include "logger.h"
+
+#ifdef MAP_32BIT
+#define DSP_EMU_MAP_FLAGS MAP_32BIT
+#else
+#define DSP_EMU_MAP_FLAGS 0
+#endif
+
+#define DSP_EMU_HANDLE 0x0d5b
+
+struct dsp_emu_mapping {
+	char *dsp;
+	unsigned long size;
+};
+
+/* reserved DSP ranges by address, mappings by ARM address */
+static std::map<char*, unsigned long> reserved;
+static std::map<char*, dsp_emu_mapping> mapped;
+static pthread_mutex_t mapping_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int proc_dummy;
+
+/* mapping containing [mpu_addr, mpu_addr + size), size is clamped */
+static bool find_mapping(void *mpu_addr, unsigned long &size,
+		char **arm, dsp_emu_mapping *m)
+{
+	char *p = (char*)mpu_addr;
+	std::map<char*, dsp_emu_mapping>::iterator it = mapped.upper_bound(p);
+
+	if (it == mapped.begin())
+		return false;
+	--it;
+
+	if (p >= it->first + it->second.size)
+		return false;
+
+	if (p + size > it->first + it->second.size)
+		size = it->first + it->second.size - p;
+
+	*arm = it->first;
+	*m = it->second;
+	return true;
+}
+
+int dsp_open(void)
+{
+	Logger::info(Logger::DSP, "dsp_open(): using the emulated DSP bridge");
+	DspEmulator::Instance().SetLatency(DspEmulatorLatency::FromEnvironment());
+	return DSP_EMU_HANDLE;
+}
+
+int dsp_close(int handle)
+{
+	return handle == DSP_EMU_HANDLE ? 0 : -1;
+}
+
+bool dsp_attach(int,
+		unsigned int,
+		const void *,
+		void **ret_handle)
+{
+	*ret_handle = &proc_dummy;
+	return true;
+}
+
+bool dsp_detach(int,
+		void *)
+{
+	return true;
+}
+
+bool dsp_start(int,
+		void *)
+{
+	return true;
+}
+
+bool dsp_stop(int,
+		void *)
+{
+	return true;
+}
+
+bool dsp_load(int,
+		void *,
+		int, char **,
+		char **)
+{
+	/* the node is linked into the program */
+	return true;
+}
+
+bool dsp_node_allocate(int,
+		void *,
+		const struct dsp_uuid *,
+		const void *,
+		struct dsp_node_attr_in *,
+		struct dsp_node **ret_node)
+{
+	struct dsp_node *node = (dsp_node*)calloc(1, sizeof(*node));
+
+	node->handle = &DspEmulator::Instance();
+	*ret_node = node;
+
+	return true;
+}
+
+bool dsp_node_free(int,
+		struct dsp_node *node)
+{
+	DspEmulator *emu = (DspEmulator*)node->handle;
+
+	if (emu->IsRunning())
+		emu->Stop();
+
+	free(node);
+	return true;
+}
+
+bool dsp_node_connect(int,
+		struct dsp_node *,
+		unsigned int,
+		struct dsp_node *,
+		unsigned int,
+		struct dsp_stream_attr *,
+		void *)
+{
+	Logger::error(Logger::DSP, "dsp_node_connect: streams are not emulated");
+	return false;
+}
+
+bool dsp_node_create(int,
+		struct dsp_node *)
+{
+	return true;
+}
+
+bool dsp_node_run(int,
+		struct dsp_node *node)
+{
+	try {
+		((DspEmulator*)node->handle)->Start();
+	}
+	catch (DspEmulatorException &e) {
+		return false;
+	}
+
+	return true;
+}
+
+bool dsp_node_terminate(int,
+		struct dsp_node *node,
+		unsigned long *status)
+{
+	((DspEmulator*)node->handle)->Stop();
+	*status = 0;
+	return true;
+}
+
+bool dsp_node_put_message(int,
+		struct dsp_node *node,
+		const struct dsp_msg *message,
+		unsigned int)
+{
+	DspEmulator *emu = (DspEmulator*)node->handle;
+	dsp_msg_t msg;
+
+	if (!emu->IsRunning())
+		return false;
+
+	msg.cmd = message->cmd;
+	msg.arg_1 = message->arg_1;
+	msg.arg_2 = message->arg_2;
+	emu->SendMessage(msg);
+
+	return true;
+}
+
+bool dsp_node_get_message(int,
+		struct dsp_node *node,
+		struct dsp_msg *message,
+		unsigned int timeout)
+{
+	dsp_msg_t msg;
+
+	if (!((DspEmulator*)node->handle)->GetMessage(msg, timeout))
+		return false;
+
+	message->cmd = msg.cmd;
+	message->arg_1 = msg.arg_1;
+	message->arg_2 = msg.arg_2;
+	return true;
+}
+
+bool dsp_reserve(int,
+		void *,
+		unsigned long size,
+		void **addr)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | DSP_EMU_MAP_FLAGS, -1, 0);
+
+	if (p == MAP_FAILED) {
+		Logger::error(Logger::DSP, "dsp_reserve(%lu) failed", size);
+		return false;
+	}
+
+	/* the DSP side addresses are 32 bit, without MAP_32BIT the kernel
+	   may place the reservation anywhere */
+	if ((uint64_t)(uintptr_t)p + size > 0xffffffffU) {
+		Logger::error(Logger::DSP, "dsp_reserve(%lu): %p is not below 4GB", size, p);
+		munmap(p, size);
+		return false;
+	}
+
+	pthread_mutex_lock(&mapping_mutex);
+	reserved[(char*)p] = size;
+	pthread_mutex_unlock(&mapping_mutex);
+
+	*addr = p;
+	return true;
+}
+
+bool dsp_unreserve(int,
+		void *,
+		void *addr)
+{
+	pthread_mutex_lock(&mapping_mutex);
+	std::map<char*, unsigned long>::iterator it = reserved.find((char*)addr);
+	bool found = it != reserved.end();
+
+	if (found) {
+		munmap(it->first, it->second);
+		reserved.erase(it);
+	}
+	pthread_mutex_unlock(&mapping_mutex);
+
+	return found;
+}
+
+bool dsp_map(int,
+		void *,
+		void *mpu_addr,
+		unsigned long size,
+		void *req_addr,
+		void *ret_map_addr,
+		unsigned long)
+{
+	dsp_emu_mapping m;
+
+	m.dsp = (char*)req_addr;
+	m.size = size;
+
+	pthread_mutex_lock(&mapping_mutex);
+	mapped[(char*)mpu_addr] = m;
+	pthread_mutex_unlock(&mapping_mutex);
+
+	/* the DSP starts with what is in memory */
+	memcpy(m.dsp, mpu_addr, size);
+	DspEmulator::Instance().CountMap();
+
+	*(void**)ret_map_addr = req_addr;
+	return true;
+}
+
+bool dsp_unmap(int,
+		void *,
+		void *map_addr)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&mapping_mutex);
+	std::map<char*, dsp_emu_mapping>::iterator it;
+	for (it = mapped.begin(); it != mapped.end(); ++it) {
+		if (it->second.dsp == map_addr) {
+			mapped.erase(it);
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mapping_mutex);
+
+	if (found)
+		DspEmulator::Instance().CountMap();
+
+	return found;
+}
+
+bool dsp_flush(int,
+		void *,
+		void *mpu_addr,
+		unsigned long size,
+		unsigned long)
+{
+	char *arm;
+	dsp_emu_mapping m;
+
+	pthread_mutex_lock(&mapping_mutex);
+	bool found = find_mapping(mpu_addr, size, &arm, &m);
+	pthread_mutex_unlock(&mapping_mutex);
+
+	if (!found) {
+		Logger::error(Logger::DSP, "dsp_flush(%p): not mapped", mpu_addr);
+		return false;
+	}
+
+	memcpy(m.dsp + ((char*)mpu_addr - arm), mpu_addr, size);
+	DspEmulator::Instance().CountBufferBegin(size);
+
+	return true;
+}
+
+bool dsp_invalidate(int,
+		void *,
+		void *mpu_addr,
+		unsigned long size)
+{
+	char *arm;
+	dsp_emu_mapping m;
+
+	pthread_mutex_lock(&mapping_mutex);
+	bool found = find_mapping(mpu_addr, size, &arm, &m);
+	pthread_mutex_unlock(&mapping_mutex);
+
+	if (!found) {
+		Logger::error(Logger::DSP, "dsp_invalidate(%p): not mapped", mpu_addr);
+		return false;
+	}
+
+	memcpy(mpu_addr, m.dsp + ((char*)mpu_addr - arm), size);
+	DspEmulator::Instance().CountBufferEnd(size);
+
+	return true;
+}
+
+bool dsp_register_notify(int,
+		void *,
+		unsigned int,
+		unsigned int,
+		struct dsp_notification *)
+{
+	Logger::error(Logger::DSP, "dsp_register_notify: notifications are not emulated");
+	return false;
+}
+
+bool dsp_node_register_notify(int,
+		struct dsp_node *,
+		unsigned int,
+		unsigned int,
+		struct dsp_notification *)
+{
+	Logger::error(Logger::DSP, "dsp_node_register_notify: notifications are not emulated");
+	return false;
+}
+
+bool dsp_wait_for_events(int,
+		struct dsp_notification **,
+		unsigned int,
+		unsigned int *,
+		unsigned int)
+{
+	return false;
+}
+
+bool dsp_enum(int,
+		unsigned int,
+		struct dsp_ndb_props *,
+		size_t,
+		unsigned int *ret_num)
+{
+	*ret_num = 0;
+	return false;
+}
+
+bool dsp_register(int,
+		const struct dsp_uuid *,
+		enum dsp_dcd_object_type,
+		const char *)
+{
+	return true;
+}
+
+bool dsp_unregister(int,
+		const struct dsp_uuid *,
+		enum dsp_dcd_object_type)
+{
+	return true;
+}
+
+bool dsp_proc_get_info(int,
+		void *,
+		enum dsp_resource,
+		struct dsp_info *,
+		unsigned)
+{
+	return false;
+}
+
+bool dsp_node_get_attr(int,
+		struct dsp_node *,
+		struct dsp_node_attr *,
+		size_t)
+{
+	return false;
+}
+
+bool dsp_enum_nodes(int,
+		void *,
+		void **,
+		unsigned,
+		unsigned *num_nodes,
+		unsigned *allocated)
+{
+	*num_nodes = 0;
+	*allocated = 0;
+	return true;
+}
+
+bool dsp_stream_open(int,
+		struct dsp_node *,
+		unsigned int,
+		unsigned int,
+		struct dsp_stream_attr_in *,
+		void *)
+{
+	Logger::error(Logger::DSP, "dsp_stream_open: streams are not emulated");
+	return false;
+}
+
+bool dsp_stream_close(int,
+		void *)
+{
+	return false;
+}
+
+bool dsp_stream_idle(int,
+		void *,
+		bool)
+{
+	return false;
+}
+
+bool dsp_stream_reclaim(int,
+		void *,
+		unsigned char **,
+		unsigned long *,
+		unsigned long *,
+		unsigned long *)
+{
+	return false;
+}
+
+bool dsp_stream_issue(int,
+		void *,
+		unsigned char *,
+		unsigned long,
+		unsigned long,
+		unsigned long)
+{
+	return false;
+}
+
+bool dsp_stream_get_info(int,
+		void *,
+		struct dsp_stream_info *,
+		unsigned int)
+{
+	return false;
+}
+
+bool dsp_stream_allocate_buffers(int,
+		void *,
+		unsigned int,
+		unsigned char **,
+		unsigned int)
+{
+	return false;
+}
+
+bool dsp_stream_free_buffers(int,
+		void *,
+		unsigned char **,
+		unsigned int)
+{
+	return false;
+}
+
+#endif /* DSP_EMULATED */
@@ -9,18 +9,41 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include <stdlib.h>
+
 #include "logger.h"
 
 #include "ConsoleLogger.h"
 #include "FileLogger.h"
+#include "LogRing.h"
 
 std::vector<Logger*> Logger::loggers;
+LogRing* Logger::ring = NULL;
 
 
 void Logger::init()
 {
   loggers.push_back(new ConsoleLogger(DEBUG));
   loggers.push_back(new FileLogger(DEBUG, "log/log"));
+
+  if(ring == NULL)
+  {
+    ring = new LogRing(writeToAllLoggers);
+    atexit(shutdown);
+  }
+}
+
+void Logger::shutdown()
+{
+  //drains the ring
+  delete ring;
+  ring = NULL;
+}
+
+void Logger::flush()
+{
+  if(ring)
+    ring->Flush();
 }
 
 
@@ -76,15 +99,50 @@ void Logger::addToAllLoggers(const int type, const int level, const char* fmt, v
 {
   unsigned i;
 
-  if(!(type&outputEna))
+  if(!enabled(type, level))
     return;
 
+  if(ring)
+  {
+    ring->Push(type, level, fmt, ap, level >= WARN);
+
+    //warnings and errors are out when the call returns, often right
+    //before the program gives up
+    if(level >= WARN)
+      ring->Flush();
+    return;
+  }
+
   for(i = 0; i < loggers.size(); i++)
   {
     if(level < loggers[i]->dbgLevel)
       continue;
 
-    loggers[i]->add(type, level, fmt, ap);
+    //every logger consumes its own copy of the argument list
+    //(va_copy is not available with -ansi)
+    va_list aq;
+    __builtin_va_copy(aq, ap);
+    loggers[i]->add(type, level, fmt, aq);
+    va_end(aq);
+  }
+}
+
+//passes an already formatted message through the va_list interface of add()
+void Logger::addFormatted(Logger* logger, const int type, const int level, const char* fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  logger->add(type, level, fmt, ap);
+  va_end(ap);
+}
+
+void Logger::writeToAllLoggers(const int type, const int level, const char* msg)
+{
+  for(unsigned i = 0; i < loggers.size(); i++)
+  {
+    if(level >= loggers[i]->dbgLevel)
+      addFormatted(loggers[i], type, level, "%s", msg);
   }
 }
 
@@ -10,27 +10,66 @@
 
 #include <vector>
 #include <stdarg.h>
+
+/*
+ * lowest level that is compiled in, for all categories (LOGGER_LEVEL) or
+ * for one (LOGGER_LEVEL_SIFT, ...): 0 debug, 1 info, 2 warn, 3 error, 4 off.
+ * Messages below it are dropped by a test on constants, and LOG_DEBUG
+ * does not even evaluate its arguments.
+ */
+#ifndef LOGGER_LEVEL
+#define LOGGER_LEVEL 0
+#endif
+#ifndef LOGGER_LEVEL_SIFT
+#define LOGGER_LEVEL_SIFT LOGGER_LEVEL
+#endif
+#ifndef LOGGER_LEVEL_SIFTTEST
+#define LOGGER_LEVEL_SIFTTEST LOGGER_LEVEL
+#endif
+#ifndef LOGGER_LEVEL_TIMEMEASURE
+#define LOGGER_LEVEL_TIMEMEASURE LOGGER_LEVEL
+#endif
+#ifndef LOGGER_LEVEL_DSP
+#define LOGGER_LEVEL_DSP LOGGER_LEVEL
+#endif
+#ifndef LOGGER_LEVEL_DMMMANGER
+#define LOGGER_LEVEL_DMMMANGER LOGGER_LEVEL
+#endif
+
+/**
+ * debug message of a hot path, compiled out below the level of its category
+ */
+#define LOG_DEBUG(type, ...)                            \
+  do {                                                  \
+    if (Logger::enabled(type, Logger::DEBUG))           \
+      Logger::debug(type, __VA_ARGS__);                 \
+  } while (0)
+
+class LogRing;
+
 /**
  * Abstract class Logger
+ *
+ * After init() the messages are queued in a LogRing and written by its
+ * drain thread, the logging thread does not format them. Warnings and
+ * errors wait for room in the ring and are written before warn() and
+ * error() return.
  */
 class Logger
 {
 private:
   static std::vector<Logger*> loggers;
+  static LogRing* ring;
   int dbgLevel;
 
   static void addToAllLoggers(const int type, const int level, const char* fmt, va_list ap);
+  static void writeToAllLoggers(const int type, const int level, const char* msg);
+  static void addFormatted(Logger* logger, const int type, const int level, const char* fmt, ...);
+  static void shutdown();
 
   static const int outputEna = 0x80000;
 
 
-  static const int DEBUG = 0;
-  static const int INFO = 1;
-  static const int WARN = 2;
-  static const int ERROR = 3;
-
-
-
 protected:
   virtual void add(const int type, const int level, const char* fmt, va_list ap) = 0;
 
@@ -49,6 +88,36 @@ public:
   static const int DSP         = 0x00008 | outputEna;
   static const int DMMMANGER   = 0x00010 | outputEna;
 
+  static const int DEBUG = 0;
+  static const int INFO = 1;
+  static const int WARN = 2;
+  static const int ERROR = 3;
+
+  /**
+   * lowest level compiled in for a category
+   */
+  static int minLevel(const int type)
+  {
+    switch(type)
+    {
+      case SIFT:        return LOGGER_LEVEL_SIFT;
+      case SIFTTEST:    return LOGGER_LEVEL_SIFTTEST;
+      case TIMEMEASURE: return LOGGER_LEVEL_TIMEMEASURE;
+      case DSP:         return LOGGER_LEVEL_DSP;
+      case DMMMANGER:   return LOGGER_LEVEL_DMMMANGER;
+      default:          return LOGGER_LEVEL;
+    }
+  }
+
+  /**
+   * if messages of this category and level are output at all, a constant
+   * for constant arguments
+   */
+  static bool enabled(const int type, const int level)
+  {
+    return (type & outputEna) && level >= minLevel(type);
+  }
+
   static void debug(const int type, const char* fmt, ...);
   static void info(const int type, const char* fmt, ...);
   static void warn(const int type, const char* fmt, ...);
@@ -56,6 +125,11 @@ public:
 
   static void init();
 
+  /**
+   * returns when all messages logged so far are written
+   */
+  static void flush();
+
 
   virtual ~Logger()
   {
@@ -24,6 +24,8 @@ extern "C" {
 #include <vl/pgm.h>
 #include <vl/sift.h>
 #include <vl/getopt_long.h>
+#include <vl/threads.h>
+#include <vl/sift_dsp.h>
 
 #ifdef __cplusplus /* If this is a C++ compiler, end C linkage */
 }
@@ -31,43 +33,97 @@ extern "C" {
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include "sift.h"
 #include "logger.h"
 #include "SystemTimeMeasure.h"
+#include "Profiler.h"
 #include "Dsp.h"
 
+PROFILE_ZONE(detect, "Sift::Detect()");
+PROFILE_ZONE(octave, "process_octave");
+PROFILE_ZONE(first_octave, "process_f_octave");
+PROFILE_ZONE(next_octave, "process_n_octave");
+PROFILE_ZONE(sift_detect, "sift_detect");
+PROFILE_ZONE(kpoint_stage, "kpoint_stage");
+PROFILE_ZONE(orientations, "orientations");
+PROFILE_ZONE(descriptors, "descriptors");
+
+/* hardware counters of the coarse stages, with PERF_COUNTERS=yes */
+#ifdef TIMEMEASURE_PERF
+#define COUNT_STAGE(name) TimeMeasureScope count_stage(name)
+#else
+#define COUNT_STAGE(name) ((void)0)
+#endif
+
+static double realTime()
+{
+  return TimeMeasureBase::getInstance()->getCurrentSeconds();
+}
+
 Sift::Sift()
 {
   data = 0;
   fdata = 0;
+  data_capacity = 0;
+  fdata_capacity = 0;
+  pim.width = 0;
+  pim.height = 0;
+
+  O = -1;
+  S = 3;
+  omin = -1;
+
+  num_threads = 0;
+  dsp_failures = 0;
+  print_profile = true;
+
+  //the ARM/DSP split is balanced with wall clock times
+  vl_set_real_time_func(realTime);
 
   //init some vlfeat stuff
-#ifdef ARCH_ARM
+#if defined(ARCH_ARM) || defined(DSP_EMULATED)
 
-  Logger::debug(Logger::SIFT, "setting up dsp...");
+  LOG_DEBUG(Logger::SIFT, "setting up dsp...");
 
   dsp = &Dsp::Instance();
 
   dsp->Init();
 
   const struct dsp_uuid sift_uuid = { 0x3dac26d0, 0x6d4b, 0x11dd, 0xad, 0x8b, { 0x08, 0x00, 0x20, 0x0c, 0x9a, 0x64 } };
-  DspNode& node = dsp->CreateNode(sift_uuid,"./sift.dll64P");
 
+  //the node of the first Sift object stays for the later ones
+  if(!dsp->HasNode())
+  {
+    DspNode& node = dsp->CreateNode(sift_uuid, "./sift.dll64P");
 
-  node.Run();
+    node.Run();
+  }
 
   //throw 0;
 
-  Logger::debug(Logger::SIFT, "Setting alloc functions");
+  LOG_DEBUG(Logger::SIFT, "Setting alloc functions");
   vl_set_alloc_func(dsp_malloc, dsp_realloc, dsp_calloc, dsp_free);
   vl_set_dsp_mem_func(dsp_get_mapped_addr, dsp_dmm_buffer_begin, dsp_dmm_buffer_end, dsp_get_message, dsp_send_message);
+  vl_set_dsp_range_func(dsp_dmm_range_begin, dsp_dmm_range_end);
 #endif
 }
 
 Sift::~Sift()
 {
+  ReleaseFilters();
+
+  /* parameter blocks of the DSP convolutions */
+  if (vl_dsp_is_available())
+    vl_dsp_release();
+
+#if defined(ARCH_ARM) || defined(DSP_EMULATED)
+  dmmManager.LogStats();
+#endif
+
   /* release image data */
   if (fdata)
   {
@@ -84,6 +140,374 @@ Sift::~Sift()
 }
 
 
+VlSiftFilt* Sift::GetFilter(int width, int height)
+{
+  SiftFilterKey key;
+  key.width = width;
+  key.height = height;
+  key.O = O;
+  key.S = S;
+  key.omin = omin;
+
+  std::map<SiftFilterKey, VlSiftFilt*>::iterator iter = filters.find(key);
+
+  if(iter != filters.end())
+    return iter->second;
+
+  ReserveDspMemory(width, height);
+
+  VlSiftFilt* filt = vl_sift_new (width, height, O, S, omin) ;
+
+  if (!filt)
+  {
+    Logger::error(Logger::SIFT, "GetFilter: could not create SIFT-fiter.");
+    throw SiftException("could not create SIFT-fiter.");
+  }
+
+  LOG_DEBUG(Logger::SIFT, "new filter(vl_sift_new) created for %dx%d:%x", width, height, filt) ;
+
+  ApplyDspSplit(filt);
+
+  filters[key] = filt;
+
+  return filt;
+}
+
+void Sift::ReserveDspMemory(int width, int height)
+{
+#if defined(ARCH_ARM) || defined(DSP_EMULATED)
+  //the buffers of vl_sift_new: temp, octave (S+3 levels), dog (S+2) and grad (2 x S)
+  size_t nel = (size_t)VL_SHIFT_LEFT(width, -omin) * VL_SHIFT_LEFT(height, -omin);
+  size_t level = sizeof(vl_sift_pix) * nel;
+
+  //buffers of the same size class (e.g. octave and grad for S = 3) are counted together
+  map<size_t, unsigned> count;
+
+  count[DmmManager::SizeClass(level)]++;
+  count[DmmManager::SizeClass(level * (S + 3))]++;
+  count[DmmManager::SizeClass(level * (S + 2))]++;
+  count[DmmManager::SizeClass(level * 2 * S)]++;
+
+  if((unsigned)(width * height) > data_capacity)
+    count[DmmManager::SizeClass(width * height)]++;
+
+  for(map<size_t, unsigned>::iterator iter = count.begin(); iter != count.end(); iter++)
+    dmmManager.Reserve(iter->first, iter->second);
+#else
+  (void)width;
+  (void)height;
+#endif
+}
+
+void Sift::ReleaseFilters()
+{
+  std::map<SiftFilterKey, VlSiftFilt*>::iterator iter;
+
+  for(iter = filters.begin(); iter != filters.end(); iter++)
+  {
+    LogDspSplit(iter->second);
+    LOG_DEBUG(Logger::SIFT, "freeing filt: %x", iter->second);
+    vl_sift_delete (iter->second) ;
+  }
+
+  filters.clear();
+}
+
+void Sift::SetDspSplit(int min_pixels, double ratio, bool adaptive)
+{
+  DspSplitRule rule;
+  rule.min_pixels = min_pixels;
+  rule.ratio = ratio;
+  rule.adaptive = adaptive;
+
+  std::vector<DspSplitRule>::iterator iter;
+
+  for(iter = split_rules.begin(); iter != split_rules.end(); iter++)
+  {
+    if(iter->min_pixels == min_pixels)
+      break;
+  }
+
+  if(iter != split_rules.end())
+    *iter = rule;
+  else
+    split_rules.push_back(rule);
+
+  //pooled filters follow the new rules
+  std::map<SiftFilterKey, VlSiftFilt*>::iterator f;
+
+  for(f = filters.begin(); f != filters.end(); f++)
+    ApplyDspSplit(f->second);
+}
+
+void Sift::ApplyDspSplit(VlSiftFilt* filt)
+{
+  int omin = vl_sift_get_octave_first(filt);
+
+  for(int o = omin; o < omin + vl_sift_get_noctaves(filt); o++)
+  {
+    int pixels = VL_SHIFT_LEFT(filt->width, -o) * VL_SHIFT_LEFT(filt->height, -o);
+    DspSplitRule const* best = NULL;
+
+    for(unsigned i = 0; i < split_rules.size(); i++)
+    {
+      if(split_rules[i].min_pixels <= pixels && (!best || split_rules[i].min_pixels > best->min_pixels))
+        best = &split_rules[i];
+    }
+
+    if(best)
+    {
+      LOG_DEBUG(Logger::SIFT, "octave %d (%d pixels): DSP share %f%s", o, pixels, best->ratio, best->adaptive ? ", adaptive" : "");
+      vl_sift_set_dsp_split(filt, o, best->ratio, best->adaptive);
+    }
+    else
+      vl_sift_set_dsp_split(filt, o, 1.0, false);
+  }
+}
+
+void Sift::LogDspSplit(VlSiftFilt* filt)
+{
+  int omin = vl_sift_get_octave_first(filt);
+
+  for(int o = omin; o < omin + vl_sift_get_noctaves(filt); o++)
+  {
+    VlSiftDspSplit const* split = vl_sift_get_dsp_split(filt, o);
+
+    if(split->armPixels + split->dspPixels > 0)
+      Logger::info(Logger::SIFT, "octave %d of %dx%d: DSP share %.3f, ARM %.0f pixels in %.3fs, DSP %.0f pixels in %.3fs",
+          o, filt->width, filt->height, split->ratio,
+          split->armPixels, split->armTime, split->dspPixels, split->dspTime);
+  }
+}
+
+void Sift::AllocImageBuffers(unsigned npixels, int bpp)
+{
+  if(npixels * bpp > data_capacity)
+  {
+    if (data)
+      vl_free (data);
+
+    data = (vl_uint8*)vl_malloc(npixels * bpp) ;
+
+    if (!data)
+    {
+      data_capacity = 0;
+      Logger::error(Logger::SIFT, "AllocImageBuffers: out of mem while allocating buffers for image.");
+      throw SiftException("out of mem while allocating buffers for image.");
+    }
+
+    data_capacity = npixels * bpp;
+  }
+
+  if(bpp > 1 && npixels > fdata_capacity)
+  {
+    if (fdata)
+      vl_free (fdata);
+
+    fdata = (vl_sift_pix*)vl_malloc(npixels * sizeof (vl_sift_pix)) ;
+
+    if (!fdata)
+    {
+      fdata_capacity = 0;
+      Logger::error(Logger::SIFT, "AllocImageBuffers: out of mem while allocating buffers for image.");
+      throw SiftException("out of mem while allocating buffers for image.");
+    }
+
+    fdata_capacity = npixels;
+  }
+}
+
+/* keypoints reserved by WarmUp(), a generous bound of the candidates
+   vl_sift_detect finds in an octave of a natural image */
+#define WARMUP_PIXELS_PER_KEYPOINT 64
+
+void Sift::WarmUp(int width, int height)
+{
+  Logger::info(Logger::SIFT, "WarmUp(%d, %d)", width, height);
+
+  VlSiftFilt* filt = GetFilter(width, height);
+
+  //vlfeat runs on one thread unless asked for more, see SetNumThreads()
+  vl_set_num_threads(num_threads);
+
+  AllocImageBuffers(width * height, 1);
+
+  vl_uint8* blank = (vl_uint8*)vl_calloc(width * height, sizeof(vl_uint8));
+
+  if (!blank)
+  {
+    Logger::error(Logger::SIFT, "WarmUp: out of mem while allocating blank image.");
+    throw SiftException("out of mem while allocating blank image.");
+  }
+
+  /* run the scale space once, this fills the gaussian kernel cache
+     of the filter and maps all of its buffers */
+  int err = vl_sift_process_first_octave_u8(filt, blank);
+
+  while(!err)
+  {
+    vl_sift_detect(filt);
+    err = vl_sift_process_next_octave(filt);
+  }
+
+  vl_free(blank);
+
+  //the buffers are mapped anyway, the next image tries the DSP again
+  if(err == VL_ERR_IO)
+  {
+    Logger::warn(Logger::SIFT, "WarmUp: %s", vl_get_last_error_message());
+    dsp_failures++;
+    ApplyDspSplit(filt);
+  }
+
+  /* the blank image has no keypoints, make room for those of real ones */
+  if(vl_sift_reserve_keypoints(filt, width * height / WARMUP_PIXELS_PER_KEYPOINT) != VL_ERR_OK)
+  {
+    Logger::error(Logger::SIFT, "WarmUp: out of mem while allocating keypoints.");
+    throw SiftException("out of mem while allocating keypoints.");
+  }
+}
+
+
+/* keypoints (or descriptors) handed out to a worker thread at once */
+#define KEYPOINTS_PER_TASK 8
+
+struct DescribeTask
+{
+  VlSiftFilt const* filt;   //read only in the workers
+  VlSiftKeypoint const* keys;
+  int nkeys;
+  KeypointSlot* slots;
+  double const* angles;
+  vl_sift_pix* descrs;
+};
+
+static void orientKeypoints(void* data, vl_uindex task, vl_uindex /* thread */)
+{
+  DescribeTask* t = (DescribeTask*)data;
+  int begin = (int)task * KEYPOINTS_PER_TASK;
+  int end = VL_MIN(begin + KEYPOINTS_PER_TASK, t->nkeys);
+
+  PROFILE_SCOPE(orientations);
+
+  /* the workers must not touch the gradient, see DescribeKeypoints() */
+  for (int i = begin; i < end; ++i)
+    t->slots[i].nangles = vl_sift_calc_keypoint_orientations_nosync(t->filt, t->slots[i].angles, t->keys + i);
+}
+
+static void describeKeypoints(void* data, vl_uindex task, vl_uindex /* thread */)
+{
+  DescribeTask* t = (DescribeTask*)data;
+  int begin = (int)task * KEYPOINTS_PER_TASK;
+  int end = VL_MIN(begin + KEYPOINTS_PER_TASK, t->nkeys);
+
+  PROFILE_SCOPE(descriptors);
+
+  vl_sift_calc_keypoint_descriptors_batch_nosync(t->filt, t->keys + begin, t->angles + begin,
+                                                 end - begin, t->descrs + 128 * begin);
+}
+
+void Sift::DescribeKeypoints(VlSiftFilt* filt)
+{
+  DescribeTask task;
+  task.filt  = filt;
+  task.keys  = vl_sift_get_keypoints(filt);
+  task.nkeys = vl_sift_get_nkeypoints(filt);
+
+  if (task.nkeys == 0)
+    return;
+
+  if (keypoint_slots.size() < (unsigned) task.nkeys)
+    keypoint_slots.resize(task.nkeys);
+
+  task.slots = &keypoint_slots[0];
+
+  /* compute the gradient around the keypoints once, before the
+     workers start reading it: the support of each keypoint is the
+     union of its orientation and descriptor windows, and the oriented
+     copies made below share position and scale with it, so the
+     _nosync calls of the workers find every tile they read valid */
+  vl_sift_update_gradient_for_keypoints(filt, task.keys, task.nkeys);
+
+  vl_size nthreads = vl_get_max_threads();
+
+  vl_parallel_for_n((task.nkeys + KEYPOINTS_PER_TASK - 1) / KEYPOINTS_PER_TASK,
+                    nthreads, orientKeypoints, &task);
+
+  /* one entry per keypoint and orientation, in detection order, so the
+     result does not depend on threads */
+  unsigned first = detected_keypoints.size();
+
+  oriented_keys.clear();
+  oriented_angles.clear();
+
+  for (int i = 0; i < task.nkeys; ++i)
+  {
+    KeypointSlot& slot = keypoint_slots[i];
+
+    for (int q = 0; q < slot.nangles; ++q)
+    {
+      KeyPointDescriptor newKeyPoint;
+
+      newKeyPoint.keypoint = task.keys[i];
+      newKeyPoint.angle = slot.angles[q];
+
+      detected_keypoints.push_back(newKeyPoint);
+      oriented_keys.push_back(task.keys[i]);
+      oriented_angles.push_back(slot.angles[q]);
+    }
+  }
+
+  if (oriented_keys.empty())
+    return;
+
+  if (descr_buffer.size() < 128 * oriented_keys.size())
+    descr_buffer.resize(128 * oriented_keys.size());
+
+  task.keys   = &oriented_keys[0];
+  task.nkeys  = oriented_keys.size();
+  task.angles = &oriented_angles[0];
+  task.descrs = &descr_buffer[0];
+
+  vl_parallel_for_n((task.nkeys + KEYPOINTS_PER_TASK - 1) / KEYPOINTS_PER_TASK,
+                    nthreads, describeKeypoints, &task);
+
+  for (int i = 0; i < task.nkeys; ++i)
+    memcpy(detected_keypoints[first + i].descr, task.descrs + 128 * i, sizeof(detected_keypoints[first + i].descr));
+}
+
+
+/**
+ * reads the body of a raw 8 bit PGM with pread straight into buf (which
+ * is DSP-mapped), without the stdio buffer in between. Returns false if
+ * the image is not of that kind or the read fails, the caller then
+ * falls back to vl_pgm_extract_data.
+ */
+static bool ReadRawBody(FILE* in, VlPgmImage const* pim, vl_uint8* buf)
+{
+  if (!pim->is_raw || vl_pgm_get_bpp(pim) != 1)
+    return false;
+
+  long offset = ftell(in);
+  size_t size = vl_pgm_get_npixels(pim);
+  size_t done = 0;
+
+  if (offset < 0)
+    return false;
+
+  while (done < size)
+  {
+    ssize_t n = pread(fileno(in), buf + done, size - done, offset + done);
+
+    if (n <= 0)
+      return false;
+
+    done += n;
+  }
+
+  return true;
+}
+
 void Sift::ReadImageFromFile(char* filename)
 {
   char basename [1024];
@@ -144,20 +568,12 @@ void Sift::ReadImageFromFile(char* filename)
             pim. width,
             pim. height) ;*/
 
-  /* allocate buffer */
-  data  = (vl_uint8*)vl_malloc(vl_pgm_get_npixels (&pim) *
-                 vl_pgm_get_bpp(&pim) * sizeof (vl_uint8)   ) ;
-  fdata = (vl_sift_pix*)vl_malloc(vl_pgm_get_npixels (&pim) *
-                 vl_pgm_get_bpp       (&pim) * sizeof (vl_sift_pix)) ;
-
-  if (!data || !fdata)
-  {
-    Logger::error(Logger::SIFT, "ReadImageFromFile: out of mem while allocating buffers for image.");
-    throw SiftException("out of mem while allocating buffers for image.");
-  }
+  /* allocate buffer (reused if the last image was at least as big) */
+  AllocImageBuffers(vl_pgm_get_npixels (&pim), vl_pgm_get_bpp(&pim));
 
   /* read PGM body */
-  err  = vl_pgm_extract_data (in, &pim, data) ;
+  if (!ReadRawBody(in, &pim, data))
+    err = vl_pgm_extract_data (in, &pim, data) ;
 
   if (err) {
     Logger::error(Logger::SIFT, "ReadImageFromFile: '%s' contains a malformed PGM body.", filename);
@@ -165,9 +581,11 @@ void Sift::ReadImageFromFile(char* filename)
     err = VL_ERR_IO ;
   }
 
-  /* convert data type */
-  for (q = 0 ; q < (unsigned) (pim.width * pim.height) ; ++q) {
-    fdata [q] = data [q] ;
+  /* 8 bit images are converted by vl_sift_process_first_octave_u8 */
+  if (vl_pgm_get_bpp(&pim) > 1) {
+    for (q = 0 ; q < (unsigned) (pim.width * pim.height) ; ++q) {
+      fdata [q] = ((vl_uint16*) data) [q] ;
+    }
   }
 
   /* close files */
@@ -177,6 +595,17 @@ void Sift::ReadImageFromFile(char* filename)
   }
 }
 
+void Sift::SetImage(const vl_uint8* pixels, int width, int height)
+{
+  pim.width = width;
+  pim.height = height;
+  pim.max_value = 255;
+  pim.is_raw = 1;
+
+  AllocImageBuffers(width * height, 1);
+  memcpy(data, pixels, width * height);
+}
+
 
 /* ---------------------------------------------------------------- */
 /** @brief SIFT driver entry point
@@ -187,20 +616,14 @@ int Sift::Detect()
   double   edge_thresh  = -1 ;
   double   peak_thresh  = -1 ;
   double   magnif       = -1 ;
-  int      O = -1, S = 3, omin = -1 ;
 
   vl_bool  err    = VL_ERR_OK ;
   vl_bool  force_orientations = 0 ;
 
 
   VlSiftFilt      *filt = 0 ;
-  vl_size          q ;
-  int              i ;
   vl_bool          first ;
-
-  TimeMeasureBase& measure = *TimeMeasureBase::getInstance();
-
-  measure.startTimer("Sift::Detect()");
+  bool             dsp_failed = false ;
 
 #define WERR(name,op)                                           \
   if (err == VL_ERR_OVERFLOW) {                               \
@@ -214,123 +637,112 @@ int Sift::Detect()
   }
 
 
-  /* ...............................................................
-   *                                                     Make filter
-   * ............................................................ */
-
-
-  filt = vl_sift_new (pim.width, pim.height, O, S, omin) ;
-  Logger::debug(Logger::SIFT, "new filter(vl_sift_new) created:%x", filt) ;
-
-  if (edge_thresh >= 0) vl_sift_set_edge_thresh (filt, edge_thresh) ;
-  if (peak_thresh >= 0) vl_sift_set_peak_thresh (filt, peak_thresh) ;
-  if (magnif      >= 0) vl_sift_set_magnif      (filt, magnif) ;
-
-  if (!filt)
+  /* detect zone ends before the report is printed */
   {
-    Logger::error(Logger::SIFT, "Detect: could not create SIFT-fiter.");
-    throw SiftException("could not create SIFT-fiter.");
-  }
-
-  Logger::debug(Logger::SIFT, "sift: filter settings:") ;
-  Logger::debug(Logger::SIFT, "sift:   octaves      (O)     = %d",
-          vl_sift_get_noctaves     (filt)) ;
-  Logger::debug(Logger::SIFT, "sift:   levels       (S)     = %d",
-          vl_sift_get_nlevels      (filt)) ;
-  Logger::debug(Logger::SIFT, "sift:   first octave (o_min) = %d",
-          vl_sift_get_octave_first (filt)) ;
-  Logger::debug(Logger::SIFT, "sift:   edge thresh           = %g",
-          vl_sift_get_edge_thresh  (filt)) ;
-  Logger::debug(Logger::SIFT, "sift:   peak thresh           = %g",
-          vl_sift_get_peak_thresh  (filt)) ;
-  Logger::debug(Logger::SIFT, "sift:   magnif                = %g",
-          vl_sift_get_magnif       (filt)) ;
-  Logger::debug(Logger::SIFT, "sift: will force orientations? %s",
-          force_orientations ? "yes" : "no") ;
-
-  /* ...............................................................
-   *                                             Process each octave
-   * ............................................................ */
-  i     = 0 ;
-  first = 1 ;
-  while (1)
-  {
-    VlSiftKeypoint const *keys = 0 ;
-    int                   nkeys ;
-
-    Logger::debug(Logger::SIFT, "sift: computing octave");
-
-    /* calculate the GSS for the next octave .................... */
-    measure.startTimer("process_octave");
-    if (first)
+    PROFILE_SCOPE(detect);
+    COUNT_STAGE("Sift::Detect()");
+
+    /* ...............................................................
+     *                                                     Make filter
+     * ............................................................ */
+
+
+    /* reuse the filter of the last image of the same size */
+    filt = GetFilter (pim.width, pim.height) ;
+
+    //vlfeat runs on one thread unless asked for more, see SetNumThreads()
+    vl_set_num_threads (num_threads) ;
+
+    if (edge_thresh >= 0) vl_sift_set_edge_thresh (filt, edge_thresh) ;
+    if (peak_thresh >= 0) vl_sift_set_peak_thresh (filt, peak_thresh) ;
+    if (magnif      >= 0) vl_sift_set_magnif      (filt, magnif) ;
+
+    detected_keypoints.clear();
+
+    LOG_DEBUG(Logger::SIFT, "sift: filter settings:") ;
+    LOG_DEBUG(Logger::SIFT, "sift:   octaves      (O)     = %d",
+            vl_sift_get_noctaves     (filt)) ;
+    LOG_DEBUG(Logger::SIFT, "sift:   levels       (S)     = %d",
+            vl_sift_get_nlevels      (filt)) ;
+    LOG_DEBUG(Logger::SIFT, "sift:   first octave (o_min) = %d",
+            vl_sift_get_octave_first (filt)) ;
+    LOG_DEBUG(Logger::SIFT, "sift:   edge thresh           = %g",
+            vl_sift_get_edge_thresh  (filt)) ;
+    LOG_DEBUG(Logger::SIFT, "sift:   peak thresh           = %g",
+            vl_sift_get_peak_thresh  (filt)) ;
+    LOG_DEBUG(Logger::SIFT, "sift:   magnif                = %g",
+            vl_sift_get_magnif       (filt)) ;
+    LOG_DEBUG(Logger::SIFT, "sift: will force orientations? %s",
+            force_orientations ? "yes" : "no") ;
+
+    /* ...............................................................
+     *                                             Process each octave
+     * ............................................................ */
+    first = 1 ;
+    while (1)
     {
-      measure.startTimer("process_f_octave");
-      first = 0 ;
-      err = vl_sift_process_first_octave(filt, fdata) ;
-      measure.stopTimer("process_f_octave");
-    }
-    else
-    {
-      measure.startTimer("process_n_octave");
-      err = vl_sift_process_next_octave(filt);
-      measure.stopTimer("process_n_octave");
-    }
-    measure.stopTimer("process_octave");
+      LOG_DEBUG(Logger::SIFT, "sift: computing octave");
 
-    if (err)
-    {
-      err = VL_ERR_OK ;
-      break ;
-    }
-
-    Logger::debug(Logger::SIFT, "sift: GSS octave %d computed",
-             vl_sift_get_octave_index (filt));
-
-
-    /* run detector ............................................. */
-    measure.startTimer("sift_detect");
-    vl_sift_detect (filt) ;
-    measure.stopTimer("sift_detect");
+      /* calculate the GSS for the next octave .................... */
+      {
+        PROFILE_SCOPE(octave);
+        if (first)
+        {
+          PROFILE_SCOPE(first_octave);
+          COUNT_STAGE("process_f_octave");
+          first = 0 ;
+          if (vl_pgm_get_bpp(&pim) == 1)
+            err = vl_sift_process_first_octave_u8(filt, data) ;
+          else
+            err = vl_sift_process_first_octave(filt, fdata) ;
+        }
+        else
+        {
+          PROFILE_SCOPE(next_octave);
+          COUNT_STAGE("process_n_octave");
+          err = vl_sift_process_next_octave(filt);
+        }
+      }
 
-    keys  = vl_sift_get_keypoints(filt) ;
-    nkeys = vl_sift_get_nkeypoints(filt) ;
-    i     = 0 ;
+      if (err == VL_ERR_IO && !dsp_failed)
+      {
+        /* the DSP failed and is done with the filter buffers, the filter
+           now runs on the ARM only: start over */
+        Logger::warn(Logger::SIFT, "sift: %s, processing the image again on the ARM",
+                     vl_get_last_error_message()) ;
+        dsp_failed = true ;
+        dsp_failures++ ;
+        detected_keypoints.clear() ;
+        first = 1 ;
+        continue ;
+      }
 
-    Logger::debug(Logger::SIFT, "sift: detected %d (unoriented) keypoints", nkeys) ;
+      if (err)
+      {
+        err = VL_ERR_OK ;
+        break ;
+      }
 
+      LOG_DEBUG(Logger::SIFT, "sift: GSS octave %d computed",
+               vl_sift_get_octave_index (filt));
 
 
-    /* for each keypoint ........................................ */
-    for (; i < nkeys ; ++i)
-    {
-      measure.startTimer("per_kpoint");
-      double                angles [4] ;
-      int                   nangles ;
-      //VlSiftKeypoint        ik ;
-      VlSiftKeypoint const *k ;
-
-      /* obtain keypoint orientations ........................... */
-      k = keys + i ;
-      nangles = vl_sift_calc_keypoint_orientations
-        (filt, angles, k) ;
-
-      /* for each orientation ................................... */
-      for (q = 0 ; q < (unsigned) nangles ; ++q)
+      /* run detector ............................................. */
       {
-        KeyPointDescriptor newKeyPoint;
-
-        /* compute descriptor (if necessary) */
-        //if (out.active || dsc.active) {
-        vl_sift_calc_keypoint_descriptor(filt, newKeyPoint.descr, k, angles [q]) ;
-        //}
+        PROFILE_SCOPE(sift_detect);
+        COUNT_STAGE("sift_detect");
+        vl_sift_detect (filt) ;
+      }
 
-        newKeyPoint.keypoint = *k;
-        newKeyPoint.angle = angles[q];
+      LOG_DEBUG(Logger::SIFT, "sift: detected %d (unoriented) keypoints",
+               vl_sift_get_nkeypoints(filt)) ;
 
-        detected_keypoints.push_back(newKeyPoint);
+      /* orientations and descriptors of all keypoints ............ */
+      {
+        PROFILE_SCOPE(kpoint_stage);
+        COUNT_STAGE("kpoint_stage");
+        DescribeKeypoints(filt);
       }
-
-      measure.stopTimer("per_kpoint");
     }
   }
 
@@ -339,18 +751,24 @@ int Sift::Detect()
    * ............................................................ */
 
 
-  /* release filter */
-  if (filt)
-  {
-    Logger::debug(Logger::SIFT, "freeing filt: %x", filt);
-    vl_sift_delete (filt) ;
-    filt = 0 ;
-  }
+  /* the next image tries the DSP again */
+  if (dsp_failed)
+    ApplyDspSplit(filt) ;
 
+  /* the filter stays in the pool, see ReleaseFilters() */
+  filt = 0 ;
 
-  measure.stopTimer("Sift::Detect()");
+  /* the report after the messages of this run */
+  if (print_profile)
+  {
+    Logger::flush();
+    Profiler::Print(stdout);
+    Profiler::Export();
 
-  measure.printStatistic();
+#ifdef TIMEMEASURE_PERF
+    TimeMeasureBase::getInstance()->printStatistic();
+#endif
+  }
 
   /* quit */
   return 0;
@@ -9,6 +9,7 @@
 #define SIFT_H_
 
 #include <vector>
+#include <map>
 #include <vl/sift.h>
 #include <vl/generic.h>
 #include <vl/generic.h>
@@ -24,30 +25,207 @@ struct KeyPointDescriptor
   double angle;
 };
 
+/**
+ * identifies the geometry of a SIFT filter, filters with the same key
+ * can be reused for several images.
+ */
+struct SiftFilterKey
+{
+  int width;
+  int height;
+  int O;
+  int S;
+  int omin;
+
+  bool operator<(const SiftFilterKey& other) const
+  {
+    if(width != other.width)   return width < other.width;
+    if(height != other.height) return height < other.height;
+    if(O != other.O)           return O < other.O;
+    if(S != other.S)           return S < other.S;
+    return omin < other.omin;
+  }
+};
+
+/**
+ * output of the orientation stage for one detected keypoint, each
+ * worker thread writes only to the slots of its own keypoints.
+ */
+struct KeypointSlot
+{
+  int nangles;
+  double angles [4];
+};
+
+/**
+ * ARM/DSP split of the octaves with at least min_pixels pixels, see
+ * vl_sift_set_dsp_split.
+ */
+struct DspSplitRule
+{
+  int min_pixels;
+  double ratio;      //fraction of the convolution columns for the DSP
+  bool adaptive;     //adapt ratio to the measured times
+};
+
 class Dsp;
 
 class Sift
 {
 protected:
   VlPgmImage pim;
-  vl_uint8 *data;
-  vl_sift_pix *fdata;
+  vl_uint8 *data;           //PGM body as read, in DSP-mapped memory
+  vl_sift_pix *fdata;       //converted image, only for 16 bit PGMs
+  unsigned data_capacity;   //number of bytes data can hold
+  unsigned fdata_capacity;  //number of pixels fdata can hold
   std::vector<KeyPointDescriptor> detected_keypoints;
   Dsp* dsp;
 
+  /* scale space geometry */
+  int O;
+  int S;
+  int omin;
+
+  /**
+   * pool of SIFT filters, the buffers of a filter (octave, dog, grad...)
+   * are DSP-mapped allocations, so they are kept for the next image
+   * of the same size.
+   */
+  std::map<SiftFilterKey, VlSiftFilt*> filters;
+
+  /* per keypoint results of the current octave, reused between octaves */
+  std::vector<KeypointSlot> keypoint_slots;
+  std::vector<VlSiftKeypoint> oriented_keys;   //one per keypoint and orientation
+  std::vector<double> oriented_angles;
+  std::vector<vl_sift_pix> descr_buffer;       //128 floats per oriented keypoint
+  int num_threads;   //0 means one per CPU
+  bool print_profile;
+  int dsp_failures;  //images processed again on the ARM after a DSP failure
+
+  std::vector<DspSplitRule> split_rules;
+
+  VlSiftFilt* GetFilter(int width, int height);
+
+  /**
+   * maps the DSP buffers of a new filter for width x height (and the
+   * image buffer if it has to grow) at once, before vl_sift_new and
+   * AllocImageBuffers ask for them, see DmmManager::Reserve. Does
+   * nothing without DSP.
+   */
+  void ReserveDspMemory(int width, int height);
+
+  /**
+   * sets the ARM/DSP split of each octave of filt from split_rules,
+   * octaves without a rule get everything on the DSP (the vlfeat
+   * default). Also undoes the ARM-only fallback after a DSP failure.
+   */
+  void ApplyDspSplit(VlSiftFilt* filt);
+
+  /**
+   * logs the split and the measured ARM/DSP times of each octave of filt.
+   */
+  void LogDspSplit(VlSiftFilt* filt);
+
+  /**
+   * makes data hold npixels pixels of bpp bytes, and fdata npixels
+   * floats if bpp > 1 (8 bit images go to vlfeat as they are).
+   */
+  void AllocImageBuffers(unsigned npixels, int bpp);
+
+  /**
+   * computes orientations and descriptors of the keypoints detected in
+   * the current octave of filt on several threads and appends them to
+   * detected_keypoints in detection order.
+   */
+  void DescribeKeypoints(VlSiftFilt* filt);
+
 public:
   virtual int Detect();
   virtual void ReadImageFromFile(char* filename);
 
+  /**
+   * takes an 8 bit image from memory instead of a file, the pixels are
+   * copied.
+   */
+  virtual void SetImage(const vl_uint8* pixels, int width, int height);
+
+  /**
+   * creates the filter for images of the given size and runs it once on
+   * a blank image, so all buffers and gaussian kernels are allocated and
+   * mapped before the first real image is processed. The keypoint buffer
+   * is sized for one keypoint per 64 pixels and octave; the detection of
+   * images of this size then allocates no DSP memory unless they have
+   * more keypoints.
+   */
+  virtual void WarmUp(int width, int height);
+
+  /**
+   * deletes all pooled filters.
+   */
+  virtual void ReleaseFilters();
+
+  /**
+   * sets the number of threads of the smoothing, orientation and
+   * descriptor stages, 0 uses one thread per CPU. Detect() and WarmUp()
+   * pass it to vlfeat with vl_set_num_threads(), whose own default is
+   * a single thread.
+   */
+  void SetNumThreads(int n)
+  {
+    num_threads = n < 0 ? 0 : n;
+  }
+
+  /**
+   * if Detect() prints (and exports) the profile, on by default
+   */
+  void SetPrintProfile(bool print)
+  {
+    print_profile = print;
+  }
+
+  /**
+   * splits the scale space smoothing of the octaves with at least
+   * min_pixels pixels between ARM and DSP: ratio is the share of the
+   * DSP (1, the default, builds the whole octave on the DSP, 0 keeps
+   * it on the ARM). The rule with the largest min_pixels not above the
+   * size of an octave applies. An adaptive ratio is tuned from the
+   * TimeMeasureBase clock while images are processed, and kept with
+   * the pooled filters.
+   */
+  void SetDspSplit(int min_pixels, double ratio, bool adaptive);
+
+  /**
+   * the DSP node is created by the first Sift object and kept by Dsp
+   * for all later ones.
+   */
   Sift();
 
   virtual ~Sift();
 
+  int GetImageWidth()
+  {
+    return pim.width;
+  }
+
+  int GetImageHeight()
+  {
+    return pim.height;
+  }
+
   virtual std::vector<KeyPointDescriptor>& GetDetectedKeypoints()
   {
     return detected_keypoints;
   }
 
+  /**
+   * number of images that were processed again on the ARM only because
+   * the DSP failed, see Detect.
+   */
+  int GetDspFailures()
+  {
+    return dsp_failures;
+  }
+
 };
 
 class SiftException : public Exception
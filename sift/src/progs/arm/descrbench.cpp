@@ -0,0 +1,147 @@
+/*
+ * descrbench.cpp
+ *
+ * measures the SIFT descriptor throughput (keypoints per second) of the
+ * scalar and of the SIMD (SSE2/NEON) histogram accumulation on the
+ * keypoints detected in an image.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "../../lib/arm/generic-driver.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C" {
+#endif
+
+#include <vl/generic.h>
+#include <vl/sift.h>
+
+#ifdef __cplusplus /* If this is a C++ compiler, end C linkage */
+}
+#endif
+
+#include "../../lib/arm/sift.h"
+#include "../../lib/arm/logger.h"
+
+
+class DescriptorBench : public Sift
+{
+  std::vector<VlSiftKeypoint> keys;
+  std::vector<double> angles;
+  std::vector<vl_sift_pix> descrs;
+
+  static double now()
+  {
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1e-6;
+  }
+
+  /* returns the time needed to describe the current octave repeats times */
+  double TimeOctave(VlSiftFilt* filt, int repeats, vl_bool simd)
+  {
+    vl_set_simd_enabled(simd);
+
+    double start = now();
+
+    for (int r = 0; r < repeats; r++)
+      vl_sift_calc_keypoint_descriptors_batch(filt, &keys[0], &angles[0], keys.size(), &descrs[0]);
+
+    return now() - start;
+  }
+
+public:
+  /* runs the benchmark, times[0] is the scalar and times[1] the SIMD time */
+  unsigned Run(int repeats, double times[2])
+  {
+    VlSiftFilt* filt = GetFilter(pim.width, pim.height);
+    unsigned ndescr = 0;
+    vl_bool simd = vl_get_simd_enabled();
+
+    times[0] = times[1] = 0;
+
+    int err = vl_sift_process_first_octave(filt, fdata);
+
+    while (!err)
+    {
+      vl_sift_detect(filt);
+
+      VlSiftKeypoint const* k = vl_sift_get_keypoints(filt);
+      int nkeys = vl_sift_get_nkeypoints(filt);
+
+      keys.clear();
+      angles.clear();
+
+      for (int i = 0; i < nkeys; i++)
+      {
+        double a[4];
+        int nangles = vl_sift_calc_keypoint_orientations(filt, a, k + i);
+
+        for (int q = 0; q < nangles; q++)
+        {
+          keys.push_back(k[i]);
+          angles.push_back(a[q]);
+        }
+      }
+
+      if (!keys.empty())
+      {
+        descrs.resize(128 * keys.size());
+
+        times[0] += TimeOctave(filt, repeats, VL_FALSE);
+        times[1] += TimeOctave(filt, repeats, VL_TRUE);
+        ndescr += keys.size() * repeats;
+      }
+
+      err = vl_sift_process_next_octave(filt);
+    }
+
+    vl_set_simd_enabled(simd);
+
+    return ndescr;
+  }
+};
+
+
+int main(int argc, char** argv)
+{
+  int repeats = 10;
+
+  if(argc != 2 && argc != 3)
+  {
+    printf("usage: descrbench <image.pgm> [repeats]\n");
+    return -1;
+  }
+
+  if(argc == 3)
+    repeats = atoi(argv[2]);
+
+  Logger::init();
+
+  DescriptorBench bench;
+  double times[2];
+  unsigned ndescr;
+
+  try
+  {
+    bench.ReadImageFromFile(argv[1]);
+    ndescr = bench.Run(repeats, times);
+  }
+  catch(SiftException &ex)
+  {
+    printf("Error: %s, aborting\n", ex.getMessage());
+    return -1;
+  }
+
+  printf("descriptors: %u (%d repeats)\n", ndescr, repeats);
+  printf("scalar: %10.1f keypoints/s\n", ndescr / times[0]);
+  printf("simd:   %10.1f keypoints/s (%s)\n", ndescr / times[1],
+         vl_cpu_has_sse2() ? "SSE2" : "NEON");
+  printf("speedup: %.2f\n", times[0] / times[1]);
+
+  return 0;
+}
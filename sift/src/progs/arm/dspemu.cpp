@@ -0,0 +1,142 @@
+/*
+ * dspemu.cpp
+ *
+ * runs SIFT on an image once on the ARM and once with the convolutions
+ * offloaded to the in-process DSP emulator (DspEmulator), and checks
+ * that both give the same keypoints. SIMD is disabled so both runs use
+ * the same scalar convolution.
+ *
+ * Built with DSP_EMULATED=yes the DSP run goes through Dsp and the
+ * emulated bridge (dsp_bridge_emu.cpp) instead, including its copies of
+ * the DSP memory. Latencies are taken from the environment, see
+ * DspEmulatorLatency.
+ *
+ * usage: dspemu <image.pgm> [dsp share [adaptive]], the optional share
+ * of the DSP splits every octave between ARM and DSP (see
+ * Sift::SetDspSplit).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../../lib/arm/generic-driver.h"
+
+#include "../../lib/arm/sift.h"
+#include "../../lib/arm/logger.h"
+#include "../../lib/arm/DspEmulator.h"
+
+
+static double split_ratio = 1.0;
+static bool split_adaptive = false;
+
+static bool DetectKeypoints(char* filename, std::vector<KeyPointDescriptor>& keypoints, bool on_dsp)
+{
+  Sift sift;
+
+  sift.SetDspSplit(0, split_ratio, split_adaptive);
+
+#ifdef DSP_EMULATED
+  //Sift has set up the emulated bridge, the reference run goes without it
+  if(!on_dsp)
+  {
+    vl_set_dsp_range_func(NULL, NULL);
+    vl_set_dsp_mem_func(NULL, NULL, NULL, NULL, NULL);
+  }
+#else
+  (void)on_dsp;
+#endif
+
+  try
+  {
+    sift.ReadImageFromFile(filename);
+    sift.Detect();
+  }
+  catch(SiftException &ex)
+  {
+    printf("Error: %s, aborting\n", ex.getMessage());
+    return false;
+  }
+
+  keypoints = sift.GetDetectedKeypoints();
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<KeyPointDescriptor> arm, dsp;
+
+  if(argc < 2 || argc > 4)
+  {
+    printf("usage: dspemu <image.pgm> [dsp share [adaptive]]\n");
+    return -1;
+  }
+
+  if(argc > 2)
+    split_ratio = atof(argv[2]);
+
+  if(argc > 3)
+    split_adaptive = atoi(argv[3]) != 0;
+
+  Logger::init();
+
+  vl_set_simd_enabled(false);
+
+  if(!DetectKeypoints(argv[1], arm, false))
+    return -1;
+
+  DspEmulator& emu = DspEmulator::Instance();
+  emu.ResetStats();
+
+#ifdef DSP_EMULATED
+  bool ok = DetectKeypoints(argv[1], dsp, true);
+#else
+  emu.SetLatency(DspEmulatorLatency::FromEnvironment());
+  emu.Start();
+
+  vl_set_alloc_func(dspemu_malloc, dspemu_realloc, dspemu_calloc, dspemu_free);
+  vl_set_dsp_mem_func(dspemu_get_mapped_addr, dspemu_dmm_buffer_begin, dspemu_dmm_buffer_end, dspemu_get_message, dspemu_send_message);
+  vl_set_dsp_range_func(dspemu_dmm_range_begin, dspemu_dmm_range_end);
+
+  bool ok = DetectKeypoints(argv[1], dsp, true);
+
+  vl_set_dsp_range_func(NULL, NULL);
+  vl_set_dsp_mem_func(NULL, NULL, NULL, NULL, NULL);
+  vl_set_alloc_func(malloc, realloc, calloc, free);
+
+  emu.Stop();
+#endif
+
+  if(!ok)
+    return -1;
+
+  DspEmulatorStats stats = emu.GetStats();
+
+  printf("messages:           %lu\n", stats.messages);
+  printf("buffer begin/end:   %lu/%lu (%lu/%lu bytes)\n", stats.buffer_begins, stats.buffer_ends, stats.begin_bytes, stats.end_bytes);
+  printf("DSP cache ops:      %lu (%lu bytes)\n", stats.cache_ops, stats.cache_bytes);
+  printf("maps:               %lu\n", stats.maps);
+  printf("modelled delays:    %lu us, node busy %lu us\n", stats.delay_us, stats.node_us);
+  printf("keypoints ARM/DSP:  %u/%u\n", (unsigned)arm.size(), (unsigned)dsp.size());
+
+  if(arm.size() != dsp.size())
+  {
+    printf("FAILED: different number of keypoints\n");
+    return 1;
+  }
+
+  for(unsigned i = 0; i < arm.size(); i++)
+  {
+    if(memcmp(&arm[i].keypoint, &dsp[i].keypoint, sizeof(VlSiftKeypoint)) ||
+       memcmp(arm[i].descr, dsp[i].descr, sizeof(arm[i].descr)) ||
+       arm[i].angle != dsp[i].angle)
+    {
+      printf("FAILED: keypoint %u differs\n", i);
+      return 1;
+    }
+  }
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * matchbench.cpp
+ *
+ * speed and recall of the kd-tree forest matching against brute force.
+ * The matches of SiftMatcher::MatchExact() are the ground truth, for
+ * several forest sizes and comparison budgets the build time, the match
+ * time, the speedup and the recall (share of the exact matches found
+ * with the same reference keypoint) and precision (share of the forest
+ * matches that are exact matches) are printed.
+ *
+ * The table is printed for float descriptors and again for descriptors
+ * quantized to uint8 as by sifttest, whose recall and precision are also
+ * measured against the exact float matches; the uint8 brute force
+ * matches are compared to them as well. All speedups are over the float
+ * brute force. The values of .sift files are quantized already: to see
+ * the loss of the quantization pass two .pgm images instead, whose
+ * keypoints are detected by Sift::Detect.
+ *
+ * The batch queries of a forest of 4 trees with 128 comparisons are then
+ * timed with 1 up to max_threads threads (default: one per CPU), the
+ * matches must not depend on the number of threads.
+ *
+ * usage: matchbench [-r threshold] [-n repetitions] [-j max_threads]
+ *                   <reference.sift|pgm> <query.sift|pgm>
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <vector>
+
+#include "../../lib/arm/SiftMatcher.h"
+
+
+static const unsigned bench_trees[] = { 1, 4, 8 };
+static const unsigned bench_comparisons[] = { 16, 32, 64, 128, 256, 512, 1024 };
+
+static double now_ms()
+{
+  timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec * 1e3 + t.tv_usec * 1e-3;
+}
+
+static void Usage()
+{
+  printf("usage: matchbench [-r threshold] [-n repetitions] [-j max_threads]\n"
+         "                  <reference.sift|pgm> <query.sift|pgm>\n");
+}
+
+/* the descriptors of a .sift file or detected in a .pgm image, as floats and uint8 */
+static unsigned ReadDescriptors(Sift& sift, const char* filename, std::vector<float>& descr,
+                                std::vector<vl_uint8>& descr_u8)
+{
+  size_t len = strlen(filename);
+  unsigned n;
+
+  if(len > 4 && strcmp(filename + len - 4, ".pgm") == 0)
+  {
+    sift.ReadImageFromFile((char*)filename);
+    sift.Detect();
+
+    std::vector<KeyPointDescriptor>& keypoints = sift.GetDetectedKeypoints();
+
+    for(unsigned i = 0; i < keypoints.size(); i++)
+      descr.insert(descr.end(), keypoints[i].descr, keypoints[i].descr + SIFT_DESCRIPTOR_SIZE);
+
+    n = keypoints.size();
+    if(n)
+      SiftMatcher::Quantize(&descr[0], n, descr_u8);
+  }
+  else
+  {
+    //the values of .sift files are already scaled to 0..255
+    n = SiftMatcher::ReadSiftFile(filename, descr);
+    if(n)
+      SiftMatcher::Quantize(&descr[0], n, descr_u8, 1);
+  }
+
+  return n;
+}
+
+/* best of repetitions runs of Match(), on the queries of the type of the matcher */
+static double TimeMatch(SiftMatcher& matcher, const float* query, const vl_uint8* query_u8,
+                        unsigned n, int repetitions, std::vector<SiftMatch>& matches)
+{
+  double best = 1e300;
+
+  for(int r = 0; r < repetitions; r++)
+  {
+    matches.clear();
+    double start = now_ms();
+    if(matcher.GetDataType() == VL_TYPE_UINT8)
+      matcher.Match(query_u8, n, matches);
+    else
+      matcher.Match(query, n, matches);
+    double t = now_ms() - start;
+    if(t < best)
+      best = t;
+  }
+
+  return best;
+}
+
+int main(int argc, char** argv)
+{
+  double threshold = 1.5;
+  int repetitions = 3;
+  int max_threads = vl_get_num_cpus();
+  int ch;
+
+  while((ch = getopt(argc, argv, "r:n:j:h")) != -1)
+  {
+    switch(ch)
+    {
+      case 'r': threshold = atof(optarg); break;
+      case 'n': repetitions = atoi(optarg) < 1 ? 1 : atoi(optarg); break;
+      case 'j': max_threads = atoi(optarg) < 1 ? 1 : atoi(optarg); break;
+      default:
+        Usage();
+        return -1;
+    }
+  }
+
+  if(argc - optind != 2)
+  {
+    Usage();
+    return -1;
+  }
+
+  std::vector<float> reference, query;
+  std::vector<vl_uint8> reference_u8, query_u8;
+  unsigned nref, nquery;
+
+  try
+  {
+    Sift sift;
+
+    sift.SetPrintProfile(false);
+    nref = ReadDescriptors(sift, argv[optind], reference, reference_u8);
+    nquery = ReadDescriptors(sift, argv[optind + 1], query, query_u8);
+  }
+  catch(Exception& e)
+  {
+    printf("%s\n", e.getMessage());
+    return -1;
+  }
+
+  if(nref < 2 || nquery == 0)
+  {
+    printf("not enough descriptors\n");
+    return -1;
+  }
+
+  //ground truth
+  SiftMatcher exact(1, 0, threshold);
+  std::vector<SiftMatch> truth;
+  double exact_ms = 1e300;
+
+  exact.SetReference(&reference[0], nref);
+
+  for(int r = 0; r < repetitions; r++)
+  {
+    truth.clear();
+    double start = now_ms();
+    exact.MatchExact(&query[0], nquery, truth);
+    double t = now_ms() - start;
+    if(t < exact_ms)
+      exact_ms = t;
+  }
+
+  //reference keypoint of the exact match of every query, -1 if none
+  std::vector<int> truth_of(nquery, -1);
+  for(unsigned i = 0; i < truth.size(); i++)
+    truth_of[truth[i].query] = truth[i].reference;
+
+  printf("%u reference, %u query descriptors, threshold %g\n", nref, nquery, threshold);
+
+  //the same for uint8 descriptors
+  SiftMatcher exact_u8(1, 0, threshold);
+  std::vector<SiftMatch> truth_u8;
+  double exact_u8_ms = 1e300;
+  unsigned agree = 0;
+
+  exact_u8.SetReference(&reference_u8[0], nref);
+
+  for(int r = 0; r < repetitions; r++)
+  {
+    truth_u8.clear();
+    double start = now_ms();
+    exact_u8.MatchExact(&query_u8[0], nquery, truth_u8);
+    double t = now_ms() - start;
+    if(t < exact_u8_ms)
+      exact_u8_ms = t;
+  }
+
+  for(unsigned i = 0; i < truth_u8.size(); i++)
+  {
+    if(truth_of[truth_u8[i].query] == (int)truth_u8[i].reference)
+      agree++;
+  }
+
+  for(int u = 0; u < 2; u++)
+  {
+    SiftMatcher& brute = u ? exact_u8 : exact;
+
+    printf("\n%s descriptors, %lu KB\n", u ? "uint8" : "float", brute.GetReferenceBytes() / 1024);
+
+    if(u)
+      printf("brute force: %u matches in %.2f ms, recall %.1f%%, precision %.1f%%\n\n",
+          (unsigned)truth_u8.size(), exact_u8_ms,
+          truth.empty() ? 100.0 : 100.0 * agree / truth.size(),
+          truth_u8.empty() ? 100.0 : 100.0 * agree / truth_u8.size());
+    else
+      printf("brute force: %u matches in %.2f ms\n\n", (unsigned)truth.size(), exact_ms);
+
+    printf("%5s %11s %10s %10s %8s %8s %8s %8s %12s\n",
+        "trees", "comparisons", "build(ms)", "match(ms)", "speedup", "matches", "recall", "precis.", "cmp/query");
+
+    for(unsigned ti = 0; ti < sizeof(bench_trees) / sizeof(bench_trees[0]); ti++)
+    {
+      SiftMatcher matcher(bench_trees[ti], 0, threshold);
+
+      if(u)
+        matcher.SetReference(&reference_u8[0], nref);
+      else
+        matcher.SetReference(&reference[0], nref);
+
+      double start = now_ms();
+      matcher.Build();
+      double build_ms = now_ms() - start;
+
+      for(unsigned ci = 0; ci < sizeof(bench_comparisons) / sizeof(bench_comparisons[0]); ci++)
+      {
+        std::vector<SiftMatch> matches;
+
+        matcher.SetMaxComparisons(bench_comparisons[ci]);
+        double match_ms = TimeMatch(matcher, &query[0], &query_u8[0], nquery, repetitions, matches);
+
+        //against the float ground truth in both cases
+        unsigned correct = 0;
+        for(unsigned i = 0; i < matches.size(); i++)
+        {
+          if(truth_of[matches[i].query] == (int)matches[i].reference)
+            correct++;
+        }
+
+        printf("%5u %11u %10.2f %10.2f %7.1fx %8u %7.1f%% %7.1f%% %12.1f\n",
+            bench_trees[ti], bench_comparisons[ci], build_ms, match_ms, exact_ms / match_ms,
+            (unsigned)matches.size(),
+            truth.empty() ? 100.0 : 100.0 * correct / truth.size(),
+            matches.empty() ? 100.0 : 100.0 * correct / matches.size(),
+            (double)matcher.GetComparisons() / nquery);
+      }
+    }
+  }
+
+  //batch queries on several threads
+  SiftMatcher matcher(4, 128, threshold);
+  std::vector<SiftMatch> single;
+  double single_ms = 0;
+  bool same = true;
+
+  matcher.SetReference(&reference[0], nref);
+  matcher.Build();
+
+  printf("\n4 trees, 128 comparisons\n%7s %10s %8s %10s %8s\n", "threads", "match(ms)", "speedup", "query/s", "matches");
+
+  //1, 2, 4, ... threads and max_threads
+  for(int threads = 1; ; threads = std::min(2 * threads, max_threads))
+  {
+    std::vector<SiftMatch> matches;
+
+    vl_set_num_threads(threads);
+    double match_ms = TimeMatch(matcher, &query[0], NULL, nquery, repetitions, matches);
+
+    if(threads == 1)
+    {
+      single = matches;
+      single_ms = match_ms;
+    }
+
+    bool equal = matches.size() == single.size();
+    for(unsigned i = 0; equal && i < matches.size(); i++)
+      equal = matches[i].query == single[i].query && matches[i].reference == single[i].reference;
+    same = same && equal;
+
+    printf("%7d %10.2f %7.1fx %10.0f %8u%s\n", threads, match_ms, single_ms / match_ms,
+        nquery / (match_ms / 1e3), (unsigned)matches.size(), equal ? "" : "  DIFFERENT");
+
+    if(threads == max_threads)
+      break;
+  }
+
+  vl_set_num_threads(0);
+
+  return same ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+/*
+ * profcompare.cpp
+ *
+ * compares the stage times of two sets of runs and flags the stages that
+ * got significantly slower (or faster).
+ *
+ * usage: profcompare [-t percent] <before> <after>
+ *
+ * before and after are a run each, or a directory of runs such as
+ * data/before_opt/ARM. A run is a file with the statistics of one image:
+ * the output of a program (with the table of TimeMeasureBase or of
+ * Profiler::Print in it, named <image>_output) or a CSV file of
+ * Profiler::WriteCsv (<image>.csv). The runs of the two directories are
+ * paired by image.
+ *
+ * For every stage the ratio after/before of the total time is taken per
+ * image. The stage is flagged if the geometric mean of the ratios changed
+ * by more than the threshold (default 5%) and a paired t-test on the log
+ * ratios is significant at the 5% level, which needs at least two images.
+ * The exit status is 1 if a stage got slower.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+struct StageTime
+{
+  unsigned long calls;
+  double total_ms;
+};
+
+typedef std::map<std::string, StageTime> Run;         //by stage
+typedef std::map<std::string, Run> RunSet;             //by image
+
+//two-sided 5% critical values of Student's t for 1 to 30 degrees of freedom
+static const double t_critical[30] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static bool EndsWith(const std::string& s, const char* suffix)
+{
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+//image of a run file, empty if it is no run
+static std::string ImageName(const std::string& path)
+{
+  std::string name = path.substr(path.find_last_of('/') + 1);
+
+  if(EndsWith(name, "_output"))
+    return name.substr(0, name.size() - 7);
+  if(EndsWith(name, ".csv"))
+    return name.substr(0, name.size() - 4);
+
+  return "";
+}
+
+/*
+ * reads the stage times of the three formats:
+ *  TimeMeasureBase:  "   Sift::Detect() |     5504.527832 |            1 |5504.527832"
+ *  Profiler::Print:  "  process_octave     6      74.084       0.003 ..." after the "zone" header
+ *  CSV:              "process_octave,Sift::Detect(),6,74.084,..." after the "zone,parent" header
+ * a stage measured more than once in the file (several images) is added up.
+ */
+static bool ReadRun(const char* path, Run& run)
+{
+  FILE* in = fopen(path, "r");
+  char line[1024];
+  enum { NONE, TABLE, CSV } format = NONE;
+
+  if(in == NULL)
+  {
+    printf("could not open '%s'\n", path);
+    return false;
+  }
+
+  while(fgets(line, sizeof(line), in))
+  {
+    char name[256];
+    StageTime t;
+
+    if(strncmp(line, "zone,parent,", 12) == 0)
+    {
+      format = CSV;
+      continue;
+    }
+
+    if(strncmp(line, "zone ", 5) == 0 && strstr(line, "total(ms)"))
+    {
+      format = TABLE;
+      continue;
+    }
+
+    if(strchr(line, '|') && sscanf(line, " %255s | %lf | %lu", name, &t.total_ms, &t.calls) == 3)
+    {
+      //TimeMeasureBase, the header line does not scan
+    }
+    else if(format == CSV)
+    {
+      char* parent = strchr(line, ',');
+      char* fields = parent ? strchr(parent + 1, ',') : NULL;
+
+      if(fields == NULL || parent - line >= (long)sizeof(name) ||
+         sscanf(fields + 1, "%lu,%lf", &t.calls, &t.total_ms) != 2)
+      {
+        format = NONE;
+        continue;
+      }
+
+      memcpy(name, line, parent - line);
+      name[parent - line] = 0;
+    }
+    else if(format == TABLE)
+    {
+      if(sscanf(line, " %255s %lu %lf", name, &t.calls, &t.total_ms) != 3)
+      {
+        format = NONE;
+        continue;
+      }
+    }
+    else
+      continue;
+
+    StageTime& s = run[name];
+    s.calls += t.calls;
+    s.total_ms += t.total_ms;
+  }
+
+  fclose(in);
+  return true;
+}
+
+static bool IsDirectory(const char* path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static bool ReadRuns(const char* path, RunSet& runs)
+{
+  if(!IsDirectory(path))
+    return ReadRun(path, runs[ImageName(path)]);
+
+  DIR* dir = opendir(path);
+  struct dirent* entry;
+
+  if(dir == NULL)
+  {
+    printf("could not open directory '%s'\n", path);
+    return false;
+  }
+
+  while((entry = readdir(dir)) != NULL)
+  {
+    std::string image = ImageName(entry->d_name);
+    std::string file = std::string(path) + "/" + entry->d_name;
+
+    if(!image.empty() && !ReadRun(file.c_str(), runs[image]))
+    {
+      closedir(dir);
+      return false;
+    }
+  }
+
+  closedir(dir);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  double threshold = 0.05;
+  int arg = 1;
+  RunSet before, after;
+
+  if(argc == 5 && strcmp(argv[1], "-t") == 0)
+  {
+    threshold = atof(argv[2]) / 100.0;
+    arg = 3;
+  }
+
+  if(argc - arg != 2)
+  {
+    printf("usage: profcompare [-t percent] <before> <after>\n");
+    return -1;
+  }
+
+  if(!ReadRuns(argv[arg], before) || !ReadRuns(argv[arg + 1], after))
+    return -1;
+
+  //two single files are compared with each other whatever their names
+  if(!IsDirectory(argv[arg]) && !IsDirectory(argv[arg + 1]))
+  {
+    Run b = before.begin()->second, a = after.begin()->second;
+    before.clear();
+    after.clear();
+    before["run"] = b;
+    after["run"] = a;
+  }
+
+  //log ratios after/before per stage, over the images in both sets
+  std::map<std::string, std::vector<double> > ratios;
+  std::map<std::string, double> total_before, total_after;
+
+  for(RunSet::iterator i = before.begin(); i != before.end(); ++i)
+  {
+    RunSet::iterator j = after.find(i->first);
+
+    if(j == after.end())
+    {
+      printf("%s: only in %s\n", i->first.c_str(), argv[arg]);
+      continue;
+    }
+
+    for(Run::iterator s = i->second.begin(); s != i->second.end(); ++s)
+    {
+      Run::iterator t = j->second.find(s->first);
+
+      if(t == j->second.end() || s->second.total_ms <= 0 || t->second.total_ms <= 0)
+        continue;
+
+      ratios[s->first].push_back(log(t->second.total_ms / s->second.total_ms));
+      total_before[s->first] += s->second.total_ms;
+      total_after[s->first] += t->second.total_ms;
+    }
+  }
+
+  for(RunSet::iterator j = after.begin(); j != after.end(); ++j)
+  {
+    if(before.find(j->first) == before.end())
+      printf("%s: only in %s\n", j->first.c_str(), argv[arg + 1]);
+  }
+
+  if(ratios.empty())
+  {
+    printf("no stages to compare\n");
+    return -1;
+  }
+
+  int regressions = 0;
+
+  printf("%-20s %6s %14s %14s %9s %8s  %s\n", "stage", "images", "before(ms)", "after(ms)", "change", "t", "");
+
+  for(std::map<std::string, std::vector<double> >::iterator r = ratios.begin(); r != ratios.end(); ++r)
+  {
+    const std::vector<double>& x = r->second;
+    unsigned n = x.size();
+    double mean = 0, var = 0;
+
+    for(unsigned i = 0; i < n; i++)
+      mean += x[i];
+    mean /= n;
+
+    for(unsigned i = 0; i < n; i++)
+      var += (x[i] - mean) * (x[i] - mean);
+
+    double change = exp(mean) - 1;
+    const char* verdict = "";
+    double t = 0;
+
+    if(n > 1)
+    {
+      var /= n - 1;
+
+      //identical ratios on every image: any change is significant
+      if(var > 0)
+        t = mean / sqrt(var / n);
+      else
+        t = mean > 0 ? HUGE_VAL : (mean < 0 ? -HUGE_VAL : 0);
+
+      double critical = n - 1 <= 30 ? t_critical[n - 2] : 1.960;
+      bool significant = fabs(t) > critical && fabs(change) > threshold;
+
+      if(significant && change > 0)
+      {
+        verdict = "REGRESSION";
+        regressions++;
+      }
+      else if(significant)
+        verdict = "improved";
+    }
+    else if(fabs(change) > threshold)
+      verdict = change > 0 ? "slower (one image, not tested)" : "faster (one image, not tested)";
+
+    printf("%-20s %6u %14.3f %14.3f %+8.1f%% %8.2f  %s\n", r->first.c_str(), n,
+        total_before[r->first], total_after[r->first], 100 * change, t, verdict);
+  }
+
+  return regressions ? 1 : 0;
+}
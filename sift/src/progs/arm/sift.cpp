@@ -438,6 +438,12 @@ main(int argc, char **argv)
     double           *ikeys = 0 ;
     int              nikeys = 0, ikeys_size = 0 ;
 
+    /* keypoints of the current octave, one per orientation */
+    VlSiftKeypoint   *okeys = 0 ;
+    double           *oangles = 0 ;
+    vl_sift_pix      *odescrs = 0 ;
+    int              nokeys = 0, okeys_size = 0 ;
+
     /* ...............................................................
      *                                                 Determine files
      * ............................................................ */
@@ -700,6 +706,7 @@ main(int argc, char **argv)
       }
 
       /* for each keypoint ........................................ */
+      nokeys = 0 ;
       for (; i < nkeys ; ++i) {
         double                angles [4] ;
         int                   nangles ;
@@ -733,45 +740,74 @@ main(int argc, char **argv)
             (filt, angles, k) ;
         }
 
-        /* for each orientation ................................... */
+        /* queue one keypoint per orientation ..................... */
+        if (okeys_size < nokeys + nangles) {
+          /* keep the old blocks if realloc fails, they are freed below */
+          VlSiftKeypoint *new_okeys ;
+          double         *new_oangles ;
+          vl_sift_pix    *new_odescrs ;
+          okeys_size += 1000 ;
+          new_okeys   = (VlSiftKeypoint*)realloc (okeys, sizeof(VlSiftKeypoint) * okeys_size) ;
+          if (new_okeys) okeys = new_okeys ;
+          new_oangles = (double*)realloc (oangles, sizeof(double) * okeys_size) ;
+          if (new_oangles) oangles = new_oangles ;
+          new_odescrs = (vl_sift_pix*)realloc (odescrs, 128 * sizeof(vl_sift_pix) * okeys_size) ;
+          if (new_odescrs) odescrs = new_odescrs ;
+          if (!new_okeys || !new_oangles || !new_odescrs) {
+            err = VL_ERR_ALLOC ;
+            snprintf(err_msg, sizeof(err_msg),
+                     "Out of memory.") ;
+            goto done ;
+          }
+        }
+
         for (q = 0 ; q < (unsigned) nangles ; ++q) {
-          vl_sift_pix descr [128] ;
+          okeys   [nokeys] = *k ;
+          oangles [nokeys] = angles [q] ;
+          ++ nokeys ;
+        }
+      }
 
-          /* compute descriptor (if necessary) */
-          if (out.active || dsc.active) {
-            vl_sift_calc_keypoint_descriptor
-              (filt, descr, k, angles [q]) ;
-          }
+      /* compute descriptors (if necessary) ....................... */
+      if (nokeys && (out.active || dsc.active)) {
+        vl_sift_calc_keypoint_descriptors_batch
+          (filt, okeys, oangles, nokeys, odescrs) ;
+      }
 
-          if (out.active) {
-            int l ;
-            vl_file_meta_put_double (&out, k -> x     ) ;
-            vl_file_meta_put_double (&out, k -> y     ) ;
-            vl_file_meta_put_double (&out, k -> sigma ) ;
-            vl_file_meta_put_double (&out, angles [q] ) ;
-            for (l = 0 ; l < 128 ; ++l) {
-              vl_file_meta_put_uint8 (&out, (vl_uint8) (512.0 * descr [l])) ;
-            }
-            if (out.protocol == VL_PROT_ASCII) fprintf(out.file, "\n") ;
+      /* for each keypoint and orientation ........................ */
+      for (q = 0 ; q < (unsigned) nokeys ; ++q) {
+        VlSiftKeypoint const *k     = okeys + q ;
+        double                angle = oangles [q] ;
+        vl_sift_pix const    *descr = odescrs + 128 * q ;
+
+        if (out.active) {
+          int l ;
+          vl_file_meta_put_double (&out, k -> x     ) ;
+          vl_file_meta_put_double (&out, k -> y     ) ;
+          vl_file_meta_put_double (&out, k -> sigma ) ;
+          vl_file_meta_put_double (&out, angle      ) ;
+          for (l = 0 ; l < 128 ; ++l) {
+            vl_file_meta_put_uint8 (&out, (vl_uint8) (512.0 * descr [l])) ;
           }
+          if (out.protocol == VL_PROT_ASCII) fprintf(out.file, "\n") ;
+        }
 
-          if (frm.active) {
-            vl_file_meta_put_double (&frm, k -> x     ) ;
-            vl_file_meta_put_double (&frm, k -> y     ) ;
-            vl_file_meta_put_double (&frm, k -> sigma ) ;
-            vl_file_meta_put_double (&frm, angles [q] ) ;
-            if (frm.protocol == VL_PROT_ASCII) fprintf(frm.file, "\n") ;
-          }
+        if (frm.active) {
+          vl_file_meta_put_double (&frm, k -> x     ) ;
+          vl_file_meta_put_double (&frm, k -> y     ) ;
+          vl_file_meta_put_double (&frm, k -> sigma ) ;
+          vl_file_meta_put_double (&frm, angle      ) ;
+          if (frm.protocol == VL_PROT_ASCII) fprintf(frm.file, "\n") ;
+        }
 
-          if (dsc.active) {
-            int l ;
-            for (l = 0 ; l < 128 ; ++l) {
-              double x = 512.0 * descr[l] ;
-              x = (x < 255.0) ? x : 255.0 ;
-              vl_file_meta_put_uint8 (&dsc, (vl_uint8) (x)) ;
-            }
-            if (dsc.protocol == VL_PROT_ASCII) fprintf(dsc.file, "\n") ;
+        if (dsc.active) {
+          int l ;
+          for (l = 0 ; l < 128 ; ++l) {
+            double x = 512.0 * descr[l] ;
+            x = (x < 255.0) ? x : 255.0 ;
+            vl_file_meta_put_uint8 (&dsc, (vl_uint8) (x)) ;
           }
+          if (dsc.protocol == VL_PROT_ASCII) fprintf(dsc.file, "\n") ;
         }
       }
     }
@@ -800,6 +836,12 @@ main(int argc, char **argv)
       ikeys = 0 ;
     }
 
+    /* release per octave keypoint buffers */
+    if (okeys)   { free (okeys) ;   okeys = 0 ; }
+    if (oangles) { free (oangles) ; oangles = 0 ; }
+    if (odescrs) { free (odescrs) ; odescrs = 0 ; }
+    okeys_size = nokeys = 0 ;
+
     /* release filter */
     if (filt) {
       vl_sift_delete (filt) ;
@@ -0,0 +1,513 @@
+/*
+ * siftbench.cpp
+ *
+ * benchmark of the SIFT detection over the image corpus: every PGM of
+ * the corpus directory is run at several upscaled resolutions, through
+ * Sift::Detect and through the plain vlfeat loop of the sift driver
+ * (progs/arm/sift.cpp), with warm-up runs and repetitions. Reported are
+ * the medians of the wall time and of the Profiler stages, and keypoints
+ * per second.
+ *
+ * At scale 1 the keypoints are checked against the saved results of the
+ * unoptimised code (data/before_opt/<arch>/<image>.sift): every keypoint
+ * needs a counterpart with the same frame (within 0.01) and a descriptor
+ * that differs by at most the tolerance in every component (in the
+ * 512 * descr units of the .sift files). A few keypoints near the
+ * thresholds may come and go, up to 1% unmatched keypoints pass. The
+ * default tolerance of 4 covers the rounding differences of the
+ * vectorised descriptor code.
+ *
+ * Runs on the host without the DSP as well as on the board.
+ *
+ * usage: siftbench [-p corpus] [-b baseline] [-s scales] [-r repetitions]
+ *                  [-w warm-ups] [-t tolerance] [-m sift|driver|both]
+ *                  [-o results.csv]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../lib/arm/generic-driver.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C" {
+#endif
+
+#include <vl/generic.h>
+#include <vl/pgm.h>
+#include <vl/sift.h>
+
+#ifdef __cplusplus /* If this is a C++ compiler, end C linkage */
+}
+#endif
+
+#include "../../lib/arm/sift.h"
+#include "../../lib/arm/Profiler.h"
+
+#ifdef __arm__
+#define SIFTBENCH_BASELINE "data/before_opt/ARM"
+#else
+#define SIFTBENCH_BASELINE "data/before_opt/glx"
+#endif
+
+//unmatched keypoints that still count as equivalent
+#define SIFTBENCH_MAX_UNMATCHED 0.01
+#define SIFTBENCH_FRAME_TOLERANCE 0.01
+
+PROFILE_ZONE(driver, "driver");
+PROFILE_ZONE(driver_octave, "driver_octave");
+PROFILE_ZONE(driver_detect, "driver_detect");
+PROFILE_ZONE(driver_kpoint, "driver_kpoint");
+
+
+//one keypoint as written to a .sift file
+struct BenchKeypoint
+{
+  double frame[4];   //x, y, sigma, angle
+  int descr[128];
+
+  bool operator<(const BenchKeypoint& other) const
+  {
+    return frame[0] < other.frame[0];
+  }
+};
+
+struct BenchResult
+{
+  std::vector<double> times;                            //ms per repetition
+  std::map<std::string, std::vector<double> > stages;   //ms per repetition
+  std::vector<BenchKeypoint> keypoints;                 //of the last repetition
+};
+
+static double now_ms()
+{
+  timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec * 1e3 + t.tv_usec * 1e-3;
+}
+
+static double median(std::vector<double> v)
+{
+  if(v.empty())
+    return 0;
+
+  std::sort(v.begin(), v.end());
+  return v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+}
+
+static BenchKeypoint MakeKeypoint(const VlSiftKeypoint& k, double angle, const vl_sift_pix* descr)
+{
+  BenchKeypoint b;
+
+  b.frame[0] = k.x;
+  b.frame[1] = k.y;
+  b.frame[2] = k.sigma;
+  b.frame[3] = angle;
+
+  //as sifttest and the sift driver write it
+  for(int l = 0; l < 128; l++)
+    b.descr[l] = (vl_uint8)(512.0 * descr[l]);
+
+  return b;
+}
+
+/* bilinear upscaling by an integer factor */
+static std::vector<vl_uint8> Upscale(const vl_uint8* image, int width, int height, int scale)
+{
+  std::vector<vl_uint8> out(width * scale * height * scale);
+
+  for(int y = 0; y < height * scale; y++)
+  {
+    double sy = (y + 0.5) / scale - 0.5;
+    int y0 = sy < 0 ? 0 : (int)sy;
+    int y1 = y0 + 1 < height ? y0 + 1 : height - 1;
+    double fy = sy < 0 ? 0 : sy - y0;
+
+    for(int x = 0; x < width * scale; x++)
+    {
+      double sx = (x + 0.5) / scale - 0.5;
+      int x0 = sx < 0 ? 0 : (int)sx;
+      int x1 = x0 + 1 < width ? x0 + 1 : width - 1;
+      double fx = sx < 0 ? 0 : sx - x0;
+
+      double v = (1 - fy) * ((1 - fx) * image[y0 * width + x0] + fx * image[y0 * width + x1]) +
+                 fy * ((1 - fx) * image[y1 * width + x0] + fx * image[y1 * width + x1]);
+
+      out[y * width * scale + x] = (vl_uint8)(v + 0.5);
+    }
+  }
+
+  return out;
+}
+
+/* the loop of the sift driver, one filter per image */
+static void RunDriver(const vl_uint8* image, int width, int height, std::vector<BenchKeypoint>& keypoints)
+{
+  PROFILE_SCOPE(driver);
+
+  std::vector<vl_sift_pix> fdata(image, image + width * height);
+  std::vector<VlSiftKeypoint> okeys;
+  std::vector<double> oangles;
+  std::vector<vl_sift_pix> odescrs;
+  VlSiftFilt* filt = vl_sift_new(width, height, -1, 3, -1);
+  bool first = true;
+
+  keypoints.clear();
+
+  while(true)
+  {
+    int err;
+
+    {
+      PROFILE_SCOPE(driver_octave);
+      err = first ? vl_sift_process_first_octave(filt, &fdata[0]) : vl_sift_process_next_octave(filt);
+      first = false;
+    }
+
+    if(err)
+      break;
+
+    {
+      PROFILE_SCOPE(driver_detect);
+      vl_sift_detect(filt);
+    }
+
+    PROFILE_SCOPE(driver_kpoint);
+
+    const VlSiftKeypoint* keys = vl_sift_get_keypoints(filt);
+    int nkeys = vl_sift_get_nkeypoints(filt);
+
+    okeys.clear();
+    oangles.clear();
+
+    for(int i = 0; i < nkeys; i++)
+    {
+      double angles[4];
+      int nangles = vl_sift_calc_keypoint_orientations(filt, angles, keys + i);
+
+      for(int q = 0; q < nangles; q++)
+      {
+        okeys.push_back(keys[i]);
+        oangles.push_back(angles[q]);
+      }
+    }
+
+    if(okeys.empty())
+      continue;
+
+    odescrs.resize(128 * okeys.size());
+    vl_sift_calc_keypoint_descriptors_batch(filt, &okeys[0], &oangles[0], okeys.size(), &odescrs[0]);
+
+    for(unsigned q = 0; q < okeys.size(); q++)
+      keypoints.push_back(MakeKeypoint(okeys[q], oangles[q], &odescrs[128 * q]));
+  }
+
+  vl_sift_delete(filt);
+}
+
+static void RunSift(Sift& sift, const vl_uint8* image, int width, int height, std::vector<BenchKeypoint>& keypoints)
+{
+  sift.SetImage(image, width, height);
+  sift.Detect();
+
+  std::vector<KeyPointDescriptor>& detected = sift.GetDetectedKeypoints();
+
+  keypoints.clear();
+  for(unsigned i = 0; i < detected.size(); i++)
+    keypoints.push_back(MakeKeypoint(detected[i].keypoint, detected[i].angle, detected[i].descr));
+}
+
+static bool ReadSiftFile(const std::string& name, std::vector<BenchKeypoint>& keypoints)
+{
+  FILE* in = fopen(name.c_str(), "r");
+
+  if(in == NULL)
+    return false;
+
+  BenchKeypoint k;
+
+  while(fscanf(in, "%lf %lf %lf %lf", &k.frame[0], &k.frame[1], &k.frame[2], &k.frame[3]) == 4)
+  {
+    int l;
+
+    for(l = 0; l < 128 && fscanf(in, "%d", &k.descr[l]) == 1; l++)
+      ;
+
+    if(l < 128)
+      break;
+
+    keypoints.push_back(k);
+  }
+
+  fclose(in);
+  return true;
+}
+
+/*
+ * number of keypoints of a without a counterpart in b, and the largest
+ * descriptor difference of the matched ones
+ */
+static unsigned Unmatched(const std::vector<BenchKeypoint>& a, std::vector<BenchKeypoint> b, int& max_diff)
+{
+  unsigned unmatched = 0;
+
+  std::sort(b.begin(), b.end());
+  max_diff = 0;
+
+  for(unsigned i = 0; i < a.size(); i++)
+  {
+    BenchKeypoint lower = a[i];
+    int best = -1;
+
+    lower.frame[0] -= SIFTBENCH_FRAME_TOLERANCE;
+
+    for(std::vector<BenchKeypoint>::iterator j = std::lower_bound(b.begin(), b.end(), lower);
+        j != b.end() && j->frame[0] <= a[i].frame[0] + SIFTBENCH_FRAME_TOLERANCE; ++j)
+    {
+      bool same = true;
+      int diff = 0;
+
+      for(int f = 1; f < 4; f++)
+        same = same && fabs(j->frame[f] - a[i].frame[f]) <= SIFTBENCH_FRAME_TOLERANCE;
+
+      if(!same)
+        continue;
+
+      for(int l = 0; l < 128; l++)
+        diff = std::max(diff, abs(j->descr[l] - a[i].descr[l]));
+
+      if(best < 0 || diff < best)
+        best = diff;
+    }
+
+    if(best < 0)
+      unmatched++;
+    else
+      max_diff = std::max(max_diff, best);
+  }
+
+  return unmatched;
+}
+
+/* compares with the baseline, prints the verdict, false if not equivalent */
+static bool CheckBaseline(const std::string& file, const std::vector<BenchKeypoint>& keypoints, int tolerance)
+{
+  std::vector<BenchKeypoint> baseline;
+
+  if(!ReadSiftFile(file, baseline))
+  {
+    printf("    baseline:  %s not found, not checked\n", file.c_str());
+    return true;
+  }
+
+  int diff_new, diff_old;
+  unsigned new_only = Unmatched(keypoints, baseline, diff_new);
+  unsigned old_only = Unmatched(baseline, keypoints, diff_old);
+  int diff = std::max(diff_new, diff_old);
+  bool ok = new_only <= SIFTBENCH_MAX_UNMATCHED * keypoints.size() &&
+            old_only <= SIFTBENCH_MAX_UNMATCHED * baseline.size() && diff <= tolerance;
+
+  printf("    baseline:  %u/%u keypoints, %u new, %u missing, max descriptor difference %d: %s\n",
+      (unsigned)keypoints.size(), (unsigned)baseline.size(), new_only, old_only, diff, ok ? "OK" : "FAILED");
+
+  return ok;
+}
+
+static void Report(FILE* csv, const std::string& image, int scale, int width, int height,
+                   const char* mode, const BenchResult& r)
+{
+  double t = median(r.times);
+  double keys_per_s = t > 0 ? r.keypoints.size() / (t / 1e3) : 0;
+
+  printf("  %-6s x%d %5dx%-5d %6u keypoints  median %9.2f ms  min %9.2f  max %9.2f  %8.0f keypoints/s\n",
+      mode, scale, width, height, (unsigned)r.keypoints.size(), t,
+      *std::min_element(r.times.begin(), r.times.end()),
+      *std::max_element(r.times.begin(), r.times.end()), keys_per_s);
+
+  for(std::map<std::string, std::vector<double> >::const_iterator s = r.stages.begin(); s != r.stages.end(); ++s)
+    printf("    %-20s %9.2f ms\n", s->first.c_str(), median(s->second));
+
+  if(csv)
+  {
+    fprintf(csv, "%s,%d,%d,%d,%s,%s,%u,%.3f,%.1f\n", image.c_str(), scale, width, height, mode,
+        "total", (unsigned)r.keypoints.size(), t, keys_per_s);
+
+    for(std::map<std::string, std::vector<double> >::const_iterator s = r.stages.begin(); s != r.stages.end(); ++s)
+      fprintf(csv, "%s,%d,%d,%d,%s,%s,,%.3f,\n", image.c_str(), scale, width, height, mode,
+          s->first.c_str(), median(s->second));
+  }
+}
+
+static void Usage()
+{
+  printf("usage: siftbench [-p corpus] [-b baseline] [-s scales] [-r repetitions]\n"
+         "                 [-w warm-ups] [-t tolerance] [-m sift|driver|both] [-o results.csv]\n");
+}
+
+int main(int argc, char** argv)
+{
+  std::string corpus = "data/pics", baseline = SIFTBENCH_BASELINE;
+  std::vector<int> scales;
+  int repetitions = 5, warmups = 1, tolerance = 4;
+  bool run_sift = true, run_driver = true;
+  const char* csv_name = NULL;
+  int ch;
+
+  while((ch = getopt(argc, argv, "p:b:s:r:w:t:m:o:h")) != -1)
+  {
+    switch(ch)
+    {
+      case 'p': corpus = optarg; break;
+      case 'b': baseline = optarg; break;
+      case 'r': repetitions = std::max(1, atoi(optarg)); break;
+      case 'w': warmups = std::max(0, atoi(optarg)); break;
+      case 't': tolerance = atoi(optarg); break;
+      case 'o': csv_name = optarg; break;
+      case 's':
+        for(char* s = strtok(optarg, ","); s; s = strtok(NULL, ","))
+          if(atoi(s) > 0)
+            scales.push_back(atoi(s));
+        break;
+      case 'm':
+        run_sift = strcmp(optarg, "driver") != 0;
+        run_driver = strcmp(optarg, "sift") != 0;
+        break;
+      default:
+        Usage();
+        return -1;
+    }
+  }
+
+  if(scales.empty())
+  {
+    scales.push_back(1);
+    scales.push_back(2);
+  }
+
+  //the corpus, in a fixed order
+  std::vector<std::string> images;
+  DIR* dir = opendir(corpus.c_str());
+  struct dirent* entry;
+
+  if(dir == NULL)
+  {
+    printf("could not open corpus directory '%s'\n", corpus.c_str());
+    return -1;
+  }
+
+  while((entry = readdir(dir)) != NULL)
+  {
+    std::string name = entry->d_name;
+    if(name.size() > 4 && name.compare(name.size() - 4, 4, ".pgm") == 0)
+      images.push_back(name.substr(0, name.size() - 4));
+  }
+  closedir(dir);
+  std::sort(images.begin(), images.end());
+
+  if(images.empty())
+  {
+    printf("no PGM images in '%s' (see data/pics/convert_to_pgm)\n", corpus.c_str());
+    return -1;
+  }
+
+  FILE* csv = NULL;
+
+  if(csv_name)
+  {
+    csv = fopen(csv_name, "w");
+    if(csv == NULL)
+    {
+      printf("could not open '%s' for writing\n", csv_name);
+      return -1;
+    }
+    fprintf(csv, "image,scale,width,height,mode,stage,keypoints,median_ms,keypoints_per_s\n");
+  }
+
+  Sift sift;
+  bool equivalent = true;
+
+  sift.SetPrintProfile(false);
+
+  for(unsigned i = 0; i < images.size(); i++)
+  {
+    std::string file = corpus + "/" + images[i] + ".pgm";
+    VlPgmImage pim;
+    vl_uint8* pixels = NULL;
+
+    if(vl_pgm_read_new(file.c_str(), &pim, &pixels) || vl_pgm_get_bpp(&pim) != 1)
+    {
+      printf("%s: could not read an 8 bit image, skipped\n", file.c_str());
+      vl_free(pixels);
+      continue;
+    }
+
+    printf("%s (%dx%d)\n", images[i].c_str(), pim.width, pim.height);
+
+    for(unsigned s = 0; s < scales.size(); s++)
+    {
+      int scale = scales[s];
+      int width = pim.width * scale, height = pim.height * scale;
+      std::vector<vl_uint8> image = Upscale(pixels, pim.width, pim.height, scale);
+
+      for(int mode = 0; mode < 2; mode++)
+      {
+        if((mode == 0 && !run_sift) || (mode == 1 && !run_driver))
+          continue;
+
+        BenchResult r;
+
+        for(int rep = -warmups; rep < repetitions; rep++)
+        {
+          std::vector<ProfileZoneStats> stats;
+
+          Profiler::Reset();
+          double start = now_ms();
+
+          if(mode == 0)
+            RunSift(sift, &image[0], width, height, r.keypoints);
+          else
+            RunDriver(&image[0], width, height, r.keypoints);
+
+          double time = now_ms() - start;
+
+          //warm-up runs fill the caches and the filter pool only
+          if(rep < 0)
+            continue;
+
+          r.times.push_back(time);
+
+          Profiler::GetStats(stats);
+          for(unsigned z = 0; z < stats.size(); z++)
+          {
+            bool driver_zone = strncmp(Profiler::GetZoneName(z), "driver", 6) == 0;
+
+            if(stats[z].count > 0 && driver_zone == (mode == 1))
+              r.stages[Profiler::GetZoneName(z)].push_back(stats[z].total / 1e6);
+          }
+        }
+
+        Report(csv, images[i], scale, width, height, mode == 0 ? "sift" : "driver", r);
+
+        if(scale == 1 && !CheckBaseline(baseline + "/" + images[i] + ".sift", r.keypoints, tolerance))
+          equivalent = false;
+      }
+    }
+
+    vl_free(pixels);
+  }
+
+  if(csv)
+    fclose(csv);
+
+  printf("%s\n", equivalent ? "all results equivalent to the baseline" : "FAILED: results differ from the baseline");
+  return equivalent ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+/*
+ * siftmatch.cpp
+ *
+ * matches the keypoints of two .sift files (as written by sift and
+ * sifttest) with SiftMatcher and writes one line per unique match:
+ *
+ *   <query index> <reference index> <squared distance> <query x y> <reference x y>
+ *
+ * usage: siftmatch [-t trees] [-c comparisons] [-r threshold] [-e] [-u] [-o matches]
+ *                  [-w index | -i index [-n]] <reference.sift> <query.sift>
+ *
+ * -e matches by brute force instead of the kd-tree forest, -c 0 searches
+ * the forest exhaustively. -u stores and matches the descriptors as uint8
+ * (a quarter of the memory of floats). -w saves the forest with the
+ * reference descriptors to an index file, -i maps a saved index instead
+ * of building the forest (the reference file then only gives the keypoint
+ * positions, the descriptor type is the one of the index). -n trusts the
+ * index: its trees are not checked, so mapping it takes constant time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "../../lib/arm/SiftMatcher.h"
+
+
+static double now_ms()
+{
+  timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec * 1e3 + t.tv_usec * 1e-3;
+}
+
+static void Usage()
+{
+  printf("usage: siftmatch [-t trees] [-c comparisons] [-r threshold] [-e] [-u] [-o matches]\n"
+         "                 [-w index | -i index [-n]] <reference.sift> <query.sift>\n");
+}
+
+int main(int argc, char** argv)
+{
+  unsigned trees = 4, max_comparisons = 128;
+  double threshold = 1.5;
+  bool exact = false;
+  bool quantize = false;
+  bool trusted = false;
+  const char* out_name = NULL;
+  const char* save_name = NULL;
+  const char* index_name = NULL;
+  int ch;
+
+  while((ch = getopt(argc, argv, "t:c:r:euo:w:i:nh")) != -1)
+  {
+    switch(ch)
+    {
+      case 't': trees = atoi(optarg); break;
+      case 'c': max_comparisons = atoi(optarg); break;
+      case 'r': threshold = atof(optarg); break;
+      case 'e': exact = true; break;
+      case 'u': quantize = true; break;
+      case 'o': out_name = optarg; break;
+      case 'w': save_name = optarg; break;
+      case 'i': index_name = optarg; break;
+      case 'n': trusted = true; break;
+      default:
+        Usage();
+        return -1;
+    }
+  }
+
+  if(argc - optind != 2 || (save_name && index_name))
+  {
+    Usage();
+    return -1;
+  }
+
+  //build and match on one thread per CPU, vlfeat defaults to one
+  vl_set_num_threads(0);
+
+  std::vector<float> reference, query;
+  std::vector<vl_uint8> reference_u8, query_u8;
+  std::vector<double> reference_frames, query_frames;
+  std::vector<SiftMatch> matches;
+  SiftMatcher matcher(trees, max_comparisons, threshold);
+  FILE* out = stdout;
+
+  try
+  {
+    unsigned nref = SiftMatcher::ReadSiftFile(argv[optind], reference, &reference_frames);
+    unsigned nquery = SiftMatcher::ReadSiftFile(argv[optind + 1], query, &query_frames);
+
+    if(nref == 0 || nquery == 0)
+    {
+      fprintf(stderr, "no descriptors in '%s'\n", nref ? argv[optind + 1] : argv[optind]);
+      return -1;
+    }
+
+    //MatchExact() needs the descriptors only
+    double start = now_ms();
+    if(index_name)
+    {
+      matcher.Load(index_name, !trusted);
+
+      if(matcher.GetNumReference() != nref)
+      {
+        fprintf(stderr, "'%s' indexes %u descriptors, '%s' has %u\n", index_name,
+            matcher.GetNumReference(), argv[optind], nref);
+        return -1;
+      }
+      quantize = matcher.GetDataType() == VL_TYPE_UINT8;
+    }
+    else if(quantize)
+    {
+      //the values of .sift files are already scaled to 0..255
+      SiftMatcher::Quantize(&reference[0], nref, reference_u8, 1);
+      matcher.SetReference(&reference_u8[0], nref);
+      if(!exact)
+        matcher.Build();
+    }
+    else
+    {
+      matcher.SetReference(&reference[0], nref);
+      if(!exact)
+        matcher.Build();
+    }
+    double build = now_ms() - start;
+
+    if(quantize)
+      SiftMatcher::Quantize(&query[0], nquery, query_u8, 1);
+
+    if(save_name)
+      matcher.Save(save_name);
+
+    start = now_ms();
+    if(exact && quantize)
+      matcher.MatchExact(&query_u8[0], nquery, matches);
+    else if(exact)
+      matcher.MatchExact(&query[0], nquery, matches);
+    else if(quantize)
+      matcher.Match(&query_u8[0], nquery, matches);
+    else
+      matcher.Match(&query[0], nquery, matches);
+    double match = now_ms() - start;
+
+    fprintf(stderr, "%u reference, %u query descriptors: %u matches, %lu comparisons, "
+        "%s %.2f ms, match %.2f ms\n", nref, nquery, (unsigned)matches.size(),
+        matcher.GetComparisons(), index_name ? "load" : "build", build, match);
+  }
+  catch(MatcherException& e)
+  {
+    fprintf(stderr, "%s\n", e.getMessage());
+    return -1;
+  }
+
+  if(out_name)
+  {
+    out = fopen(out_name, "w");
+    if(out == NULL)
+    {
+      fprintf(stderr, "could not open '%s' for writing\n", out_name);
+      return -1;
+    }
+  }
+
+  for(unsigned i = 0; i < matches.size(); i++)
+  {
+    const SiftMatch& m = matches[i];
+
+    fprintf(out, "%u %u %g %g %g %g %g\n", m.query, m.reference, m.distance,
+        query_frames[4 * m.query], query_frames[4 * m.query + 1],
+        reference_frames[4 * m.reference], reference_frames[4 * m.reference + 1]);
+  }
+
+  if(out != stdout)
+    fclose(out);
+
+  return 0;
+}
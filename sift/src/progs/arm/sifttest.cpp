@@ -13,6 +13,7 @@
 #include "../../lib/arm/generic-driver.h"
 
 #include "../../lib/arm/sift.h"
+#include "../../lib/arm/Dsp.h"
 #include "../../lib/arm/logger.h"
 
 
@@ -77,7 +78,21 @@ int main(int argc, char** argv)
 
   try
   {
+    /* allocate and map everything before the measured run */
+    sift.WarmUp(sift.GetImageWidth(), sift.GetImageHeight());
+
+    DmmStats before = dmmManager.GetStats();
     sift.Detect();
+    DmmStats after = dmmManager.GetStats();
+
+    /* after WarmUp the run must not map or take buffers from the pool */
+    unsigned long maps = after.maps - before.maps;
+    unsigned long allocs = (after.pool_hits + after.pool_misses) - (before.pool_hits + before.pool_misses);
+
+    if(maps || allocs)
+      Logger::warn(Logger::SIFTTEST, "Detect after WarmUp: %lu maps, %lu DSP buffer allocations", maps, allocs);
+    else
+      Logger::info(Logger::SIFTTEST, "Detect after WarmUp: no maps, no DSP buffer allocations");
   }
   catch(SiftException &ex)
   {
@@ -26,6 +26,13 @@
 //#include "../../../vl/imopv.h"
 #include "../../../vl/sift_dsp.h"
 
+/* message arguments are 32 bit DSP addresses; through uintptr_t, so the
+ * emulator (which compiles this file) can run on 64 bit hosts */
+#define DSP_PTR(type, x) ((type*) (uintptr_t) (x))
+
+static void convolve(imconvol_vf_params * params);
+static void build_octave(octave_params * params);
+
 
 unsigned int dsp_sift_create(void)
 {
@@ -47,35 +54,53 @@ unsigned int dsp_sift_execute(void *env)
 		NODE_getMsg(env, &msg, (unsigned) -1);
 
 		switch (msg.cmd) {
-		case 1:
+		case VL_DSP_CMD_IMCONVCOL:
 			{
-			  imconvol_vf_params * params = (imconvol_vf_params*) msg.arg_1;
+			  imconvol_vf_params * params = DSP_PTR(imconvol_vf_params, msg.arg_1);
 
+			  BCACHE_inv((void*) params, sizeof(*params), 1);
 
-			  BCACHE_inv((void*) params, sizeof(params), 1);
-			  BCACHE_inv((void*) params->src, params->src_size, 1);
-			  BCACHE_inv((void*) params->dst, params->dst_size, 1);
-			  BCACHE_inv((void*) params->filt, params->filt_size, 1);
+			  convolve(params);
 
-			  vl_imconvcol_vf (params->dst, params->dst_stride,
-			      params->src, params->src_width, params->src_height, params->src_stride,
-			      params->filt,
-			      params->filt_begin, params->filt_end,
-			      params->step, params->flags);
+        msg.cmd = VL_DSP_CMD_DONE;  /* arg_1 and arg_2 are echoed */
 
+				NODE_putMsg(env, NULL, &msg, 0);
+				break;
+			}
+		case VL_DSP_CMD_OCTAVE:
+			{
+			  octave_params * params = DSP_PTR(octave_params, msg.arg_1);
 
-			  BCACHE_wbInv((void*) params, sizeof(params), 1);
-			  BCACHE_wbInv((void*) params->src, params->src_size, 1);
-			  BCACHE_wbInv((void*) params->dst, params->dst_size, 1);
-			  BCACHE_wbInv((void*) params->filt, params->filt_size, 1);
+			  BCACHE_inv((void*) params, sizeof(*params), 1);
 
+			  build_octave(params);
 
-        msg.cmd = 2;
+			  msg.cmd = VL_DSP_CMD_DONE;
 
-				NODE_putMsg(env, NULL, &msg, 0);
-				break;
+			  NODE_putMsg(env, NULL, &msg, 0);
+			  break;
+			}
+		case VL_DSP_CMD_BATCH:
+			{
+			  dsp_ring_entry * entries = DSP_PTR(dsp_ring_entry, msg.arg_1);
+			  unsigned k;
+
+			  BCACHE_inv((void*) entries, msg.arg_2 * sizeof(*entries), 1);
+
+			  for (k = 0; k < msg.arg_2; ++k)
+			  {
+			    if (entries[k].job.cmd == VL_DSP_CMD_IMCONVCOL)
+			      convolve(&entries[k].job.conv);
+			  }
+
+			  /* one answer for the whole batch */
+			  msg.cmd = VL_DSP_CMD_DONE;
+			  msg.arg_2 = msg.arg_2 ? entries[msg.arg_2 - 1].job.token : 0;
+
+			  NODE_putMsg(env, NULL, &msg, 0);
+			  break;
 			}
-		case 0x80000000:
+		case VL_DSP_CMD_EXIT:
 			done = 1;
 			break;
 		}
@@ -84,6 +109,84 @@ unsigned int dsp_sift_execute(void *env)
 	return 0x8000;
 }
 
+/* runs one convolution, params are already in the cache */
+static void convolve(imconvol_vf_params * params)
+{
+  /* inputs only, dst is completely overwritten */
+  BCACHE_inv((void*) params->src, params->src_size, 1);
+  BCACHE_inv((void*) params->filt, params->filt_size, 1);
+
+  vl_imconvcol_vf (params->dst, params->dst_stride,
+      params->src, params->src_width, params->src_height, params->src_stride,
+      params->filt,
+      params->filt_begin, params->filt_end,
+      params->step, params->flags);
+
+  /* the inputs were only read, nothing to write back */
+  BCACHE_wbInv((void*) params->dst, params->dst_size, 1);
+}
+
+/* out = in smoothed with filt, in place if out == in */
+static void smooth(float* out, float* temp, float const* in,
+    int width, int height, float const* filt, int filt_width)
+{
+  vl_imconvcol_vf(temp, height, in, width, height, width,
+      filt, -filt_width, filt_width, 1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE);
+
+  vl_imconvcol_vf(out, width, temp, height, width, height,
+      filt, -filt_width, filt_width, 1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE);
+}
+
+/*
+ * builds the octave described by params. The levels stay in the cache
+ * from one smoothing to the next, the octave and the DoG are written
+ * back once at the end.
+ */
+static void build_octave(octave_params * params)
+{
+  int level_size = params->width * params->height;
+  float* level = params->octave;
+  float* dog = params->dog;
+  int k, i;
+
+  /* level 0 and the filters come from the ARM */
+  BCACHE_inv((void*) params->octave, level_size * sizeof(float), 1);
+
+  for (k = 0; k < params->nlevels; ++k)
+  {
+    if (params->filt[k])
+      BCACHE_inv((void*) params->filt[k], (2 * params->filt_width[k] + 1) * sizeof(float), 1);
+  }
+
+  if (params->smooth_first)
+  {
+    smooth(level, params->temp, level, params->width, params->height,
+        params->filt[0], params->filt_width[0]);
+  }
+
+  for (k = 1; k < params->nlevels; ++k)
+  {
+    level += level_size;
+
+    smooth(level, params->temp, level - level_size, params->width, params->height,
+        params->filt[k], params->filt_width[k]);
+
+    for (i = 0; i < level_size; ++i)
+      dog[i] = level[i] - level[i - level_size];
+
+    dog += level_size;
+  }
+
+  /* level 0 only changed if it was smoothed, temp is scratch and is dropped */
+  if (params->smooth_first)
+    BCACHE_wbInv((void*) params->octave, params->nlevels * level_size * sizeof(float), 1);
+  else
+    BCACHE_wbInv((void*) (params->octave + level_size), (params->nlevels - 1) * level_size * sizeof(float), 1);
+
+  BCACHE_wbInv((void*) params->dog, (params->nlevels - 1) * level_size * sizeof(float), 1);
+  BCACHE_inv((void*) params->temp, level_size * sizeof(float), 1);
+}
+
 void vl_imconvcol_vf(float* dst, int dst_stride,
     float const* src,
     int src_width, int src_height, int src_stride,
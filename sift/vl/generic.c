@@ -321,6 +321,7 @@ GNU GPLv2, or (at your option) any later version.
 **/
 
 #include "generic.h"
+#include "threads.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -654,6 +655,48 @@ vl_set_dsp_mem_func (void *(*dsp_get_mapped_addr) (void* ptr),
   vl_unlock_state () ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set range cache maintenance functions for DSP
+ ** @param dsp_dmm_range_begin pointer to @c dsp_dmm_range_begin.
+ ** @param dsp_dmm_range_end   pointer to @c dsp_dmm_range_end.
+ **
+ ** Optional, see ::vl_dsp_dmm_range_begin. Pass @c NULL to go back to
+ ** whole buffer maintenance.
+ **/
+VL_EXPORT void
+vl_set_dsp_range_func (int (*dsp_dmm_range_begin) (void* ptr, size_t size, int dir),
+                       int (*dsp_dmm_range_end)   (void* ptr, size_t size, int dir))
+{
+  VlState * state ;
+  vl_lock_state () ;
+  state = vl_get_state() ;
+
+  state->dsp_dmm_range_begin = dsp_dmm_range_begin;
+  state->dsp_dmm_range_end = dsp_dmm_range_end;
+
+  vl_unlock_state () ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the wall clock
+ ** @param real_time_func function returning the time in seconds.
+ **
+ ** Used by code that balances work between the ARM and the DSP
+ ** (::vl_get_real_time); ::vl_get_cpu_time cannot measure time spent
+ ** waiting for the DSP. Pass @c NULL to remove it.
+ **/
+VL_EXPORT void
+vl_set_real_time_func (double (*real_time_func) (void))
+{
+  VlState * state ;
+  vl_lock_state () ;
+  state = vl_get_state() ;
+
+  state->real_time_func = real_time_func ;
+
+  vl_unlock_state () ;
+}
+
 
 
 VL_EXPORT void
@@ -888,6 +931,8 @@ vl_destructor ()
 
   state = vl_get_state() ;
 
+  _vl_parallel_pool_delete () ;
+
 #if ! defined(VL_DISABLE_THREADS)
 #if   defined(VL_THREADS_POSIX)
   {
@@ -165,10 +165,14 @@ typedef struct _VlState
   void *(*dsp_get_mapped_addr) (void* ptr);
   int (*dsp_dmm_buffer_begin) (void* ptr);
   int (*dsp_dmm_buffer_end)  (void* ptr);
+  int (*dsp_dmm_range_begin) (void* ptr, size_t size, int dir);
+  int (*dsp_dmm_range_end)   (void* ptr, size_t size, int dir);
 
   dsp_msg_t (*dsp_get_message)();
   int (*dsp_send_message)(uint32_t cmd, uint32_t arg1, uint32_t arg2);
 
+  double (*real_time_func) (void) ;
+
 #if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
   VlX86CpuInfo cpuInfo ;
 #endif
@@ -195,6 +199,8 @@ VL_INLINE vl_bool vl_get_simd_enabled () ;
 VL_INLINE vl_bool vl_cpu_has_sse3 () ;
 VL_INLINE vl_bool vl_cpu_has_sse2 () ;
 VL_INLINE int vl_get_num_cpus () ;
+VL_INLINE void vl_set_num_threads (vl_size n) ;
+VL_INLINE vl_size vl_get_max_threads () ;
 VL_EXPORT VlRand * vl_get_rand () ;
 
 /** @} */
@@ -234,6 +240,21 @@ vl_set_dsp_mem_func (void *(*dsp_get_mapped_addr) (void* ptr),
                     dsp_msg_t (*dsp_get_message)(),
                     int (*dsp_send_message)(uint32_t cmd, uint32_t arg1, uint32_t arg2));
 
+/** @name DSP cache maintenance directions
+ ** Same values as the @c dma_data_direction of the DSP bridge.
+ ** @{ */
+#define VL_DSP_BIDIRECTIONAL 0 /**< read and written by the DSP */
+#define VL_DSP_TO_DEVICE     1 /**< only read by the DSP */
+#define VL_DSP_FROM_DEVICE   2 /**< only written by the DSP */
+/** @} */
+
+VL_EXPORT void
+vl_set_dsp_range_func (int (*dsp_dmm_range_begin) (void* ptr, size_t size, int dir),
+                       int (*dsp_dmm_range_end)   (void* ptr, size_t size, int dir)) ;
+
+VL_EXPORT void
+vl_set_real_time_func (double (*real_time_func) (void)) ;
+
 VL_INLINE void *vl_malloc  (size_t n) ;
 VL_INLINE void *vl_realloc (void *ptr, size_t n) ;
 VL_INLINE void *vl_calloc  (size_t n, size_t size) ;
@@ -389,6 +410,36 @@ vl_get_num_cpus ()
   return vl_get_state()->numCPUs ;
 }
 
+/** @brief Set the maximum number of computational threads
+ ** @param n maximum number of threads (0 to use one per CPU).
+ **
+ ** This setting is used by the functions that split their work
+ ** with ::vl_parallel_for. The default is one thread, so that the
+ ** library does not start threads unless the application asks for
+ ** them. It is not thread safe, see
+ ** @ref design-threads.
+ **/
+
+VL_INLINE void
+vl_set_num_threads (vl_size n)
+{
+  vl_get_state()->maxNumThreads = (n == 0) ? vl_get_num_cpus() : (int)n ;
+}
+
+/** @brief Get the maximum number of computational threads
+ ** @return maximum number of threads.
+ **/
+
+VL_INLINE vl_size
+vl_get_max_threads ()
+{
+#if defined(VL_DISABLE_THREADS)
+  return 1 ;
+#else
+  return VL_MAX(vl_get_state()->maxNumThreads, 1) ;
+#endif
+}
+
 VL_INLINE int
 vl_get_last_error () {
   return vl_get_thread_specific_state()->lastError ;
@@ -443,6 +494,45 @@ vl_dsp_dmm_buffer_end (void *ptr)
 }
 
 
+/** @brief Prepare a memory range for the DSP
+ ** @param ptr  first byte of the range.
+ ** @param size size of the range in bytes.
+ ** @param dir  ::VL_DSP_TO_DEVICE, ::VL_DSP_FROM_DEVICE or ::VL_DSP_BIDIRECTIONAL.
+ **
+ ** Ranges the DSP reads are written back from the ARM cache, ranges
+ ** it only writes are just invalidated. Without range functions (see
+ ** ::vl_set_dsp_range_func) the whole buffer containing @a ptr is
+ ** flushed (::vl_dsp_dmm_buffer_begin).
+ **/
+
+VL_INLINE int
+vl_dsp_dmm_range_begin (void *ptr, vl_size size, int dir)
+{
+  if (vl_get_state()->dsp_dmm_range_begin)
+    return (vl_get_state()->dsp_dmm_range_begin)(ptr, (size_t) size, dir);
+  return vl_dsp_dmm_buffer_begin (ptr) ;
+}
+
+/** @brief Get a memory range back from the DSP
+ ** @param ptr  first byte of the range.
+ ** @param size size of the range in bytes.
+ ** @param dir  ::VL_DSP_TO_DEVICE, ::VL_DSP_FROM_DEVICE or ::VL_DSP_BIDIRECTIONAL.
+ **
+ ** Invalidates the ARM cache for ranges the DSP has written and does
+ ** nothing for ::VL_DSP_TO_DEVICE ranges. Without range functions the
+ ** whole buffer is invalidated (::vl_dsp_dmm_buffer_end).
+ **/
+
+VL_INLINE int
+vl_dsp_dmm_range_end (void *ptr, vl_size size, int dir)
+{
+  if (vl_get_state()->dsp_dmm_range_end)
+    return (vl_get_state()->dsp_dmm_range_end)(ptr, (size_t) size, dir);
+  if (dir == VL_DSP_TO_DEVICE)
+    return 0 ;
+  return vl_dsp_dmm_buffer_end (ptr) ;
+}
+
 VL_INLINE int vl_dsp_send_message(uint32_t cmd, uint32_t arg1, uint32_t arg2)
 {
   return (vl_get_state()->dsp_send_message(cmd, arg1, arg2));
@@ -453,6 +543,28 @@ VL_INLINE dsp_msg_t vl_dsp_get_message()
   return (vl_get_state()->dsp_get_message());
 }
 
+/** @brief Get the wall clock time
+ ** @return time in seconds from the function installed by
+ ** ::vl_set_real_time_func, or 0 if there is none.
+ **/
+
+VL_INLINE double vl_get_real_time ()
+{
+  VlState * state = vl_get_state () ;
+  return state->real_time_func ? (state->real_time_func)() : 0 ;
+}
+
+/** @brief Check whether a DSP is attached
+ ** @return true if ::vl_set_dsp_mem_func has installed the DSP
+ ** functions, in which case the convolutions of the SIFT scale space
+ ** are offloaded to the DSP.
+ **/
+
+VL_INLINE vl_bool vl_dsp_is_available()
+{
+  return vl_get_state()->dsp_send_message != NULL ;
+}
+
 
 /* VL_GENERIC_H */
 #endif
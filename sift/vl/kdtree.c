@@ -14,8 +14,19 @@ GNU GPLv2, or (at your option) any later version.
 #include "generic.h"
 #include "random.h"
 #include "mathop.h"
+#include "threads.h"
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(VL_OS_LINUX) || defined(VL_OS_MACOSX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define VL_KDFOREST_MMAP
+#endif
 
 /** @file kdtree.h
  **
@@ -45,6 +56,26 @@ GNU GPLv2, or (at your option) any later version.
  ** query and calculate approximate nearest neighbors use
  ** ::vl_kdforest_set_max_num_comparisons.
  **
+ ** The search buffers of a query live in a ::VlKDForestSearcher
+ ** object. ::vl_kdforest_query uses one owned by the forest and is
+ ** therefore not reentrant; to query the same forest from several
+ ** threads give each thread its own searcher
+ ** (::vl_kdforest_new_searcher, ::vl_kdforestsearcher_query). To
+ ** query many points at once use ::vl_kdforest_query_with_array,
+ ** which splits the queries over ::vl_get_max_threads threads with
+ ** ::vl_parallel_for and keeps one searcher per thread for the next
+ ** call.
+ **
+ ** A built forest can be saved with ::vl_kdforest_save and loaded
+ ** back with ::vl_kdforest_load, see @ref kdtree-file.
+ **
+ ** The data can be ::VL_TYPE_FLOAT, ::VL_TYPE_DOUBLE or
+ ** ::VL_TYPE_UINT8. The latter suits quantized descriptors such as
+ ** SIFT (one byte per component): the data and the queries take a
+ ** quarter of the memory of floats and the distances are computed
+ ** exactly with integer arithmetic
+ ** (::vl_get_vector_comparison_function_ui8).
+ **
  ** @section kdtree-tech Technical details
  ** @sa @ref kdtree-references
  **
@@ -73,6 +104,23 @@ GNU GPLv2, or (at your option) any later version.
  ** any point in the partition and the query point. Such a lower bound
  ** is trivial to compute because partitions are hyper-rectangles.
  **
+ ** @section kdtree-file File format
+ **
+ ** ::vl_kdforest_save writes a header (::VlKDForestFileHeader), a
+ ** table with one ::VlKDForestFileTree per tree and then, each
+ ** aligned to ::VL_KDFOREST_FILE_ALIGN bytes, the used nodes and the
+ ** data index of every tree and optionally the data. The nodes are
+ ** stored as they are in memory, with the bounds the queries use, and
+ ** the data index as one 32 bit integer per data point (the build
+ ** only values are not kept), so ::vl_kdforest_load maps the file
+ ** (@c mmap) and uses the arrays in place: processes loading the same
+ ** file share one copy of it in the page cache. The header records
+ ** the byte order and the size of the structures, and a file written
+ ** by a machine with a different layout is rejected. Loading checks
+ ** the header and the array layout in constant time; checking the
+ ** trees themselves, which catches corrupted nodes and indices, takes
+ ** linear time and can be skipped for trusted files.
+ **
  ** @section kdtree-references References
  **
  ** [1] J. S. Beis and D. G. Lowe. Shape indexing using approximate
@@ -107,7 +155,7 @@ GNU GPLv2, or (at your option) any later version.
  **/
 
 static vl_uindex
-vl_kdtree_node_new (VlKDTree * tree, vl_uindex parentIndex)
+vl_kdtree_node_new (VlKDTree * tree)
 {
   VlKDTreeNode * node = NULL ;
   vl_uindex nodeIndex = tree->numUsedNodes ;
@@ -116,7 +164,6 @@ vl_kdtree_node_new (VlKDTree * tree, vl_uindex parentIndex)
   assert (tree->numUsedNodes <= tree->numAllocatedNodes) ;
 
   node = tree->nodes + nodeIndex ;
-  node -> parent = parentIndex ;
   node -> lowerChild = 0 ;
   node -> upperChild = 0 ;
   node -> splitDimension = 0 ;
@@ -126,26 +173,98 @@ vl_kdtree_node_new (VlKDTree * tree, vl_uindex parentIndex)
 
 /** ------------------------------------------------------------------
  ** @internal
- ** @brief Compare KDTree index entries for sorting
+ ** @brief Move the k-th smallest index entry to position k
+ ** @param array index entries.
+ ** @param begin first entry of the range.
+ ** @param end one past the last entry of the range.
+ ** @param k position to fill, in [begin, end).
+ **
+ ** Quickselect with a median of three pivot: afterwards the entries
+ ** before @a k are not larger and the entries after @a k are not
+ ** smaller than the one at @a k, in linear expected time.
+ **/
+
+static void
+vl_kdtree_select (VlKDTreeDataIndexEntry * array,
+                  vl_uindex begin, vl_uindex end, vl_uindex k)
+{
+  vl_index lo = begin ;
+  vl_index hi = end - 1 ;
+
+  while (lo < hi) {
+    double a = array[lo].value ;
+    double b = array[(lo + hi) / 2].value ;
+    double c = array[hi].value ;
+    double pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a))
+                           : ((a < c) ? a : ((b < c) ? c : b)) ;
+    vl_index i = lo ;
+    vl_index j = hi ;
+
+    while (i <= j) {
+      while (array[i].value < pivot) ++ i ;
+      while (array[j].value > pivot) -- j ;
+      if (i <= j) {
+        VlKDTreeDataIndexEntry t = array[i] ;
+        array[i] = array[j] ;
+        array[j] = t ;
+        ++ i ;
+        -- j ;
+      }
+    }
+
+    /* [lo, j] <= pivot, (j, i) == pivot, [i, hi] >= pivot */
+    if ((vl_index) k <= j) hi = j ;
+    else if ((vl_index) k >= i) lo = i ;
+    else break ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Partition index entries by a threshold
+ ** @param array index entries.
+ ** @param begin first entry of the range.
+ ** @param end one past the last entry of the range.
+ ** @param threshold threshold.
+ ** @return first entry with value larger than @a threshold.
  **/
 
-VL_INLINE int
-vl_kdtree_compare_index_entries (void const * a,
-                                 void const * b)
+static vl_uindex
+vl_kdtree_partition (VlKDTreeDataIndexEntry * array,
+                     vl_uindex begin, vl_uindex end, double threshold)
 {
-  double delta =
-   ((VlKDTreeDataIndexEntry const*)a) -> value -
-   ((VlKDTreeDataIndexEntry const*)b) -> value ;
-  if (delta < 0) return -1 ;
-  if (delta > 0) return +1 ;
-  return 0 ;
+  vl_index i = begin ;
+  vl_index j = end - 1 ;
+
+  while (i <= j) {
+    if (array[i].value <= threshold) {
+      ++ i ;
+    } else {
+      VlKDTreeDataIndexEntry t = array[i] ;
+      array[i] = array[j] ;
+      array[j] = t ;
+      -- j ;
+    }
+  }
+  return i ;
 }
 
+/** @internal @brief State of the construction of one tree */
+typedef struct _VlKDTreeBuilder
+{
+  VlKDForest * forest ;
+  VlKDTree * tree ;
+  VlRand rand ;
+  VlKDTreeSplitDimension splitHeapArray [VL_KDTREE_SPLIT_HEALP_SIZE] ;
+  vl_size splitHeapNumNodes ;
+  double * moments ;   /* sum and sum of squares per dimension */
+  VlKDTreeDataIndexEntry * dataIndex ;   /* data points and split values */
+} VlKDTreeBuilder ;
+
 /** ------------------------------------------------------------------
  ** @internal
  ** @brief Build KDTree recursively
- ** @param forest forest to which the tree belongs.
- ** @param tree tree being built.
+ ** @param builder construction state of the tree.
  ** @param nodeIndex node to process.
  ** @param dataBegin begin of data for this node.
  ** @param dataEnd end of data for this node.
@@ -154,14 +273,17 @@ vl_kdtree_compare_index_entries (void const * a,
 
 static void
 vl_kdtree_build_recursively
-(VlKDForest * forest,
- VlKDTree * tree, vl_uindex nodeIndex,
+(VlKDTreeBuilder * builder, vl_uindex nodeIndex,
  vl_uindex dataBegin, vl_uindex dataEnd,
  unsigned int depth)
 {
+  VlKDForest * forest = builder->forest ;
+  VlKDTree * tree = builder->tree ;
   vl_uindex d, i, medianIndex, splitIndex ;
   VlKDTreeNode * node = tree->nodes + nodeIndex ;
   VlKDTreeSplitDimension * splitDimension ;
+  double * sum = builder->moments ;
+  double * sumSquares = builder->moments + forest->dimension ;
 
   /* base case: there is only one data point */
   if (dataEnd - dataBegin <= 1) {
@@ -171,52 +293,72 @@ vl_kdtree_build_recursively
     return ;
   }
 
-  /* compute the dimension with largest variance */
-  forest->splitHeapNumNodes = 0 ;
+  /* accumulate the moments of all dimensions, one data point at a time */
   for (d = 0 ; d < forest->dimension ; ++ d) {
-    double mean = 0 ; /* unnormalized */
-    double secondMoment = 0 ;
-    double variance = 0 ;
-    for (i = dataBegin ; i < dataEnd ; ++ i) {
-      int di = tree -> dataIndex [i] .index ;
-      double datum ;
-      switch(forest->dataType) {
-        case VL_TYPE_FLOAT: datum = ((float const*)forest->data)
-          [di * forest->dimension + d] ; break ;
-        case VL_TYPE_DOUBLE: datum = ((double const*)forest->data)
-          [di * forest->dimension + d] ; break ;
-        default:
-          abort() ;
+    sum [d] = 0 ;
+    sumSquares [d] = 0 ;
+  }
+  for (i = dataBegin ; i < dataEnd ; ++ i) {
+    vl_uindex di = builder -> dataIndex [i] .index ;
+    switch(forest->dataType) {
+      case VL_TYPE_FLOAT: {
+        float const * datum = (float const*)forest->data + di * forest->dimension ;
+        for (d = 0 ; d < forest->dimension ; ++ d) {
+          sum [d] += datum [d] ;
+          sumSquares [d] += (double) datum [d] * datum [d] ;
+        }
+        break ;
+      }
+      case VL_TYPE_DOUBLE: {
+        double const * datum = (double const*)forest->data + di * forest->dimension ;
+        for (d = 0 ; d < forest->dimension ; ++ d) {
+          sum [d] += datum [d] ;
+          sumSquares [d] += datum [d] * datum [d] ;
+        }
+        break ;
       }
-      mean += datum ;
-      secondMoment += datum * datum ;
+      case VL_TYPE_UINT8: {
+        vl_uint8 const * datum = (vl_uint8 const*)forest->data + di * forest->dimension ;
+        for (d = 0 ; d < forest->dimension ; ++ d) {
+          sum [d] += datum [d] ;
+          sumSquares [d] += (double) (datum [d] * datum [d]) ;
+        }
+        break ;
+      }
+      default:
+        abort() ;
     }
-    mean /= (dataEnd - dataBegin) ;
-    secondMoment /= (dataEnd - dataBegin) ;
-    variance = secondMoment - mean * mean ;
+  }
+
+  /* compute the dimension with largest variance */
+  builder->splitHeapNumNodes = 0 ;
+  for (d = 0 ; d < forest->dimension ; ++ d) {
+    double mean = sum [d] / (dataEnd - dataBegin) ;
+    double secondMoment = sumSquares [d] / (dataEnd - dataBegin) ;
+    double variance = secondMoment - mean * mean ;
 
     /* keep splitHeapSize most varying dimensions */
-    if (forest->splitHeapNumNodes < forest->splitHeapSize) {
+    if (builder->splitHeapNumNodes < forest->splitHeapSize) {
       VlKDTreeSplitDimension * splitDimension
-        = forest->splitHeapArray + forest->splitHeapNumNodes ;
+        = builder->splitHeapArray + builder->splitHeapNumNodes ;
       splitDimension->dimension = d ;
       splitDimension->mean = mean ;
       splitDimension->variance = variance ;
-      vl_kdtree_split_heap_push (forest->splitHeapArray, &forest->splitHeapNumNodes) ;
+      vl_kdtree_split_heap_push (builder->splitHeapArray, &builder->splitHeapNumNodes) ;
     } else {
-      VlKDTreeSplitDimension * splitDimension = forest->splitHeapArray + 0 ;
+      VlKDTreeSplitDimension * splitDimension = builder->splitHeapArray + 0 ;
       if (splitDimension->variance < variance) {
         splitDimension->dimension = d ;
         splitDimension->mean = mean ;
         splitDimension->variance = variance ;
-        vl_kdtree_split_heap_update (forest->splitHeapArray, forest->splitHeapNumNodes, 0) ;
+        vl_kdtree_split_heap_update (builder->splitHeapArray, builder->splitHeapNumNodes, 0) ;
       }
     }
   }
 
   /* toss a dice to decide the splitting dimension */
-  splitDimension = forest->splitHeapArray
-  + (vl_rand_uint32(forest->rand) % VL_MIN(forest->splitHeapSize, forest->splitHeapNumNodes)) ;
+  splitDimension = builder->splitHeapArray
+  + (vl_rand_uint32(&builder->rand) % VL_MIN(forest->splitHeapSize, builder->splitHeapNumNodes)) ;
 
   /* additional base case: variance is equal to 0 (overlapping points) */
   if (splitDimension->variance == 0) {
@@ -226,9 +368,9 @@ vl_kdtree_build_recursively
   }
   node->splitDimension = splitDimension->dimension ;
 
-  /* sort data along largest variance dimension */
+  /* get the data along the split dimension */
   for (i = dataBegin ; i < dataEnd ; ++ i) {
-    int di = tree->dataIndex [i] .index ;
+    vl_uindex di = builder->dataIndex [i] .index ;
     double datum ;
     switch (forest->dataType) {
       case VL_TYPE_FLOAT: datum = ((float const*)forest->data)
@@ -237,36 +379,38 @@ vl_kdtree_build_recursively
       case VL_TYPE_DOUBLE: datum = ((double const*)forest->data)
         [di * forest->dimension + splitDimension->dimension] ;
         break ;
+      case VL_TYPE_UINT8: datum = ((vl_uint8 const*)forest->data)
+        [di * forest->dimension + splitDimension->dimension] ;
+        break ;
       default:
         abort() ;
     }
-    tree->dataIndex [i] .value = datum ;
+    builder->dataIndex [i] .value = datum ;
   }
-  qsort (tree->dataIndex + dataBegin,
-         dataEnd - dataBegin,
-         sizeof (VlKDTreeDataIndexEntry),
-         vl_kdtree_compare_index_entries) ;
 
-  /* determine split threshold */
+  /* determine split threshold and partition the data (no full sort) */
   switch (forest->thresholdingMethod) {
     case VL_KDTREE_MEAN :
       node->splitThreshold = splitDimension->mean ;
-      for (splitIndex = dataBegin ;
-           splitIndex < dataEnd && tree->dataIndex[splitIndex].value <= node->splitThreshold ;
-           ++ splitIndex) ;
-      splitIndex -= 1 ;
+      splitIndex = vl_kdtree_partition (builder->dataIndex, dataBegin, dataEnd,
+                                        node->splitThreshold) ;
       /* If the mean does not provide a proper partition, fall back to
        * median. This usually happens if all points have the same
        * value and the zero variance test fails for numerical accuracy
        * reasons. In this case, also due to numerical accuracy, the
        * mean value can be smaller, equal, or larger than all
        * points. */
-      if (dataBegin <= splitIndex && splitIndex + 1 < dataEnd) break ;
+      if (dataBegin < splitIndex && splitIndex < dataEnd) {
+        splitIndex -= 1 ;
+        break ;
+      }
+      /* fall through */
 
     case VL_KDTREE_MEDIAN :
       medianIndex = (dataBegin + dataEnd - 1) / 2 ;
+      vl_kdtree_select (builder->dataIndex, dataBegin, dataEnd, medianIndex) ;
       splitIndex = medianIndex ;
-      node -> splitThreshold = tree->dataIndex[medianIndex].value ;
+      node -> splitThreshold = builder->dataIndex[medianIndex].value ;
       break ;
 
     default:
@@ -274,16 +418,80 @@ vl_kdtree_build_recursively
   }
 
   /* divide subparts */
-  node->lowerChild = vl_kdtree_node_new (tree, nodeIndex) ;
-  vl_kdtree_build_recursively (forest, tree, node->lowerChild, dataBegin, splitIndex + 1, depth + 1) ;
+  node->lowerChild = vl_kdtree_node_new (tree) ;
+  vl_kdtree_build_recursively (builder, node->lowerChild, dataBegin, splitIndex + 1, depth + 1) ;
+
+  node->upperChild = vl_kdtree_node_new (tree) ;
+  vl_kdtree_build_recursively (builder, node->upperChild, splitIndex + 1, dataEnd, depth + 1) ;
+}
+
+/** @internal @brief Magic number of a KDForest file */
+#define VL_KDFOREST_FILE_MAGIC "VLKDF02"
+
+/** @internal @brief Alignment of the arrays in a KDForest file */
+#define VL_KDFOREST_FILE_ALIGN 16
+
+/** @internal @brief Header of a KDForest file (all fields 64 bit) */
+typedef struct _VlKDForestFileHeader
+{
+  char magic [8] ;
+  vl_uint64 byteOrder ;          /**< 0x0102030405060708 as written */
+  vl_uint64 nodeSize ;           /**< sizeof(::VlKDTreeNode) */
+  vl_uint64 entrySize ;          /**< size of a data index entry (4) */
+  vl_uint64 dataType ;
+  vl_uint64 thresholdingMethod ;
+  vl_uint64 dimension ;
+  vl_uint64 numData ;
+  vl_uint64 numTrees ;
+  vl_uint64 dataOffset ;         /**< 0 if the data is not stored */
+  vl_uint64 fileSize ;
+} VlKDForestFileHeader ;
+
+/** @internal @brief Tree table entry of a KDForest file */
+typedef struct _VlKDForestFileTree
+{
+  vl_uint64 numUsedNodes ;
+  vl_uint64 depth ;
+  vl_uint64 nodesOffset ;
+  vl_uint64 dataIndexOffset ;
+} VlKDForestFileTree ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Size of a data element of a forest
+ **/
 
-  node->upperChild = vl_kdtree_node_new (tree, nodeIndex) ;
-  vl_kdtree_build_recursively (forest, tree, node->upperChild, splitIndex + 1, dataEnd, depth + 1) ;
+static vl_size
+vl_kdforest_data_size (vl_type dataType)
+{
+  switch (dataType) {
+    case VL_TYPE_FLOAT: return sizeof(float) ;
+    case VL_TYPE_DOUBLE: return sizeof(double) ;
+    case VL_TYPE_UINT8: return sizeof(vl_uint8) ;
+    default: return 0 ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Release the file mapping of a loaded forest
+ **/
+
+static void
+vl_kdforest_unmap (void * mapping, vl_size size)
+{
+#if defined(VL_KDFOREST_MMAP)
+  munmap (mapping, size) ;
+#else
+  (void) size ;
+  vl_free (mapping) ;
+#endif
 }
 
 /** ------------------------------------------------------------------
  ** @brief Create new KDForest object
- ** @param dataType type of data (::VL_TYPE_FLOAT or VL_TYPE_DOUBLE)
+ ** @param dataType type of data (::VL_TYPE_FLOAT, ::VL_TYPE_DOUBLE or
+ **   ::VL_TYPE_UINT8)
  ** @param dimension data dimensionality.
  ** @param numTrees number of trees in the forest.
  ** @return new KDForest.
@@ -295,7 +503,8 @@ vl_kdforest_new (vl_type dataType,
 {
   VlKDForest * self = vl_malloc (sizeof(VlKDForest)) ;
 
-  assert(dataType == VL_TYPE_FLOAT || dataType == VL_TYPE_DOUBLE) ;
+  assert(dataType == VL_TYPE_FLOAT || dataType == VL_TYPE_DOUBLE ||
+         dataType == VL_TYPE_UINT8) ;
   assert(dimension >= 1) ;
   assert(numTrees >= 1) ;
 
@@ -308,14 +517,13 @@ vl_kdforest_new (vl_type dataType,
   self -> trees = 0 ;
   self -> thresholdingMethod = VL_KDTREE_MEDIAN ;
   self -> splitHeapSize = (numTrees == 1) ? 1 : VL_KDTREE_SPLIT_HEALP_SIZE ;
-  self -> splitHeapNumNodes = 0 ;
-
-  self -> searchHeapArray = 0 ;
-  self -> searchHeapNumNodes = 0 ;
 
+  self -> searchBoundsComputed = VL_FALSE ;
+  self -> searchers = 0 ;
+  self -> numSearchers = 0 ;
   self -> searchMaxNumComparisons = 0 ;
-  self -> searchIdBook = 0 ;
-  self -> searchId = 0 ;
+  self -> mapping = 0 ;
+  self -> mappingSize = 0 ;
 
   switch (self->dataType) {
     case VL_TYPE_FLOAT:
@@ -326,6 +534,10 @@ vl_kdforest_new (vl_type dataType,
       self -> distanceFunction = (void(*)(void))
       vl_get_vector_comparison_function_d (VlDistanceL2) ;
       break ;
+    case VL_TYPE_UINT8 :
+      self -> distanceFunction = (void(*)(void))
+      vl_get_vector_comparison_function_ui8 (VlDistanceL2) ;
+      break ;
     default :
       abort() ;
   }
@@ -343,19 +555,49 @@ VL_EXPORT void
 vl_kdforest_delete (VlKDForest * self)
 {
   vl_uindex ti ;
-  if (self->searchIdBook) vl_free (self->searchIdBook) ;
+  for (ti = 0 ; ti < self->numSearchers ; ++ ti) {
+    vl_kdforestsearcher_delete (self->searchers[ti]) ;
+  }
+  if (self->searchers) vl_free (self->searchers) ;
   if (self->trees) {
     for (ti = 0 ; ti < self->numTrees ; ++ ti) {
       if (self->trees[ti]) {
-        if (self->trees[ti]->nodes) vl_free (self->trees[ti]->nodes) ;
-        if (self->trees[ti]->dataIndex) vl_free (self->trees[ti]->dataIndex) ;
+        /* the arrays of a loaded forest are part of the mapping */
+        if (! self->mapping) {
+          if (self->trees[ti]->nodes) vl_free (self->trees[ti]->nodes) ;
+          if (self->trees[ti]->dataIndex) vl_free (self->trees[ti]->dataIndex) ;
+        }
+        vl_free (self->trees[ti]) ;
       }
     }
     vl_free (self->trees) ;
   }
+  if (self->mapping) vl_kdforest_unmap (self->mapping, self->mappingSize) ;
   vl_free (self) ;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Build one tree of ::vl_kdforest_build
+ **/
+
+static void
+vl_kdforest_build_task (void * data, vl_uindex taskIndex, vl_uindex threadIndex)
+{
+  VlKDTreeBuilder * builder = (VlKDTreeBuilder *) data + taskIndex ;
+  vl_uindex di ;
+  (void) threadIndex ;
+
+  vl_kdtree_build_recursively (builder,
+                               vl_kdtree_node_new(builder->tree), 0,
+                               builder->forest->numData, 0) ;
+
+  /* the queries need the data points only */
+  for (di = 0 ; di < builder->forest->numData ; ++ di) {
+    builder->tree->dataIndex [di] = (vl_uint32) builder->dataIndex [di] .index ;
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @brief Build KDTree from data
  ** @param self KDTree object
@@ -366,33 +608,62 @@ vl_kdforest_delete (VlKDForest * self)
  ** efficiency, KDTree does not copy the data, but retains a pointer to it.
  ** Therefore the data must survive (and not change) until the KDTree
  ** is deleted.
+ **
+ ** The trees are built in parallel with ::vl_parallel_for. Each tree
+ ** draws its random split dimensions from its own generator, seeded
+ ** from the forest generator in tree order, so the forest does not
+ ** depend on the number of threads. All memory, including the scratch
+ ** space of the builders, is allocated by the calling thread, as the
+ ** allocation functions (::vl_set_alloc_func) need not be thread
+ ** safe.
  **/
 
 VL_EXPORT void
 vl_kdforest_build (VlKDForest * self, vl_size numData, void const * data)
 {
   vl_uindex di, ti ;
+  VlKDTreeBuilder * builders ;
+  double * moments ;
+  VlKDTreeDataIndexEntry * entries ;
+
+  /* the trees index the data with 32 bit integers */
+  assert (numData <= 0xffffffffU) ;
 
   /* need to check: if alredy built, clean first */
   self->data = data ;
   self->numData = numData ;
+  self->searchBoundsComputed = VL_FALSE ;
   self->trees = vl_malloc (sizeof(VlKDTree*) * self->numTrees) ;
+  builders = vl_malloc (sizeof(VlKDTreeBuilder) * self->numTrees) ;
+  moments = vl_malloc (sizeof(double) * 2 * self->dimension * self->numTrees) ;
+  entries = vl_malloc (sizeof(VlKDTreeDataIndexEntry) * self->numData * self->numTrees) ;
 
   for (ti = 0 ; ti < self->numTrees ; ++ ti) {
     self->trees[ti] = vl_malloc (sizeof(VlKDTree)) ;
-    self->trees[ti]->dataIndex = vl_malloc (sizeof(VlKDTreeDataIndexEntry) * self->numData) ;
-    for (di = 0 ; di < self->numData ; ++ di) {
-      self->trees[ti]->dataIndex[di].index = di ;
-    }
+    self->trees[ti]->dataIndex = vl_malloc (sizeof(vl_uint32) * self->numData) ;
     self->trees[ti]->numUsedNodes = 0 ;
     /* num. nodes of a complete binary tree with numData leaves */
     self->trees[ti]->numAllocatedNodes = 2 * self->numData - 1 ;
     self->trees[ti]->nodes = vl_malloc (sizeof(VlKDTreeNode) * self->trees[ti]->numAllocatedNodes) ;
+    /* the nodes are saved as they are, padding included */
+    memset (self->trees[ti]->nodes, 0, sizeof(VlKDTreeNode) * self->trees[ti]->numAllocatedNodes) ;
     self->trees[ti]->depth = 0 ;
-    vl_kdtree_build_recursively (self, self->trees[ti],
-                                 vl_kdtree_node_new(self->trees[ti], 0), 0,
-                                 self->numData, 0) ;
+
+    builders[ti].forest = self ;
+    builders[ti].tree = self->trees[ti] ;
+    builders[ti].moments = moments + 2 * self->dimension * ti ;
+    builders[ti].dataIndex = entries + self->numData * ti ;
+    for (di = 0 ; di < self->numData ; ++ di) {
+      builders[ti].dataIndex[di].index = di ;
+    }
+    vl_rand_seed (&builders[ti].rand, vl_rand_uint32 (self->rand)) ;
   }
+
+  vl_parallel_for (self->numTrees, vl_kdforest_build_task, builders) ;
+
+  vl_free (entries) ;
+  vl_free (moments) ;
+  vl_free (builders) ;
 }
 
 /** ------------------------------------------------------------------
@@ -400,7 +671,7 @@ vl_kdforest_build (VlKDForest * self, vl_size numData, void const * data)
  **/
 
 VL_EXPORT int
-vl_kdforest_query_recursively (VlKDForest  * self,
+vl_kdforest_query_recursively (VlKDForestSearcher * searcher,
                                VlKDTree * tree,
                                vl_uindex nodeIndex,
                                VlKDForestNeighbor * neighbors,
@@ -409,6 +680,7 @@ vl_kdforest_query_recursively (VlKDForest  * self,
                                double dist,
                                void const * query)
 {
+  VlKDForest * self = searcher->forest ;
   VlKDTreeNode const * node = tree->nodes + nodeIndex ;
   vl_uindex i = node->splitDimension ;
   vl_index nextChild, saveChild ;
@@ -419,7 +691,7 @@ vl_kdforest_query_recursively (VlKDForest  * self,
   double x3 = node->upperBound ;
   VlKDForestSearchState * searchState ;
 
-  self->searchNumRecursions ++ ;
+  searcher->searchNumRecursions ++ ;
 
   switch (self->dataType) {
     case VL_TYPE_FLOAT :
@@ -428,6 +700,9 @@ vl_kdforest_query_recursively (VlKDForest  * self,
     case VL_TYPE_DOUBLE :
       x = ((double const*) query)[i] ;
       break ;
+    case VL_TYPE_UINT8 :
+      x = ((vl_uint8 const*) query)[i] ;
+      break ;
     default :
       abort() ;
   }
@@ -441,15 +716,15 @@ vl_kdforest_query_recursively (VlKDForest  * self,
     for (iter = begin ;
          iter < end &&
          (self->searchMaxNumComparisons == 0 ||
-          self->searchNumComparisons < self->searchMaxNumComparisons) ;
+          searcher->searchNumComparisons < self->searchMaxNumComparisons) ;
          ++ iter) {
 
-      vl_index di = tree->dataIndex [iter].index ;
+      vl_index di = tree->dataIndex [iter] ;
 
       /* multiple KDTrees share the database points and we must avoid
        * adding the same point twice */
-      if (self->searchIdBook[di] == self->searchId) continue ;
-      self->searchIdBook[di] = self->searchId ;
+      if (searcher->searchIdBook[di] == searcher->searchId) continue ;
+      searcher->searchIdBook[di] = searcher->searchId ;
 
       /* compare the query to this point */
       switch (self->dataType) {
@@ -465,10 +740,16 @@ vl_kdforest_query_recursively (VlKDForest  * self,
            ((double const *)query),
            ((double const*)self->data) + di * self->dimension) ;
           break ;
+        case VL_TYPE_UINT8:
+          dist = ((VlUInt8VectorComparisonFunction)self->distanceFunction)
+          (self->dimension,
+           ((vl_uint8 const *)query),
+           ((vl_uint8 const*)self->data) + di * self->dimension) ;
+          break ;
         default:
           abort() ;
       }
-      self->searchNumComparisons += 1 ;
+      searcher->searchNumComparisons += 1 ;
 
       /* see if it should be added to the result set */
       if (*numAddedNeighbors < numNeighbors) {
@@ -523,15 +804,15 @@ vl_kdforest_query_recursively (VlKDForest  * self,
   }
 
   if (*numAddedNeighbors < numNeighbors || neighbors[0].distance > saveDist) {
-    searchState = self->searchHeapArray + self->searchHeapNumNodes ;
+    searchState = searcher->searchHeapArray + searcher->searchHeapNumNodes ;
     searchState->tree = tree ;
     searchState->nodeIndex = saveChild ;
     searchState->distanceLowerBound = saveDist ;
-    vl_kdforest_search_heap_push (self->searchHeapArray,
-                                  &self->searchHeapNumNodes) ;
+    vl_kdforest_search_heap_push (searcher->searchHeapArray,
+                                  &searcher->searchHeapNumNodes) ;
   }
 
-  return vl_kdforest_query_recursively (self,
+  return vl_kdforest_query_recursively (searcher,
                                         tree,
                                         nextChild,
                                         neighbors,
@@ -572,12 +853,114 @@ vl_kdtree_calc_bounds_recursively (VlKDTree * tree,
 }
 
 /** ------------------------------------------------------------------
- ** @brief Query operation
- ** @param self KDTree object instance.
+ ** @internal
+ ** @brief Compute the bounds of the tree nodes once
+ ** @param self KDForest object.
+ **/
+
+static void
+vl_kdforest_prepare_search (VlKDForest * self)
+{
+  vl_uindex ti ;
+
+  if (self->searchBoundsComputed) return ;
+
+  for (ti = 0 ; ti < self->numTrees ; ++ti) {
+    double * searchBounds = vl_malloc(sizeof(double) * 2 * self->dimension) ;
+    double * iter = searchBounds  ;
+    double * end = iter + 2 * self->dimension ;
+    while (iter < end) {
+      *iter++ = - VL_INFINITY_F ;
+      *iter++ = + VL_INFINITY_F ;
+    }
+    vl_kdtree_calc_bounds_recursively (self->trees[ti], 0, searchBounds) ;
+    vl_free (searchBounds) ;
+  }
+  self->searchBoundsComputed = VL_TRUE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Create a searcher of a KDForest
+ ** @param self KDForest object (already built).
+ ** @return new searcher.
+ **
+ ** The searcher allocates the search heap (one entry per node of the
+ ** forest) and a book of the visited data points, which are reused by
+ ** all its queries. Searchers of the same forest can be used from
+ ** different threads at the same time. The forest must outlive its
+ ** searchers.
+ **
+ ** @sa ::vl_kdforestsearcher_delete, ::vl_kdforestsearcher_query.
+ **/
+
+VL_EXPORT VlKDForestSearcher *
+vl_kdforest_new_searcher (VlKDForest * self)
+{
+  VlKDForestSearcher * searcher = vl_malloc (sizeof(VlKDForestSearcher)) ;
+  vl_size maxNumNodes = 0 ;
+  vl_uindex ti ;
+
+  vl_kdforest_prepare_search (self) ;
+
+  for (ti = 0 ; ti < self->numTrees ; ++ti) {
+    maxNumNodes += self->trees[ti]->numUsedNodes ;
+  }
+
+  searcher -> forest = self ;
+  searcher -> searchHeapArray = vl_malloc (sizeof(VlKDForestSearchState) * maxNumNodes) ;
+  searcher -> searchHeapNumNodes = 0 ;
+  searcher -> searchIdBook = vl_calloc (sizeof(vl_uindex), self->numData) ;
+  searcher -> searchId = 0 ;
+  searcher -> searchNumComparisons = 0 ;
+  searcher -> searchNumRecursions = 0 ;
+  searcher -> searchNumSimplifications = 0 ;
+  searcher -> batchNeighbors = 0 ;
+  searcher -> batchNumNeighbors = 0 ;
+  searcher -> batchNumComparisons = 0 ;
+  return searcher ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Delete a KDForest searcher
+ ** @param self searcher to delete.
+ ** @sa ::vl_kdforest_new_searcher
+ **/
+
+VL_EXPORT void
+vl_kdforestsearcher_delete (VlKDForestSearcher * self)
+{
+  if (self->searchHeapArray) vl_free (self->searchHeapArray) ;
+  if (self->searchIdBook) vl_free (self->searchIdBook) ;
+  if (self->batchNeighbors) vl_free (self->batchNeighbors) ;
+  vl_free (self) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Make sure the forest has a number of searchers
+ ** @param self KDForest object.
+ ** @param numSearchers number of searchers needed.
+ **/
+
+static void
+vl_kdforest_reserve_searchers (VlKDForest * self, vl_size numSearchers)
+{
+  if (self->numSearchers >= numSearchers) return ;
+
+  self->searchers = vl_realloc (self->searchers,
+                                sizeof(VlKDForestSearcher*) * numSearchers) ;
+  while (self->numSearchers < numSearchers) {
+    self->searchers[self->numSearchers++] = vl_kdforest_new_searcher (self) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Query operation with a searcher
+ ** @param self searcher.
  ** @param neighbors list of nearest neighbors found (output).
  ** @param numNeighbors number of nearest neighbors to find.
  ** @param query query point.
- ** @return number of tree leaves visited.
+ ** @return number of comparisons made.
  **
  ** A neighbor is represented by an instance of the structure
  ** ::VlKDForestNeighbor. Each entry contains the index of the
@@ -586,13 +969,14 @@ vl_kdtree_calc_bounds_recursively (VlKDTree * tree,
  **/
 
 VL_EXPORT vl_size
-vl_kdforest_query (VlKDForest * self,
-                   VlKDForestNeighbor * neighbors,
-                   vl_size numNeighbors,
-                   void const * query)
+vl_kdforestsearcher_query (VlKDForestSearcher * self,
+                           VlKDForestNeighbor * neighbors,
+                           vl_size numNeighbors,
+                           void const * query)
 {
+  VlKDForest * forest = self->forest ;
   vl_uindex i, ti ;
-  vl_bool exactSearch = (self->searchMaxNumComparisons == 0) ;
+  vl_bool exactSearch = (forest->searchMaxNumComparisons == 0) ;
   VlKDForestSearchState * searchState  ;
   vl_size numAddedNeighbors = 0 ;
 
@@ -603,45 +987,21 @@ vl_kdforest_query (VlKDForest * self,
   /* this number is used to differentiate a query from the next */
   self -> searchId += 1 ;
   self -> searchNumRecursions = 0 ;
-
-  if (! self -> searchHeapArray) {
-    /* count number of tree nodes */
-    /* add support structures */
-    vl_size maxNumNodes = 0 ;
-    for (ti = 0 ; ti < self->numTrees ; ++ti) {
-      maxNumNodes += self->trees[ti]->numUsedNodes ;
-    }
-    self -> searchHeapArray = vl_malloc (sizeof(VlKDForestSearchState) * maxNumNodes) ;
-    self -> searchIdBook = vl_calloc (sizeof(vl_uindex), self->numData) ;
-
-    for (ti = 0 ; ti < self->numTrees ; ++ti) {
-      double * searchBounds = vl_malloc(sizeof(double) * 2 * self->dimension) ;
-      double * iter = searchBounds  ;
-      double * end = iter + 2 * self->dimension ;
-      while (iter < end) {
-        *iter++ = - VL_INFINITY_F ;
-        *iter++ = + VL_INFINITY_F ;
-      }
-      vl_kdtree_calc_bounds_recursively (self->trees[ti], 0, searchBounds) ;
-      vl_free (searchBounds) ;
-    }
-  }
-
-  self->searchNumComparisons = 0 ;
-  self->searchNumSimplifications = 0 ;
+  self -> searchNumComparisons = 0 ;
+  self -> searchNumSimplifications = 0 ;
 
   /* put the root node into the search heap */
   self->searchHeapNumNodes = 0 ;
-  for (ti = 0 ; ti < self->numTrees ; ++ ti) {
+  for (ti = 0 ; ti < forest->numTrees ; ++ ti) {
     searchState = self->searchHeapArray + self->searchHeapNumNodes ;
-    searchState -> tree = self->trees[ti] ;
+    searchState -> tree = forest->trees[ti] ;
     searchState -> nodeIndex = 0 ;
     searchState -> distanceLowerBound = 0 ;
     vl_kdforest_search_heap_push (self->searchHeapArray, &self->searchHeapNumNodes) ;
   }
 
   /* branch and bound */
-  while (exactSearch || self->searchNumComparisons < self->searchMaxNumComparisons)
+  while (exactSearch || self->searchNumComparisons < forest->searchMaxNumComparisons)
   {
     /* pop the next optimal search node */
     VlKDForestSearchState * searchState ;
@@ -682,3 +1042,517 @@ vl_kdforest_query (VlKDForest * self,
 
   return self->searchNumComparisons ;
 }
+
+/** ------------------------------------------------------------------
+ ** @brief Query operation
+ ** @param self KDTree object instance.
+ ** @param neighbors list of nearest neighbors found (output).
+ ** @param numNeighbors number of nearest neighbors to find.
+ ** @param query query point.
+ ** @return number of comparisons made.
+ **
+ ** Same as ::vl_kdforestsearcher_query with a searcher owned by the
+ ** forest. The function is not reentrant.
+ **/
+
+VL_EXPORT vl_size
+vl_kdforest_query (VlKDForest * self,
+                   VlKDForestNeighbor * neighbors,
+                   vl_size numNeighbors,
+                   void const * query)
+{
+  vl_kdforest_reserve_searchers (self, 1) ;
+  return vl_kdforestsearcher_query (self->searchers[0], neighbors, numNeighbors, query) ;
+}
+
+/** @internal @brief Queries handed to a thread at a time */
+#define VL_KDFOREST_QUERY_CHUNK 32
+
+/** @internal @brief Shared state of ::vl_kdforest_query_with_array */
+typedef struct _VlKDForestQueryArray
+{
+  VlKDForest * forest ;
+  vl_uint32 * indexes ;
+  void * distances ;
+  void const * queries ;
+  vl_size numNeighbors ;
+  vl_size numQueries ;
+} VlKDForestQueryArray ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run a chunk of queries of ::vl_kdforest_query_with_array
+ **/
+
+static void
+vl_kdforest_query_array_task (void * data, vl_uindex taskIndex, vl_uindex threadIndex)
+{
+  VlKDForestQueryArray * q = (VlKDForestQueryArray *) data ;
+  VlKDForest * forest = q->forest ;
+  VlKDForestSearcher * searcher = forest->searchers[threadIndex] ;
+  VlKDForestNeighbor * neighbors = searcher->batchNeighbors ;
+  vl_uindex begin = taskIndex * VL_KDFOREST_QUERY_CHUNK ;
+  vl_uindex end = VL_MIN(begin + VL_KDFOREST_QUERY_CHUNK, q->numQueries) ;
+  vl_uindex qi, ni ;
+
+  for (qi = begin ; qi < end ; ++ qi) {
+    vl_uint32 * indexes = q->indexes + qi * q->numNeighbors ;
+    void const * query ;
+
+    switch (forest->dataType) {
+      case VL_TYPE_FLOAT:
+        query = (float const *) q->queries + qi * forest->dimension ;
+        break ;
+      case VL_TYPE_DOUBLE:
+        query = (double const *) q->queries + qi * forest->dimension ;
+        break ;
+      case VL_TYPE_UINT8:
+        query = (vl_uint8 const *) q->queries + qi * forest->dimension ;
+        break ;
+      default:
+        abort() ;
+    }
+
+    searcher->batchNumComparisons +=
+      vl_kdforestsearcher_query (searcher, neighbors, q->numNeighbors, query) ;
+
+    for (ni = 0 ; ni < q->numNeighbors ; ++ ni) {
+      indexes [ni] = (vl_uint32) neighbors[ni].index ;
+      if (q->distances) {
+        switch (forest->dataType) {
+          case VL_TYPE_FLOAT:
+          case VL_TYPE_UINT8:
+            ((float *) q->distances) [qi * q->numNeighbors + ni] = neighbors[ni].distance ;
+            break ;
+          case VL_TYPE_DOUBLE:
+            ((double *) q->distances) [qi * q->numNeighbors + ni] = neighbors[ni].distance ;
+            break ;
+          default:
+            abort() ;
+        }
+      }
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Query operation for many points
+ ** @param self KDForest object.
+ ** @param indexes numNeighbors x numQueries neighbor indexes (output).
+ ** @param numNeighbors number of nearest neighbors to find per query.
+ ** @param numQueries number of query points.
+ ** @param distances numNeighbors x numQueries distances (output), or @c NULL.
+ ** @param queries query points, one after the other.
+ ** @return total number of comparisons made.
+ **
+ ** The neighbors of each query are sorted by increasing distance. If
+ ** fewer than @a numNeighbors neighbors are found, the remaining
+ ** entries have index @c (vl_uint32)-1 and distance NaN. The queries
+ ** and @a distances have the data type of the forest, except that the
+ ** distances of a ::VL_TYPE_UINT8 forest are @c float (they are
+ ** exact below 2^24, which holds for SIFT descriptors).
+ **
+ ** The queries are split over ::vl_get_max_threads threads of the
+ ** ::vl_parallel_for pool. Each thread uses a searcher of the forest,
+ ** which is kept for the next call together with its neighbor buffer,
+ ** so repeated calls allocate nothing. The function
+ ** must not run concurrently with other queries of the same forest
+ ** that do not use a searcher of their own.
+ **/
+
+VL_EXPORT vl_size
+vl_kdforest_query_with_array (VlKDForest * self,
+                              vl_uint32 * indexes,
+                              vl_size numNeighbors,
+                              vl_size numQueries,
+                              void * distances,
+                              void const * queries)
+{
+  VlKDForestQueryArray q ;
+  vl_size numThreads = vl_get_max_threads () ;
+  vl_size numTasks = (numQueries + VL_KDFOREST_QUERY_CHUNK - 1) / VL_KDFOREST_QUERY_CHUNK ;
+  vl_size numComparisons = 0 ;
+  vl_uindex t ;
+
+  assert (indexes) ;
+  assert (numNeighbors > 0) ;
+  assert (queries || numQueries == 0) ;
+
+  if (numQueries == 0) return 0 ;
+
+  numThreads = VL_MIN(numThreads, numTasks) ;
+  vl_kdforest_reserve_searchers (self, numThreads) ;
+  for (t = 0 ; t < numThreads ; ++ t) {
+    VlKDForestSearcher * searcher = self->searchers[t] ;
+    if (searcher->batchNumNeighbors < numNeighbors) {
+      if (searcher->batchNeighbors) vl_free (searcher->batchNeighbors) ;
+      searcher->batchNeighbors = vl_malloc (sizeof(VlKDForestNeighbor) * numNeighbors) ;
+      searcher->batchNumNeighbors = numNeighbors ;
+    }
+    searcher->batchNumComparisons = 0 ;
+  }
+
+  q.forest = self ;
+  q.indexes = indexes ;
+  q.distances = distances ;
+  q.queries = queries ;
+  q.numNeighbors = numNeighbors ;
+  q.numQueries = numQueries ;
+
+  vl_parallel_for_n (numTasks, numThreads, vl_kdforest_query_array_task, &q) ;
+
+  for (t = 0 ; t < numThreads ; ++ t) {
+    numComparisons += self->searchers[t]->batchNumComparisons ;
+  }
+  return numComparisons ;
+}
+
+/** @internal @brief Round a file offset up to ::VL_KDFOREST_FILE_ALIGN */
+#define VL_KDFOREST_FILE_ALIGN_UP(x) \
+  (((x) + VL_KDFOREST_FILE_ALIGN - 1) & ~ (vl_uint64) (VL_KDFOREST_FILE_ALIGN - 1))
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Write a block to a KDForest file
+ ** @param file file.
+ ** @param position current position in the file (in/out).
+ ** @param offset where the block goes (at most one alignment ahead).
+ ** @param data block.
+ ** @param size size of the block.
+ ** @return error code.
+ **/
+
+static int
+vl_kdforest_file_write (FILE * file, vl_uint64 * position, vl_uint64 offset,
+                        void const * data, vl_size size)
+{
+  static char const zeros [VL_KDFOREST_FILE_ALIGN] = { 0 } ;
+  vl_size padding = (vl_size) (offset - *position) ;
+
+  assert (offset >= *position && padding < VL_KDFOREST_FILE_ALIGN) ;
+
+  if (fwrite (zeros, 1, padding, file) != padding ||
+      fwrite (data, 1, size, file) != size) {
+    return VL_ERR_IO ;
+  }
+  *position = offset + size ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Save a KDForest to a file
+ ** @param self KDForest object (built).
+ ** @param fileName name of the file.
+ ** @param withData whether to store the indexed data too.
+ ** @return error code (::VL_ERR_OK on success).
+ **
+ ** The file can be loaded with ::vl_kdforest_load. Without the data
+ ** the file holds only the trees, and whoever loads it must provide
+ ** the same data the forest was built on.
+ **
+ ** @sa @ref kdtree-file
+ **/
+
+VL_EXPORT int
+vl_kdforest_save (VlKDForest * self, char const * fileName, vl_bool withData)
+{
+  VlKDForestFileHeader header ;
+  VlKDForestFileTree * table ;
+  vl_size dataSize = vl_kdforest_data_size (self->dataType) ;
+  vl_uint64 offset, position = 0 ;
+  vl_uindex ti ;
+  FILE * file ;
+  int err ;
+
+  assert (self->trees) ;
+
+  /* the node bounds are stored with the nodes */
+  vl_kdforest_prepare_search (self) ;
+
+  memset (&header, 0, sizeof(header)) ;
+  memcpy (header.magic, VL_KDFOREST_FILE_MAGIC, sizeof(header.magic)) ;
+  header.byteOrder = 0x0102030405060708ULL ;
+  header.nodeSize = sizeof(VlKDTreeNode) ;
+  header.entrySize = sizeof(vl_uint32) ;
+  header.dataType = self->dataType ;
+  header.thresholdingMethod = self->thresholdingMethod ;
+  header.dimension = self->dimension ;
+  header.numData = self->numData ;
+  header.numTrees = self->numTrees ;
+
+  /* lay out the arrays */
+  table = vl_malloc (sizeof(VlKDForestFileTree) * self->numTrees) ;
+  offset = VL_KDFOREST_FILE_ALIGN_UP(sizeof(header) + sizeof(VlKDForestFileTree) * self->numTrees) ;
+  for (ti = 0 ; ti < self->numTrees ; ++ ti) {
+    VlKDTree const * tree = self->trees[ti] ;
+    table[ti].numUsedNodes = tree->numUsedNodes ;
+    table[ti].depth = tree->depth ;
+    table[ti].nodesOffset = offset ;
+    offset = VL_KDFOREST_FILE_ALIGN_UP(offset + sizeof(VlKDTreeNode) * tree->numUsedNodes) ;
+    table[ti].dataIndexOffset = offset ;
+    offset = VL_KDFOREST_FILE_ALIGN_UP(offset + sizeof(vl_uint32) * self->numData) ;
+  }
+  if (withData) {
+    header.dataOffset = offset ;
+    offset += dataSize * self->dimension * self->numData ;
+  }
+  header.fileSize = offset ;
+
+  file = fopen (fileName, "wb") ;
+  if (! file) {
+    vl_free (table) ;
+    return vl_set_last_error (VL_ERR_IO, "Could not open '%s' for writing.", fileName) ;
+  }
+
+  err = vl_kdforest_file_write (file, &position, 0, &header, sizeof(header)) ;
+  if (! err) {
+    err = vl_kdforest_file_write (file, &position, position, table,
+                                  sizeof(VlKDForestFileTree) * self->numTrees) ;
+  }
+  for (ti = 0 ; ti < self->numTrees && ! err ; ++ ti) {
+    VlKDTree const * tree = self->trees[ti] ;
+    err = vl_kdforest_file_write (file, &position, table[ti].nodesOffset,
+                                  tree->nodes, sizeof(VlKDTreeNode) * tree->numUsedNodes) ;
+    if (! err) {
+      err = vl_kdforest_file_write (file, &position, table[ti].dataIndexOffset,
+                                    tree->dataIndex, sizeof(vl_uint32) * self->numData) ;
+    }
+  }
+  if (withData && ! err) {
+    err = vl_kdforest_file_write (file, &position, header.dataOffset,
+                                  self->data, dataSize * self->dimension * self->numData) ;
+  }
+
+  vl_free (table) ;
+  if (fclose (file) || err) {
+    return vl_set_last_error (VL_ERR_IO, "Could not write '%s'.", fileName) ;
+  }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Check the layout of a KDForest file
+ ** @param mapping file contents.
+ ** @param size file size.
+ ** @param hasData whether the caller provides the data.
+ ** @return @c NULL if the file is valid, else what is wrong with it.
+ **/
+
+static char const *
+vl_kdforest_check_file (char const * mapping, vl_uint64 size, vl_bool hasData)
+{
+  VlKDForestFileHeader const * header = (VlKDForestFileHeader const *) mapping ;
+  VlKDForestFileTree const * table = (VlKDForestFileTree const *) (header + 1) ;
+  vl_size dataSize ;
+  vl_uindex ti ;
+
+  if (size < sizeof(*header) ||
+      memcmp (header->magic, VL_KDFOREST_FILE_MAGIC, sizeof(header->magic))) {
+    return "not a KDForest file" ;
+  }
+  if (header->byteOrder != 0x0102030405060708ULL ||
+      header->nodeSize != sizeof(VlKDTreeNode) ||
+      header->entrySize != sizeof(vl_uint32)) {
+    return "written on a machine with a different byte order or word size" ;
+  }
+
+  dataSize = vl_kdforest_data_size ((vl_type) header->dataType) ;
+  if (header->fileSize != size || dataSize == 0 ||
+      header->dimension == 0 || header->numData == 0 || header->numTrees == 0 ||
+      header->numData > 0xffffffffU ||
+      header->dimension > 0xffffffffU ||
+      (header->thresholdingMethod != VL_KDTREE_MEDIAN &&
+       header->thresholdingMethod != VL_KDTREE_MEAN) ||
+      header->numTrees > (size - sizeof(*header)) / sizeof(VlKDForestFileTree)) {
+    return "corrupted header" ;
+  }
+
+  for (ti = 0 ; ti < header->numTrees ; ++ ti) {
+    if (table[ti].numUsedNodes == 0 ||
+        table[ti].numUsedNodes > 2 * header->numData ||
+        table[ti].nodesOffset % VL_KDFOREST_FILE_ALIGN ||
+        table[ti].dataIndexOffset % VL_KDFOREST_FILE_ALIGN ||
+        table[ti].nodesOffset > size ||
+        table[ti].numUsedNodes * sizeof(VlKDTreeNode) > size - table[ti].nodesOffset ||
+        table[ti].dataIndexOffset > size ||
+        header->numData * sizeof(vl_uint32) > size - table[ti].dataIndexOffset) {
+      return "corrupted tree table" ;
+    }
+  }
+
+  if (header->dataOffset) {
+    if (header->dataOffset % VL_KDFOREST_FILE_ALIGN ||
+        header->dataOffset > size ||
+        header->numData > (size - header->dataOffset) / (header->dimension * dataSize)) {
+      return "corrupted data offset" ;
+    }
+  } else if (! hasData) {
+    return "the file does not contain the data and none was given" ;
+  }
+
+  return NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Check the nodes and the data index of a loaded tree
+ ** @param self KDForest object (loaded).
+ ** @param tree tree to check.
+ ** @return @c NULL if the tree is valid, else what is wrong with it.
+ **
+ ** The children of a node follow it in the node array, so that a
+ ** valid tree cannot make the queries loop, and every index is in
+ ** range, so that the queries stay within the nodes and the data.
+ **/
+
+static char const *
+vl_kdforest_check_tree (VlKDForest const * self, VlKDTree const * tree)
+{
+  vl_uindex ni, di ;
+
+  for (ni = 0 ; ni < tree->numUsedNodes ; ++ ni) {
+    VlKDTreeNode const * node = tree->nodes + ni ;
+    /* the queries read the split dimension of the leaves too */
+    if (node->splitDimension >= self->dimension) {
+      return "corrupted node split dimension" ;
+    }
+    if (node->lowerChild < 0) {
+      vl_index begin = - node->lowerChild - 1 ;
+      vl_index end = - node->upperChild - 1 ;
+      if (node->upperChild >= 0 || begin > end || (vl_size) end > self->numData) {
+        return "corrupted leaf data range" ;
+      }
+    } else if ((vl_uindex) node->lowerChild <= ni ||
+               (vl_uindex) node->lowerChild >= tree->numUsedNodes ||
+               node->upperChild < 0 ||
+               (vl_uindex) node->upperChild <= ni ||
+               (vl_uindex) node->upperChild >= tree->numUsedNodes) {
+      return "corrupted node children" ;
+    }
+  }
+
+  for (di = 0 ; di < self->numData ; ++ di) {
+    if (tree->dataIndex [di] >= self->numData) {
+      return "corrupted data index" ;
+    }
+  }
+  return NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Load a KDForest from a file
+ ** @param fileName name of a file written by ::vl_kdforest_save.
+ ** @param data indexed data, or @c NULL to use the data in the file.
+ ** @param checkTrees whether to check every node and index entry.
+ ** @return new KDForest, or @c NULL on error (see ::vl_get_last_error).
+ **
+ ** The file is mapped read-only into memory and the trees (and the
+ ** data, if @a data is @c NULL) are used in place until the forest is
+ ** deleted with ::vl_kdforest_delete. The forest is ready to be
+ ** queried and must not be built again.
+ **
+ ** The header and the layout of the arrays are always checked. If
+ ** @a checkTrees is true, the trees are checked too (child and data
+ ** indices, split dimensions), which takes time linear in the size of
+ ** the forest; without it loading takes constant time, but a
+ ** corrupted file can make the queries read out of bounds, so only
+ ** trusted files should be loaded this way.
+ **
+ ** @sa @ref kdtree-file
+ **/
+
+VL_EXPORT VlKDForest *
+vl_kdforest_load (char const * fileName, void const * data, vl_bool checkTrees)
+{
+  VlKDForestFileHeader const * header ;
+  VlKDForestFileTree const * table ;
+  VlKDForest * self ;
+  char * mapping ;
+  vl_size size ;
+  char const * problem ;
+  vl_uindex ti ;
+
+#if defined(VL_KDFOREST_MMAP)
+  struct stat st ;
+  int fd = open (fileName, O_RDONLY) ;
+
+  if (fd < 0) {
+    vl_set_last_error (VL_ERR_IO, "Could not open '%s'.", fileName) ;
+    return NULL ;
+  }
+  if (fstat (fd, &st) || st.st_size <= 0) {
+    close (fd) ;
+    vl_set_last_error (VL_ERR_IO, "'%s' is empty.", fileName) ;
+    return NULL ;
+  }
+  size = st.st_size ;
+  mapping = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+  if (mapping == MAP_FAILED) {
+    vl_set_last_error (VL_ERR_ALLOC, "Could not map '%s'.", fileName) ;
+    return NULL ;
+  }
+#else
+  FILE * file = fopen (fileName, "rb") ;
+  long length ;
+
+  if (! file) {
+    vl_set_last_error (VL_ERR_IO, "Could not open '%s'.", fileName) ;
+    return NULL ;
+  }
+  fseek (file, 0, SEEK_END) ;
+  length = ftell (file) ;
+  fseek (file, 0, SEEK_SET) ;
+  size = length > 0 ? (vl_size) length : 0 ;
+  mapping = size ? vl_malloc (size) : NULL ;
+  if (! mapping || fread (mapping, 1, size, file) != size) {
+    fclose (file) ;
+    if (mapping) vl_free (mapping) ;
+    vl_set_last_error (VL_ERR_IO, "Could not read '%s'.", fileName) ;
+    return NULL ;
+  }
+  fclose (file) ;
+#endif
+
+  problem = vl_kdforest_check_file (mapping, size, data != NULL) ;
+  if (problem) {
+    vl_kdforest_unmap (mapping, size) ;
+    vl_set_last_error (VL_ERR_BAD_ARG, "'%s': %s.", fileName, problem) ;
+    return NULL ;
+  }
+
+  header = (VlKDForestFileHeader const *) mapping ;
+  table = (VlKDForestFileTree const *) (header + 1) ;
+
+  self = vl_kdforest_new ((vl_type) header->dataType, header->dimension, header->numTrees) ;
+  self->thresholdingMethod = (VlKDTreeThresholdingMethod) header->thresholdingMethod ;
+  self->numData = header->numData ;
+  self->data = data ? data : mapping + header->dataOffset ;
+  self->trees = vl_malloc (sizeof(VlKDTree*) * self->numTrees) ;
+
+  for (ti = 0 ; ti < self->numTrees ; ++ ti) {
+    VlKDTree * tree = vl_malloc (sizeof(VlKDTree)) ;
+    tree->nodes = (VlKDTreeNode *) (mapping + table[ti].nodesOffset) ;
+    tree->numUsedNodes = table[ti].numUsedNodes ;
+    tree->numAllocatedNodes = table[ti].numUsedNodes ;
+    tree->dataIndex = (vl_uint32 *) (mapping + table[ti].dataIndexOffset) ;
+    tree->depth = (unsigned int) table[ti].depth ;
+    self->trees[ti] = tree ;
+  }
+
+  /* the bounds were saved with the nodes, which are read-only now */
+  self->searchBoundsComputed = VL_TRUE ;
+  self->mapping = mapping ;
+  self->mappingSize = size ;
+
+  for (ti = 0 ; ti < self->numTrees && checkTrees ; ++ ti) {
+    problem = vl_kdforest_check_tree (self, self->trees[ti]) ;
+    if (problem) {
+      vl_kdforest_delete (self) ;
+      vl_set_last_error (VL_ERR_BAD_ARG, "'%s': %s.", fileName, problem) ;
+      return NULL ;
+    }
+  }
+  return self ;
+}
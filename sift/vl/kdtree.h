@@ -22,10 +22,10 @@ typedef struct _VlKDTreeNode VlKDTreeNode ;
 typedef struct _VlKDTreeSplitDimension VlKDTreeSplitDimension ;
 typedef struct _VlKDTreeDataIndexEntry VlKDTreeDataIndexEntry ;
 typedef struct _VlKDForestSearchState VlKDForestSearchState ;
+typedef struct _VlKDForestSearcher VlKDForestSearcher ;
 
 struct _VlKDTreeNode
 {
-  vl_uindex parent ;
   vl_index lowerChild ;
   vl_index upperChild ;
   unsigned int splitDimension ;
@@ -65,7 +65,7 @@ typedef struct _VlKDTree
   VlKDTreeNode * nodes ;
   vl_size numUsedNodes ;
   vl_size numAllocatedNodes ;
-  VlKDTreeDataIndexEntry * dataIndex ;
+  vl_uint32 * dataIndex ;        /* data points in leaf order */
   unsigned int depth ;
 } VlKDTree ;
 
@@ -96,21 +96,43 @@ typedef struct _VlKDForest
 
   /* build */
   VlKDTreeThresholdingMethod thresholdingMethod ;
-  VlKDTreeSplitDimension splitHeapArray [VL_KDTREE_SPLIT_HEALP_SIZE] ;
-  vl_size splitHeapNumNodes ;
   vl_size splitHeapSize ;
 
   /* querying */
+  vl_bool searchBoundsComputed ;
+  VlKDForestSearcher ** searchers ;  /* one per thread of the batch queries */
+  vl_size numSearchers ;
+  vl_size searchMaxNumComparisons ;
+
+  /* file the trees (and data) are mapped from, see vl_kdforest_load */
+  void * mapping ;
+  vl_size mappingSize ;
+} VlKDForest ;
+
+/** @brief KDForest search state
+ **
+ ** A searcher holds the buffers of a query (search heap, book of the
+ ** visited data points) and the statistics of the last query. Queries
+ ** through different searchers of the same forest can run in parallel.
+ **/
+struct _VlKDForestSearcher
+{
+  VlKDForest * forest ;
+
   VlKDForestSearchState * searchHeapArray ;
   vl_size searchHeapNumNodes ;
   vl_uindex searchId ;
   vl_uindex * searchIdBook ;
 
-  vl_size searchMaxNumComparisons ;
   vl_size searchNumComparisons;
   vl_size searchNumRecursions ;
   vl_size searchNumSimplifications ;
-} VlKDForest ;
+
+  /* scratch of vl_kdforest_query_with_array */
+  VlKDForestNeighbor * batchNeighbors ;
+  vl_size batchNumNeighbors ;
+  vl_size batchNumComparisons ;
+} ;
 
 /** @name Creatind and disposing
  ** @{ */
@@ -128,6 +150,32 @@ VL_EXPORT vl_size vl_kdforest_query (VlKDForest * self,
                                      VlKDForestNeighbor * neighbors,
                                      vl_size numNeighbors,
                                      void const * query) ;
+VL_EXPORT vl_size vl_kdforest_query_with_array (VlKDForest * self,
+                                                vl_uint32 * indexes,
+                                                vl_size numNeighbors,
+                                                vl_size numQueries,
+                                                void * distances,
+                                                void const * queries) ;
+/** @} */
+
+/** @name Saving and loading
+ ** @{ */
+VL_EXPORT int vl_kdforest_save (VlKDForest * self,
+                                char const * fileName,
+                                vl_bool withData) ;
+VL_EXPORT VlKDForest * vl_kdforest_load (char const * fileName,
+                                         void const * data,
+                                         vl_bool checkTrees) ;
+/** @} */
+
+/** @name Searchers
+ ** @{ */
+VL_EXPORT VlKDForestSearcher * vl_kdforest_new_searcher (VlKDForest * self) ;
+VL_EXPORT void vl_kdforestsearcher_delete (VlKDForestSearcher * self) ;
+VL_EXPORT vl_size vl_kdforestsearcher_query (VlKDForestSearcher * self,
+                                             VlKDForestNeighbor * neighbors,
+                                             vl_size numNeighbors,
+                                             void const * query) ;
 /** @} */
 
 /** @name Retrieving and setting parameters
@@ -262,7 +310,7 @@ vl_kdforest_get_data_dimension (VlKDForest const * self)
 /** ------------------------------------------------------------------
  ** @brief Get the data type
  ** @param self KDForest object.
- ** @return data type (one of ::VL_TYPE_FLOAT, ::VL_TYPE_DOUBLE).
+ ** @return data type (one of ::VL_TYPE_FLOAT, ::VL_TYPE_DOUBLE, ::VL_TYPE_UINT8).
  **/
 
 VL_INLINE vl_type
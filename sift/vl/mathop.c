@@ -28,6 +28,12 @@ GNU GPLv2, or (at your option) any later version.
  the comparison function on all pairs of one or two sequences of
  vectors.
 
+ ::vl_get_vector_comparison_function_ui8 returns the (squared) l2
+ distance of vectors of 8-bit unsigned integers, such as quantized
+ SIFT descriptors. The distance is computed exactly with integer
+ arithmetic (SSE2 or NEON where available); it moves a quarter of
+ the memory of the float version.
+
  Let @f$ \mathbf{x} = (x_1,\dots,x_d) @f$ and @f$ \mathbf{y} =
  (y_1,\dots,y_d) @f$ be two vectors.  The following comparison
  functions are supported:
@@ -138,6 +144,15 @@ GNU GPLv2, or (at your option) any later version.
  ** @sa vl_get_vector_comparison_function_f
  **/
 
+/** @fn vl_get_vector_comparison_function_ui8(VlVectorComparisonType)
+ ** @brief Get vector comparison function for 8-bit unsigned integers
+ ** @param type vector comparison type.
+ ** @return comparison function, or @c NULL if @a type is not supported.
+ **
+ ** Only ::VlDistanceL2 is supported. The function returns the exact
+ ** squared distance, which fits 32 bits up to a dimension of 66051.
+ **/
+
 /** @fn vl_eval_vector_comparison_on_all_pairs_f(float*,vl_size,
  **     float const*,vl_size,float const*,vl_size,VlFloatVectorComparisonFunction)
  **
@@ -170,6 +185,7 @@ GNU GPLv2, or (at your option) any later version.
 
 #include "mathop.h"
 #include "mathop_sse2.h"
+#include "mathop_neon.h"
 #include <math.h>
 
 #undef FLT
@@ -180,6 +196,43 @@ GNU GPLv2, or (at your option) any later version.
 #define FLT VL_TYPE_DOUBLE
 #include "mathop.c"
 
+/* ---------------------------------------------------------------- */
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint32 acc = 0 ;
+  while (X < X_end) {
+    int d = (int) *X++ - (int) *Y++ ;
+    acc += d * d ;
+  }
+  return acc ;
+}
+
+VL_EXPORT VlUInt8VectorComparisonFunction
+vl_get_vector_comparison_function_ui8 (VlVectorComparisonType type)
+{
+  VlUInt8VectorComparisonFunction function = 0 ;
+  switch (type) {
+    case VlDistanceL2 : function = _vl_distance_l2_ui8 ; break ;
+    default: return 0 ;
+  }
+
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    function = _vl_distance_l2_sse2_ui8 ;
+  }
+#endif
+#if defined(ARCH_ARM) && ! defined(VL_DISABLE_NEON)
+  if (vl_get_simd_enabled()) {
+    function = _vl_distance_l2_neon_ui8 ;
+  }
+#endif
+
+  return function ;
+}
+
 /* ---------------------------------------------------------------- */
 /* VL_MATHOP_SSE2_INSTANTIATING */
 #else
@@ -480,6 +480,11 @@ typedef float (*VlFloatVectorComparisonFunction)(vl_size dimension, float const
  **/
 typedef double (*VlDoubleVectorComparisonFunction)(vl_size dimension, double const * X, double const * Y) ;
 
+/** @typedef VlUInt8VectorComparisonFunction
+ ** @brief Pointer to a function to compare vectors of 8-bit unsigned integers
+ **/
+typedef vl_uint32 (*VlUInt8VectorComparisonFunction)(vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
 /** @brief Vector comparison types */
 enum _VlVectorComparisonType {
   VlDistanceL1,        /**< l1 distance (squared intersection metric) */
@@ -522,6 +527,9 @@ vl_get_vector_comparison_function_f (VlVectorComparisonType type) ;
 VL_EXPORT VlDoubleVectorComparisonFunction
 vl_get_vector_comparison_function_d (VlVectorComparisonType type) ;
 
+VL_EXPORT VlUInt8VectorComparisonFunction
+vl_get_vector_comparison_function_ui8 (VlVectorComparisonType type) ;
+
 VL_EXPORT void
 vl_eval_vector_comparison_on_all_pairs_f (float * result, vl_size dimension,
                                           float const * X, vl_size numDataX,
@@ -0,0 +1,66 @@
+/** @internal
+ ** @file     mathop_neon.c
+ ** @brief    mathop for NEON definition
+ **/
+
+/* AUTORIGHTS
+Copyright (C) 2007-10 Andrea Vedaldi and Brian Fulkerson
+
+This file is part of VLFeat, available under the terms of the
+GNU GPLv2, or (at your option) any later version.
+*/
+
+#include "mathop_neon.h"
+
+#if defined(ARCH_ARM) && ! defined(VL_DISABLE_NEON)
+
+#if ! defined(__ARM_NEON__)
+#error "Compiling with NEON enabled, but no __ARM_NEON__ defined"
+#endif
+
+#include <arm_neon.h>
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Squared l2 distance of 8-bit vectors - NEON
+ **
+ ** Same as ::_vl_distance_l2_sse2_ui8: the absolute differences are
+ ** widened to 16 bits by @c vabdl_u8 and squared and accumulated in
+ ** 32-bit lanes by @c vmlal_u16.
+ **/
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_neon_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~ (vl_size) 15) ;
+  uint32x4_t vacc = vdupq_n_u32 (0) ;
+  uint64x2_t vsum ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    uint8x16_t a = vld1q_u8 (X) ;
+    uint8x16_t b = vld1q_u8 (Y) ;
+    uint16x8_t dlo = vabdl_u8 (vget_low_u8 (a), vget_low_u8 (b)) ;
+    uint16x8_t dhi = vabdl_u8 (vget_high_u8 (a), vget_high_u8 (b)) ;
+    vacc = vmlal_u16 (vacc, vget_low_u16 (dlo), vget_low_u16 (dlo)) ;
+    vacc = vmlal_u16 (vacc, vget_high_u16 (dlo), vget_high_u16 (dlo)) ;
+    vacc = vmlal_u16 (vacc, vget_low_u16 (dhi), vget_low_u16 (dhi)) ;
+    vacc = vmlal_u16 (vacc, vget_high_u16 (dhi), vget_high_u16 (dhi)) ;
+    X += 16 ;
+    Y += 16 ;
+  }
+
+  vsum = vpaddlq_u32 (vacc) ;
+  acc = (vl_uint32) (vgetq_lane_u64 (vsum, 0) + vgetq_lane_u64 (vsum, 1)) ;
+
+  while (X < X_end) {
+    int d = (int) *X++ - (int) *Y++ ;
+    acc += d * d ;
+  }
+
+  return acc ;
+}
+
+/* ARCH_ARM && ! VL_DISABLE_NEON */
+#endif
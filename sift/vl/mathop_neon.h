@@ -0,0 +1,26 @@
+/** @internal
+ ** @file     mathop_neon.h
+ ** @brief    mathop for NEON declaration
+ **/
+
+/* AUTORIGHTS
+Copyright (C) 2007-10 Andrea Vedaldi and Brian Fulkerson
+
+This file is part of VLFeat, available under the terms of the
+GNU GPLv2, or (at your option) any later version.
+*/
+
+#ifndef VL_MATHOP_NEON_H
+#define VL_MATHOP_NEON_H
+
+#include "generic.h"
+
+#if defined(ARCH_ARM) && ! defined(VL_DISABLE_NEON)
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_neon_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
+#endif
+
+/* VL_MATHOP_NEON_H */
+#endif
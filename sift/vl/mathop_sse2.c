@@ -32,6 +32,43 @@ GNU GPLv2, or (at your option) any later version.
 #define FLT VL_TYPE_FLOAT
 #include "mathop_sse2.c"
 
+/* ---------------------------------------------------------------- */
+
+/* The bytes are widened to 16 bits, subtracted and squared and
+ * summed in pairs into 32-bit lanes by _mm_madd_epi16. */
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y)
+{
+  vl_uint8 const * X_end = X + dimension ;
+  vl_uint8 const * X_vec_end = X + (dimension & ~ (vl_size) 15) ;
+  __m128i zero = _mm_setzero_si128 () ;
+  __m128i vacc = _mm_setzero_si128 () ;
+  vl_uint32 lanes [4] ;
+  vl_uint32 acc ;
+
+  while (X < X_vec_end) {
+    __m128i a = _mm_loadu_si128 ((__m128i const*) X) ;
+    __m128i b = _mm_loadu_si128 ((__m128i const*) Y) ;
+    __m128i dlo = _mm_sub_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (b, zero)) ;
+    __m128i dhi = _mm_sub_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (b, zero)) ;
+    vacc = _mm_add_epi32 (vacc, _mm_madd_epi16 (dlo, dlo)) ;
+    vacc = _mm_add_epi32 (vacc, _mm_madd_epi16 (dhi, dhi)) ;
+    X += 16 ;
+    Y += 16 ;
+  }
+
+  _mm_storeu_si128 ((__m128i*) lanes, vacc) ;
+  acc = lanes [0] + lanes [1] + lanes [2] + lanes [3] ;
+
+  while (X < X_end) {
+    int d = (int) *X++ - (int) *Y++ ;
+    acc += d * d ;
+  }
+
+  return acc ;
+}
+
 /* VL_DISABLE_SSE2 */
 #endif
 
@@ -25,6 +25,14 @@ GNU GPLv2, or (at your option) any later version.
 #define FLT VL_TYPE_FLOAT
 #include "mathop_sse2.h"
 
+#ifndef VL_DISABLE_SSE2
+
+VL_EXPORT vl_uint32
+_vl_distance_l2_sse2_ui8 (vl_size dimension, vl_uint8 const * X, vl_uint8 const * Y) ;
+
+/* ! VL_DISABLE_SSE2 */
+#endif
+
 /* VL_MATHOP_SSE2_H */
 #endif
 
@@ -277,6 +277,9 @@ To use a <b>SIFT filter</b> object:
     - Use ::vl_sift_calc_keypoint_orientations() to get the keypoint orientation(s).
     - For each orientation:
       - Use ::vl_sift_calc_keypoint_descriptor() to get the keypoint descriptor.
+  - Alternatively, collect the keypoints and orientations of the octave
+    and compute all descriptors at once with
+    ::vl_sift_calc_keypoint_descriptors_batch().
 - Delete the SIFT filter by ::vl_sift_delete().
 
 To compute SIFT descriptors of custom keypoints, use
@@ -674,9 +677,12 @@ Gaussian window size is set to have standard deviation
 **/
 
 #include "sift.h"
+#include "sift_sse2.h"
+#include "sift_neon.h"
 #include "imopv.h"
 #include "mathop.h"
 #include "sift_dsp.h"
+#include "threads.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -777,6 +783,537 @@ copy_and_upsample_rows
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Get the Gaussian kernel of given standard deviation
+ **
+ ** @param self   SIFT filter.
+ ** @param sigma  smoothing.
+ **
+ ** The function looks up the kernel in the filter cache and computes
+ ** it if it is not there yet. Since the scale levels are the same for
+ ** all octaves and images, after the first image the cache always
+ ** hits and smoothing does not allocate memory anymore. If the cache
+ ** is full, the oldest entry is recycled.
+ **
+ ** @return the cache entry of the kernel.
+ **/
+
+static VlSiftGaussFilter *
+_vl_sift_get_gauss_filter (VlSiftFilt * self, double sigma)
+{
+  VlSiftGaussFilter *entry = 0 ;
+  vl_uindex j ;
+  vl_sift_pix acc = 0 ;
+  int i ;
+
+  for (i = 0 ; i < self->gaussFilterCacheSize ; ++i) {
+    entry = self->gaussFilterCache + i ;
+    if (entry->sigma == sigma) return entry ;
+    if (entry->sigma == 0) break ;
+  }
+
+  if (i == self->gaussFilterCacheSize) {
+    /* cache full: recycle the first slot and shift the others */
+    VlSiftGaussFilter oldest = self->gaussFilterCache [0] ;
+    memmove (self->gaussFilterCache, self->gaussFilterCache + 1,
+             sizeof(VlSiftGaussFilter) * (self->gaussFilterCacheSize - 1)) ;
+    entry = self->gaussFilterCache + self->gaussFilterCacheSize - 1 ;
+    *entry = oldest ;
+  }
+
+  entry->width = VL_MAX(ceil(4.0 * sigma), 1) ;
+  if (entry->filter) vl_free (entry->filter) ;
+  entry->filter = (vl_sift_pix*)vl_malloc (sizeof(vl_sift_pix) * (2 * entry->width + 1)) ;
+  entry->sigma = sigma ;
+
+  for (j = 0 ; j < 2 * entry->width + 1 ; ++j) {
+    vl_sift_pix d = ((vl_sift_pix)((signed)j - (signed)entry->width)) / ((vl_sift_pix)sigma) ;
+    entry->filter[j] = (vl_sift_pix) exp (- 0.5 * (d*d)) ;
+    acc += entry->filter[j] ;
+  }
+  for (j = 0 ; j < 2 * entry->width + 1 ; ++j) {
+    entry->filter[j] /= acc ;
+  }
+  return entry ;
+}
+
+/** @internal @brief Minimum number of pixels to split a smoothing pass */
+#define VL_SIFT_SMOOTH_MIN_PARALLEL (64 * 64)
+
+/** @internal @brief Number of strips of a DSP convolution pass */
+#define VL_SIFT_DSP_STRIPS 4
+
+/** @internal @brief Smallest share of an adaptive ARM/DSP split */
+#define VL_SIFT_DSP_SPLIT_MIN 0.05
+
+/** @internal
+ ** @brief Step of an adaptive split towards the DSP
+ **
+ ** When the ARM finishes its share last, the DSP time is not known and
+ ** its share grows by this much.
+ **/
+#define VL_SIFT_DSP_SPLIT_STEP 0.05
+
+/** @internal
+ ** @brief Relative wait below which the DSP is taken to have finished first
+ **/
+#define VL_SIFT_DSP_SPLIT_SLACK 0.02
+
+/** @internal @brief Side of the gradient tiles (in pixels) */
+#define VL_SIFT_GRAD_TILE 32
+
+/** @internal
+ ** @brief Fraction of tiles above which the gradient is computed densely
+ **
+ ** If the keypoints of the octave need more than this fraction of the
+ ** gradient tiles, ::vl_sift_update_gradient_for_keypoints computes
+ ** the whole octave, which streams better than many sparse tiles.
+ **/
+#define VL_SIFT_GRAD_DENSE_RATIO 0.5
+
+/** @internal @brief State of a gradient tile */
+enum {
+  VL_SIFT_GRAD_TILE_INVALID = 0, /**< gradient not computed */
+  VL_SIFT_GRAD_TILE_VALID,       /**< gradient up to date */
+  VL_SIFT_GRAD_TILE_NEEDED       /**< gradient requested */
+} ;
+
+/** @internal @brief Column range of a convolution pass */
+typedef struct _VlSiftSmoothPass
+{
+  vl_sift_pix * dst ;
+  int dst_stride ;
+  vl_sift_pix const * src ;
+  int src_width ;
+  int src_height ;
+  int src_stride ;
+  vl_sift_pix const * filt ;
+  int filt_width ;
+  int chunk ;                 /**< columns per task */
+  vl_sift_pix * dog ;         /**< DoG output (or NULL) */
+  vl_sift_pix const * prev ;  /**< level subtracted to get the DoG */
+} VlSiftSmoothPass ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute a difference of Gaussians
+ **
+ ** @param dog   output (@a b - @a a).
+ ** @param b     finer level.
+ ** @param a     coarser level.
+ ** @param n     number of pixels.
+ **/
+
+static void
+_vl_sift_subtract (vl_sift_pix * dog,
+                   vl_sift_pix const * b,
+                   vl_sift_pix const * a,
+                   vl_size n)
+{
+  vl_sift_pix const * end = a + n ;
+  while (a != end) {
+    *dog++ = *b++ - *a++ ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run a convolution pass on a range of columns
+ **
+ ** @param data   pass (::VlSiftSmoothPass).
+ ** @param task   index of the range of columns.
+ ** @param thread not used.
+ **
+ ** Because the pass transposes its output, the columns @c [begin,end)
+ ** of the source are the rows @c [begin,end) of the destination. If
+ ** the pass produces a GSS level, the same rows of the DoG are
+ ** computed while they are still in the cache.
+ **/
+
+static void
+_vl_sift_smooth_columns (void * data, vl_uindex task, vl_uindex thread)
+{
+  VlSiftSmoothPass * p = (VlSiftSmoothPass *) data ;
+  int begin = (int) task * p->chunk ;
+  int end   = VL_MIN (begin + p->chunk, p->src_width) ;
+  vl_size offset = (vl_size) begin * p->dst_stride ;
+
+  (void) thread ;
+
+  vl_imconvcol_vf (p->dst + offset, p->dst_stride,
+                   p->src + begin, end - begin, p->src_height, p->src_stride,
+                   p->filt, - p->filt_width, p->filt_width,
+                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+
+  if (p->dog) {
+    _vl_sift_subtract (p->dog + offset, p->dst + offset, p->prev + offset,
+                       (vl_size) (end - begin) * p->dst_stride) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run a convolution pass on several threads
+ **
+ ** @param p pass.
+ **
+ ** The columns are split into chunks of a multiple of four columns,
+ ** so that the SSE2 convolution sees aligned columns.
+ **/
+
+static void
+_vl_sift_smooth_pass (VlSiftSmoothPass * p)
+{
+  int numThreads = (int) vl_get_max_threads () ;
+  int numTasks ;
+
+  if (numThreads <= 1 ||
+      p->src_width * p->src_height < VL_SIFT_SMOOTH_MIN_PARALLEL) {
+    p->chunk = p->src_width ;
+  } else {
+    /* a few tasks per thread to balance the load */
+    p->chunk = (p->src_width + 4 * numThreads - 1) / (4 * numThreads) ;
+    p->chunk = VL_MAX ((p->chunk + 3) & ~3, 16) ;
+  }
+
+  numTasks = (p->src_width + p->chunk - 1) / p->chunk ;
+  vl_parallel_for (numTasks, _vl_sift_smooth_columns, p) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Smooth an image on the DSP
+ **
+ ** @param self         SIFT filter.
+ ** @param outputImage  output image buffer.
+ ** @param tempImage    temporary image buffer.
+ ** @param inputImage   input image buffer.
+ ** @param width        input image width.
+ ** @param height       input image height.
+ ** @param dog          DoG output (or @c NULL).
+ **
+ ** Both convolution passes are posted to the DSP at once. The second
+ ** one is split in ::VL_SIFT_DSP_STRIPS strips of rows, and the DoG
+ ** of a strip is computed on the ARM while the DSP convolves the next
+ ** one. The Gaussian filter must be prepared by the caller.
+ **
+ ** @return error code of ::vl_dsp_wait.
+ **/
+
+static int
+_vl_sift_smooth_on_dsp (VlSiftFilt * self,
+                        vl_sift_pix * outputImage,
+                        vl_sift_pix * tempImage,
+                        vl_sift_pix const * inputImage,
+                        vl_size width,
+                        vl_size height,
+                        vl_sift_pix * dog)
+{
+  int const   fw = self->gaussFilterWidth ;
+  int const   nstrips = dog ? VL_SIFT_DSP_STRIPS : 1 ;
+  vl_dsp_token tokens [VL_SIFT_DSP_STRIPS] ;
+  int k ;
+
+  vl_size const size = sizeof(vl_sift_pix) * width * height ;
+
+  vl_dsp_dmm_range_begin ((void*) inputImage, size, VL_DSP_TO_DEVICE) ;
+  vl_dsp_dmm_range_begin (self->gaussFilter,
+                          sizeof(vl_sift_pix) * (2 * fw + 1), VL_DSP_TO_DEVICE) ;
+  vl_dsp_dmm_range_begin (tempImage,   size, VL_DSP_FROM_DEVICE) ;
+  vl_dsp_dmm_range_begin (outputImage, size, VL_DSP_FROM_DEVICE) ;
+
+  /* columns of the input to rows of the temporary buffer */
+  vl_imconvcol_vf_on_dsp_async (tempImage, height,
+                                inputImage, height, width,
+                                self->gaussFilter, - fw, fw,
+                                1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE,
+                                0, (int) width) ;
+
+  /* and back, one strip of output rows at a time; the DSP runs the
+     commands in order, so the strips start after the first pass. The
+     DSP answers once per batch, so each strip is submitted on its own
+     (the first one together with the first pass) */
+  for (k = 0 ; k < nstrips ; ++k) {
+    tokens [k] = vl_imconvcol_vf_on_dsp_async
+      (outputImage, width,
+       tempImage, width, height,
+       self->gaussFilter, - fw, fw,
+       1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE,
+       (int) (height *  k      / nstrips),
+       (int) (height * (k + 1) / nstrips)) ;
+    vl_dsp_submit () ;
+  }
+
+  for (k = 0 ; k < nstrips ; ++k) {
+    vl_size y0 = height *  k      / nstrips ;
+    vl_size y1 = height * (k + 1) / nstrips ;
+    if (vl_dsp_wait (tokens [k])) {
+      return VL_ERR_IO ;
+    }
+    vl_dsp_dmm_range_end (outputImage + y0 * width,
+                          sizeof(vl_sift_pix) * (y1 - y0) * width,
+                          VL_DSP_FROM_DEVICE) ;
+    if (dog) {
+      _vl_sift_subtract (dog         + y0 * width,
+                         outputImage + y0 * width,
+                         inputImage  + y0 * width,
+                         (y1 - y0) * width) ;
+    }
+  }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Choose the DSP share of a convolution pass
+ **
+ ** @param dst     output of the pass.
+ ** @param rowSize output pixels per column of the input (transposed).
+ ** @param n       number of columns of the input.
+ ** @param ratio   fraction of the columns wanted on the DSP.
+ ** @return number of columns, starting from the first, for the DSP.
+ **
+ ** The split is moved so that the output rows of the DSP end on a
+ ** cache line (::VL_DSP_CACHE_LINE); ARM and DSP never write back the
+ ** same line. If no such split exists, the larger share gets all.
+ **/
+
+static int
+_vl_sift_split_columns (vl_sift_pix const * dst,
+                        vl_size rowSize,
+                        int n,
+                        double ratio)
+{
+  int c = (int) (ratio * n + 0.5) ;
+  int k ;
+
+  if (c <= 0) return 0 ;
+  if (c >= n) return n ;
+
+  for (k = 0 ; k < (int) (VL_DSP_CACHE_LINE / sizeof(vl_sift_pix)) && c + k < n ; ++k) {
+    if ((vl_uintptr) (dst + (c + k) * rowSize) % VL_DSP_CACHE_LINE == 0) {
+      return c + k ;
+    }
+  }
+  return (2 * c >= n) ? n : 0 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Account for a split smoothing and adapt the split
+ **
+ ** @param split     split of the octave.
+ ** @param armPixels pixels convolved on the ARM.
+ ** @param dspPixels pixels convolved on the DSP.
+ ** @param armTime   time the ARM spent on its share.
+ ** @param waitTime  time the ARM then waited for the DSP.
+ **
+ ** If the ARM waited, both throughputs are known and the ratio moves
+ ** halfway to the one that makes both finish together. Otherwise the
+ ** DSP may have been idle and its share grows by
+ ** ::VL_SIFT_DSP_SPLIT_STEP.
+ **/
+
+static void
+_vl_sift_dsp_split_update (VlSiftDspSplit * split,
+                           double armPixels,
+                           double dspPixels,
+                           double armTime,
+                           double waitTime)
+{
+  double dspTime = armTime + waitTime ;
+  double ratio ;
+
+  split->armTime   += armTime ;
+  split->dspTime   += dspTime ;
+  split->armPixels += armPixels ;
+  split->dspPixels += dspPixels ;
+
+  if (! split->adaptive || armTime <= 0 || armPixels <= 0 || dspPixels <= 0) {
+    return ;
+  }
+
+  if (waitTime < VL_SIFT_DSP_SPLIT_SLACK * armTime) {
+    ratio = split->ratio + VL_SIFT_DSP_SPLIT_STEP ;
+  } else {
+    double armRate = armPixels / armTime ;
+    double dspRate = dspPixels / dspTime ;
+    ratio = 0.5 * (split->ratio + dspRate / (armRate + dspRate)) ;
+  }
+
+  split->ratio = VL_MAX (VL_MIN (ratio, 1 - VL_SIFT_DSP_SPLIT_MIN),
+                         VL_SIFT_DSP_SPLIT_MIN) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Smooth an image on both the ARM and the DSP
+ **
+ ** @param self         SIFT filter.
+ ** @param split        split of the current octave.
+ ** @param outputImage  output image buffer.
+ ** @param tempImage    temporary image buffer.
+ ** @param inputImage   input image buffer.
+ ** @param width        input image width.
+ ** @param height       input image height.
+ ** @param dog          DoG output (or @c NULL).
+ **
+ ** In each convolution pass the first columns (see
+ ** ::_vl_sift_split_columns) are posted to the DSP and the others are
+ ** convolved by the ARM threads meanwhile. The second pass needs all
+ ** of the first one, so the two shares of the temporary image are
+ ** exchanged in between. The Gaussian filter must be prepared by the
+ ** caller.
+ **
+ ** @return error code of ::vl_dsp_wait.
+ **/
+
+static int
+_vl_sift_smooth_split (VlSiftFilt * self,
+                       VlSiftDspSplit * split,
+                       vl_sift_pix * outputImage,
+                       vl_sift_pix * tempImage,
+                       vl_sift_pix const * inputImage,
+                       vl_size width,
+                       vl_size height,
+                       vl_sift_pix * dog)
+{
+  int const fw    = self->gaussFilterWidth ;
+  int const flags = VL_PAD_BY_CONTINUITY | VL_TRANSPOSE ;
+  int const c1    = _vl_sift_split_columns (tempImage,   height, (int) width,  split->ratio) ;
+  int const c2    = _vl_sift_split_columns (outputImage, width,  (int) height, split->ratio) ;
+  double armTime  = 0 ;
+  double waitTime = 0 ;
+  double t0, t1 ;
+  vl_dsp_token token = 0 ;
+  VlSiftSmoothPass pass ;
+
+  vl_dsp_dmm_range_begin ((void*) inputImage,
+                          sizeof(vl_sift_pix) * width * height, VL_DSP_TO_DEVICE) ;
+  vl_dsp_dmm_range_begin (self->gaussFilter,
+                          sizeof(vl_sift_pix) * (2 * fw + 1), VL_DSP_TO_DEVICE) ;
+  if (c1 > 0) {
+    vl_dsp_dmm_range_begin (tempImage,
+                            sizeof(vl_sift_pix) * c1 * height, VL_DSP_FROM_DEVICE) ;
+  }
+  if (c2 > 0) {
+    vl_dsp_dmm_range_begin (outputImage,
+                            sizeof(vl_sift_pix) * c2 * width, VL_DSP_FROM_DEVICE) ;
+  }
+
+  pass.filt       = self->gaussFilter ;
+  pass.filt_width = fw ;
+
+  /* columns of the input to rows of the temporary buffer */
+  t0 = vl_get_real_time () ;
+  if (c1 > 0) {
+    token = vl_imconvcol_vf_on_dsp_async (tempImage, height,
+                                          inputImage, height, width,
+                                          self->gaussFilter, - fw, fw,
+                                          1, flags, 0, c1) ;
+    vl_dsp_submit () ;
+  }
+  if (c1 < (int) width) {
+    pass.dst        = tempImage + c1 * height ;
+    pass.dst_stride = height ;
+    pass.src        = inputImage + c1 ;
+    pass.src_width  = width - c1 ;
+    pass.src_height = height ;
+    pass.src_stride = width ;
+    pass.dog        = NULL ;
+    pass.prev       = NULL ;
+    _vl_sift_smooth_pass (&pass) ;
+  }
+  t1 = vl_get_real_time () ;
+  armTime += t1 - t0 ;
+
+  if (c1 > 0) {
+    if (vl_dsp_wait (token)) {
+      return VL_ERR_IO ;
+    }
+    waitTime += vl_get_real_time () - t1 ;
+    vl_dsp_dmm_range_end (tempImage,
+                          sizeof(vl_sift_pix) * c1 * height, VL_DSP_FROM_DEVICE) ;
+  }
+
+  /* the DSP reads all of the temporary buffer in the second pass */
+  if (c2 > 0 && c1 < (int) width) {
+    vl_dsp_dmm_range_begin (tempImage + c1 * height,
+                            sizeof(vl_sift_pix) * (width - c1) * height, VL_DSP_TO_DEVICE) ;
+  }
+
+  /* and back, computing the DoG rows as they are completed */
+  t0 = vl_get_real_time () ;
+  if (c2 > 0) {
+    token = vl_imconvcol_vf_on_dsp_async (outputImage, width,
+                                          tempImage, width, height,
+                                          self->gaussFilter, - fw, fw,
+                                          1, flags, 0, c2) ;
+    vl_dsp_submit () ;
+  }
+  if (c2 < (int) height) {
+    pass.dst        = outputImage + c2 * width ;
+    pass.dst_stride = width ;
+    pass.src        = tempImage + c2 ;
+    pass.src_width  = height - c2 ;
+    pass.src_height = width ;
+    pass.src_stride = height ;
+    pass.dog        = dog ? dog + c2 * width : NULL ;
+    pass.prev       = inputImage + c2 * width ;
+    _vl_sift_smooth_pass (&pass) ;
+  }
+  t1 = vl_get_real_time () ;
+  armTime += t1 - t0 ;
+
+  if (c2 > 0) {
+    if (vl_dsp_wait (token)) {
+      return VL_ERR_IO ;
+    }
+    waitTime += vl_get_real_time () - t1 ;
+    vl_dsp_dmm_range_end (outputImage,
+                          sizeof(vl_sift_pix) * c2 * width, VL_DSP_FROM_DEVICE) ;
+    if (dog) {
+      _vl_sift_subtract (dog, outputImage, inputImage, (vl_size) c2 * width) ;
+    }
+  }
+
+  _vl_sift_dsp_split_update (split,
+                             (double) ((width - c1) * height + (height - c2) * width),
+                             (double) (c1 * height + c2 * width),
+                             armTime, waitTime) ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Stop using the DSP after it failed
+ **
+ ** @param self SIFT filter.
+ ** @return ::VL_ERR_IO.
+ **
+ ** The results of the failed commands are lost. The function waits
+ ** for the answers to all the commands still pending, so the DSP no
+ ** longer writes the filter buffers, then moves all octaves to the
+ ** ARM and returns the error to the caller, which can process the
+ ** image again. The caller restores the split with
+ ** ::vl_sift_set_dsp_split when it wants to use the DSP again.
+ **/
+
+static int
+_vl_sift_dsp_failed (VlSiftFilt * self)
+{
+  int o ;
+
+  vl_dsp_drain () ;
+
+  for (o = 0 ; o < self->O ; ++o) {
+    self->dspSplit [o].ratio    = 0 ;
+    self->dspSplit [o].adaptive = VL_FALSE ;
+  }
+  return VL_ERR_IO ;
+}
+
 /** ------------------------------------------------------------------
  ** @internal
  ** @brief Smooth an image
@@ -788,62 +1325,87 @@ copy_and_upsample_rows
  ** @param width       input image width.
  ** @param height      input image height.
  ** @param sigma       smoothing.
+ ** @param dog         DoG output buffer (or NULL).
+ **
+ ** If @a dog is not @c NULL, the function also stores there the
+ ** difference @a outputImage - @a inputImage (the two must then be
+ ** distinct buffers).
+ **
+ ** The two passes of the separable convolution are split by columns
+ ** over ::vl_get_max_threads threads. If a DSP is available, the
+ ** split of the current octave (::vl_sift_set_dsp_split) decides
+ ** whether they run on the DSP, on the ARM or on both.
+ **
+ ** @return error code, ::VL_ERR_IO if the DSP failed (see
+ ** ::_vl_sift_dsp_failed).
  **/
 
-static void
+static int
 _vl_sift_smooth (VlSiftFilt * self,
                  vl_sift_pix * outputImage,
                  vl_sift_pix * tempImage,
                  vl_sift_pix const * inputImage,
                  vl_size width,
                  vl_size height,
-                 double sigma)
+                 double sigma,
+                 vl_sift_pix * dog)
 {
+  VlSiftSmoothPass pass ;
+
   /* prepare Gaussian filter */
   if (self->gaussFilterSigma != sigma) {
-    vl_uindex j ;
-    vl_sift_pix acc = 0 ;
-    if (self->gaussFilter) vl_free (self->gaussFilter) ;
-    self->gaussFilterWidth = VL_MAX(ceil(4.0 * sigma), 1) ;
+    VlSiftGaussFilter *entry = _vl_sift_get_gauss_filter (self, sigma) ;
+    self->gaussFilter      = entry->filter ;
+    self->gaussFilterWidth = entry->width ;
     self->gaussFilterSigma = sigma ;
-    self->gaussFilter = (vl_sift_pix*)vl_malloc (sizeof(vl_sift_pix) * (2 * self->gaussFilterWidth + 1)) ;
-
-    for (j = 0 ; j < 2 * self->gaussFilterWidth + 1 ; ++j) {
-      vl_sift_pix d = ((vl_sift_pix)((signed)j - (signed)self->gaussFilterWidth)) / ((vl_sift_pix)sigma) ;
-      self->gaussFilter[j] = (vl_sift_pix) exp (- 0.5 * (d*d)) ;
-      acc += self->gaussFilter[j] ;
-    }
-    for (j = 0 ; j < 2 * self->gaussFilterWidth + 1 ; ++j) {
-      self->gaussFilter[j] /= acc ;
-    }
   }
 
   if (self->gaussFilterWidth == 0) {
     memcpy (outputImage, inputImage, sizeof(vl_sift_pix) * width * height) ;
-    return ;
+    if (dog) memset (dog, 0, sizeof(vl_sift_pix) * width * height) ;
+    return VL_ERR_OK ;
   }
 
-  #ifdef ARCH_ARM
-    vl_imconvcol_vf_on_dsp
-  #else
-    vl_imconvcol_vf
-  #endif
-                  (tempImage, height,
-                   inputImage, width, height, width,
-                   self->gaussFilter,
-                   - self->gaussFilterWidth, self->gaussFilterWidth,
-                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+  if (vl_dsp_is_available()) {
+    VlSiftDspSplit * split = self->dspSplit + (self->o_cur - self->o_min) ;
+    int err = VL_ERR_OK ;
+    if (split->ratio >= 1) {
+      err = _vl_sift_smooth_on_dsp (self, outputImage, tempImage, inputImage,
+                                    width, height, dog) ;
+      return err ? _vl_sift_dsp_failed (self) : VL_ERR_OK ;
+    }
+    if (split->ratio > 0) {
+      err = _vl_sift_smooth_split (self, split, outputImage, tempImage, inputImage,
+                                   width, height, dog) ;
+      return err ? _vl_sift_dsp_failed (self) : VL_ERR_OK ;
+    }
+  }
 
-  #ifdef ARCH_ARM
-    vl_imconvcol_vf_on_dsp
-  #else
-    vl_imconvcol_vf
-  #endif
-                  (outputImage, width,
-                   tempImage, height, width, height,
-                   self->gaussFilter,
-                   - self->gaussFilterWidth, self->gaussFilterWidth,
-                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+  pass.filt       = self->gaussFilter ;
+  pass.filt_width = self->gaussFilterWidth ;
+
+  /* columns of the input to rows of the temporary buffer */
+  pass.dst        = tempImage ;
+  pass.dst_stride = height ;
+  pass.src        = inputImage ;
+  pass.src_width  = width ;
+  pass.src_height = height ;
+  pass.src_stride = width ;
+  pass.dog        = NULL ;
+  pass.prev       = NULL ;
+  _vl_sift_smooth_pass (&pass) ;
+
+  /* and back, computing the DoG rows as they are completed */
+  pass.dst        = outputImage ;
+  pass.dst_stride = width ;
+  pass.src        = tempImage ;
+  pass.src_width  = height ;
+  pass.src_height = width ;
+  pass.src_stride = height ;
+  pass.dog        = dog ;
+  pass.prev       = inputImage ;
+  _vl_sift_smooth_pass (&pass) ;
+  return VL_ERR_OK ;
 }
 
 
@@ -883,6 +1445,129 @@ copy_and_downsample
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Downsample an 8 bit image
+ **
+ ** Same as ::copy_and_downsample, for an image of bytes.
+ **/
+
+static void
+copy_and_downsample_u8
+(vl_sift_pix    *dst,
+ vl_uint8 const *src,
+ int width, int height, int d)
+{
+  int x, y ;
+
+  d = 1 << d ; /* d = 2^d */
+  for(y = 0 ; y < height ; y+=d) {
+    vl_uint8 const * srcrowp = src + y * width ;
+    for(x = 0 ; x < width - (d-1) ; x+=d) {
+      *dst++ = *srcrowp ;
+      srcrowp += d ;
+    }
+  }
+}
+
+/** @internal @brief First level from an 8 bit image */
+typedef struct _VlSiftBaseU8
+{
+  vl_sift_pix    *dst ;     /**< first level of the octave */
+  vl_uint8 const *src ;     /**< input image */
+  int width ;               /**< input width */
+  int height ;              /**< input height */
+  int rows ;                /**< input rows per task */
+  vl_bool upsample ;        /**< double the image (or just convert it) */
+} VlSiftBaseU8 ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Convert and possibly double a chunk of input rows
+ **
+ ** @param data   ::VlSiftBaseU8.
+ ** @param task   chunk index.
+ ** @param thread thread index (unused).
+ **
+ ** When doubling, input row @c y gives the output rows @c 2y and @c
+ ** 2y+1 in one pass: the even row is the horizontally doubled input
+ ** row, the odd row the average of it and the (doubled) next input
+ ** row. The result is the same as the two passes of
+ ** ::copy_and_upsample_rows, without their intermediate image.
+ **/
+
+static void
+_vl_sift_base_u8_rows (void * data, vl_uindex task, vl_uindex thread)
+{
+  VlSiftBaseU8 * b = (VlSiftBaseU8 *) data ;
+  int w  = b->width ;
+  int y0 = (int) task * b->rows ;
+  int y1 = VL_MIN (y0 + b->rows, b->height) ;
+  int x, y ;
+
+  (void) thread ;
+
+  if (! b->upsample) {
+    vl_sift_pix    * dst = b->dst + y0 * w ;
+    vl_uint8 const * src = b->src + y0 * w ;
+    vl_uint8 const * end = b->src + y1 * w ;
+    while (src < end) *dst++ = *src++ ;
+    return ;
+  }
+
+  for (y = y0 ; y < y1 ; ++y) {
+    vl_uint8 const * a = b->src + y * w ;
+    vl_uint8 const * c = b->src + VL_MIN (y + 1, b->height - 1) * w ;
+    vl_sift_pix * even = b->dst + 4 * w * y ;
+    vl_sift_pix * odd  = even + 2 * w ;
+
+    for (x = 0 ; x < w - 1 ; ++x) {
+      vl_sift_pix c1 = (vl_sift_pix) (0.5 * (c [x] + c [x+1])) ;
+      even [2*x]   = a [x] ;
+      even [2*x+1] = (vl_sift_pix) (0.5 * (a [x] + a [x+1])) ;
+      odd  [2*x]   = (vl_sift_pix) (0.5 * (even [2*x]   + c [x])) ;
+      odd  [2*x+1] = (vl_sift_pix) (0.5 * (even [2*x+1] + c1)) ;
+    }
+    even [2*w-2] = even [2*w-1] = a [w-1] ;
+    odd  [2*w-2] = odd  [2*w-1] = (vl_sift_pix) (0.5 * (even [2*w-2] + c [w-1])) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the first level of an octave from an 8 bit image
+ **
+ ** @param dst      first level.
+ ** @param src      input image.
+ ** @param width    input width.
+ ** @param height   input height.
+ ** @param upsample double the image (or just convert it).
+ **
+ ** The rows are split among the threads, like the convolutions.
+ **/
+
+static void
+_vl_sift_base_u8 (vl_sift_pix *dst, vl_uint8 const *src,
+                  int width, int height, vl_bool upsample)
+{
+  VlSiftBaseU8 b ;
+  int numThreads = (int) vl_get_max_threads () ;
+
+  b.dst = dst ;
+  b.src = src ;
+  b.width = width ;
+  b.height = height ;
+  b.upsample = upsample ;
+
+  if (numThreads <= 1 || width * height < VL_SIFT_SMOOTH_MIN_PARALLEL) {
+    b.rows = height ;
+  } else {
+    b.rows = VL_MAX ((height + 4 * numThreads - 1) / (4 * numThreads), 8) ;
+  }
+
+  vl_parallel_for ((height + b.rows - 1) / b.rows, _vl_sift_base_u8_rows, &b) ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Create a new SIFT filter
  **
@@ -913,6 +1598,7 @@ vl_sift_new (int width, int height,
   int w   = VL_SHIFT_LEFT (width,  -o_min) ;
   int h   = VL_SHIFT_LEFT (height, -o_min) ;
   int nel = w * h ;
+  int o ;
 
   /* negative value O => calculate max. value */
   if (noctaves < 0) {
@@ -934,7 +1620,11 @@ vl_sift_new (int width, int height,
   f-> dog     = (vl_sift_pix*)vl_malloc (sizeof(vl_sift_pix) * nel
                         * (f->s_max - f->s_min    )  ) ;
   f-> grad    = (vl_sift_pix*)vl_malloc (sizeof(vl_sift_pix) * nel * 2
-                        * (f->s_max - f->s_min    )  ) ;
+                        * (f->s_max - f->s_min - 2)  ) ;
+  f-> gradTiles = (vl_uint8*)vl_calloc
+    ((f->s_max - f->s_min - 2) *
+     ((w + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE) *
+     ((h + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE), sizeof(vl_uint8)) ;
 
   f-> sigman  = 0.5 ;
   f-> sigmak  = pow (2.0, 1.0 / nlevels) ;
@@ -945,6 +1635,12 @@ vl_sift_new (int width, int height,
   f-> gaussFilterSigma = 0 ;
   f-> gaussFilterWidth = 0 ;
 
+  /* one kernel per level, plus the first-level kernels of the first
+     and of the following octaves */
+  f-> gaussFilterCacheSize = (f->s_max - f->s_min) + 2 ;
+  f-> gaussFilterCache = (VlSiftGaussFilter*)vl_calloc (f->gaussFilterCacheSize,
+                                                        sizeof(VlSiftGaussFilter)) ;
+
   f-> octave_width  = 0 ;
   f-> octave_height = 0 ;
 
@@ -959,6 +1655,13 @@ vl_sift_new (int width, int height,
   f-> windowSize  = NBP / 2 ;
 
   f-> grad_o  = o_min - 1 ;
+  f-> dog_o   = o_min - 1 ;
+
+  /* everything on the DSP, if there is one */
+  f-> dspSplit = (VlSiftDspSplit*)vl_calloc (noctaves, sizeof(VlSiftDspSplit)) ;
+  for (o = 0 ; o < noctaves ; ++o) {
+    f-> dspSplit [o] .ratio = 1.0 ;
+  }
 
   /* initialize fast_expn stuff */
   fast_expn_init () ;
@@ -981,14 +1684,226 @@ vl_sift_delete (VlSiftFilt* f)
   if (f) {
     if (f->keys) vl_free (f->keys) ;
     if (f->grad) vl_free (f->grad) ;
+    if (f->gradTiles) vl_free (f->gradTiles) ;
+    if (f->dspSplit) vl_free (f->dspSplit) ;
     if (f->dog) vl_free (f->dog) ;
     if (f->octave) vl_free (f->octave) ;
     if (f->temp) vl_free (f->temp) ;
-    if (f->gaussFilter) vl_free (f->gaussFilter) ;
+    if (f->gaussFilterCache) {
+      int i ;
+      for (i = 0 ; i < f->gaussFilterCacheSize ; ++i) {
+        if (f->gaussFilterCache[i].filter) vl_free (f->gaussFilterCache[i].filter) ;
+      }
+      vl_free (f->gaussFilterCache) ;
+    }
     vl_free (f) ;
   }
 }
 
+/** -------------------------------------------------------------------
+ ** @brief Set the ARM/DSP split of an octave
+ **
+ ** @param f        SIFT filter.
+ ** @param o        octave index.
+ ** @param ratio    fraction of the convolution columns for the DSP.
+ ** @param adaptive whether to adapt @a ratio to the measured times.
+ **
+ ** With a DSP (::vl_dsp_is_available), a ratio of 1 (the default)
+ ** builds the whole octave with one DSP command and a ratio of 0
+ ** keeps it on the ARM. In between, each smoothing is shared so that
+ ** the ARM and the DSP work at the same time.
+ **
+ ** An adaptive split starts from @a ratio (kept within
+ ** ::VL_SIFT_DSP_SPLIT_MIN of 0 and 1) and moves towards the ratio at
+ ** which both finish together. It needs a wall clock
+ ** (::vl_set_real_time_func). The measured times are accumulated in
+ ** any case (::vl_sift_get_dsp_split).
+ **/
+
+VL_EXPORT void
+vl_sift_set_dsp_split (VlSiftFilt *f, int o, double ratio, vl_bool adaptive)
+{
+  VlSiftDspSplit * split ;
+
+  if (o < f->o_min || o >= f->o_min + f->O) return ;
+  split = f->dspSplit + (o - f->o_min) ;
+
+  ratio = VL_MAX (VL_MIN (ratio, 1.0), 0.0) ;
+  if (adaptive) {
+    ratio = VL_MAX (VL_MIN (ratio, 1 - VL_SIFT_DSP_SPLIT_MIN),
+                    VL_SIFT_DSP_SPLIT_MIN) ;
+  }
+  split->ratio    = ratio ;
+  split->adaptive = adaptive ;
+}
+
+/** -------------------------------------------------------------------
+ ** @brief Get the ARM/DSP split of an octave
+ **
+ ** @param f SIFT filter.
+ ** @param o octave index.
+ ** @return split of the octave, or @c NULL if @a o is out of range.
+ **/
+
+VL_EXPORT VlSiftDspSplit const *
+vl_sift_get_dsp_split (VlSiftFilt const *f, int o)
+{
+  if (o < f->o_min || o >= f->o_min + f->O) return NULL ;
+  return f->dspSplit + (o - f->o_min) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the levels of the current octave and the DoG
+ **
+ ** @param f   SIFT filter.
+ ** @param sd0 smoothing to apply to the first level in place (0 for none).
+ **
+ ** The first level of the octave must be set. The other levels are
+ ** obtained by smoothing the previous one incrementally; the DoG is
+ ** computed along. If a DSP is available and the octave is not split
+ ** with the ARM (::vl_sift_set_dsp_split), the whole octave is built
+ ** by a single DSP command.
+ **
+ ** @return error code, ::VL_ERR_IO if the DSP failed (see
+ ** ::_vl_sift_dsp_failed).
+ **/
+
+static int
+_vl_sift_fill_octave (VlSiftFilt *f, double sd0)
+{
+  int    w      = f->octave_width ;
+  int    h      = f->octave_height ;
+  int    s_min  = f->s_min ;
+  int    s_max  = f->s_max ;
+  int    s ;
+  VlSiftDspSplit const * split = f->dspSplit + (f->o_cur - f->o_min) ;
+
+  if (vl_dsp_is_available() && split->ratio >= 1 &&
+      s_max - s_min + 1 <= VL_DSP_MAX_LEVELS) {
+    float const * filt       [VL_DSP_MAX_LEVELS] ;
+    int           filt_width [VL_DSP_MAX_LEVELS] ;
+
+    for (s = s_min ; s <= s_max ; ++s) {
+      double sd = (s == s_min) ? sd0 : f->dsigma0 * pow (f->sigmak, s) ;
+      VlSiftGaussFilter *entry = (sd > 0) ? _vl_sift_get_gauss_filter (f, sd) : NULL ;
+      filt       [s - s_min] = entry ? entry->filter : NULL ;
+      filt_width [s - s_min] = entry ? (int) entry->width : 0 ;
+    }
+
+    if (vl_sift_octave_on_dsp (vl_sift_get_octave (f, s_min), f->dog, f->temp,
+                               w, h, s_max - s_min + 1, sd0 > 0,
+                               filt, filt_width)) {
+      return _vl_sift_dsp_failed (f) ;
+    }
+  } else {
+    if (sd0 > 0) {
+      vl_sift_pix *octave = vl_sift_get_octave (f, s_min) ;
+      if (_vl_sift_smooth (f, octave, f->temp, octave, w, h, sd0, NULL)) {
+        return VL_ERR_IO ;
+      }
+    }
+
+    for (s = s_min + 1 ; s <= s_max ; ++s) {
+      double sd = f->dsigma0 * pow (f->sigmak, s) ;
+      if (_vl_sift_smooth (f, vl_sift_get_octave(f, s), f->temp,
+                           vl_sift_get_octave(f, s - 1), w, h, sd,
+                           f->dog + (s - 1 - s_min) * w * h)) {
+        return VL_ERR_IO ;
+      }
+    }
+  }
+
+  f->dog_o = f->o_cur ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Reset the filter for a new image
+ **
+ ** @param f SIFT filter.
+ **
+ ** @return ::VL_ERR_EOF if there are no octaves to process.
+ **/
+
+static int
+_vl_sift_begin_first_octave (VlSiftFilt *f)
+{
+  /* restart from the first */
+  f->o_cur = f->o_min ;
+  f->nkeys = 0 ;
+
+  /* the filter may be reused for several images: invalidate the
+     gradient and DoG computed for the previous one */
+  f->grad_o = f->o_min - 1 ;
+  f->dog_o  = f->o_min - 1 ;
+  f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
+  f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
+
+  /* is there at least one octave? */
+  if (f->O == 0)
+    return VL_ERR_EOF ;
+
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Upsample the first level of the first octave further
+ **
+ ** @param f SIFT filter.
+ **
+ ** The first level holds the image doubled once; this doubles it
+ ** until it has the size of octave @c o_min.
+ **/
+
+static void
+_vl_sift_double_more (VlSiftFilt *f)
+{
+  int o ;
+  vl_sift_pix *temp   = f-> temp ;
+  vl_sift_pix *octave = vl_sift_get_octave (f, f->s_min) ;
+  int width           = f-> width ;
+  int height          = f-> height ;
+
+  for(o = -1 ; o > f->o_min ; --o) {
+    copy_and_upsample_rows (temp, octave,
+                            width << -o,      height << -o ) ;
+    copy_and_upsample_rows (octave, temp,
+                            width << -o, 2 * (height << -o)) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the first octave from its first level
+ **
+ ** @param f SIFT filter.
+ ** @return error code of ::_vl_sift_fill_octave.
+ **/
+
+static int
+_vl_sift_end_first_octave (VlSiftFilt *f)
+{
+  double sa, sb ;
+
+  /*
+   * Here we adjust the smoothing of the first level of the octave.
+   * The input image is assumed to have nominal smoothing equal to
+   * f->simgan.
+   */
+
+  sa = f->sigma0 * pow (f->sigmak,   f->s_min) ;
+  sb = f->sigman * pow (2.0,       - f->o_min) ;
+
+  /* -----------------------------------------------------------------
+   *                                          Compute the first octave
+   * -------------------------------------------------------------- */
+
+  return _vl_sift_fill_octave (f, (sa > sb) ? sqrt (sa*sa - sb*sb) : 0) ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Start processing a new image
  **
@@ -1000,7 +1915,9 @@ vl_sift_delete (VlSiftFilt* f)
  ** internal keypoint buffer.
  **
  ** @return error code. The function returns ::VL_ERR_EOF if there are
- ** no more octaves to process.
+ ** no more octaves to process, and ::VL_ERR_IO if the DSP failed; the
+ ** filter then runs on the ARM only and the image can be processed
+ ** again.
  **
  ** @sa ::vl_sift_process_next_octave().
  **/
@@ -1009,8 +1926,6 @@ VL_EXPORT
 int
 vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
 {
-  int o, s, h, w ;
-  double sa, sb ;
   vl_sift_pix *octave ;
 
   /* shortcuts */
@@ -1018,21 +1933,8 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
   int width           = f-> width ;
   int height          = f-> height ;
   int o_min           = f-> o_min ;
-  int s_min           = f-> s_min ;
-  int s_max           = f-> s_max ;
-  double sigma0       = f-> sigma0 ;
-  double sigmak       = f-> sigmak ;
-  double sigman       = f-> sigman ;
-  double dsigma0      = f-> dsigma0 ;
 
-  /* restart from the first */
-  f->o_cur = o_min ;
-  f->nkeys = 0 ;
-  w = f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
-  h = f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
-
-  /* is there at least one octave? */
-  if (f->O == 0)
+  if (_vl_sift_begin_first_octave (f))
     return VL_ERR_EOF ;
 
   /* ------------------------------------------------------------------
@@ -1045,58 +1947,75 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
    * the first octave has index zero, we just copy the image.
    */
 
-  octave = vl_sift_get_octave (f, s_min) ;
+  octave = vl_sift_get_octave (f, f->s_min) ;
+
+  if (o_min < 0) {
+    /* double once */
+    copy_and_upsample_rows (temp,   im,   width,      height) ;
+    copy_and_upsample_rows (octave, temp, height, 2 * width ) ;
+
+    /* double more */
+    _vl_sift_double_more (f) ;
+  }
+  else if (o_min > 0) {
+    /* downsample */
+    copy_and_downsample (octave, im, width, height, o_min) ;
+  }
+  else {
+    /* direct copy */
+    memcpy(octave, im, sizeof(vl_sift_pix) * width * height) ;
+  }
+
+  return _vl_sift_end_first_octave (f) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Start processing a new 8 bit image
+ **
+ ** @param f  SIFT filter.
+ ** @param im image data, one byte per pixel.
+ **
+ ** Same as ::vl_sift_process_first_octave(), but the image is
+ ** converted while computing the first level of the first octave, so
+ ** no floating point copy of it is needed. If the image is doubled,
+ ** conversion and doubling are done in a single pass.
+ **
+ ** @return error code (see ::vl_sift_process_first_octave()).
+ **/
+
+VL_EXPORT
+int
+vl_sift_process_first_octave_u8 (VlSiftFilt *f, vl_uint8 const *im)
+{
+  vl_sift_pix *octave ;
+
+  /* shortcuts */
+  int width           = f-> width ;
+  int height          = f-> height ;
+  int o_min           = f-> o_min ;
+
+  if (_vl_sift_begin_first_octave (f))
+    return VL_ERR_EOF ;
+
+  /* first sublevel of the first octave, as in
+     vl_sift_process_first_octave() */
+  octave = vl_sift_get_octave (f, f->s_min) ;
 
   if (o_min < 0) {
-    /* double once */
-    copy_and_upsample_rows (temp,   im,   width,      height) ;
-    copy_and_upsample_rows (octave, temp, height, 2 * width ) ;
+    /* convert and double once */
+    _vl_sift_base_u8 (octave, im, width, height, VL_TRUE) ;
 
     /* double more */
-    for(o = -1 ; o > o_min ; --o) {
-      copy_and_upsample_rows (temp, octave,
-                              width << -o,      height << -o ) ;
-      copy_and_upsample_rows (octave, temp,
-                              width << -o, 2 * (height << -o)) ;
-    }
+    _vl_sift_double_more (f) ;
   }
   else if (o_min > 0) {
-    /* downsample */
-    copy_and_downsample (octave, im, width, height, o_min) ;
+    copy_and_downsample_u8 (octave, im, width, height, o_min) ;
   }
   else {
-    /* direct copy */
-    memcpy(octave, im, sizeof(vl_sift_pix) * width * height) ;
-  }
-
-  /*
-   * Here we adjust the smoothing of the first level of the octave.
-   * The input image is assumed to have nominal smoothing equal to
-   * f->simgan.
-   */
-
-  sa = sigma0 * pow (sigmak,   s_min) ;
-  sb = sigman * pow (2.0,    - o_min) ;
-
-
-
-  if (sa > sb) {
-    double sd = sqrt (sa*sa - sb*sb) ;
-    _vl_sift_smooth (f, octave, temp, octave, w, h, sd) ;
-  }
-
-  /* -----------------------------------------------------------------
-   *                                          Compute the first octave
-   * -------------------------------------------------------------- */
-
-  for(s = s_min + 1 ; s <= s_max ; ++s) {
-    double sd = dsigma0 * pow (sigmak, s) ;
-    _vl_sift_smooth (f, vl_sift_get_octave(f, s), temp,
-                     vl_sift_get_octave(f, s - 1), w, h, sd) ;
+    _vl_sift_base_u8 (octave, im, width, height, VL_FALSE) ;
   }
 
-
-  return VL_ERR_OK ;
+  return _vl_sift_end_first_octave (f) ;
 }
 
 /** ------------------------------------------------------------------
@@ -1109,7 +2028,9 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
  ** previous octave.
  **
  ** @return error code. The function returns the error
- ** ::VL_ERR_EOF when there are no more octaves to process.
+ ** ::VL_ERR_EOF when there are no more octaves to process, and
+ ** ::VL_ERR_IO if the DSP failed (see
+ ** ::vl_sift_process_first_octave()).
  **
  ** @sa ::vl_sift_process_first_octave().
  **/
@@ -1119,12 +2040,11 @@ int
 vl_sift_process_next_octave (VlSiftFilt *f)
 {
 
-  int s, h, w, s_best ;
+  int h, w, s_best ;
   double sa, sb ;
   vl_sift_pix *octave, *pt ;
 
   /* shortcuts */
-  vl_sift_pix *temp   = f-> temp ;
   int O               = f-> O ;
   int S               = f-> S ;
   int o_min           = f-> o_min ;
@@ -1132,7 +2052,6 @@ vl_sift_process_next_octave (VlSiftFilt *f)
   int s_max           = f-> s_max ;
   double sigma0       = f-> sigma0 ;
   double sigmak       = f-> sigmak ;
-  double dsigma0      = f-> dsigma0 ;
 
   /* is there another octave ? */
   if (f->o_cur == o_min + O - 1)
@@ -1156,21 +2075,41 @@ vl_sift_process_next_octave (VlSiftFilt *f)
   sa = sigma0 * powf (sigmak, s_min     ) ;
   sb = sigma0 * powf (sigmak, s_best - S) ;
 
-  if (sa > sb) {
-    double sd = sqrt (sa*sa - sb*sb) ;
-    _vl_sift_smooth (f, octave, temp, octave, w, h, sd) ;
-  }
-
   /* ------------------------------------------------------------------
    *                                                        Fill octave
    * --------------------------------------------------------------- */
 
-  for(s = s_min + 1 ; s <= s_max ; ++s) {
-    double sd = dsigma0 * pow (sigmak, s) ;
-    _vl_sift_smooth (f, vl_sift_get_octave(f, s), temp,
-                     vl_sift_get_octave(f, s - 1), w, h, sd) ;
-  }
+  return _vl_sift_fill_octave (f, (sa > sb) ? sqrt (sa*sa - sb*sb) : 0) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Make room for a number of keypoints
+ **
+ ** @param f SIFT filter.
+ ** @param n number of keypoints.
+ ** @return error code (::VL_ERR_ALLOC if the buffer cannot grow).
+ **
+ ** ::vl_sift_detect grows the keypoint buffer as it needs. Reserving
+ ** it beforehand keeps the detection of images with up to @a n
+ ** keypoints per octave from allocating memory.
+ **/
+
+VL_EXPORT
+int
+vl_sift_reserve_keypoints (VlSiftFilt * f, int n)
+{
+  VlSiftKeypoint * keys ;
+  int keys_res ;
+
+  if (n <= f->keys_res) return VL_ERR_OK ;
+
+  /* same granularity as vl_sift_detect */
+  keys_res = (n + 499) / 500 * 500 ;
+  keys = (VlSiftKeypoint*) vl_realloc (f->keys, keys_res * sizeof(VlSiftKeypoint)) ;
+  if (! keys) return VL_ERR_ALLOC ;
 
+  f->keys = keys ;
+  f->keys_res = keys_res ;
   return VL_ERR_OK ;
 }
 
@@ -1210,15 +2149,19 @@ vl_sift_detect (VlSiftFilt * f)
   f-> nkeys = 0 ;
 
 
-  /* compute difference of gaussian (DoG) */
-  pt = f-> dog ;
-  for (s = s_min ; s <= s_max - 1 ; ++s) {
-    vl_sift_pix* src_a = vl_sift_get_octave (f, s    ) ;
-    vl_sift_pix* src_b = vl_sift_get_octave (f, s + 1) ;
-    vl_sift_pix* end_a = src_a + w * h ;
-    while (src_a != end_a) {
-      *pt++ = *src_b++ - *src_a++ ;
+  /* compute difference of gaussian (DoG), unless the octave
+     processing did it already */
+  if (f->dog_o != f->o_cur) {
+    pt = f-> dog ;
+    for (s = s_min ; s <= s_max - 1 ; ++s) {
+      vl_sift_pix* src_a = vl_sift_get_octave (f, s    ) ;
+      vl_sift_pix* src_b = vl_sift_get_octave (f, s + 1) ;
+      vl_sift_pix* end_a = src_a + w * h ;
+      while (src_a != end_a) {
+        *pt++ = *src_b++ - *src_a++ ;
+      }
     }
+    f->dog_o = f->o_cur ;
   }
 
   /* -----------------------------------------------------------------
@@ -1470,132 +2413,410 @@ vl_sift_detect (VlSiftFilt * f)
 
 /** ------------------------------------------------------------------
  ** @internal
- ** @brief Update gradients to current GSS octave
- **
+ ** @brief Number of gradient tiles of the current octave
+ ** @param f   SIFT filter.
+ ** @param ntx number of tiles along x (output).
+ ** @param nty number of tiles along y (output).
+ ** @return number of tiles of a scale level.
+ **/
+
+static int
+_vl_sift_gradient_tiles (VlSiftFilt const *f, int *ntx, int *nty)
+{
+  *ntx = (f->octave_width  + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE ;
+  *nty = (f->octave_height + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE ;
+  return *ntx * *nty ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Invalidate the gradient if the octave has changed
  ** @param f SIFT filter.
+ **/
+
+static void
+_vl_sift_gradient_reset (VlSiftFilt *f)
+{
+  int ntx, nty ;
+  if (f->grad_o == f->o_cur) return ;
+  memset (f->gradTiles, VL_SIFT_GRAD_TILE_INVALID,
+          _vl_sift_gradient_tiles (f, &ntx, &nty) *
+          (f->s_max - f->s_min - 2)) ;
+  f->grad_o = f->o_cur ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Store the gradient modulus and angle of a pixel
+ **/
+
+#define SAVE_BACK(grad,gx,gy)                                           \
+  (grad) [0] = vl_fast_sqrt_f ((gx)*(gx) + (gy)*(gy)) ;                 \
+  (grad) [1] = vl_mod_2pi_f   (vl_fast_atan2_f ((gy), (gx)) + 2*VL_PI) ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the gradient of a segment of row
  **
- ** The function makes sure that the gradient buffer is up-to-date
- ** with the current GSS data.
+ ** @param f  SIFT filter.
+ ** @param s  scale level.
+ ** @param y  row.
+ ** @param x0 first column.
+ ** @param x1 last column (excluded).
  **
- ** @remark The minimum octave size is 2x2xS.
+ ** Central differences are used in the interior of the octave and
+ ** forward/backward differences at its borders.
  **/
 
 static void
-update_gradient (VlSiftFilt *f)
+_vl_sift_gradient_row (VlSiftFilt *f, int s, int y, int x0, int x1)
 {
-  int       s_min = f->s_min ;
-  int       s_max = f->s_max ;
-  int       w     = vl_sift_get_octave_width  (f) ;
-  int       h     = vl_sift_get_octave_height (f) ;
-  int const xo    = 1 ;
-  int const yo    = w ;
-  int const so    = h * w ;
-  int y, s ;
-
-  if (f->grad_o == f->o_cur) return ;
+  int               w    = f->octave_width ;
+  int               h    = f->octave_height ;
+  vl_sift_pix const *src  = vl_sift_get_octave (f, s) + y * w ;
+  vl_sift_pix const *up   = (y > 0)     ? src - w : src ;
+  vl_sift_pix const *down = (y < h - 1) ? src + w : src ;
+  vl_sift_pix       *grad = f->grad + 2 * (w * h * (s - f->s_min - 1) + y * w) ;
+  float       const gyScale = (up == src || down == src) ? 1.0f : 0.5f ;
+  int               xend = VL_MIN (x1, w - 1) ;
+  int               x    = x0 ;
+  vl_sift_pix gx, gy ;
+
+  /* first pixel of the row */
+  if (x == 0) {
+    gx = src [1] - src [0] ;
+    gy = gyScale * (down [0] - up [0]) ;
+    SAVE_BACK (grad, gx, gy) ;
+    ++ x ;
+  }
 
-  for (s  = s_min + 1 ;
-       s <= s_max - 2 ; ++ s) {
+  /* middle pixels of the row */
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled() && x < xend) {
+    x += _vl_sift_gradient_row_sse2
+      (grad + 2 * x, src + x, up + x, down + x, gyScale, xend - x) ;
+  }
+#endif
+#if defined(ARCH_ARM) && ! defined(VL_DISABLE_NEON)
+  if (vl_get_simd_enabled() && x < xend) {
+    x += _vl_sift_gradient_row_neon
+      (grad + 2 * x, src + x, up + x, down + x, gyScale, xend - x) ;
+  }
+#endif
+  for ( ; x < xend ; ++ x) {
+    gx = 0.5 * (src [x + 1] - src [x - 1]) ;
+    gy = gyScale * (down [x] - up [x]) ;
+    SAVE_BACK (grad + 2 * x, gx, gy) ;
+  }
 
-    vl_sift_pix *src, *end, *grad, gx, gy ;
+  /* last pixel of the row */
+  if (x1 == w) {
+    gx = src [w - 1] - src [w - 2] ;
+    gy = gyScale * (down [w - 1] - up [w - 1]) ;
+    SAVE_BACK (grad + 2 * (w - 1), gx, gy) ;
+  }
+}
 
-#define SAVE_BACK                                                       \
-    *grad++ = vl_fast_sqrt_f (gx*gx + gy*gy) ;                          \
-    *grad++ = vl_mod_2pi_f   (vl_fast_atan2_f (gy, gx) + 2*VL_PI) ;     \
-    ++src ;                                                             \
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the gradient of a tile
+ ** @param f  SIFT filter.
+ ** @param s  scale level.
+ ** @param tx tile column.
+ ** @param ty tile row.
+ **/
 
-    src  = vl_sift_get_octave (f,s) ;
-    grad = f->grad + 2 * so * (s - s_min -1) ;
+static void
+_vl_sift_gradient_tile (VlSiftFilt *f, int s, int tx, int ty)
+{
+  int x0 = tx * VL_SIFT_GRAD_TILE ;
+  int y0 = ty * VL_SIFT_GRAD_TILE ;
+  int x1 = VL_MIN (x0 + VL_SIFT_GRAD_TILE, f->octave_width) ;
+  int y1 = VL_MIN (y0 + VL_SIFT_GRAD_TILE, f->octave_height) ;
+  int y ;
+  for (y = y0 ; y < y1 ; ++ y) {
+    _vl_sift_gradient_row (f, s, y, x0, x1) ;
+  }
+}
 
-    /* first pixel of the first row */
-    gx = src[+xo] - src[0] ;
-    gy = src[+yo] - src[0] ;
-    SAVE_BACK ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Make the gradient of a window up to date
+ **
+ ** @param f  SIFT filter.
+ ** @param s  scale level.
+ ** @param xc window center x.
+ ** @param yc window center y.
+ ** @param W  window radius.
+ **
+ ** Only the tiles intersecting the window that have not been
+ ** computed yet are processed. If they all are, the function only
+ ** reads the filter.
+ **/
 
-    /* middle pixels of the  first row */
-    end = (src - 1) + w - 1 ;
-    while (src < end) {
-      gx = 0.5 * (src[+xo] - src[-xo]) ;
-      gy =        src[+yo] - src[0] ;
-      SAVE_BACK ;
+static void
+_vl_sift_update_gradient_window (VlSiftFilt *f, int s, int xc, int yc, int W)
+{
+  int ntx, nty, tx, ty, tx0, tx1, ty0, ty1 ;
+  vl_uint8 *tiles ;
+
+  _vl_sift_gradient_reset (f) ;
+  tiles = f->gradTiles + (s - f->s_min - 1) * _vl_sift_gradient_tiles (f, &ntx, &nty) ;
+
+  tx0 = VL_MAX (xc - W, 0)                    / VL_SIFT_GRAD_TILE ;
+  ty0 = VL_MAX (yc - W, 0)                    / VL_SIFT_GRAD_TILE ;
+  tx1 = VL_MIN (xc + W, f->octave_width  - 1) / VL_SIFT_GRAD_TILE ;
+  ty1 = VL_MIN (yc + W, f->octave_height - 1) / VL_SIFT_GRAD_TILE ;
+
+  for (ty = ty0 ; ty <= ty1 ; ++ ty) {
+    for (tx = tx0 ; tx <= tx1 ; ++ tx) {
+      if (tiles [ty * ntx + tx] != VL_SIFT_GRAD_TILE_VALID) {
+        _vl_sift_gradient_tile (f, s, tx, ty) ;
+        tiles [ty * ntx + tx] = VL_SIFT_GRAD_TILE_VALID ;
+      }
     }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Radius of the orientation histogram window
+ ** @param sigma keypoint scale in octave coordinates.
+ **/
+
+VL_INLINE int
+_vl_sift_orientation_radius (double sigma)
+{
+  double const sigmaw = 1.5 * sigma ;
+  return VL_MAX (floor (3.0 * sigmaw), 1) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Radius of the descriptor window
+ ** @param f     SIFT filter.
+ ** @param sigma keypoint scale in octave coordinates.
+ **/
 
-    /* last pixel of the first row */
-    gx = src[0]   - src[-xo] ;
-    gy = src[+yo] - src[0] ;
-    SAVE_BACK ;
+VL_INLINE int
+_vl_sift_descriptor_radius (VlSiftFilt const *f, double sigma)
+{
+  double const SBP = f->magnif * sigma + VL_EPSILON_D ;
+  return floor (sqrt(2.0) * SBP * (NBP + 1) / 2.0 + 0.5) ;
+}
 
-    for (y = 1 ; y < h -1 ; ++y) {
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Gradient support of a keypoint
+ **
+ ** @param f SIFT filter.
+ ** @param k keypoint.
+ ** @param xi keypoint center x in octave coordinates (output or @c NULL).
+ ** @param yi keypoint center y in octave coordinates (output or @c NULL).
+ ** @return radius of the window read by the orientation and the
+ ** descriptor of the keypoint.
+ **
+ ** The window is the union of the windows of
+ ** ::vl_sift_calc_keypoint_orientations and
+ ** ::vl_sift_calc_keypoint_descriptor, whose radii come from the same
+ ** functions.
+ **/
 
-      /* first pixel of the middle rows */
-      gx =        src[+xo] - src[0] ;
-      gy = 0.5 * (src[+yo] - src[-yo]) ;
-      SAVE_BACK ;
+static int
+_vl_sift_keypoint_support (VlSiftFilt const *f, VlSiftKeypoint const *k,
+                           int *xi, int *yi)
+{
+  double xper  = pow (2.0, f->o_cur) ;
+  double sigma = k-> sigma / xper ;
+  int    Wo    = _vl_sift_orientation_radius (sigma) ;
+  int    Wd    = _vl_sift_descriptor_radius (f, sigma) ;
+  if (xi) *xi = (int) (k-> x / xper + 0.5) ;
+  if (yi) *yi = (int) (k-> y / xper + 0.5) ;
+  return VL_MAX (Wo, Wd) ;
+}
 
-      /* middle pixels of the middle rows */
-      end = (src - 1) + w - 1 ;
-      while (src < end) {
-        gx = 0.5 * (src[+xo] - src[-xo]) ;
-        gy = 0.5 * (src[+yo] - src[-yo]) ;
-        SAVE_BACK ;
-      }
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Check that a keypoint lies on the current octave
+ ** @param f SIFT filter.
+ ** @param k keypoint.
+ ** @return true if the orientation of @a k can be computed.
+ **/
+
+static vl_bool
+_vl_sift_keypoint_in_octave (VlSiftFilt const *f, VlSiftKeypoint const *k)
+{
+  int xi, yi ;
+  if (k->o != f->o_cur) return VL_FALSE ;
+  _vl_sift_keypoint_support (f, k, &xi, &yi) ;
+  return
+    xi >= 0 && xi <= f->octave_width  - 1 &&
+    yi >= 0 && yi <= f->octave_height - 1 &&
+    k->is >= f->s_min + 1 && k->is <= f->s_max - 2 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Check that the gradient of a keypoint support is up to date
+ ** @param f SIFT filter.
+ ** @param k keypoint.
+ ** @return true if every tile read for @a k is valid.
+ **/
+
+static vl_bool
+_vl_sift_keypoint_gradient_valid (VlSiftFilt const *f, VlSiftKeypoint const *k)
+{
+  int ntx, nty, tx, ty, xi, yi ;
+  int W = _vl_sift_keypoint_support (f, k, &xi, &yi) ;
+  vl_uint8 const *tiles ;
+
+  if (f->grad_o != f->o_cur) return VL_FALSE ;
+  tiles = f->gradTiles + (k->is - f->s_min - 1) * _vl_sift_gradient_tiles (f, &ntx, &nty) ;
+
+  for (ty  = VL_MAX (yi - W, 0)                    / VL_SIFT_GRAD_TILE ;
+       ty <= VL_MIN (yi + W, f->octave_height - 1) / VL_SIFT_GRAD_TILE ; ++ ty) {
+    for (tx  = VL_MAX (xi - W, 0)                    / VL_SIFT_GRAD_TILE ;
+         tx <= VL_MIN (xi + W, f->octave_width  - 1) / VL_SIFT_GRAD_TILE ; ++ tx) {
+      if (tiles [ty * ntx + tx] != VL_SIFT_GRAD_TILE_VALID) return VL_FALSE ;
+    }
+  }
+  return VL_TRUE ;
+}
 
-      /* last pixel of the middle row */
-      gx =        src[0]   - src[-xo] ;
-      gy = 0.5 * (src[+yo] - src[-yo]) ;
-      SAVE_BACK ;
+/** ------------------------------------------------------------------
+ ** @brief Update gradients to current GSS octave
+ **
+ ** @param f SIFT filter.
+ **
+ ** The function makes sure that the whole gradient buffer is
+ ** up-to-date with the current GSS data. The gradient is otherwise
+ ** computed lazily, a tile at a time, by
+ ** ::vl_sift_calc_keypoint_orientations and
+ ** ::vl_sift_calc_keypoint_descriptor, which only touch the tiles
+ ** overlapping the keypoint support. Calling this function (or
+ ** ::vl_sift_update_gradient_for_keypoints) explicitly once per
+ ** octave leaves those two functions reading the filter only, so
+ ** that they can be invoked concurrently from several threads on the
+ ** same filter.
+ **
+ ** @remark The minimum octave size is 2x2xS.
+ **/
+
+VL_EXPORT
+void
+vl_sift_update_gradient (VlSiftFilt *f)
+{
+  int ntx, nty, n, i, s ;
+  vl_uint8 *tiles ;
+
+  _vl_sift_gradient_reset (f) ;
+  n = _vl_sift_gradient_tiles (f, &ntx, &nty) ;
+
+  for (s  = f->s_min + 1 ;
+       s <= f->s_max - 2 ; ++ s) {
+    tiles = f->gradTiles + (s - f->s_min - 1) * n ;
+    for (i = 0 ; i < n ; ++ i) {
+      if (tiles [i] != VL_SIFT_GRAD_TILE_VALID) {
+        _vl_sift_gradient_tile (f, s, i % ntx, i / ntx) ;
+        tiles [i] = VL_SIFT_GRAD_TILE_VALID ;
+      }
     }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Update the gradient around some keypoints
+ **
+ ** @param f    SIFT filter.
+ ** @param keys keypoints.
+ ** @param n    number of keypoints.
+ **
+ ** The function computes the gradient of the tiles overlapping the
+ ** support of the orientation histogram and of the descriptor of
+ ** the keypoints @a keys that belong to the current octave. Octaves
+ ** with few keypoints (typically the coarser ones) are thus
+ ** processed only partially. If the keypoints cover a large part of
+ ** the octave, the function computes it all, as
+ ** ::vl_sift_update_gradient.
+ **
+ ** Afterwards, ::vl_sift_calc_keypoint_orientations and
+ ** ::vl_sift_calc_keypoint_descriptor do not modify the filter for
+ ** these keypoints and can be called concurrently.
+ **/
 
-    /* first pixel of the last row */
-    gx = src[+xo] - src[0] ;
-    gy = src[  0] - src[-yo] ;
-    SAVE_BACK ;
-
-    /* middle pixels of the last row */
-    end = (src - 1) + w - 1 ;
-    while (src < end) {
-      gx = 0.5 * (src[+xo] - src[-xo]) ;
-      gy =        src[0]   - src[-yo] ;
-      SAVE_BACK ;
+VL_EXPORT
+void
+vl_sift_update_gradient_for_keypoints (VlSiftFilt *f,
+                                       VlSiftKeypoint const *keys,
+                                       vl_size n)
+{
+  int ntx, nty, ntiles, nlevels, nneeded = 0 ;
+  int xi, yi, W, tx, ty, tx0, tx1, ty0, ty1, i ;
+  vl_uindex k ;
+  vl_uint8 *tiles ;
+
+  _vl_sift_gradient_reset (f) ;
+  ntiles  = _vl_sift_gradient_tiles (f, &ntx, &nty) ;
+  nlevels = f->s_max - f->s_min - 2 ;
+
+  /* mark the tiles that the keypoints need */
+  for (k = 0 ; k < n ; ++ k) {
+    VlSiftKeypoint const *key = keys + k ;
+    if (key->o  != f->o_cur       ||
+        key->is <  f->s_min + 1   ||
+        key->is >  f->s_max - 2) continue ;
+
+    W = _vl_sift_keypoint_support (f, key, &xi, &yi) ;
+    if (xi < 0 || xi > f->octave_width  - 1 ||
+        yi < 0 || yi > f->octave_height - 1) continue ;
+
+    tiles = f->gradTiles + (key->is - f->s_min - 1) * ntiles ;
+    tx0 = VL_MAX (xi - W, 0)                    / VL_SIFT_GRAD_TILE ;
+    ty0 = VL_MAX (yi - W, 0)                    / VL_SIFT_GRAD_TILE ;
+    tx1 = VL_MIN (xi + W, f->octave_width  - 1) / VL_SIFT_GRAD_TILE ;
+    ty1 = VL_MIN (yi + W, f->octave_height - 1) / VL_SIFT_GRAD_TILE ;
+
+    for (ty = ty0 ; ty <= ty1 ; ++ ty) {
+      for (tx = tx0 ; tx <= tx1 ; ++ tx) {
+        if (tiles [ty * ntx + tx] == VL_SIFT_GRAD_TILE_INVALID) {
+          tiles [ty * ntx + tx] = VL_SIFT_GRAD_TILE_NEEDED ;
+          ++ nneeded ;
+        }
+      }
     }
+  }
+
+  /* dense keypoints: sweep the whole octave */
+  if (nneeded > VL_SIFT_GRAD_DENSE_RATIO * ntiles * nlevels) {
+    vl_sift_update_gradient (f) ;
+    return ;
+  }
 
-    /* last pixel of the last row */
-    gx = src[0]   - src[-xo] ;
-    gy = src[0]   - src[-yo] ;
-    SAVE_BACK ;
+  for (i = 0 ; i < ntiles * nlevels ; ++ i) {
+    if (f->gradTiles [i] == VL_SIFT_GRAD_TILE_NEEDED) {
+      _vl_sift_gradient_tile (f, f->s_min + 1 + i / ntiles,
+                              (i % ntiles) % ntx, (i % ntiles) / ntx) ;
+      f->gradTiles [i] = VL_SIFT_GRAD_TILE_VALID ;
+    }
   }
-  f->grad_o = f->o_cur ;
 }
 
 /** ------------------------------------------------------------------
- ** @brief Calculate the keypoint orientation(s)
+ ** @internal
+ ** @brief Calculate the keypoint orientation(s) (core)
  **
  ** @param f        SIFT filter.
  ** @param angles   orientations (output).
  ** @param k        keypoint.
  **
- ** The function computes the orientation(s) of the keypoint @a k.
- ** The function returns the number of orientations found (up to
- ** four). The orientations themselves are written to the vector @a
- ** angles.
- **
- ** @remark The function requires the keypoint octave @a k->o to be
- ** equal to the filter current octave ::vl_sift_get_octave. If this
- ** is not the case, the function returns zero orientations.
- **
- ** @remark The function requires the keypoint scale level @c k->s to
- ** be in the range @c s_min+1 and @c s_max-2 (where usually @c
- ** s_min=0 and @c s_max=S+2). If this is not the case, the function
- ** returns zero orientations.
- **
- ** @return number of orientations found.
+ ** Same as ::vl_sift_calc_keypoint_orientations, assuming that the
+ ** gradient around the keypoint is up to date.
  **/
 
-VL_EXPORT
-int
-vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
-                                    double angles [4],
-                                    VlSiftKeypoint const *k)
+static int
+_vl_sift_calc_keypoint_orientations_core (VlSiftFilt const *f,
+                                          double angles [4],
+                                          VlSiftKeypoint const *k)
 {
   double const winf   = 1.5 ;
   double       xper   = pow (2.0, f->o_cur) ;
@@ -1614,7 +2835,7 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
   int          si     = k-> is ;
 
   double const sigmaw = winf * sigma ;
-  int          W      = VL_MAX(floor (3.0 * sigmaw), 1) ;
+  int          W      = _vl_sift_orientation_radius (sigma) ;
 
   int          nangles= 0 ;
 
@@ -1638,9 +2859,6 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
     return 0 ;
   }
 
-  /* make gradient up to date */
-  update_gradient (f) ;
-
   /* clear histogram */
   memset (hist, 0, sizeof(double) * nbins) ;
 
@@ -1713,19 +2931,86 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
     double hm = hist [(i - 1 + nbins) % nbins] ;
     double hp = hist [(i + 1 + nbins) % nbins] ;
 
-    /* is this a peak? */
-    if (h0 > 0.8*maxh && h0 > hm && h0 > hp) {
+    /* is this a peak? */
+    if (h0 > 0.8*maxh && h0 > hm && h0 > hp) {
+
+      /* quadratic interpolation */
+      double di = - 0.5 * (hp - hm) / (hp + hm - 2 * h0) ;
+      double th = 2 * VL_PI * (i + di + 0.5) / nbins ;
+      angles [ nangles++ ] = th ;
+      if( nangles == 4 )
+        goto enough_angles ;
+    }
+  }
+ enough_angles:
+  return nangles ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Calculate the keypoint orientation(s)
+ **
+ ** @param f        SIFT filter.
+ ** @param angles   orientations (output).
+ ** @param k        keypoint.
+ **
+ ** The function computes the orientation(s) of the keypoint @a k.
+ ** The function returns the number of orientations found (up to
+ ** four). The orientations themselves are written to the vector @a
+ ** angles.
+ **
+ ** @remark The function requires the keypoint octave @a k->o to be
+ ** equal to the filter current octave ::vl_sift_get_octave. If this
+ ** is not the case, the function returns zero orientations.
+ **
+ ** @remark The function requires the keypoint scale level @c k->s to
+ ** be in the range @c s_min+1 and @c s_max-2 (where usually @c
+ ** s_min=0 and @c s_max=S+2). If this is not the case, the function
+ ** returns zero orientations.
+ **
+ ** @return number of orientations found.
+ **/
+
+VL_EXPORT
+int
+vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
+                                    double angles [4],
+                                    VlSiftKeypoint const *k)
+{
+  /* make gradient up to date around the keypoint */
+  if (_vl_sift_keypoint_in_octave (f, k)) {
+    int xi, yi ;
+    int W = _vl_sift_keypoint_support (f, k, &xi, &yi) ;
+    _vl_sift_update_gradient_window (f, k->is, xi, yi, W) ;
+  }
+
+  return _vl_sift_calc_keypoint_orientations_core (f, angles, k) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Calculate the keypoint orientation(s) without updating the gradient
+ **
+ ** @param f        SIFT filter.
+ ** @param angles   orientations (output).
+ ** @param k        keypoint.
+ ** @return number of orientations found.
+ **
+ ** Same as ::vl_sift_calc_keypoint_orientations, but the gradient
+ ** around the keypoint must have been made up to date by
+ ** ::vl_sift_update_gradient or ::vl_sift_update_gradient_for_keypoints.
+ ** The function only reads the filter, so several threads can call
+ ** it on the same filter.
+ **/
+
+VL_EXPORT
+int
+vl_sift_calc_keypoint_orientations_nosync (VlSiftFilt const *f,
+                                           double angles [4],
+                                           VlSiftKeypoint const *k)
+{
+  assert (! _vl_sift_keypoint_in_octave (f, k) ||
+          _vl_sift_keypoint_gradient_valid (f, k)) ;
 
-      /* quadratic interpolation */
-      double di = - 0.5 * (hp - hm) / (hp + hm - 2 * h0) ;
-      double th = 2 * VL_PI * (i + di + 0.5) / nbins ;
-      angles [ nangles++ ] = th ;
-      if( nangles == 4 )
-        goto enough_angles ;
-    }
-  }
- enough_angles:
-  return nangles ;
+  return _vl_sift_calc_keypoint_orientations_core (f, angles, k) ;
 }
 
 
@@ -1940,111 +3225,87 @@ vl_sift_calc_raw_descriptor (VlSiftFilt const *f,
 }
 
 /** ------------------------------------------------------------------
- ** @brief Compute the descriptor of a keypoint
- **
- ** @param f        SIFT filter.
- ** @param descr    SIFT descriptor (output)
- ** @param k        keypoint.
- ** @param angle0   keypoint direction.
- **
- ** The function computes the SIFT descriptor of the keypoint @a k of
- ** orientation @a angle0. The function fills the buffer @a descr
- ** which must be large enough to hold the descriptor.
+ ** @internal
+ ** @brief Check that a keypoint descriptor can be computed
  **
- ** The function assumes that the keypoint is on the current octave.
- ** If not, it does not do anything.
+ ** @param f SIFT filter.
+ ** @param k keypoint.
+ ** @param xper sampling step of the current octave.
+ ** @return true if @a k is on the current octave and far enough
+ ** from the borders of the octave.
  **/
 
-VL_EXPORT
-void
-vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
-                                  vl_sift_pix *descr,
-                                  VlSiftKeypoint const* k,
-                                  double angle0)
+static vl_bool
+_vl_sift_descriptor_in_bounds (VlSiftFilt const *f,
+                               VlSiftKeypoint const *k,
+                               double xper)
 {
-  /*
-     The SIFT descriptor is a three dimensional histogram of the
-     position and orientation of the gradient.  There are NBP bins for
-     each spatial dimension and NBO bins for the orientation dimension,
-     for a total of NBP x NBP x NBO bins.
-
-     The support of each spatial bin has an extension of SBP = 3sigma
-     pixels, where sigma is the scale of the keypoint.  Thus all the
-     bins together have a support SBP x NBP pixels wide. Since
-     weighting and interpolation of pixel is used, the support extends
-     by another half bin. Therefore, the support is a square window of
-     SBP x (NBP + 1) pixels. Finally, since the patch can be
-     arbitrarily rotated, we need to consider a window 2W += sqrt(2) x
-     SBP x (NBP + 1) pixels wide.
-  */
-
-  double const magnif      = f-> magnif ;
-
-  double       xper        = pow (2.0, f->o_cur) ;
-
-  int          w           = f-> octave_width ;
-  int          h           = f-> octave_height ;
-  int const    xo          = 2 ;         /* x-stride */
-  int const    yo          = 2 * w ;     /* y-stride */
-  int const    so          = 2 * w * h ; /* s-stride */
-  double       x           = k-> x     / xper ;
-  double       y           = k-> y     / xper ;
-  double       sigma       = k-> sigma / xper ;
-
-  int          xi          = (int) (x + 0.5) ;
-  int          yi          = (int) (y + 0.5) ;
-  int          si          = k-> is ;
+  int    xi   = (int) (k-> x / xper + 0.5) ;
+  int    yi   = (int) (k-> y / xper + 0.5) ;
+  int    si   = k-> is ;
+
+  return
+    k->o  == f->o_cur            &&
+    xi    >= 0                   &&
+    xi    <  f->octave_width     &&
+    yi    >= 0                   &&
+    yi    <  f->octave_height - 1 &&
+    si    >= f->s_min + 1        &&
+    si    <= f->s_max - 2 ;
+}
 
-  double const st0         = sin (angle0) ;
-  double const ct0         = cos (angle0) ;
-  double const SBP         = magnif * sigma + VL_EPSILON_D ;
-  int    const W           = floor
-    (sqrt(2.0) * SBP * (NBP + 1) / 2.0 + 0.5) ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Accumulate gradient samples into a SIFT descriptor
+ **
+ ** @param dpt        descriptor bin of center (NBP/2,NBP/2,0).
+ ** @param pt         gradient (modulus, angle) at the keypoint center.
+ ** @param yo         gradient y-stride.
+ ** @param dxi_begin  first sample x offset.
+ ** @param dxi_end    last sample x offset (included).
+ ** @param dyi_begin  first sample y offset.
+ ** @param dyi_end    last sample y offset (included).
+ ** @param xi         keypoint x rounded to the closest sample.
+ ** @param yi         keypoint y rounded to the closest sample.
+ ** @param x          keypoint x.
+ ** @param y          keypoint y.
+ ** @param ct0        cosine of the keypoint orientation.
+ ** @param st0        sine of the keypoint orientation.
+ ** @param SBP        spatial bin size.
+ ** @param angle0     keypoint orientation.
+ ** @param wden       Gaussian window denominator (2 sigma^2).
+ **
+ ** Each sample is weighted by the gradient modulus and by the
+ ** Gaussian window and distributed into the 8 adjacent bins by
+ ** trilinear interpolation. ::_vl_sift_descriptor_accumulate_sse2 and
+ ** ::_vl_sift_descriptor_accumulate_neon are vectorized versions.
+ **/
 
+static void
+_vl_sift_descriptor_accumulate (vl_sift_pix *dpt,
+                                vl_sift_pix const *pt,
+                                int yo,
+                                int dxi_begin, int dxi_end,
+                                int dyi_begin, int dyi_end,
+                                int xi, int yi,
+                                double x, double y,
+                                double ct0, double st0,
+                                double SBP, double angle0,
+                                double wden)
+{
+  int const xo    = 2 ;          /* x-stride */
   int const binto = 1 ;          /* bin theta-stride */
   int const binyo = NBO * NBP ;  /* bin y-stride */
   int const binxo = NBO ;        /* bin x-stride */
 
-  int bin, dxi, dyi ;
-  vl_sift_pix const *pt ;
-  vl_sift_pix       *dpt ;
-
-  /* check bounds */
-  if(k->o  != f->o_cur        ||
-     xi    <  0               ||
-     xi    >= w               ||
-     yi    <  0               ||
-     yi    >= h -    1        ||
-     si    <  f->s_min + 1    ||
-     si    >  f->s_max - 2     )
-    return ;
-
-  /* synchronize gradient buffer */
-  update_gradient (f) ;
-
-  /* VL_PRINTF("W = %d ; magnif = %g ; SBP = %g\n", W,magnif,SBP) ; */
-
-  /* clear descriptor */
-  memset (descr, 0, sizeof(vl_sift_pix) * NBO*NBP*NBP) ;
-
-  /* Center the scale space and the descriptor on the current keypoint.
-   * Note that dpt is pointing to the bin of center (SBP/2,SBP/2,0).
-   */
-  pt  = f->grad + xi*xo + yi*yo + (si - f->s_min - 1)*so ;
-  dpt = descr + (NBP/2) * binyo + (NBP/2) * binxo ;
+  int dxi, dyi ;
 
 #undef atd
 #define atd(dbinx,dbiny,dbint) *(dpt + (dbint)*binto + (dbiny)*binyo + (dbinx)*binxo)
 
-  /*
-   * Process pixels in the intersection of the image rectangle
-   * (1,1)-(M-1,N-1) and the keypoint bounding box.
-   */
-  for(dyi =  VL_MAX (- W, 1 - yi    ) ;
-      dyi <= VL_MIN (+ W, h - yi - 2) ; ++ dyi) {
+  for(dyi = dyi_begin ; dyi <= dyi_end ; ++ dyi) {
 
-    for(dxi =  VL_MAX (- W, 1 - xi    ) ;
-        dxi <= VL_MIN (+ W, w - xi - 2) ; ++ dxi) {
+    for(dxi = dxi_begin ; dxi <= dxi_end ; ++ dxi) {
 
       /* retrieve */
       vl_sift_pix mod   = *( pt + dxi*xo + dyi*yo + 0 ) ;
@@ -2061,13 +3322,10 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
       vl_sift_pix ny = (-st0 * dx + ct0 * dy) / SBP ;
       vl_sift_pix nt = NBO * theta / (2 * VL_PI) ;
 
-      /* Get the Gaussian weight of the sample. The Gaussian window
-       * has a standard deviation equal to NBP/2. Note that dx and dy
+      /* Get the Gaussian weight of the sample. Note that dx and dy
        * are in the normalized frame, so that -NBP/2 <= dx <=
        * NBP/2. */
-      vl_sift_pix const wsigma = f->windowSize ;
-      vl_sift_pix win = fast_expn
-        ((nx*nx + ny*ny)/(2.0 * wsigma * wsigma)) ;
+      vl_sift_pix win = fast_expn ((nx*nx + ny*ny) / wden) ;
 
       /* The sample will be distributed in 8 adjacent bins.
          We start from the ``lower-left'' bin. */
@@ -2103,6 +3361,121 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
       }
     }
   }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the descriptor of a keypoint (core)
+ **
+ ** @param f        SIFT filter.
+ ** @param descr    SIFT descriptor (output).
+ ** @param k        keypoint.
+ ** @param angle0   keypoint direction.
+ ** @param xper     sampling step of the current octave.
+ ** @param pt0      gradient of the keypoint scale level.
+ **
+ ** The function computes the descriptor assuming that the keypoint
+ ** passed ::_vl_sift_descriptor_in_bounds and that the gradient is
+ ** up to date. The quantities that depend only on the octave and on
+ ** the scale level are passed in by the caller, so that
+ ** ::vl_sift_calc_keypoint_descriptors_batch can compute them once.
+ **/
+
+static void
+_vl_sift_calc_keypoint_descriptor_core (VlSiftFilt const *f,
+                                        vl_sift_pix *descr,
+                                        VlSiftKeypoint const* k,
+                                        double angle0,
+                                        double xper,
+                                        vl_sift_pix const *pt0)
+{
+  /*
+     The SIFT descriptor is a three dimensional histogram of the
+     position and orientation of the gradient.  There are NBP bins for
+     each spatial dimension and NBO bins for the orientation dimension,
+     for a total of NBP x NBP x NBO bins.
+
+     The support of each spatial bin has an extension of SBP = 3sigma
+     pixels, where sigma is the scale of the keypoint.  Thus all the
+     bins together have a support SBP x NBP pixels wide. Since
+     weighting and interpolation of pixel is used, the support extends
+     by another half bin. Therefore, the support is a square window of
+     SBP x (NBP + 1) pixels. Finally, since the patch can be
+     arbitrarily rotated, we need to consider a window 2W += sqrt(2) x
+     SBP x (NBP + 1) pixels wide.
+  */
+
+  double const magnif      = f-> magnif ;
+
+  int          w           = f-> octave_width ;
+  int          h           = f-> octave_height ;
+  int const    xo          = 2 ;         /* x-stride */
+  int const    yo          = 2 * w ;     /* y-stride */
+  double       x           = k-> x     / xper ;
+  double       y           = k-> y     / xper ;
+  double       sigma       = k-> sigma / xper ;
+
+  int          xi          = (int) (x + 0.5) ;
+  int          yi          = (int) (y + 0.5) ;
+
+  double const st0         = sin (angle0) ;
+  double const ct0         = cos (angle0) ;
+  double const SBP         = magnif * sigma + VL_EPSILON_D ;
+  int    const W           = _vl_sift_descriptor_radius (f, sigma) ;
+
+  /* The Gaussian window has a standard deviation equal to NBP/2. */
+  vl_sift_pix const wsigma = f->windowSize ;
+  double      const wden   = 2.0 * wsigma * wsigma ;
+
+  int const binyo = NBO * NBP ;  /* bin y-stride */
+  int const binxo = NBO ;        /* bin x-stride */
+
+  int bin, dxi_begin, dxi_end, dyi_begin, dyi_end ;
+  vl_sift_pix const *pt ;
+  vl_sift_pix       *dpt ;
+
+  /* VL_PRINTF("W = %d ; magnif = %g ; SBP = %g\n", W,magnif,SBP) ; */
+
+  /* clear descriptor */
+  memset (descr, 0, sizeof(vl_sift_pix) * NBO*NBP*NBP) ;
+
+  /* Center the scale space and the descriptor on the current keypoint.
+   * Note that dpt is pointing to the bin of center (SBP/2,SBP/2,0).
+   */
+  pt  = pt0 + xi*xo + yi*yo ;
+  dpt = descr + (NBP/2) * binyo + (NBP/2) * binxo ;
+
+  /*
+   * Process pixels in the intersection of the image rectangle
+   * (1,1)-(M-1,N-1) and the keypoint bounding box.
+   */
+  dxi_begin = VL_MAX (- W, 1 - xi    ) ;
+  dxi_end   = VL_MIN (+ W, w - xi - 2) ;
+  dyi_begin = VL_MAX (- W, 1 - yi    ) ;
+  dyi_end   = VL_MIN (+ W, h - yi - 2) ;
+
+  /* dispatch to accelerated version */
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    _vl_sift_descriptor_accumulate_sse2
+      (dpt, pt, yo, dxi_begin, dxi_end, dyi_begin, dyi_end,
+       xi, yi, x, y, ct0, st0, SBP, angle0, wden,
+       expn_tab, EXPN_SZ, EXPN_MAX) ;
+  } else
+#endif
+#if defined(ARCH_ARM) && ! defined(VL_DISABLE_NEON)
+  if (vl_get_simd_enabled()) {
+    _vl_sift_descriptor_accumulate_neon
+      (dpt, pt, yo, dxi_begin, dxi_end, dyi_begin, dyi_end,
+       xi, yi, x, y, ct0, st0, SBP, angle0, wden,
+       expn_tab, EXPN_SZ, EXPN_MAX) ;
+  } else
+#endif
+  {
+    _vl_sift_descriptor_accumulate
+      (dpt, pt, yo, dxi_begin, dxi_end, dyi_begin, dyi_end,
+       xi, yi, x, y, ct0, st0, SBP, angle0, wden) ;
+  }
 
   /* Standard SIFT descriptors are normalized, truncated and normalized again */
   if(1) {
@@ -2129,6 +3502,211 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
 
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Compute the descriptor of a keypoint
+ **
+ ** @param f        SIFT filter.
+ ** @param descr    SIFT descriptor (output)
+ ** @param k        keypoint.
+ ** @param angle0   keypoint direction.
+ **
+ ** The function computes the SIFT descriptor of the keypoint @a k of
+ ** orientation @a angle0. The function fills the buffer @a descr
+ ** which must be large enough to hold the descriptor.
+ **
+ ** The function assumes that the keypoint is on the current octave.
+ ** If not, it does not do anything.
+ **
+ ** @sa ::vl_sift_calc_keypoint_descriptors_batch to compute many
+ ** descriptors at once.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
+                                  vl_sift_pix *descr,
+                                  VlSiftKeypoint const* k,
+                                  double angle0)
+{
+  int const so   = 2 * f->octave_width * f->octave_height ; /* s-stride */
+  double    xper = pow (2.0, f->o_cur) ;
+
+  /* check bounds */
+  if (! _vl_sift_descriptor_in_bounds (f, k, xper))
+    return ;
+
+  /* synchronize gradient buffer around the keypoint */
+  {
+    int xi, yi ;
+    int W = _vl_sift_keypoint_support (f, k, &xi, &yi) ;
+    _vl_sift_update_gradient_window (f, k->is, xi, yi, W) ;
+  }
+
+  _vl_sift_calc_keypoint_descriptor_core
+    (f, descr, k, angle0, xper,
+     f->grad + (k->is - f->s_min - 1)*so) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute many descriptors (core)
+ **
+ ** @param f       SIFT filter.
+ ** @param keys    keypoints.
+ ** @param angles  keypoint directions.
+ ** @param n       number of keypoints.
+ ** @param descrs  descriptors (output), or @c NULL.
+ ** @param descrs8 quantized descriptors (output), or @c NULL.
+ **
+ ** The gradient around the keypoints must be up to date, the
+ ** function only reads the filter.
+ **/
+
+static void
+_vl_sift_calc_keypoint_descriptors_batch (VlSiftFilt const *f,
+                                          VlSiftKeypoint const *keys,
+                                          double const *angles,
+                                          vl_size n,
+                                          vl_sift_pix *descrs,
+                                          vl_uint8 *descrs8)
+{
+  enum { dimension = NBO*NBP*NBP } ;
+  int const so   = 2 * f->octave_width * f->octave_height ; /* s-stride */
+  double    xper = pow (2.0, f->o_cur) ;
+  vl_sift_pix tmp [dimension] ;
+  vl_uindex i ;
+  int s, l ;
+
+  if (n == 0) return ;
+
+  /* Visit the keypoints grouped by scale level, so that the gradient
+   * of a level is swept once and stays in the cache. */
+  for (s = f->s_min + 1 ; s <= f->s_max - 2 ; ++s) {
+    vl_sift_pix const *pt0 = f->grad + (s - f->s_min - 1)*so ;
+
+    for (i = 0 ; i < n ; ++i) {
+      VlSiftKeypoint const *k = keys + i ;
+      vl_sift_pix *descr = descrs ? descrs + dimension * i : tmp ;
+
+      if (k->is != s) continue ;
+      if (! _vl_sift_descriptor_in_bounds (f, k, xper)) continue ;
+      assert (_vl_sift_keypoint_gradient_valid (f, k)) ;
+
+      _vl_sift_calc_keypoint_descriptor_core
+        (f, descr, k, angles [i], xper, pt0) ;
+
+      if (descrs8) {
+        vl_uint8 *descr8 = descrs8 + dimension * i ;
+        for (l = 0 ; l < dimension ; ++l) {
+          double x = 512.0 * descr [l] ;
+          descr8 [l] = (vl_uint8) ((x < 255.0) ? x : 255.0) ;
+        }
+      }
+    }
+  }
+
+  /* keypoints that could not be described get a null descriptor */
+  for (i = 0 ; i < n ; ++i) {
+    if (_vl_sift_descriptor_in_bounds (f, keys + i, xper)) continue ;
+    if (descrs)  memset (descrs  + dimension * i, 0, sizeof(vl_sift_pix) * dimension) ;
+    if (descrs8) memset (descrs8 + dimension * i, 0, sizeof(vl_uint8) * dimension) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the descriptors of many keypoints
+ **
+ ** @param f       SIFT filter.
+ ** @param keys    keypoints.
+ ** @param angles  keypoint directions.
+ ** @param n       number of keypoints.
+ ** @param descrs  descriptors (output).
+ **
+ ** The function computes the descriptor of the keypoint @c keys[i]
+ ** with orientation @c angles[i] for each @c i in [0, @a n - 1] and
+ ** stores it in the 128 elements starting at @c descrs + 128*i. A
+ ** keypoint appears once for each of its orientations.
+ **
+ ** The result is the same as calling
+ ** ::vl_sift_calc_keypoint_descriptor for each keypoint, except that
+ ** keypoints that are not on the current octave (or too close to its
+ ** border) get a null descriptor instead of leaving the buffer
+ ** untouched. The octave and scale level setup is computed once and
+ ** the keypoints are processed level by level.
+ **
+ ** As ::vl_sift_calc_keypoint_descriptor, the function only reads the
+ ** filter once the gradient is up to date (see
+ ** ::vl_sift_update_gradient).
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_descriptors_batch (VlSiftFilt *f,
+                                         VlSiftKeypoint const *keys,
+                                         double const *angles,
+                                         vl_size n,
+                                         vl_sift_pix *descrs)
+{
+  vl_sift_update_gradient_for_keypoints (f, keys, n) ;
+  _vl_sift_calc_keypoint_descriptors_batch
+    (f, keys, angles, n, descrs, NULL) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the descriptors of many keypoints without updating the gradient
+ **
+ ** @param f       SIFT filter.
+ ** @param keys    keypoints.
+ ** @param angles  keypoint directions.
+ ** @param n       number of keypoints.
+ ** @param descrs  descriptors (output).
+ **
+ ** Same as ::vl_sift_calc_keypoint_descriptors_batch, but the
+ ** gradient around the keypoints must have been made up to date by
+ ** ::vl_sift_update_gradient or ::vl_sift_update_gradient_for_keypoints.
+ ** The function only reads the filter, so several threads can call
+ ** it on the same filter with different keypoints.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_descriptors_batch_nosync (VlSiftFilt const *f,
+                                                VlSiftKeypoint const *keys,
+                                                double const *angles,
+                                                vl_size n,
+                                                vl_sift_pix *descrs)
+{
+  _vl_sift_calc_keypoint_descriptors_batch
+    (f, keys, angles, n, descrs, NULL) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the quantized descriptors of many keypoints
+ **
+ ** @param f       SIFT filter.
+ ** @param keys    keypoints.
+ ** @param angles  keypoint directions.
+ ** @param n       number of keypoints.
+ ** @param descrs  descriptors (output).
+ **
+ ** Same as ::vl_sift_calc_keypoint_descriptors_batch, but each
+ ** descriptor component @c d is stored as the byte
+ ** <code>min(512 d, 255)</code>, as in the @c .sift files.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoint_descriptors_batch_u8 (VlSiftFilt *f,
+                                            VlSiftKeypoint const *keys,
+                                            double const *angles,
+                                            vl_size n,
+                                            vl_uint8 *descrs)
+{
+  vl_sift_update_gradient_for_keypoints (f, keys, n) ;
+  _vl_sift_calc_keypoint_descriptors_batch
+    (f, keys, angles, n, NULL, descrs) ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Initialize a keypoint from its position and scale
  **
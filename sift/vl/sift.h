@@ -43,6 +43,38 @@ typedef struct _VlSiftKeypoint
   float sigma ; /**< scale. */
 } VlSiftKeypoint ;
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief SIFT Gaussian smoothing kernel
+ **
+ ** The smoothing kernels of an octave depend only on the scale level,
+ ** so the filter keeps them around instead of rebuilding (and
+ ** reallocating) one for each call of the smoothing routine.
+ **/
+
+typedef struct _VlSiftGaussFilter
+{
+  double sigma ;        /**< kernel standard deviation (0 = unused slot). */
+  vl_size width ;       /**< kernel half-width. */
+  vl_sift_pix *filter ; /**< kernel samples (2 width + 1). */
+} VlSiftGaussFilter ;
+
+/** ------------------------------------------------------------------
+ ** @brief Split of the scale space smoothing between ARM and DSP
+ **
+ ** One per octave, see ::vl_sift_set_dsp_split.
+ **/
+
+typedef struct _VlSiftDspSplit
+{
+  double ratio ;        /**< fraction of the columns convolved on the DSP */
+  vl_bool adaptive ;    /**< update @c ratio from the measured times */
+  double armTime ;      /**< time of the ARM share so far (s) */
+  double dspTime ;      /**< time of the DSP share so far (s) */
+  double armPixels ;    /**< pixels convolved on the ARM so far */
+  double dspPixels ;    /**< pixels convolved on the DSP so far */
+} VlSiftDspSplit ;
+
 /** ------------------------------------------------------------------
  ** @brief SIFT filter
  **
@@ -68,12 +100,15 @@ typedef struct _VlSiftFilt
   vl_sift_pix *temp ;   /**< temporary pixel buffer. */
   vl_sift_pix *octave ; /**< current GSS data. */
   vl_sift_pix *dog ;    /**< current DoG data. */
+  int dog_o ;           /**< DoG data octave. */
   int octave_width ;    /**< current octave width. */
   int octave_height ;   /**< current octave height. */
 
   vl_sift_pix *gaussFilter ;  /**< current Gaussian filter */
   double gaussFilterSigma ;   /**< current Gaussian filter std */
   vl_size gaussFilterWidth ;  /**< current Gaussian filter width */
+  VlSiftGaussFilter *gaussFilterCache ; /**< Gaussian filters of the octave levels */
+  int gaussFilterCacheSize ;            /**< number of cached Gaussian filters */
 
   VlSiftKeypoint* keys ;/**< detected keypoints. */
   int nkeys ;           /**< number of detected keypoints. */
@@ -87,6 +122,9 @@ typedef struct _VlSiftFilt
 
   vl_sift_pix *grad ;   /**< GSS gradient data. */
   int grad_o ;          /**< GSS gradient data octave. */
+  vl_uint8 *gradTiles ; /**< state of the gradient tiles of the octave. */
+
+  VlSiftDspSplit *dspSplit ; /**< ARM/DSP split of each octave. */
 
 } VlSiftFilt ;
 
@@ -109,22 +147,62 @@ VL_EXPORT
 int   vl_sift_process_first_octave       (VlSiftFilt *f,
                                           vl_sift_pix const *im) ;
 
+VL_EXPORT
+int   vl_sift_process_first_octave_u8    (VlSiftFilt *f,
+                                          vl_uint8 const *im) ;
+
 VL_EXPORT
 int   vl_sift_process_next_octave        (VlSiftFilt *f) ;
 
 VL_EXPORT
 void  vl_sift_detect                     (VlSiftFilt *f) ;
 
+VL_EXPORT
+int   vl_sift_reserve_keypoints          (VlSiftFilt *f, int n) ;
+
+VL_EXPORT
+void  vl_sift_update_gradient            (VlSiftFilt *f) ;
+
+VL_EXPORT
+void  vl_sift_update_gradient_for_keypoints (VlSiftFilt *f,
+                                             VlSiftKeypoint const *keys,
+                                             vl_size n) ;
+
 VL_EXPORT
 int   vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
                                           double angles [4],
                                           VlSiftKeypoint const*k);
 VL_EXPORT
+int   vl_sift_calc_keypoint_orientations_nosync (VlSiftFilt const *f,
+                                                 double angles [4],
+                                                 VlSiftKeypoint const*k);
+VL_EXPORT
 void  vl_sift_calc_keypoint_descriptor   (VlSiftFilt *f,
                                           vl_sift_pix *descr,
                                           VlSiftKeypoint const* k,
                                           double angle) ;
 
+VL_EXPORT
+void  vl_sift_calc_keypoint_descriptors_batch (VlSiftFilt *f,
+                                               VlSiftKeypoint const *keys,
+                                               double const *angles,
+                                               vl_size n,
+                                               vl_sift_pix *descrs) ;
+
+VL_EXPORT
+void  vl_sift_calc_keypoint_descriptors_batch_nosync (VlSiftFilt const *f,
+                                                      VlSiftKeypoint const *keys,
+                                                      double const *angles,
+                                                      vl_size n,
+                                                      vl_sift_pix *descrs) ;
+
+VL_EXPORT
+void  vl_sift_calc_keypoint_descriptors_batch_u8 (VlSiftFilt *f,
+                                                  VlSiftKeypoint const *keys,
+                                                  double const *angles,
+                                                  vl_size n,
+                                                  vl_uint8 *descrs) ;
+
 VL_EXPORT
 void  vl_sift_calc_raw_descriptor        (VlSiftFilt const *f,
                                           vl_sift_pix const* image,
@@ -171,6 +249,15 @@ VL_INLINE void vl_sift_set_magnif      (VlSiftFilt *f, double m) ;
 VL_INLINE void vl_sift_set_window_size (VlSiftFilt *f, double m) ;
 /** @} */
 
+/** @name ARM/DSP work split
+ ** @{
+ **/
+VL_EXPORT
+void vl_sift_set_dsp_split (VlSiftFilt *f, int o, double ratio, vl_bool adaptive) ;
+VL_EXPORT
+VlSiftDspSplit const * vl_sift_get_dsp_split (VlSiftFilt const *f, int o) ;
+/** @} */
+
 /* -------------------------------------------------------------------
  *                                     Inline functions implementation
  * ---------------------------------------------------------------- */
@@ -9,49 +9,378 @@
 #include "sift_dsp.h"
 #include "imopv.h"
 
-void vl_imconvcol_vf_on_dsp(float* dst, int dst_stride,
+/*
+ * Convolutions are posted to the DSP node without waiting for them.
+ * They are written to the command ring (see sift_dsp.h); the entries
+ * posted since the last submission form the open batch, which is
+ * handed to the node with a single message by vl_dsp_submit, when it
+ * reaches VL_DSP_BATCH_MAX entries or when the ring wraps around. Up
+ * to VL_DSP_RING_SIZE convolutions can be pending, so the ARM can keep
+ * posting while the DSP works. The node answers the messages in order,
+ * one answer each, with the token of their last command.
+ *
+ * The queue remembers the token each message must be answered with, so
+ * every answer is matched to its message by position. A wrong answer
+ * (or a message that could not be sent) loses the commands of that
+ * message only; the answers of the later ones are still recognised.
+ */
+
+/* messages that can wait for their answer, more than the ring can hold */
+#define VL_DSP_MAX_ANSWERS (2 * VL_DSP_RING_SIZE)
+
+typedef struct _VlDspAnswer
+{
+  vl_dsp_token token;      /* last command of the message */
+  vl_bool sent;            /* false if sending failed, no answer comes */
+} VlDspAnswer;
+
+typedef struct _VlDspQueue
+{
+  dsp_ring_entry* ring;    /* VL_DSP_RING_SIZE entries, entry of token t is t % VL_DSP_RING_SIZE */
+  octave_params* octave;   /* parameter block of vl_sift_octave_on_dsp */
+  vl_dsp_token posted;     /* last token posted */
+  vl_dsp_token submitted;  /* last token handed to the DSP */
+  vl_dsp_token completed;  /* last token answered by the DSP */
+  vl_dsp_token lost_begin; /* tokens [lost_begin, lost_end] were lost, */
+  vl_dsp_token lost_end;   /* see vl_dsp_wait (none if lost_end == 0) */
+  VlDspAnswer answers[VL_DSP_MAX_ANSWERS];  /* expected answers, oldest first */
+  unsigned first_answer;
+  unsigned num_answers;
+} VlDspQueue;
+
+static VlDspQueue queue;
+
+/* takes the answer to the oldest message. Its commands are lost if
+   the answer is not the expected one or if the message was not sent */
+static void _vl_dsp_receive(void)
+{
+  VlDspAnswer answer = queue.answers[queue.first_answer];
+  dsp_msg_t msg;
+
+  queue.first_answer = (queue.first_answer + 1) % VL_DSP_MAX_ANSWERS;
+  queue.num_answers--;
+
+  if (answer.sent)
+  {
+    msg = vl_dsp_get_message();
+
+    if (msg.cmd != VL_DSP_CMD_DONE || msg.arg_2 != (uint32_t)answer.token)
+    {
+      vl_set_last_error(VL_ERR_IO, "DSP commands %u to %u: unexpected answer (cmd=%u, token=%u)",
+          (unsigned)(queue.completed + 1), (unsigned)answer.token, (unsigned)msg.cmd, (unsigned)msg.arg_2);
+      answer.sent = VL_FALSE;
+    }
+  }
+  else
+  {
+    vl_set_last_error(VL_ERR_IO, "DSP commands %u to %u: sending failed",
+        (unsigned)(queue.completed + 1), (unsigned)answer.token);
+  }
+
+  /* lost ranges are merged, later commands of a merged range count as
+     lost too, which only costs a redo on the ARM */
+  if (!answer.sent)
+  {
+    if (queue.lost_end == 0)
+      queue.lost_begin = queue.completed + 1;
+    queue.lost_end = answer.token;
+  }
+
+  queue.completed = answer.token;
+}
+
+/* sends a message answered with token, remembers whether it was sent */
+static void _vl_dsp_send(uint32_t cmd, uint32_t arg1, uint32_t arg2, vl_dsp_token token)
+{
+  unsigned last;
+
+  if (queue.num_answers == VL_DSP_MAX_ANSWERS)
+    _vl_dsp_receive();
+
+  last = (queue.first_answer + queue.num_answers) % VL_DSP_MAX_ANSWERS;
+  queue.answers[last].token = token;
+  queue.answers[last].sent = vl_dsp_send_message(cmd, arg1, arg2) == 0;
+  queue.num_answers++;
+}
+
+/**
+ * hands the open batch of the command ring to the DSP. Convolutions
+ * are submitted anyway when waited for, calling this right after
+ * posting lets the DSP start while the ARM does something else.
+ */
+VL_EXPORT
+void vl_dsp_submit(void)
+{
+  vl_dsp_token first = queue.submitted + 1;
+  unsigned count = (unsigned)(queue.posted - queue.submitted);
+  dsp_ring_entry* entries;
+
+  if (count == 0)
+    return;
+
+  entries = queue.ring + first % VL_DSP_RING_SIZE;
+  vl_dsp_dmm_range_begin(entries, count * sizeof(dsp_ring_entry), VL_DSP_TO_DEVICE);
+
+  _vl_dsp_send(VL_DSP_CMD_BATCH,
+      (uint32_t)(vl_uintptr)vl_dsp_get_mapped_addr(entries), count, queue.posted);
+
+  queue.submitted = queue.posted;
+}
+
+/* sends a command with its parameter block after the open batch, returns its token */
+static vl_dsp_token _vl_dsp_post(uint32_t cmd, void* params, vl_size size)
+{
+  vl_dsp_token token;
+
+  vl_dsp_submit();
+
+  token = queue.posted + 1;
+  vl_dsp_dmm_range_begin(params, size, VL_DSP_TO_DEVICE);
+
+  _vl_dsp_send(cmd,
+      (uint32_t)(vl_uintptr)vl_dsp_get_mapped_addr(params), (uint32_t)token, token);
+
+  queue.posted = token;
+  queue.submitted = token;
+  return token;
+}
+
+/* next free entry of the command ring, the open batch is submitted
+   before it wraps around or gets too long */
+static dsp_ring_entry* _vl_dsp_ring_entry(vl_dsp_token token)
+{
+  if (queue.ring == NULL)
+    queue.ring = vl_malloc(VL_DSP_RING_SIZE * sizeof(dsp_ring_entry));
+
+  if (token % VL_DSP_RING_SIZE == 0 || queue.posted - queue.submitted >= VL_DSP_BATCH_MAX)
+    vl_dsp_submit();
+
+  /* the entry is free once the token VL_DSP_RING_SIZE places before is done */
+  while (queue.completed + VL_DSP_RING_SIZE < token)
+    _vl_dsp_receive();
+
+  return queue.ring + token % VL_DSP_RING_SIZE;
+}
+
+/* size in bytes of the memory spanned by a rows x cols region */
+static unsigned _vl_dsp_region_size(int rows, int cols, int stride)
+{
+  return (rows > 0 && cols > 0) ? ((rows - 1) * stride + cols) * sizeof(float) : 0;
+}
+
+/**
+ * posts the convolution of the columns [x_begin, x_end) of src (same
+ * arguments as vl_imconvcol_vf otherwise, the width of src is not
+ * needed) to the DSP and returns at
+ * once. src and filt must already be written back to memory and dst
+ * invalidated (see vl_dsp_dmm_range_begin), and they must not be
+ * touched by the ARM before vl_dsp_wait has returned for the token.
+ *
+ * The convolution joins the open batch of the command ring, see
+ * vl_dsp_submit. Blocks only if the ring is full.
+ */
+VL_EXPORT
+vl_dsp_token vl_imconvcol_vf_on_dsp_async(float* dst, int dst_stride,
     float const* src,
-    int src_width, int src_height, int src_stride,
+    int src_height, int src_stride,
     float const* filt, int filt_begin, int filt_end,
-    int step, unsigned int flags)
+    int step, unsigned int flags,
+    int x_begin, int x_end)
 {
-  imconvol_vf_params* params = vl_malloc(sizeof(imconvol_vf_params));
+  vl_dsp_token token = queue.posted + 1;
+  dsp_ring_entry* entry = _vl_dsp_ring_entry(token);
+  imconvol_vf_params* params = &entry->job.conv;
+  int dheight = (src_height - 1) / step + 1;
+  int ncols = x_end - x_begin;
+
+  /* the strip starts at column x_begin of src, which is row x_begin
+     of the destination if it is transposed */
+  src += x_begin;
+  if (flags & VL_TRANSPOSE)
+  {
+    dst += x_begin * dst_stride;
+    params->dst_size = _vl_dsp_region_size(ncols, dheight, dst_stride);
+  }
+  else
+  {
+    dst += x_begin;
+    params->dst_size = _vl_dsp_region_size(dheight, ncols, dst_stride);
+  }
 
   params->dst = (float*)vl_dsp_get_mapped_addr((void*)dst);  //ATTENTION --> Pointer
   params->dst_stride = dst_stride;
   params->src = (float*)vl_dsp_get_mapped_addr((void*)src);  //ATTENTION --> Pointer
-  params->src_width = src_width;
+  params->src_size = _vl_dsp_region_size(src_height, ncols, src_stride);
+  params->src_width = ncols;
   params->src_height = src_height;
   params->src_stride = src_stride;
   params->filt = (float*)vl_dsp_get_mapped_addr((void*)filt);//ATTENTION --> Pointer
+  params->filt_size = (filt_end - filt_begin + 1)*sizeof(float);
   params->filt_begin = filt_begin;
   params->filt_end = filt_end;
   params->step = step;
   params->flags = flags;
 
-  params->dst_size = src_width*src_height*sizeof(float);
-  params->src_size = params->dst_size;
-  params->filt_size = (filt_end - filt_begin)*sizeof(float);
+  entry->job.cmd = VL_DSP_CMD_IMCONVCOL;
+  entry->job.token = (unsigned)token;
+
+  queue.posted = token;
+  return token;
+}
+
+/**
+ * computes the levels 1..nlevels-1 of an octave and the DoG on the DSP
+ * with a single command. Level k is level k-1 smoothed with filt[k]
+ * (2*filt_width[k]+1 taps), the DoG level k-1 is level k - level k-1.
+ * If smooth_first is set, level 0 is first smoothed in place with
+ * filt[0].
+ *
+ * The levels stay in the DSP cache between two smoothings, only the
+ * complete octave and DoG are written back. nlevels must not exceed
+ * VL_DSP_MAX_LEVELS. Returns the error of vl_dsp_wait, the octave
+ * and the DoG are undefined then.
+ */
+VL_EXPORT
+int vl_sift_octave_on_dsp(float* octave, float* dog, float* temp,
+    int width, int height, int nlevels, int smooth_first,
+    float const* const* filt, int const* filt_width)
+{
+  octave_params* params = queue.octave;
+  vl_size level_elems = (vl_size)width * height;
+  vl_size level_size = level_elems * sizeof(float);
+  int k;
+  int err;
+
+  if (params == NULL)
+  {
+    params = vl_malloc(sizeof(octave_params));
+    queue.octave = params;
+  }
+
+  params->octave = (float*)vl_dsp_get_mapped_addr((void*)octave);
+  params->dog = (float*)vl_dsp_get_mapped_addr((void*)dog);
+  params->temp = (float*)vl_dsp_get_mapped_addr((void*)temp);
+  params->width = width;
+  params->height = height;
+  params->nlevels = nlevels;
+  params->smooth_first = smooth_first;
+
+  for (k = 0; k < VL_DSP_MAX_LEVELS; ++k)
+  {
+    int used = k < nlevels && (k > 0 || smooth_first);
+    params->filt[k] = used ? (float*)vl_dsp_get_mapped_addr((void*)filt[k]) : NULL;
+    params->filt_width[k] = used ? filt_width[k] : 0;
+    if (used)
+      vl_dsp_dmm_range_begin((void*)filt[k], (2 * filt_width[k] + 1) * sizeof(float), VL_DSP_TO_DEVICE);
+  }
+
+  /* level 0 is read (and rewritten if smoothed), the others and the
+     DoG are only written, temp never comes back to the ARM */
+  vl_dsp_dmm_range_begin(octave, level_size,
+      smooth_first ? VL_DSP_BIDIRECTIONAL : VL_DSP_TO_DEVICE);
+  vl_dsp_dmm_range_begin(octave + level_elems, (nlevels - 1) * level_size, VL_DSP_FROM_DEVICE);
+  vl_dsp_dmm_range_begin(dog, (nlevels - 1) * level_size, VL_DSP_FROM_DEVICE);
+  vl_dsp_dmm_range_begin(temp, level_size, VL_DSP_FROM_DEVICE);
+
+  err = vl_dsp_wait(_vl_dsp_post(VL_DSP_CMD_OCTAVE, params, sizeof(octave_params)));
+
+  if (smooth_first)
+    vl_dsp_dmm_range_end(octave, level_size, VL_DSP_BIDIRECTIONAL);
+  vl_dsp_dmm_range_end(octave + level_elems, (nlevels - 1) * level_size, VL_DSP_FROM_DEVICE);
+  vl_dsp_dmm_range_end(dog, (nlevels - 1) * level_size, VL_DSP_FROM_DEVICE);
+
+  return err;
+}
+
+/**
+ * blocks until the DSP has completed the convolution identified by
+ * token and all the ones posted before it.
+ *
+ * Returns VL_ERR_IO (and sets the last error) if the command of token
+ * was lost: its message could not be sent, or the node answered it
+ * with something unexpected. Its results are undefined then. As the
+ * message was answered (or never sent), the DSP no longer writes them.
+ * VL_ERR_OK otherwise.
+ */
+VL_EXPORT
+int vl_dsp_wait(vl_dsp_token token)
+{
+  if (token > queue.posted)
+    token = queue.posted;
+
+  if (token > queue.submitted)
+    vl_dsp_submit();
+
+  while (queue.completed < token)
+    _vl_dsp_receive();
+
+  if (queue.lost_end != 0 && token >= queue.lost_begin && token <= queue.lost_end)
+    return VL_ERR_IO;
+
+  return VL_ERR_OK;
+}
+
+/**
+ * waits for the answers to all posted commands, lost ones included, so
+ * the DSP does not write any buffer afterwards. Returns VL_ERR_IO if
+ * any of the commands that were pending was lost.
+ */
+VL_EXPORT
+int vl_dsp_drain(void)
+{
+  vl_dsp_token pending = queue.completed + 1;
+
+  vl_dsp_wait(queue.posted);
+
+  if (queue.lost_end != 0 && queue.lost_end >= pending)
+    return VL_ERR_IO;
 
-  vl_dsp_dmm_buffer_begin((void*)dst);
-  vl_dsp_dmm_buffer_begin((void*)src);
-  vl_dsp_dmm_buffer_begin((void*)filt);
-  vl_dsp_dmm_buffer_begin((void*)params);
+  return VL_ERR_OK;
+}
 
-  vl_dsp_send_message(1, (uint32_t)vl_dsp_get_mapped_addr(params), 0);
+/**
+ * waits for all pending convolutions and frees the command ring and
+ * the parameter blocks.
+ * Must be called while the allocation functions that created them
+ * are still installed.
+ */
+VL_EXPORT
+void vl_dsp_release(void)
+{
+  vl_dsp_drain();
+
+  if (queue.ring)
+    vl_free(queue.ring);
+  queue.ring = NULL;
+
+  if (queue.octave)
+    vl_free(queue.octave);
+  queue.octave = NULL;
+}
+
+int vl_imconvcol_vf_on_dsp(float* dst, int dst_stride,
+    float const* src,
+    int src_width, int src_height, int src_stride,
+    float const* filt, int filt_begin, int filt_end,
+    int step, unsigned int flags)
+{
+  int err;
+  int dheight = (src_height - 1) / step + 1;
+  unsigned dst_size = (flags & VL_TRANSPOSE) ?
+      _vl_dsp_region_size(src_width, dheight, dst_stride) :
+      _vl_dsp_region_size(dheight, src_width, dst_stride);
 
-  /*vl_imconvcol_vf (dst, dst_stride,
-      src, src_width, src_height, src_stride,
-      filt,
-      filt_begin, filt_end,
-      step, flags) ;*/
+  vl_dsp_dmm_range_begin((void*)src, _vl_dsp_region_size(src_height, src_width, src_stride), VL_DSP_TO_DEVICE);
+  vl_dsp_dmm_range_begin((void*)filt, (filt_end - filt_begin + 1)*sizeof(float), VL_DSP_TO_DEVICE);
+  vl_dsp_dmm_range_begin((void*)dst, dst_size, VL_DSP_FROM_DEVICE);
 
-  //dsp_msg_t msg =
-  vl_dsp_get_message();
+  err = vl_dsp_wait(vl_imconvcol_vf_on_dsp_async(dst, dst_stride,
+      src, src_height, src_stride,
+      filt, filt_begin, filt_end,
+      step, flags, 0, src_width));
 
-  vl_dsp_dmm_buffer_end((void*)dst);
-  vl_dsp_dmm_buffer_end((void*)src);
-  vl_dsp_dmm_buffer_end((void*)filt);
+  /* src and filt were only read */
+  vl_dsp_dmm_range_end((void*)dst, dst_size, VL_DSP_FROM_DEVICE);
 
-  vl_free(params);
+  return err;
 }
@@ -26,12 +26,85 @@ typedef struct _imconvol_vf_params
   unsigned int flags;
 }imconvol_vf_params;
 
-void vl_imconvcol_vf_on_dsp(float* dst, int dst_stride,
+#define VL_DSP_MAX_LEVELS 16
+
+/* L2 line of the C64x+, also a multiple of the ARM cache line */
+#define VL_DSP_CACHE_LINE 128
+
+/* builds the levels 1..nlevels-1 of an octave and their DoG from level 0 */
+typedef struct _octave_params
+{
+  float* octave;       /* nlevels levels of width*height floats, level 0 is the input */
+  float* dog;          /* nlevels-1 DoG levels, level k-1 is level k - level k-1 */
+  float* temp;         /* width*height floats of scratch space */
+  int width;
+  int height;
+  int nlevels;
+  int smooth_first;    /* if set, level 0 is first smoothed in place with filt[0] */
+  float const* filt[VL_DSP_MAX_LEVELS];  /* filt[k] gets level k from level k-1 */
+  int filt_width[VL_DSP_MAX_LEVELS];     /* half width, filt[k] has 2*width+1 taps */
+}octave_params;
+
+/*
+ * command ring in DSP memory, shared by ARM and DSP. The ARM fills in
+ * consecutive entries and hands them over with one VL_DSP_CMD_BATCH
+ * message; the node runs them in order and answers once per batch.
+ * An entry takes a whole cache line, so the ARM can write back and
+ * the DSP invalidate just the entries of a batch.
+ */
+#define VL_DSP_RING_SIZE  64   /* entries, a power of two */
+#define VL_DSP_BATCH_MAX  16   /* entries per VL_DSP_CMD_BATCH message */
+
+typedef union _dsp_ring_entry
+{
+  struct
+  {
+    unsigned cmd;              /* VL_DSP_CMD_IMCONVCOL */
+    unsigned token;
+    imconvol_vf_params conv;
+  } job;
+  char pad[VL_DSP_CACHE_LINE];
+}dsp_ring_entry;
+
+/* commands understood by the DSP node (src/progs/dsp/sift.c) */
+#define VL_DSP_CMD_IMCONVCOL 1           /* arg_1: params, arg_2: token */
+#define VL_DSP_CMD_DONE      2           /* reply, echoes arg_1 and arg_2 */
+#define VL_DSP_CMD_OCTAVE    3           /* arg_1: octave_params, arg_2: token */
+#define VL_DSP_CMD_BATCH     4           /* arg_1: first ring entry, arg_2: number of entries,
+                                            DONE has the token of the last entry in arg_2 */
+#define VL_DSP_CMD_EXIT      0x80000000
+
+#ifndef ARCH_DSP
+#include "generic.h"
+
+/* identifies a convolution posted to the DSP, tokens are increasing */
+typedef vl_uint64 vl_dsp_token;
+
+int vl_imconvcol_vf_on_dsp(float* dst, int dst_stride,
     float const* src,
     int src_width, int src_height, int src_stride,
     float const* filt, int filt_begin, int filt_end,
     int step, unsigned int flags);
 
+VL_EXPORT
+vl_dsp_token vl_imconvcol_vf_on_dsp_async(float* dst, int dst_stride,
+    float const* src,
+    int src_height, int src_stride,
+    float const* filt, int filt_begin, int filt_end,
+    int step, unsigned int flags,
+    int x_begin, int x_end);
+
+VL_EXPORT
+int vl_sift_octave_on_dsp(float* octave, float* dog, float* temp,
+    int width, int height, int nlevels, int smooth_first,
+    float const* const* filt, int const* filt_width);
+
+VL_EXPORT void vl_dsp_submit(void);
+VL_EXPORT int vl_dsp_wait(vl_dsp_token token);
+VL_EXPORT int vl_dsp_drain(void);
+VL_EXPORT void vl_dsp_release(void);
+#endif
+
 #ifdef ARCH_DSP
 //defininition for DSP, to avoid including the whole vlfeat stuff...
 void vl_imconvcol_vf(float* dst, int dst_stride,
@@ -0,0 +1,265 @@
+/** @internal
+ ** @file     sift_neon.c
+ ** @brief    Vectorized SIFT descriptor - NEON - Definition
+ **/
+
+/* AUTORIGHTS
+Copyright (C) 2007-10 Andrea Vedaldi and Brian Fulkerson
+
+This file is part of VLFeat, available under the terms of the
+GNU GPLv2, or (at your option) any later version.
+*/
+
+#include "sift_neon.h"
+
+#if defined(ARCH_ARM) && ! defined(VL_DISABLE_NEON)
+
+#if ! defined(__ARM_NEON__)
+#error "Compiling with NEON enabled, but no __ARM_NEON__ defined"
+#endif
+
+#include <arm_neon.h>
+#include "mathop.h"
+
+#define NBO 8
+#define NBP 4
+
+/** @internal @brief Select @a x where @a mask is set, zero elsewhere */
+#define VMASK(mask,x) \
+  vreinterpretq_f32_u32 (vandq_u32 ((mask), vreinterpretq_u32_f32 (x)))
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Accumulate gradient samples into a SIFT descriptor - NEON
+ **
+ ** Same as ::_vl_sift_descriptor_accumulate_sse2 (see there for the
+ ** parameters).
+ **/
+
+VL_EXPORT void
+_vl_sift_descriptor_accumulate_neon (vl_sift_pix *dpt,
+                                     vl_sift_pix const *pt,
+                                     int yo,
+                                     int dxi_begin, int dxi_end,
+                                     int dyi_begin, int dyi_end,
+                                     int xi, int yi,
+                                     double x, double y,
+                                     double ct0, double st0,
+                                     double SBP, double angle0,
+                                     double wden,
+                                     double const *expn_tab,
+                                     int expn_size, double expn_max)
+{
+  int const binto = 1 ;          /* bin theta-stride */
+  int const binyo = NBO * NBP ;  /* bin y-stride */
+  int const binxo = NBO ;        /* bin x-stride */
+
+  float const lanes [4] = {0.0f, 1.0f, 2.0f, 3.0f} ;
+
+  float32x4_t const zero   = vdupq_n_f32 (0.0f) ;
+  float32x4_t const one    = vdupq_n_f32 (1.0f) ;
+  float32x4_t const half   = vdupq_n_f32 (0.5f) ;
+  float32x4_t const twopi  = vdupq_n_f32 ((float) (2 * VL_PI)) ;
+  float32x4_t const lane   = vld1q_f32 (lanes) ;
+  float32x4_t const vct    = vdupq_n_f32 ((float) (ct0 / SBP)) ;
+  float32x4_t const vst    = vdupq_n_f32 ((float) (st0 / SBP)) ;
+  float32x4_t const vang0  = vdupq_n_f32 ((float) angle0) ;
+  float32x4_t const vtscl  = vdupq_n_f32 ((float) (NBO / (2 * VL_PI))) ;
+  float32x4_t const vescl  = vdupq_n_f32 ((float) (expn_size / expn_max / wden)) ;
+  float32x4_t const vesize = vdupq_n_f32 ((float) expn_size) ;
+
+  int dxi, dyi, j, n ;
+
+  for (dyi = dyi_begin ; dyi <= dyi_end ; ++ dyi) {
+
+    vl_sift_pix const *row = pt + dyi * yo ;
+    float32x4_t const vdy  = vdupq_n_f32 ((float) (yi + dyi - y)) ;
+    float32x4_t const vdyx = vmulq_f32 (vdy, vst) ;
+    float32x4_t const vdyy = vmulq_f32 (vdy, vct) ;
+
+    for (dxi = dxi_begin ; dxi <= dxi_end ; dxi += 4) {
+
+      float w [8][4] ;
+      float ta [4], tb [4] ;
+      int bx [4], by [4], bt [4], ei [4] ;
+      float buf [8] ;
+      float32x4x2_t g ;
+      float32x4_t mod, theta, dx, nx, ny, nt, r2, t, fl ;
+      float32x4_t wa, wb, win, rbx, rby, rbt, fx, fy ;
+      int32x4_t ix ;
+
+      n = VL_MIN (4, dxi_end - dxi + 1) ;
+
+      /* load n (modulus, angle) pairs, deinterleaved */
+      if (n == 4) {
+        g = vld2q_f32 (row + 2 * dxi) ;
+      } else {
+        for (j = 0 ; j < 8 ; ++j) buf [j] = (j < 2 * n) ? row [2 * dxi + j] : 0 ;
+        g = vld2q_f32 (buf) ;
+      }
+      mod = g.val [0] ;
+
+      /* theta = mod_2pi (angle - angle0) */
+      theta = vsubq_f32 (g.val [1], vang0) ;
+      theta = vaddq_f32 (theta, VMASK (vcltq_f32 (theta, zero), twopi)) ;
+      theta = vsubq_f32 (theta, VMASK (vcgtq_f32 (theta, twopi), twopi)) ;
+
+      /* displacement normalized w.r.t. orientation and extension */
+      dx = vaddq_f32 (vdupq_n_f32 ((float) (xi + dxi - x)), lane) ;
+      nx = vaddq_f32 (vmulq_f32 (dx, vct), vdyx) ;
+      ny = vsubq_f32 (vdyy, vmulq_f32 (dx, vst)) ;
+      nt = vmulq_f32 (theta, vtscl) ;
+
+      /* Gaussian window by linear interpolation of the fast_expn table */
+      r2 = vaddq_f32 (vmulq_f32 (nx, nx), vmulq_f32 (ny, ny)) ;
+      t  = vminq_f32 (vmulq_f32 (r2, vescl), vesize) ;
+      vst1q_s32 (ei, vcvtq_s32_f32 (t)) ;
+      for (j = 0 ; j < 4 ; ++j) {
+        ei [j] = VL_MIN (ei [j], expn_size - 1) ;
+        ta [j] = (float) expn_tab [ei [j]] ;
+        tb [j] = (float) expn_tab [ei [j] + 1] ;
+      }
+      t   = vsubq_f32 (t, vcvtq_f32_s32 (vld1q_s32 (ei))) ;
+      win = vld1q_f32 (ta) ;
+      win = vaddq_f32 (win, vmulq_f32 (t, vsubq_f32 (vld1q_f32 (tb), win))) ;
+      win = vreinterpretq_f32_u32
+        (vbicq_u32 (vreinterpretq_u32_f32 (win),
+                    vcgtq_f32 (vmulq_f32 (r2, vescl), vesize))) ;
+
+      /* lower-left bin and fractional offsets (floor rounds down) */
+      fx  = vsubq_f32 (nx, half) ;
+      ix  = vcvtq_s32_f32 (fx) ;
+      fl  = vcvtq_f32_s32 (ix) ;
+      ix  = vaddq_s32 (ix, vreinterpretq_s32_u32 (vcgtq_f32 (fl, fx))) ;
+      rbx = vsubq_f32 (nx, vaddq_f32 (vcvtq_f32_s32 (ix), half)) ;
+      vst1q_s32 (bx, ix) ;
+
+      fy  = vsubq_f32 (ny, half) ;
+      ix  = vcvtq_s32_f32 (fy) ;
+      fl  = vcvtq_f32_s32 (ix) ;
+      ix  = vaddq_s32 (ix, vreinterpretq_s32_u32 (vcgtq_f32 (fl, fy))) ;
+      rby = vsubq_f32 (ny, vaddq_f32 (vcvtq_f32_s32 (ix), half)) ;
+      vst1q_s32 (by, ix) ;
+
+      ix  = vcvtq_s32_f32 (nt) ;
+      rbt = vsubq_f32 (nt, vcvtq_f32_s32 (ix)) ;
+      vst1q_s32 (bt, ix) ;
+
+      /* the 8 trilinear weights */
+      win = vmulq_f32 (win, mod) ;
+      wa  = vmulq_f32 (win, vsubq_f32 (one, rbx)) ;
+      wb  = vmulq_f32 (win, rbx) ;
+      {
+        float32x4_t wa0 = vmulq_f32 (wa, vsubq_f32 (one, rby)) ;
+        float32x4_t wa1 = vmulq_f32 (wa, rby) ;
+        float32x4_t wb0 = vmulq_f32 (wb, vsubq_f32 (one, rby)) ;
+        float32x4_t wb1 = vmulq_f32 (wb, rby) ;
+        float32x4_t rt0 = vsubq_f32 (one, rbt) ;
+        vst1q_f32 (w [0], vmulq_f32 (wa0, rt0)) ; vst1q_f32 (w [1], vmulq_f32 (wa0, rbt)) ;
+        vst1q_f32 (w [2], vmulq_f32 (wa1, rt0)) ; vst1q_f32 (w [3], vmulq_f32 (wa1, rbt)) ;
+        vst1q_f32 (w [4], vmulq_f32 (wb0, rt0)) ; vst1q_f32 (w [5], vmulq_f32 (wb0, rbt)) ;
+        vst1q_f32 (w [6], vmulq_f32 (wb1, rt0)) ; vst1q_f32 (w [7], vmulq_f32 (wb1, rbt)) ;
+      }
+
+      /* scatter */
+      for (j = 0 ; j < n ; ++j) {
+        int dbinx, dbiny, dbint ;
+        for (dbinx = 0 ; dbinx < 2 ; ++dbinx) {
+          if (bx [j] + dbinx < - (NBP/2) || bx [j] + dbinx >= (NBP/2)) continue ;
+          for (dbiny = 0 ; dbiny < 2 ; ++dbiny) {
+            if (by [j] + dbiny < - (NBP/2) || by [j] + dbiny >= (NBP/2)) continue ;
+            for (dbint = 0 ; dbint < 2 ; ++dbint) {
+              *(dpt
+                + ((bt [j] + dbint) % NBO) * binto
+                + (by [j] + dbiny) * binyo
+                + (bx [j] + dbinx) * binxo) += w [4*dbinx + 2*dbiny + dbint][j] ;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/** @internal @brief Single precision division (reciprocal estimate and two Newton steps) */
+static float32x4_t
+_vl_vdivq_f32 (float32x4_t a, float32x4_t b)
+{
+  float32x4_t inv = vrecpeq_f32 (b) ;
+  inv = vmulq_f32 (vrecpsq_f32 (b, inv), inv) ;
+  inv = vmulq_f32 (vrecpsq_f32 (b, inv), inv) ;
+  return vmulq_f32 (a, inv) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Gradient modulus and angle of a row of pixels - NEON
+ **
+ ** Same as ::_vl_sift_gradient_row_sse2 (see there for the
+ ** parameters). NEON has no division, which is replaced by a refined
+ ** reciprocal.
+ **/
+
+VL_EXPORT int
+_vl_sift_gradient_row_neon (vl_sift_pix *grad,
+                            vl_sift_pix const *src,
+                            vl_sift_pix const *up,
+                            vl_sift_pix const *down,
+                            float gyScale,
+                            int n)
+{
+  float32x4_t const vhalf  = vdupq_n_f32 (0.5f) ;
+  float32x4_t const vgys   = vdupq_n_f32 (gyScale) ;
+  float32x4_t const v1p5   = vdupq_n_f32 (1.5f) ;
+  float32x4_t const vtiny  = vdupq_n_f32 (1e-8f) ;
+  float32x4_t const veps   = vdupq_n_f32 (VL_EPSILON_F) ;
+  float32x4_t const vc3    = vdupq_n_f32 (0.1821f) ;
+  float32x4_t const vc1    = vdupq_n_f32 (0.9675f) ;
+  float32x4_t const vpi4   = vdupq_n_f32 ((float) (VL_PI / 4)) ;
+  float32x4_t const v3pi4  = vdupq_n_f32 ((float) (3 * VL_PI / 4)) ;
+  float32x4_t const vtwopi = vdupq_n_f32 ((float) (2 * VL_PI)) ;
+  float32x4_t const zero   = vdupq_n_f32 (0.0f) ;
+  uint32x4_t  const magic  = vdupq_n_u32 (0x5f3759df) ;
+  int x ;
+
+  for (x = 0 ; x + 4 <= n ; x += 4) {
+    float32x4_t gx, gy, m2, y, xhalf, mod, ay, r, angle ;
+    float32x4x2_t out ;
+    uint32x4_t pos, neg ;
+
+    gx = vmulq_f32 (vhalf, vsubq_f32 (vld1q_f32 (src + x + 1),
+                                      vld1q_f32 (src + x - 1))) ;
+    gy = vmulq_f32 (vgys,  vsubq_f32 (vld1q_f32 (down + x),
+                                      vld1q_f32 (up + x))) ;
+
+    /* modulus: x * resqrt(x) with two Newton steps, 0 below 1e-8 */
+    m2    = vaddq_f32 (vmulq_f32 (gx, gx), vmulq_f32 (gy, gy)) ;
+    xhalf = vmulq_f32 (vhalf, m2) ;
+    y     = vreinterpretq_f32_u32 (vsubq_u32 (magic, vshrq_n_u32 (vreinterpretq_u32_f32 (m2), 1))) ;
+    y     = vmulq_f32 (y, vsubq_f32 (v1p5, vmulq_f32 (vmulq_f32 (xhalf, y), y))) ;
+    y     = vmulq_f32 (y, vsubq_f32 (v1p5, vmulq_f32 (vmulq_f32 (xhalf, y), y))) ;
+    mod   = vreinterpretq_f32_u32
+      (vbicq_u32 (vreinterpretq_u32_f32 (vmulq_f32 (m2, y)), vcltq_f32 (m2, vtiny))) ;
+
+    /* angle: fast atan2 mapped to [0, 2pi] */
+    ay    = vaddq_f32 (vabsq_f32 (gy), veps) ;
+    pos   = vcgeq_f32 (gx, zero) ;
+    r     = vbslq_f32 (pos,
+                       _vl_vdivq_f32 (vsubq_f32 (gx, ay), vaddq_f32 (gx, ay)),
+                       _vl_vdivq_f32 (vaddq_f32 (gx, ay), vsubq_f32 (ay, gx))) ;
+    angle = vbslq_f32 (pos, vpi4, v3pi4) ;
+    angle = vaddq_f32 (angle, vmulq_f32 (vsubq_f32 (vmulq_f32 (vmulq_f32 (vc3, r), r), vc1), r)) ;
+    neg   = vcltq_f32 (gy, zero) ;
+    angle = vbslq_f32 (neg, vnegq_f32 (angle), angle) ;
+    angle = vaddq_f32 (angle, vtwopi) ;
+    angle = vbslq_f32 (vcgtq_f32 (angle, vtwopi), vsubq_f32 (angle, vtwopi), angle) ;
+
+    out.val [0] = mod ;
+    out.val [1] = angle ;
+    vst2q_f32 (grad + 2 * x, out) ;
+  }
+  return x ;
+}
+
+/* ARCH_ARM && ! VL_DISABLE_NEON */
+#endif
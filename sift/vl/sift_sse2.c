@@ -0,0 +1,273 @@
+/** @internal
+ ** @file     sift_sse2.c
+ ** @brief    Vectorized SIFT descriptor - SSE2 - Definition
+ **/
+
+/* AUTORIGHTS
+Copyright (C) 2007-10 Andrea Vedaldi and Brian Fulkerson
+
+This file is part of VLFeat, available under the terms of the
+GNU GPLv2, or (at your option) any later version.
+*/
+
+#if ! defined(VL_DISABLE_SSE2) & ! defined(__SSE2__)
+#error "Compiling with SSE2 enabled, but no __SSE2__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_SSE2)
+
+#include <emmintrin.h>
+#include "mathop.h"
+#include "sift_sse2.h"
+
+#define NBO 8
+#define NBP 4
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Accumulate gradient samples into a SIFT descriptor - SSE2
+ **
+ ** @param dpt        descriptor bin of center (NBP/2,NBP/2,0).
+ ** @param pt         gradient (modulus, angle) at the keypoint center.
+ ** @param yo         gradient y-stride.
+ ** @param dxi_begin  first sample x offset.
+ ** @param dxi_end    last sample x offset (included).
+ ** @param dyi_begin  first sample y offset.
+ ** @param dyi_end    last sample y offset (included).
+ ** @param xi         keypoint x rounded to the closest sample.
+ ** @param yi         keypoint y rounded to the closest sample.
+ ** @param x          keypoint x.
+ ** @param y          keypoint y.
+ ** @param ct0        cosine of the keypoint orientation.
+ ** @param st0        sine of the keypoint orientation.
+ ** @param SBP        spatial bin size.
+ ** @param angle0     keypoint orientation.
+ ** @param wden       Gaussian window denominator (2 sigma^2).
+ ** @param expn_tab   ::fast_expn table.
+ ** @param expn_size  ::fast_expn table size.
+ ** @param expn_max   ::fast_expn table maximum argument.
+ **
+ ** The function computes the Gaussian weight and the trilinear bin
+ ** coordinates of four samples of a row at once and then scatters
+ ** them into the histogram. It is equivalent to the scalar loop of
+ ** ::vl_sift_calc_keypoint_descriptor up to single precision rounding.
+ **/
+
+VL_EXPORT void
+_vl_sift_descriptor_accumulate_sse2 (vl_sift_pix *dpt,
+                                     vl_sift_pix const *pt,
+                                     int yo,
+                                     int dxi_begin, int dxi_end,
+                                     int dyi_begin, int dyi_end,
+                                     int xi, int yi,
+                                     double x, double y,
+                                     double ct0, double st0,
+                                     double SBP, double angle0,
+                                     double wden,
+                                     double const *expn_tab,
+                                     int expn_size, double expn_max)
+{
+  int const binto = 1 ;          /* bin theta-stride */
+  int const binyo = NBO * NBP ;  /* bin y-stride */
+  int const binxo = NBO ;        /* bin x-stride */
+
+  __m128 const zero   = _mm_setzero_ps () ;
+  __m128 const one    = _mm_set1_ps (1.0f) ;
+  __m128 const half   = _mm_set1_ps (0.5f) ;
+  __m128 const twopi  = _mm_set1_ps ((float) (2 * VL_PI)) ;
+  __m128 const lane   = _mm_set_ps (3.0f, 2.0f, 1.0f, 0.0f) ;
+  __m128 const vct    = _mm_set1_ps ((float) (ct0 / SBP)) ;
+  __m128 const vst    = _mm_set1_ps ((float) (st0 / SBP)) ;
+  __m128 const vang0  = _mm_set1_ps ((float) angle0) ;
+  __m128 const vtscl  = _mm_set1_ps ((float) (NBO / (2 * VL_PI))) ;
+  __m128 const vescl  = _mm_set1_ps ((float) (expn_size / expn_max / wden)) ;
+  __m128 const vesize = _mm_set1_ps ((float) expn_size) ;
+
+  int dxi, dyi, j, n ;
+
+  for (dyi = dyi_begin ; dyi <= dyi_end ; ++ dyi) {
+
+    vl_sift_pix const *row = pt + dyi * yo ;
+    __m128 const vdy  = _mm_set1_ps ((float) (yi + dyi - y)) ;
+    __m128 const vdyx = _mm_mul_ps (vdy, vst) ;
+    __m128 const vdyy = _mm_mul_ps (vdy, vct) ;
+
+    for (dxi = dxi_begin ; dxi <= dxi_end ; dxi += 4) {
+
+      union { __m128 v ; float x [4] ; } w [8] ;
+      union { __m128i v ; int x [4] ; } bx, by, bt, ei ;
+      float buf [8] ;
+      __m128 a, b, mod, ang, theta, dx, nx, ny, nt, r2, t, fl ;
+      __m128 wa, wb, win, rbx, rby, rbt, fx, fy ;
+
+      n = VL_MIN (4, dxi_end - dxi + 1) ;
+
+      /* load n (modulus, angle) pairs and deinterleave */
+      if (n == 4) {
+        a = _mm_loadu_ps (row + 2 * dxi) ;
+        b = _mm_loadu_ps (row + 2 * dxi + 4) ;
+      } else {
+        for (j = 0 ; j < 8 ; ++j) buf [j] = (j < 2 * n) ? row [2 * dxi + j] : 0 ;
+        a = _mm_loadu_ps (buf) ;
+        b = _mm_loadu_ps (buf + 4) ;
+      }
+      mod = _mm_shuffle_ps (a, b, _MM_SHUFFLE(2,0,2,0)) ;
+      ang = _mm_shuffle_ps (a, b, _MM_SHUFFLE(3,1,3,1)) ;
+
+      /* theta = mod_2pi (angle - angle0) */
+      theta = _mm_sub_ps (ang, vang0) ;
+      theta = _mm_add_ps (theta, _mm_and_ps (_mm_cmplt_ps (theta, zero), twopi)) ;
+      theta = _mm_sub_ps (theta, _mm_and_ps (_mm_cmpgt_ps (theta, twopi), twopi)) ;
+
+      /* displacement normalized w.r.t. orientation and extension */
+      dx = _mm_add_ps (_mm_set1_ps ((float) (xi + dxi - x)), lane) ;
+      nx = _mm_add_ps (_mm_mul_ps (dx, vct), vdyx) ;
+      ny = _mm_sub_ps (vdyy, _mm_mul_ps (dx, vst)) ;
+      nt = _mm_mul_ps (theta, vtscl) ;
+
+      /* Gaussian window by linear interpolation of the fast_expn table */
+      r2 = _mm_add_ps (_mm_mul_ps (nx, nx), _mm_mul_ps (ny, ny)) ;
+      t  = _mm_min_ps (_mm_mul_ps (r2, vescl), vesize) ;
+      ei.v = _mm_cvttps_epi32 (t) ;
+      for (j = 0 ; j < 4 ; ++j) {
+        int i = VL_MIN (ei.x [j], expn_size - 1) ;
+        w [0].x [j] = (float) expn_tab [i] ;
+        w [1].x [j] = (float) expn_tab [i + 1] ;
+        ei.x [j] = i ;
+      }
+      t   = _mm_sub_ps (t, _mm_cvtepi32_ps (ei.v)) ;
+      win = _mm_add_ps (w [0].v, _mm_mul_ps (t, _mm_sub_ps (w [1].v, w [0].v))) ;
+      win = _mm_andnot_ps (_mm_cmpgt_ps (_mm_mul_ps (r2, vescl), vesize), win) ;
+
+      /* lower-left bin and fractional offsets (floor rounds down) */
+      fx   = _mm_sub_ps (nx, half) ;
+      bx.v = _mm_cvttps_epi32 (fx) ;
+      fl   = _mm_cvtepi32_ps (bx.v) ;
+      bx.v = _mm_add_epi32 (bx.v, _mm_castps_si128 (_mm_cmpgt_ps (fl, fx))) ;
+      rbx  = _mm_sub_ps (nx, _mm_add_ps (_mm_cvtepi32_ps (bx.v), half)) ;
+
+      fy   = _mm_sub_ps (ny, half) ;
+      by.v = _mm_cvttps_epi32 (fy) ;
+      fl   = _mm_cvtepi32_ps (by.v) ;
+      by.v = _mm_add_epi32 (by.v, _mm_castps_si128 (_mm_cmpgt_ps (fl, fy))) ;
+      rby  = _mm_sub_ps (ny, _mm_add_ps (_mm_cvtepi32_ps (by.v), half)) ;
+
+      bt.v = _mm_cvttps_epi32 (nt) ;
+      rbt  = _mm_sub_ps (nt, _mm_cvtepi32_ps (bt.v)) ;
+
+      /* the 8 trilinear weights */
+      win  = _mm_mul_ps (win, mod) ;
+      wa   = _mm_mul_ps (win, _mm_sub_ps (one, rbx)) ;
+      wb   = _mm_mul_ps (win, rbx) ;
+      {
+        __m128 wa0 = _mm_mul_ps (wa, _mm_sub_ps (one, rby)) ;
+        __m128 wa1 = _mm_mul_ps (wa, rby) ;
+        __m128 wb0 = _mm_mul_ps (wb, _mm_sub_ps (one, rby)) ;
+        __m128 wb1 = _mm_mul_ps (wb, rby) ;
+        __m128 rt0 = _mm_sub_ps (one, rbt) ;
+        w [0].v = _mm_mul_ps (wa0, rt0) ; w [1].v = _mm_mul_ps (wa0, rbt) ;
+        w [2].v = _mm_mul_ps (wa1, rt0) ; w [3].v = _mm_mul_ps (wa1, rbt) ;
+        w [4].v = _mm_mul_ps (wb0, rt0) ; w [5].v = _mm_mul_ps (wb0, rbt) ;
+        w [6].v = _mm_mul_ps (wb1, rt0) ; w [7].v = _mm_mul_ps (wb1, rbt) ;
+      }
+
+      /* scatter */
+      for (j = 0 ; j < n ; ++j) {
+        int binx = bx.x [j] ;
+        int biny = by.x [j] ;
+        int bint = bt.x [j] ;
+        int dbinx, dbiny, dbint ;
+        for (dbinx = 0 ; dbinx < 2 ; ++dbinx) {
+          if (binx + dbinx < - (NBP/2) || binx + dbinx >= (NBP/2)) continue ;
+          for (dbiny = 0 ; dbiny < 2 ; ++dbiny) {
+            if (biny + dbiny < - (NBP/2) || biny + dbiny >= (NBP/2)) continue ;
+            for (dbint = 0 ; dbint < 2 ; ++dbint) {
+              *(dpt
+                + ((bint + dbint) % NBO) * binto
+                + (biny + dbiny) * binyo
+                + (binx + dbinx) * binxo) += w [4*dbinx + 2*dbiny + dbint].x [j] ;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Gradient modulus and angle of a row of pixels - SSE2
+ **
+ ** @param grad     output (modulus, angle) pairs.
+ ** @param src      first pixel (its left neighbor must exist).
+ ** @param up       pixel above @a src (or @a src on the first row).
+ ** @param down     pixel below @a src (or @a src on the last row).
+ ** @param gyScale  0.5 for central y differences, 1 otherwise.
+ ** @param n        number of pixels (their right neighbors must exist).
+ ** @return number of pixels processed (a multiple of four).
+ **
+ ** The function is the vectorized version of the inner loop of
+ ** ::vl_sift_update_gradient, with the same ::vl_fast_sqrt_f and
+ ** ::vl_fast_atan2_f approximations. The caller completes the last
+ ** <code>n % 4</code> pixels.
+ **/
+
+VL_EXPORT int
+_vl_sift_gradient_row_sse2 (vl_sift_pix *grad,
+                            vl_sift_pix const *src,
+                            vl_sift_pix const *up,
+                            vl_sift_pix const *down,
+                            float gyScale,
+                            int n)
+{
+  __m128 const vhalf  = _mm_set1_ps (0.5f) ;
+  __m128 const vgys   = _mm_set1_ps (gyScale) ;
+  __m128 const v1p5   = _mm_set1_ps (1.5f) ;
+  __m128 const vtiny  = _mm_set1_ps (1e-8f) ;
+  __m128 const veps   = _mm_set1_ps (VL_EPSILON_F) ;
+  __m128 const vsign  = _mm_set1_ps (-0.0f) ;
+  __m128 const vc3    = _mm_set1_ps (0.1821f) ;
+  __m128 const vc1    = _mm_set1_ps (0.9675f) ;
+  __m128 const vpi4   = _mm_set1_ps ((float) (VL_PI / 4)) ;
+  __m128 const v3pi4  = _mm_set1_ps ((float) (3 * VL_PI / 4)) ;
+  __m128 const vtwopi = _mm_set1_ps ((float) (2 * VL_PI)) ;
+  __m128 const zero   = _mm_setzero_ps () ;
+  __m128i const magic = _mm_set1_epi32 (0x5f3759df) ;
+  int x ;
+
+  for (x = 0 ; x + 4 <= n ; x += 4) {
+    __m128 gx, gy, m2, y, xhalf, mod, ay, pos, r, rp, rn, angle ;
+
+    gx = _mm_mul_ps (vhalf, _mm_sub_ps (_mm_loadu_ps (src + x + 1),
+                                        _mm_loadu_ps (src + x - 1))) ;
+    gy = _mm_mul_ps (vgys,  _mm_sub_ps (_mm_loadu_ps (down + x),
+                                        _mm_loadu_ps (up + x))) ;
+
+    /* modulus: x * resqrt(x) with two Newton steps, 0 below 1e-8 */
+    m2    = _mm_add_ps (_mm_mul_ps (gx, gx), _mm_mul_ps (gy, gy)) ;
+    xhalf = _mm_mul_ps (vhalf, m2) ;
+    y     = _mm_castsi128_ps (_mm_sub_epi32 (magic, _mm_srli_epi32 (_mm_castps_si128 (m2), 1))) ;
+    y     = _mm_mul_ps (y, _mm_sub_ps (v1p5, _mm_mul_ps (_mm_mul_ps (xhalf, y), y))) ;
+    y     = _mm_mul_ps (y, _mm_sub_ps (v1p5, _mm_mul_ps (_mm_mul_ps (xhalf, y), y))) ;
+    mod   = _mm_andnot_ps (_mm_cmplt_ps (m2, vtiny), _mm_mul_ps (m2, y)) ;
+
+    /* angle: fast atan2 mapped to [0, 2pi] */
+    ay    = _mm_add_ps (_mm_andnot_ps (vsign, gy), veps) ;
+    pos   = _mm_cmpge_ps (gx, zero) ;
+    rp    = _mm_div_ps (_mm_sub_ps (gx, ay), _mm_add_ps (gx, ay)) ;
+    rn    = _mm_div_ps (_mm_add_ps (gx, ay), _mm_sub_ps (ay, gx)) ;
+    r     = _mm_or_ps (_mm_and_ps (pos, rp), _mm_andnot_ps (pos, rn)) ;
+    angle = _mm_or_ps (_mm_and_ps (pos, vpi4), _mm_andnot_ps (pos, v3pi4)) ;
+    angle = _mm_add_ps (angle, _mm_mul_ps (_mm_sub_ps (_mm_mul_ps (_mm_mul_ps (vc3, r), r), vc1), r)) ;
+    angle = _mm_xor_ps (angle, _mm_and_ps (_mm_cmplt_ps (gy, zero), vsign)) ;
+    angle = _mm_add_ps (angle, vtwopi) ;
+    angle = _mm_sub_ps (angle, _mm_and_ps (_mm_cmpgt_ps (angle, vtwopi), vtwopi)) ;
+
+    _mm_storeu_ps (grad + 2 * x,     _mm_unpacklo_ps (mod, angle)) ;
+    _mm_storeu_ps (grad + 2 * x + 4, _mm_unpackhi_ps (mod, angle)) ;
+  }
+  return x ;
+}
+
+/* ! VL_DISABLE_SSE2 */
+#endif
@@ -0,0 +1,45 @@
+/** @internal
+ ** @file     sift_sse2.h
+ ** @brief    Vectorized SIFT descriptor - SSE2
+ **/
+
+/* AUTORIGHTS
+Copyright (C) 2007-10 Andrea Vedaldi and Brian Fulkerson
+
+This file is part of VLFeat, available under the terms of the
+GNU GPLv2, or (at your option) any later version.
+*/
+
+#ifndef VL_SIFT_SSE2_H
+#define VL_SIFT_SSE2_H
+
+#include "sift.h"
+
+#ifndef VL_DISABLE_SSE2
+
+VL_EXPORT
+void _vl_sift_descriptor_accumulate_sse2 (vl_sift_pix *dpt,
+                                          vl_sift_pix const *pt,
+                                          int yo,
+                                          int dxi_begin, int dxi_end,
+                                          int dyi_begin, int dyi_end,
+                                          int xi, int yi,
+                                          double x, double y,
+                                          double ct0, double st0,
+                                          double SBP, double angle0,
+                                          double wden,
+                                          double const *expn_tab,
+                                          int expn_size, double expn_max) ;
+
+VL_EXPORT
+int _vl_sift_gradient_row_sse2 (vl_sift_pix *grad,
+                                 vl_sift_pix const *src,
+                                 vl_sift_pix const *up,
+                                 vl_sift_pix const *down,
+                                 float gyScale,
+                                 int n) ;
+
+#endif
+
+/* VL_SIFT_SSE2_H */
+#endif
@@ -0,0 +1,253 @@
+/** @file    threads.c
+ ** @brief   Parallel loops - Definition
+ ** @author  Andrea Vedaldi
+ **/
+
+/* AUTORIGHTS
+Copyright (C) 2007-10 Andrea Vedaldi and Brian Fulkerson
+
+This file is part of VLFeat, available under the terms of the
+GNU GPLv2, or (at your option) any later version.
+*/
+
+/** @file threads.h
+
+ This module runs a loop of independent tasks on a pool of
+ threads. For instance
+
+ @code
+ vl_parallel_for (numTasks, func, data) ;
+ @endcode
+
+ calls <code>func(data, taskIndex, threadIndex)</code> once for each
+ @c taskIndex in [0, @c numTasks - 1]. Tasks are handed out to the
+ threads one at a time as these become free, so tasks of uneven
+ cost are balanced automatically. The calling thread takes part to
+ the computation and has @c threadIndex equal to zero; the function
+ returns only when all tasks are done. The @c threadIndex argument
+ can be used to select per-thread scratch buffers.
+
+ The number of threads is ::vl_get_max_threads (see
+ ::vl_set_num_threads), which is one unless the application asks
+ for more. ::vl_parallel_for_n lets the caller choose it
+ explicitly. If the library is compiled with @c VL_DISABLE_THREADS,
+ the tasks are run sequentially, in order, by the calling thread.
+
+ The worker threads form a pool that is started by the first loop
+ that needs them and kept until the library is unloaded: a loop
+ only wakes them up, and allocates no memory. The pool runs one
+ loop at a time. A loop started while the pool is busy (by another
+ thread, or by a task of the running loop) runs sequentially in the
+ thread that starts it.
+
+ The task function must not call VLFeat functions that modify the
+ global state (see @ref design-threads).
+ **/
+
+#include "threads.h"
+
+#if ! defined(VL_DISABLE_THREADS) && defined(VL_THREADS_POSIX)
+#include <pthread.h>
+#define VL_PARALLEL_POSIX
+#endif
+
+#if defined(VL_PARALLEL_POSIX)
+
+/** @internal @brief Maximum number of threads of a parallel loop */
+#define VL_PARALLEL_MAX_THREADS 64
+
+/** @internal @brief Pool of the worker threads of the parallel loops
+ **
+ ** All fields are protected by ::vl_parallel_mutex.
+ **/
+typedef struct _VlParallelPool
+{
+  pthread_t threads [VL_PARALLEL_MAX_THREADS] ;
+  vl_size numWorkers ;          /* started workers (thread 0 is the caller) */
+  vl_bool busy ;
+  vl_bool quit ;
+
+  /* current loop */
+  vl_uint64 generation ;        /* incremented by each loop */
+  VlParallelTaskFunction func ;
+  void * data ;
+  vl_size numTasks ;
+  vl_uindex nextTask ;
+  vl_size numThreads ;          /* threads of the loop, including the caller */
+  vl_size numActive ;           /* workers that did not leave the loop yet */
+} VlParallelPool ;
+
+static VlParallelPool pool ;
+/** @internal @brief Protects ::pool */
+static pthread_mutex_t vl_parallel_mutex = PTHREAD_MUTEX_INITIALIZER ;
+/** @internal @brief Signalled when a loop is posted or the pool stops */
+static pthread_cond_t vl_parallel_start = PTHREAD_COND_INITIALIZER ;
+/** @internal @brief Signalled when the last worker leaves a loop */
+static pthread_cond_t vl_parallel_finish = PTHREAD_COND_INITIALIZER ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run tasks of the current loop until it is exhausted
+ ** @param threadIndex index of the running thread.
+ **
+ ** The pool mutex is held on entry and on exit.
+ **/
+
+static void
+vl_parallel_run_tasks (vl_uindex threadIndex)
+{
+  while (pool.nextTask < pool.numTasks) {
+    vl_uindex taskIndex = pool.nextTask ++ ;
+    pthread_mutex_unlock (&vl_parallel_mutex) ;
+    pool.func (pool.data, taskIndex, threadIndex) ;
+    pthread_mutex_lock (&vl_parallel_mutex) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Body of a worker thread of the pool
+ ** @param arg index of the worker (cast to a pointer).
+ ** @return @c NULL.
+ **/
+
+static void *
+vl_parallel_worker (void * arg)
+{
+  vl_uindex threadIndex = (vl_uindex) arg ;
+  /* a worker is started by a loop and takes part to it */
+  vl_uint64 seen = 0 ;
+
+  pthread_mutex_lock (&vl_parallel_mutex) ;
+  while (1) {
+    while (! pool.quit && pool.generation == seen) {
+      pthread_cond_wait (&vl_parallel_start, &vl_parallel_mutex) ;
+    }
+    if (pool.quit) break ;
+    seen = pool.generation ;
+    if (threadIndex >= pool.numThreads) continue ;
+
+    vl_parallel_run_tasks (threadIndex) ;
+    if (-- pool.numActive == 0) pthread_cond_signal (&vl_parallel_finish) ;
+  }
+  pthread_mutex_unlock (&vl_parallel_mutex) ;
+  return NULL ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Stop the worker threads of the pool
+ **
+ ** Called when the library is unloaded. The pool must be idle.
+ **/
+
+VL_EXPORT void
+_vl_parallel_pool_delete (void)
+{
+  vl_uindex t ;
+  vl_size numWorkers ;
+
+  pthread_mutex_lock (&vl_parallel_mutex) ;
+  if (pool.busy) {
+    pthread_mutex_unlock (&vl_parallel_mutex) ;
+    return ;
+  }
+  pool.quit = VL_TRUE ;
+  numWorkers = pool.numWorkers ;
+  pthread_cond_broadcast (&vl_parallel_start) ;
+  pthread_mutex_unlock (&vl_parallel_mutex) ;
+
+  for (t = 1 ; t <= numWorkers ; ++t) {
+    pthread_join (pool.threads[t], NULL) ;
+  }
+  pool.numWorkers = 0 ;
+  pool.quit = VL_FALSE ;
+}
+
+#else
+
+VL_EXPORT void
+_vl_parallel_pool_delete (void)
+{
+}
+
+#endif
+
+/** ------------------------------------------------------------------
+ ** @brief Run a loop of independent tasks in parallel
+ ** @param numTasks number of tasks.
+ ** @param func task function.
+ ** @param data user data passed to @a func.
+ **
+ ** Equivalent to ::vl_parallel_for_n with ::vl_get_max_threads
+ ** threads.
+ **/
+
+VL_EXPORT void
+vl_parallel_for (vl_size numTasks,
+                 VlParallelTaskFunction func,
+                 void * data)
+{
+  vl_parallel_for_n (numTasks, vl_get_max_threads(), func, data) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Run a loop of independent tasks on a given number of threads
+ ** @param numTasks number of tasks.
+ ** @param numThreads number of threads (including the caller).
+ ** @param func task function.
+ ** @param data user data passed to @a func.
+ **
+ ** At most @a numTasks threads are used, and no more than
+ ** @c VL_PARALLEL_MAX_THREADS. Missing workers are added to the pool;
+ ** if a thread cannot be created, the tasks are run by the threads
+ ** there are.
+ **/
+
+VL_EXPORT void
+vl_parallel_for_n (vl_size numTasks,
+                   vl_size numThreads,
+                   VlParallelTaskFunction func,
+                   void * data)
+{
+  vl_uindex t ;
+
+#if defined(VL_PARALLEL_POSIX)
+  numThreads = VL_MIN(VL_MIN(numThreads, numTasks), VL_PARALLEL_MAX_THREADS) ;
+  if (numThreads > 1) {
+    pthread_mutex_lock (&vl_parallel_mutex) ;
+    if (! pool.busy) {
+      pool.busy = VL_TRUE ;
+      while (pool.numWorkers + 1 < numThreads) {
+        if (pthread_create (pool.threads + pool.numWorkers + 1, NULL,
+                            vl_parallel_worker,
+                            (void *) (pool.numWorkers + 1))) break ;
+        ++ pool.numWorkers ;
+      }
+      pool.func = func ;
+      pool.data = data ;
+      pool.numTasks = numTasks ;
+      pool.nextTask = 0 ;
+      pool.numThreads = VL_MIN(numThreads, pool.numWorkers + 1) ;
+      pool.numActive = pool.numThreads - 1 ;
+      ++ pool.generation ;
+      pthread_cond_broadcast (&vl_parallel_start) ;
+
+      vl_parallel_run_tasks (0) ;
+      while (pool.numActive > 0) {
+        pthread_cond_wait (&vl_parallel_finish, &vl_parallel_mutex) ;
+      }
+      pool.busy = VL_FALSE ;
+      pthread_mutex_unlock (&vl_parallel_mutex) ;
+      return ;
+    }
+    pthread_mutex_unlock (&vl_parallel_mutex) ;
+  }
+#else
+  (void) numThreads ;
+#endif
+
+  for (t = 0 ; t < numTasks ; ++t) {
+    func (data, t, 0) ;
+  }
+}
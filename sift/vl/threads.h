@@ -0,0 +1,40 @@
+/** @file    threads.h
+ ** @brief   Parallel loops
+ ** @author  Andrea Vedaldi
+ **/
+
+/* AUTORIGHTS
+Copyright (C) 2007-10 Andrea Vedaldi and Brian Fulkerson
+
+This file is part of VLFeat, available under the terms of the
+GNU GPLv2, or (at your option) any later version.
+*/
+
+#ifndef VL_THREADS_H
+#define VL_THREADS_H
+
+#include "generic.h"
+
+/** @brief Parallel loop body
+ ** @param data user data passed to ::vl_parallel_for.
+ ** @param taskIndex index of the task to run, in [0, numTasks-1].
+ ** @param threadIndex index of the running thread, in [0, numThreads-1].
+ **/
+typedef void (*VlParallelTaskFunction) (void * data,
+                                        vl_uindex taskIndex,
+                                        vl_uindex threadIndex) ;
+
+VL_EXPORT void vl_parallel_for (vl_size numTasks,
+                                VlParallelTaskFunction func,
+                                void * data) ;
+
+VL_EXPORT void vl_parallel_for_n (vl_size numTasks,
+                                  vl_size numThreads,
+                                  VlParallelTaskFunction func,
+                                  void * data) ;
+
+/** @internal @brief Stop the worker threads (on library unload) */
+VL_EXPORT void _vl_parallel_pool_delete (void) ;
+
+/* VL_THREADS_H */
+#endif